@@ -0,0 +1,192 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/30 10:00
+* @version: 1.0
+* @description: 网络地址封装：IPv4、IPv6、Unix 域地址，和 sockaddr 互相转换
+********************************************************************************/
+
+#include "address.h"
+#include "socket.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <arpa/inet.h>
+
+namespace sylar {
+
+Address::ptr Address::Create(const sockaddr *addr, socklen_t addrlen) {
+    if(!addr || addrlen < sizeof(sa_family_t)) {
+        return nullptr;
+    }
+    switch(addr->sa_family) {
+        case AF_INET:
+            if(addrlen < sizeof(sockaddr_in)) {
+                return nullptr;
+            }
+            return std::make_shared<IPv4Address>(*(const sockaddr_in *)addr);
+        case AF_INET6:
+            if(addrlen < sizeof(sockaddr_in6)) {
+                return nullptr;
+            }
+            return std::make_shared<IPv6Address>(*(const sockaddr_in6 *)addr);
+        case AF_UNIX: {
+            sockaddr_un un;
+            memset(&un, 0, sizeof(un));
+            addrlen = std::min(addrlen, (socklen_t)sizeof(un));
+            memcpy(&un, addr, addrlen);
+            return std::make_shared<UnixAddress>(un, addrlen);
+        }
+        default:
+            return std::make_shared<UnknownAddress>(addr, addrlen);
+    }
+}
+
+std::ostream &Address::insert(std::ostream &os) const {
+    return os << Socket::AddressToString(getAddr(), getAddrLen());
+}
+
+std::string Address::toString() const {
+    return Socket::AddressToString(getAddr(), getAddrLen());
+}
+
+bool Address::operator<(const Address &rhs) const {
+    socklen_t len = std::min(getAddrLen(), rhs.getAddrLen());
+    int rt = memcmp(getAddr(), rhs.getAddr(), len);
+    if(rt) {
+        return rt < 0;
+    }
+    return getAddrLen() < rhs.getAddrLen();
+}
+
+bool Address::operator==(const Address &rhs) const {
+    return getAddrLen() == rhs.getAddrLen() && memcmp(getAddr(), rhs.getAddr(), getAddrLen()) == 0;
+}
+
+bool Address::operator!=(const Address &rhs) const {
+    return !(*this == rhs);
+}
+
+IPAddress::ptr IPAddress::Create(const std::string &address, uint16_t port) {
+    if(address.find(':') != std::string::npos) {
+        return IPv6Address::Create(address, port);
+    }
+    return IPv4Address::Create(address, port);
+}
+
+IPAddress::ptr IPAddress::withPort(uint16_t port) const {
+    IPAddress::ptr rt = clone();
+    rt->setPort(port);
+    return rt;
+}
+
+IPv4Address::ptr IPv4Address::Create(const std::string &address, uint16_t port) {
+    IPv4Address::ptr rt = std::make_shared<IPv4Address>(INADDR_ANY, port);
+    if(inet_pton(AF_INET, address.c_str(), &rt->m_addr.sin_addr) != 1) {
+        return nullptr;
+    }
+    return rt;
+}
+
+IPv4Address::IPv4Address(uint32_t address, uint16_t port) {
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_addr.sin_family = AF_INET;
+    m_addr.sin_port = htons(port);
+    m_addr.sin_addr.s_addr = htonl(address);
+}
+
+IPv4Address::IPv4Address(const sockaddr_in &addr)
+        :m_addr(addr) {
+}
+
+uint16_t IPv4Address::getPort() const {
+    return ntohs(m_addr.sin_port);
+}
+
+void IPv4Address::setPort(uint16_t v) {
+    m_addr.sin_port = htons(v);
+}
+
+IPAddress::ptr IPv4Address::clone() const {
+    return std::make_shared<IPv4Address>(m_addr);
+}
+
+IPv6Address::ptr IPv6Address::Create(const std::string &address, uint16_t port) {
+    IPv6Address::ptr rt = std::make_shared<IPv6Address>();
+    if(inet_pton(AF_INET6, address.c_str(), &rt->m_addr.sin6_addr) != 1) {
+        return nullptr;
+    }
+    rt->setPort(port);
+    return rt;
+}
+
+IPv6Address::IPv6Address() {
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_addr.sin6_family = AF_INET6;
+}
+
+IPv6Address::IPv6Address(const uint8_t address[16], uint16_t port) {
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_addr.sin6_family = AF_INET6;
+    m_addr.sin6_port = htons(port);
+    memcpy(&m_addr.sin6_addr.s6_addr, address, 16);
+}
+
+IPv6Address::IPv6Address(const sockaddr_in6 &addr)
+        :m_addr(addr) {
+}
+
+uint16_t IPv6Address::getPort() const {
+    return ntohs(m_addr.sin6_port);
+}
+
+void IPv6Address::setPort(uint16_t v) {
+    m_addr.sin6_port = htons(v);
+}
+
+IPAddress::ptr IPv6Address::clone() const {
+    return std::make_shared<IPv6Address>(m_addr);
+}
+
+UnixAddress::UnixAddress() {
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_addr.sun_family = AF_UNIX;
+    m_length = offsetof(sockaddr_un, sun_path);
+}
+
+UnixAddress::UnixAddress(const std::string &path) {
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_addr.sun_family = AF_UNIX;
+    // 普通路径带上结尾的 '\0'，抽象命名空间按长度算
+    bool abstract = !path.empty() && path[0] == '\0';
+    size_t len = std::min(path.size(), sizeof(m_addr.sun_path) - (abstract ? 0 : 1));
+    memcpy(m_addr.sun_path, path.c_str(), len);
+    m_length = offsetof(sockaddr_un, sun_path) + len + (abstract ? 0 : 1);
+}
+
+UnixAddress::UnixAddress(const sockaddr_un &addr, socklen_t addrlen)
+        :m_addr(addr)
+        ,m_length(std::min(addrlen, (socklen_t)sizeof(addr))) {
+}
+
+std::string UnixAddress::getPath() const {
+    size_t len = m_length > offsetof(sockaddr_un, sun_path) ? m_length - offsetof(sockaddr_un, sun_path) : 0;
+    if(len && m_addr.sun_path[0] == '\0') {
+        return std::string(m_addr.sun_path, len);
+    }
+    return std::string(m_addr.sun_path, strnlen(m_addr.sun_path, len));
+}
+
+UnknownAddress::UnknownAddress(const sockaddr *addr, socklen_t addrlen)
+        :m_length(std::min(addrlen, (socklen_t)sizeof(m_addr))) {
+    memset(&m_addr, 0, sizeof(m_addr));
+    memcpy(&m_addr, addr, m_length);
+}
+
+std::ostream &operator<<(std::ostream &os, const Address &addr) {
+    return addr.insert(os);
+}
+
+}
@@ -0,0 +1,184 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/30 10:00
+* @version: 1.0
+* @description: 网络地址封装：IPv4、IPv6、Unix 域地址，和 sockaddr 互相转换
+********************************************************************************/
+
+
+#ifndef SYLAR_ADDRESS_H
+#define SYLAR_ADDRESS_H
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <cstdint>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+namespace sylar {
+
+/**
+ * @brief 网络地址基类
+ * 只是 sockaddr 的包装，构造之后不可变（setPort 除外），可以放进缓存里被多个协程共享
+ */
+class Address {
+public:
+    typedef std::shared_ptr<Address> ptr;
+
+    /**
+     * @brief 按 sa_family 创建对应的子类，未知的地址族原样拷贝
+     * @return addr 为空或者 addrlen 不够返回 nullptr
+     */
+    static Address::ptr Create(const sockaddr *addr, socklen_t addrlen);
+
+    virtual ~Address() {}
+
+    int getFamily() const { return getAddr()->sa_family; }
+    virtual const sockaddr *getAddr() const = 0;
+    virtual socklen_t getAddrLen() const = 0;
+
+    /**
+     * @brief 可读的字符串，ipv4 "1.2.3.4:80"，ipv6 "[::1]:80"，unix 是路径
+     */
+    std::ostream &insert(std::ostream &os) const;
+    std::string toString() const;
+
+    /**
+     * @brief 按字节比较，可以做 map 的 key
+     */
+    bool operator<(const Address &rhs) const;
+    bool operator==(const Address &rhs) const;
+    bool operator!=(const Address &rhs) const;
+};
+
+/**
+ * @brief IP 地址
+ */
+class IPAddress : public Address {
+public:
+    typedef std::shared_ptr<IPAddress> ptr;
+
+    /**
+     * @brief 数字形式的地址（"1.2.3.4"、"::1"），不做域名解析，域名用 Resolver
+     * @return 不是合法的数字地址返回 nullptr
+     */
+    static IPAddress::ptr Create(const std::string &address, uint16_t port = 0);
+
+    /**
+     * @brief 端口(主机字节序)
+     */
+    virtual uint16_t getPort() const = 0;
+    virtual void setPort(uint16_t v) = 0;
+
+    /**
+     * @brief 换一个端口的副本，缓存里的地址不改
+     */
+    IPAddress::ptr withPort(uint16_t port) const;
+
+protected:
+    virtual IPAddress::ptr clone() const = 0;
+};
+
+class IPv4Address : public IPAddress {
+public:
+    typedef std::shared_ptr<IPv4Address> ptr;
+
+    /**
+     * @param[in] address "1.2.3.4"
+     * @return 不合法返回 nullptr
+     */
+    static IPv4Address::ptr Create(const std::string &address, uint16_t port = 0);
+
+    /**
+     * @param[in] address 主机字节序，默认 INADDR_ANY
+     */
+    IPv4Address(uint32_t address = INADDR_ANY, uint16_t port = 0);
+    IPv4Address(const sockaddr_in &addr);
+
+    const sockaddr *getAddr() const override { return (const sockaddr *)&m_addr; }
+    socklen_t getAddrLen() const override { return sizeof(m_addr); }
+    uint16_t getPort() const override;
+    void setPort(uint16_t v) override;
+
+protected:
+    IPAddress::ptr clone() const override;
+
+private:
+    sockaddr_in m_addr;
+};
+
+class IPv6Address : public IPAddress {
+public:
+    typedef std::shared_ptr<IPv6Address> ptr;
+
+    /**
+     * @param[in] address "::1"
+     * @return 不合法返回 nullptr
+     */
+    static IPv6Address::ptr Create(const std::string &address, uint16_t port = 0);
+
+    IPv6Address();      // in6addr_any
+    IPv6Address(const uint8_t address[16], uint16_t port = 0);
+    IPv6Address(const sockaddr_in6 &addr);
+
+    const sockaddr *getAddr() const override { return (const sockaddr *)&m_addr; }
+    socklen_t getAddrLen() const override { return sizeof(m_addr); }
+    uint16_t getPort() const override;
+    void setPort(uint16_t v) override;
+
+protected:
+    IPAddress::ptr clone() const override;
+
+private:
+    sockaddr_in6 m_addr;
+};
+
+/**
+ * @brief Unix 域地址，path 以 '\0' 开头的是抽象命名空间
+ */
+class UnixAddress : public Address {
+public:
+    typedef std::shared_ptr<UnixAddress> ptr;
+
+    UnixAddress();
+    /**
+     * @param[in] path 太长的时候截断到 sun_path 的大小
+     */
+    UnixAddress(const std::string &path);
+    UnixAddress(const sockaddr_un &addr, socklen_t addrlen);
+
+    const sockaddr *getAddr() const override { return (const sockaddr *)&m_addr; }
+    socklen_t getAddrLen() const override { return m_length; }
+    std::string getPath() const;
+
+private:
+    sockaddr_un m_addr;
+    socklen_t m_length;
+};
+
+/**
+ * @brief 不认识的地址族，原样保存
+ */
+class UnknownAddress : public Address {
+public:
+    typedef std::shared_ptr<UnknownAddress> ptr;
+
+    UnknownAddress(const sockaddr *addr, socklen_t addrlen);
+
+    const sockaddr *getAddr() const override { return (const sockaddr *)&m_addr; }
+    socklen_t getAddrLen() const override { return m_length; }
+
+private:
+    sockaddr_storage m_addr;
+    socklen_t m_length;
+};
+
+std::ostream &operator<<(std::ostream &os, const Address &addr);
+
+}
+
+#endif //SYLAR_ADDRESS_H
@@ -0,0 +1,232 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/29 10:00
+* @version: 1.0
+* @description: 阻塞调用卸载：第三方库的阻塞调用（getaddrinfo、压缩、加解密）放到单独的线程池里执行，协程让出等结果
+********************************************************************************/
+
+#include "blocking.h"
+#include "config.h"
+#include "fiber.h"
+#include "log.h"
+#include "macro.h"
+#include "scheduler.h"
+#include "util.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint32_t>::ptr BlockingThreads() {
+    static sylar::ConfigVar<uint32_t>::ptr s_var =
+            sylar::Config::Lookup("blocking.threads", (uint32_t)4, "blocking call executor thread count");
+    return s_var;
+}
+
+static sylar::ConfigVar<uint32_t>::ptr BlockingMaxQueue() {
+    static sylar::ConfigVar<uint32_t>::ptr s_var =
+            sylar::Config::Lookup("blocking.max_queue", (uint32_t)1024, "blocking call executor max queued tasks");
+    return s_var;
+}
+
+// 启动的时候就注册上，加载配置文件的时候找得到
+static sylar::ConfigVar<uint32_t>::ptr g_blocking_threads = BlockingThreads();
+static sylar::ConfigVar<uint32_t>::ptr g_blocking_max_queue = BlockingMaxQueue();
+
+bool InSchedulerFiber() {
+    return Scheduler::GetThis() && Fiber::GetFiberId() && Fiber::GetThis().get() != Scheduler::GetMainFiber();
+}
+
+static void UpdateMax(std::atomic<uint64_t> &max, uint64_t v) {
+    uint64_t old = max;
+    while(v > old && !max.compare_exchange_weak(old, v)) {
+    }
+}
+
+BlockingExecutor::BlockingExecutor(size_t threads, size_t max_queue, const std::string &name)
+        :m_name(name)
+        ,m_maxQueue(max_queue) {
+    SYLAR_ASSERT(threads > 0);
+    for(size_t i = 0; i < threads; ++i) {
+        m_threads.push_back(std::make_shared<Thread>(std::bind(&BlockingExecutor::work, this),
+                                                     name + "_" + std::to_string(i)));
+    }
+}
+
+BlockingExecutor::~BlockingExecutor() {
+    stop();
+}
+
+bool BlockingExecutor::push(Task &task, bool wait) {
+    task.enqueue_us = GetMonotonicUS();   // 排队、执行时间用单调时钟，系统时间跳变不影响
+    while(true) {
+        MutexType::Lock lock(m_mutex);
+        if(m_stopping) {
+            return false;
+        }
+        if(!m_maxQueue || m_tasks.size() < m_maxQueue) {
+            m_tasks.push_back(std::move(task));
+            UpdateMax(m_maxQueued, m_tasks.size());
+            lock.unlock();
+            m_sem.notify();
+            return true;
+        }
+        if(!wait) {
+            ++m_rejected;
+            return false;
+        }
+        // 满了：协程排队等工作线程取走一个任务，不占着线程
+        m_waiters.push_back(std::make_pair(Scheduler::GetThis(), Fiber::GetThis()));
+        ++m_fullWaits;
+        lock.unlock();
+        Fiber::YieldToHold();
+    }
+}
+
+void BlockingExecutor::run(std::function<void()> cb) {
+    if(!InSchedulerFiber()) {
+        cb();
+        return;
+    }
+    Task task;
+    task.cb = std::move(cb);
+    task.scheduler = Scheduler::GetThis();
+    task.fiber = Fiber::GetThis();
+    task.scheduler->addExternalWait();  // 执行完之前调度器不能退出
+    if(!push(task, true)) {
+        task.scheduler->delExternalWait();
+        task.cb();
+        return;
+    }
+    // 工作线程可能在让出之前就把协程放回调度器，协程切出去之前不会被别的线程换入
+    Fiber::YieldToHold();
+}
+
+bool BlockingExecutor::post(std::function<void()> cb) {
+    Task task;
+    task.cb = std::move(cb);
+    return push(task, false);
+}
+
+void BlockingExecutor::stop() {
+    std::vector<Thread::ptr> threads;
+    std::deque<std::pair<Scheduler *, std::shared_ptr<Fiber> > > waiters;
+    {
+        MutexType::Lock lock(m_mutex);
+        if(m_stopping) {
+            return;
+        }
+        m_stopping = true;
+        threads.swap(m_threads);
+        waiters.swap(m_waiters);
+    }
+    for(auto &i : waiters) {
+        i.first->schedule(i.second);
+    }
+    for(size_t i = 0; i < threads.size(); ++i) {
+        m_sem.notify();
+    }
+    for(auto &i : threads) {
+        i->join();
+    }
+}
+
+void BlockingExecutor::work() {
+    while(true) {
+        m_sem.wait();
+        Task task;
+        std::pair<Scheduler *, std::shared_ptr<Fiber> > waiter(nullptr, nullptr);
+        {
+            MutexType::Lock lock(m_mutex);
+            if(m_tasks.empty()) {
+                if(m_stopping) {    // 排着的任务都执行完了才退出
+                    return;
+                }
+                continue;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+            if(!m_waiters.empty()) {    // 空出一个位置
+                waiter = std::move(m_waiters.front());
+                m_waiters.pop_front();
+            }
+        }
+        if(waiter.first) {
+            waiter.first->schedule(waiter.second);
+        }
+
+        uint64_t begin = GetMonotonicUS();
+        uint64_t wait = begin - task.enqueue_us;
+        ++m_running;
+        try {
+            task.cb();
+        } catch(std::exception &ex) {
+            SYLAR_LOG_ERROR(g_logger) << "BlockingExecutor " << m_name << " task exception: " << ex.what();
+        } catch(...) {
+            SYLAR_LOG_ERROR(g_logger) << "BlockingExecutor " << m_name << " task exception";
+        }
+        --m_running;
+        uint64_t exec = GetMonotonicUS() - begin;
+        m_waitUs += wait;
+        m_execUs += exec;
+        UpdateMax(m_maxWaitUs, wait);
+        UpdateMax(m_maxExecUs, exec);
+        ++m_count;
+
+        if(task.scheduler) {
+            task.scheduler->schedule(task.fiber);
+            task.scheduler->delExternalWait();  // 先放回队列再减，中间调度器不会退出
+        }
+    }
+}
+
+void BlockingExecutor::getStats(Stats &stats) const {
+    {
+        MutexType::Lock lock(const_cast<MutexType &>(m_mutex));
+        stats.threads = m_threads.size();
+        stats.queued = m_tasks.size();
+    }
+    stats.max_queue = m_maxQueue;
+    stats.max_queued = m_maxQueued;
+    stats.running = m_running;
+    stats.tasks = m_count;
+    stats.full_waits = m_fullWaits;
+    stats.rejected = m_rejected;
+    stats.wait_us = m_waitUs;
+    stats.max_wait_us = m_maxWaitUs;
+    stats.exec_us = m_execUs;
+    stats.max_exec_us = m_maxExecUs;
+}
+
+std::string BlockingExecutor::dumpStats() const {
+    Stats stats;
+    getStats(stats);
+    std::stringstream ss;
+    ss << "[BlockingExecutor name=" << m_name
+       << " threads=" << stats.threads
+       << " max_queue=" << stats.max_queue
+       << " queued=" << stats.queued
+       << " max_queued=" << stats.max_queued
+       << " running=" << stats.running
+       << " tasks=" << stats.tasks
+       << " full_waits=" << stats.full_waits
+       << " rejected=" << stats.rejected
+       << " avg_wait_us=" << (stats.tasks ? stats.wait_us / stats.tasks : 0)
+       << " max_wait_us=" << stats.max_wait_us
+       << " avg_exec_us=" << (stats.tasks ? stats.exec_us / stats.tasks : 0)
+       << " max_exec_us=" << stats.max_exec_us << "]";
+    return ss.str();
+}
+
+BlockingExecutor *BlockingExecutor::GetInstance() {
+    static GlobalExecutorHolder<BlockingExecutor> s_holder(new BlockingExecutor(
+            std::max(BlockingThreads()->getValue(), (uint32_t)1), BlockingMaxQueue()->getValue(), "blocking"));
+    return s_holder.get();
+}
+
+}
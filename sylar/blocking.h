@@ -0,0 +1,222 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/29 10:00
+* @version: 1.0
+* @description: 阻塞调用卸载：第三方库的阻塞调用（getaddrinfo、压缩、加解密）放到单独的线程池里执行，协程让出等结果
+********************************************************************************/
+
+
+#ifndef SYLAR_BLOCKING_H
+#define SYLAR_BLOCKING_H
+
+#include <atomic>
+#include <cerrno>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "thread.h"
+
+namespace sylar {
+
+class Scheduler;
+class Fiber;
+
+/**
+ * @brief 当前是不是在调度器调度的协程里，只有这时候才能让出协程等结果
+ * 线程的主协程、use_caller 线程还没开始调度的时候都不算
+ */
+bool InSchedulerFiber();
+
+/**
+ * @brief 执行阻塞调用的有界线程池
+ * 调用方的协程让出，工作线程执行完之后把协程放回它原来的调度器，IO 线程不会卡在阻塞调用上。
+ * 排队的任务数有上限：满了的时候协程排队等空位（同样是让出，不占线程），普通线程直接自己执行。
+ * 记录排队深度和排队、执行的耗时
+ */
+class BlockingExecutor {
+public:
+    typedef std::shared_ptr<BlockingExecutor> ptr;
+    typedef Mutex MutexType;
+
+    /**
+     * @param[in] threads 线程数
+     * @param[in] max_queue 最多排队的任务数，0 表示不限制
+     * @param[in] name 线程名字前缀
+     */
+    BlockingExecutor(size_t threads, size_t max_queue = 0, const std::string &name = "blocking");
+    ~BlockingExecutor();
+
+    BlockingExecutor(const BlockingExecutor &) = delete;
+    BlockingExecutor &operator=(const BlockingExecutor &) = delete;
+
+    /**
+     * @brief 在线程池里执行 cb，当前协程让出直到执行完
+     * 不在协程里（普通线程）或者线程池已经停止的时候直接在当前线程执行
+     */
+    void run(std::function<void()> cb);
+    /**
+     * @brief 交给线程池执行，不等结果
+     * @return 队列满了或者线程池已经停止返回 false，调用方自己决定怎么办
+     */
+    bool post(std::function<void()> cb);
+
+    /**
+     * @brief 执行完已经排队的任务之后停止所有线程，等空位的协程被唤醒之后自己执行
+     */
+    void stop();
+
+    const std::string &getName() const { return m_name; }
+    size_t getMaxQueue() const { return m_maxQueue; }
+
+    struct Stats {
+        uint64_t threads = 0;
+        uint64_t max_queue = 0;
+        uint64_t queued = 0;        // 当前排队的任务数
+        uint64_t max_queued = 0;    // 排队数的最大值
+        uint64_t running = 0;       // 正在执行的任务数
+        uint64_t tasks = 0;         // 执行完的任务数
+        uint64_t full_waits = 0;    // 队列满了协程等空位的次数
+        uint64_t rejected = 0;      // 队列满了 post 失败的次数
+        uint64_t wait_us = 0;       // 从提交到开始执行的累计耗时
+        uint64_t max_wait_us = 0;
+        uint64_t exec_us = 0;       // 执行的累计耗时
+        uint64_t max_exec_us = 0;
+    };
+    void getStats(Stats &stats) const;
+    std::string dumpStats() const;
+
+    /**
+     * @brief 全局的线程池，第一次使用的时候按 blocking.threads、blocking.max_queue 创建
+     * 进程退出的时候执行完剩下的任务然后停止，之后的任务在调用方线程上直接执行
+     */
+    static BlockingExecutor *GetInstance();
+
+private:
+    struct Task {
+        std::function<void()> cb;
+        Scheduler *scheduler = nullptr;     // 执行完放回去的协程，post 的任务为空
+        std::shared_ptr<Fiber> fiber;
+        uint64_t enqueue_us = 0;
+    };
+
+    /**
+     * @param[in] wait 队列满了的时候协程是否等空位
+     * @return 成功的时候把 task 移走
+     */
+    bool push(Task &task, bool wait);
+    void work();
+
+private:
+    std::string m_name;
+    size_t m_maxQueue;
+    MutexType m_mutex;
+    Semaphore m_sem;
+    std::deque<Task> m_tasks;
+    std::deque<std::pair<Scheduler *, std::shared_ptr<Fiber> > > m_waiters;  // 等空位的协程
+    std::vector<Thread::ptr> m_threads;
+    bool m_stopping = false;
+
+    std::atomic<uint64_t> m_maxQueued{0};
+    std::atomic<uint64_t> m_running{0};
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_fullWaits{0};
+    std::atomic<uint64_t> m_rejected{0};
+    std::atomic<uint64_t> m_waitUs{0};
+    std::atomic<uint64_t> m_maxWaitUs{0};
+    std::atomic<uint64_t> m_execUs{0};
+    std::atomic<uint64_t> m_maxExecUs{0};
+};
+
+/**
+ * @brief 进程级全局对象（线程池、解析器）的持有者，用函数内的静态变量保存
+ * 第一次使用的时候创建，进程退出的时候停掉它的线程池；对象本身不释放，
+ * 退出过程中别的静态对象还可能用到，之后提交的任务在调用方线程上直接执行
+ */
+template<class T>
+class GlobalExecutorHolder {
+public:
+    /**
+     * @param[in] object 持有的对象，不释放
+     * @param[in] executor 进程退出的时候要停掉的线程池，一般是 object 自己或者它的成员
+     */
+    GlobalExecutorHolder(T *object, BlockingExecutor *executor)
+            :m_object(object), m_executor(executor) {
+    }
+    /**
+     * @brief 持有的就是线程池本身
+     */
+    explicit GlobalExecutorHolder(T *executor)
+            :GlobalExecutorHolder(executor, executor) {
+    }
+    ~GlobalExecutorHolder() {
+        m_executor->stop();
+    }
+    T *get() const { return m_object; }
+
+private:
+    T *m_object;
+    BlockingExecutor *m_executor;
+};
+
+/**
+ * @brief 在 executor 上执行 fn，当前协程让出，执行完之后在原来的调度器上带着结果返回
+ * fn 抛出的异常在调用方重新抛出，fn 执行完之后的 errno 带回调用方
+ */
+template<class F>
+auto blocking(BlockingExecutor *executor, F fn)
+        -> typename std::enable_if<!std::is_void<decltype(fn())>::value, decltype(fn())>::type {
+    typedef decltype(fn()) R;
+    std::unique_ptr<R> result;
+    std::exception_ptr error;
+    int err = 0;
+    executor->run([&fn, &result, &error, &err]() {
+        try {
+            result.reset(new R(fn()));
+        } catch(...) {
+            error = std::current_exception();
+        }
+        err = errno;
+    });
+    if(error) {
+        std::rethrow_exception(error);
+    }
+    errno = err;
+    return std::move(*result);
+}
+
+template<class F>
+auto blocking(BlockingExecutor *executor, F fn)
+        -> typename std::enable_if<std::is_void<decltype(fn())>::value>::type {
+    std::exception_ptr error;
+    int err = 0;
+    executor->run([&fn, &error, &err]() {
+        try {
+            fn();
+        } catch(...) {
+            error = std::current_exception();
+        }
+        err = errno;
+    });
+    if(error) {
+        std::rethrow_exception(error);
+    }
+    errno = err;
+}
+
+/**
+ * @brief 在全局的 BlockingExecutor 上执行
+ */
+template<class F>
+auto blocking(F fn) -> decltype(fn()) {
+    return blocking(BlockingExecutor::GetInstance(), std::move(fn));
+}
+
+}
+
+#endif //SYLAR_BLOCKING_H
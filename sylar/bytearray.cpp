@@ -0,0 +1,628 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/15 09:40
+* @version: 1.0
+* @description: 二进制数组，链式的定长内存块，支持定长、varint、zigzag 编码和 iovec 收发
+********************************************************************************/
+
+#include "bytearray.h"
+#include "config.h"
+#include "endian.h"
+#include "log.h"
+
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint32_t>::ptr g_bytearray_pool_blocks =
+        sylar::Config::Lookup("bytearray.pool.blocks", (uint32_t)256,
+                              "max free 4096 byte blocks cached per thread");
+
+static const size_t POOL_BLOCK_SIZE = 4096;     // 只缓存默认大小的块
+static uint32_t s_pool_blocks = 256;
+
+struct _ByteArrayIniter {
+    _ByteArrayIniter() {
+        s_pool_blocks = g_bytearray_pool_blocks->getValue();
+        g_bytearray_pool_blocks->addListener([](const uint32_t &old_value, const uint32_t &new_value) {
+            s_pool_blocks = new_value;
+        });
+    }
+};
+
+static _ByteArrayIniter s_bytearray_initer;
+
+/**
+ * @brief 线程本地的空闲块，不用加锁；别的线程释放的块进别的线程的池子
+ */
+struct BlockPool {
+    std::vector<char *> blocks;
+    ~BlockPool();
+};
+
+static thread_local BlockPool t_pool;
+static thread_local bool t_pool_destroyed = false;  // 线程退出的时候池子先析构了，之后直接 delete
+
+BlockPool::~BlockPool() {
+    t_pool_destroyed = true;
+    for(auto i : blocks) {
+        delete[] i;
+    }
+}
+
+static char *AllocBlock(size_t size) {
+    if(size == POOL_BLOCK_SIZE && !t_pool_destroyed && !t_pool.blocks.empty()) {
+        char *block = t_pool.blocks.back();
+        t_pool.blocks.pop_back();
+        return block;
+    }
+    return new char[size];
+}
+
+static void FreeBlock(char *block, size_t size) {
+    if(size == POOL_BLOCK_SIZE && !t_pool_destroyed && t_pool.blocks.size() < s_pool_blocks) {
+        t_pool.blocks.push_back(block);
+        return;
+    }
+    delete[] block;
+}
+
+ByteArray::Node::Node(size_t s)
+        :ptr(AllocBlock(s))
+        ,next(nullptr)
+        ,size(s) {
+}
+
+ByteArray::Node::Node()
+        :ptr(nullptr)
+        ,next(nullptr)
+        ,size(0) {
+}
+
+ByteArray::Node::~Node() {
+    if(ptr) {
+        FreeBlock(ptr, size);
+    }
+}
+
+ByteArray::ByteArray(size_t base_size)
+        :m_baseSize(base_size ? base_size : POOL_BLOCK_SIZE)
+        ,m_position(0)
+        ,m_capacity(m_baseSize)
+        ,m_size(0)
+        ,m_endian(SYLAR_BIG_ENDIAN)
+        ,m_root(new Node(m_baseSize))
+        ,m_cur(m_root)
+        ,m_tail(m_root) {
+}
+
+ByteArray::~ByteArray() {
+    Node *tmp = m_root;
+    while(tmp) {
+        m_cur = tmp;
+        tmp = tmp->next;
+        delete m_cur;
+    }
+}
+
+bool ByteArray::isLittleEndian() const {
+    return m_endian == SYLAR_LITTLE_ENDIAN;
+}
+
+void ByteArray::setIsLittleEndian(bool val) {
+    m_endian = val ? SYLAR_LITTLE_ENDIAN : SYLAR_BIG_ENDIAN;
+}
+
+void ByteArray::writeFint8(int8_t value) {
+    write(&value, sizeof(value));
+}
+
+void ByteArray::writeFuint8(uint8_t value) {
+    write(&value, sizeof(value));
+}
+
+#define XX(type) \
+    if(m_endian != SYLAR_BYTE_ORDER) { \
+        value = byteswap(value); \
+    } \
+    write(&value, sizeof(type));
+
+void ByteArray::writeFint16(int16_t value) {
+    XX(int16_t);
+}
+
+void ByteArray::writeFuint16(uint16_t value) {
+    XX(uint16_t);
+}
+
+void ByteArray::writeFint32(int32_t value) {
+    XX(int32_t);
+}
+
+void ByteArray::writeFuint32(uint32_t value) {
+    XX(uint32_t);
+}
+
+void ByteArray::writeFint64(int64_t value) {
+    XX(int64_t);
+}
+
+void ByteArray::writeFuint64(uint64_t value) {
+    XX(uint64_t);
+}
+
+#undef XX
+
+static uint32_t EncodeZigzag32(int32_t v) {     // 0,-1,1,-2,2 ... 映射到 0,1,2,3,4 ...
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static uint64_t EncodeZigzag64(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int32_t DecodeZigzag32(uint32_t v) {
+    return (int32_t)((v >> 1) ^ -(v & 1));
+}
+
+static int64_t DecodeZigzag64(uint64_t v) {
+    return (int64_t)((v >> 1) ^ -(v & 1));
+}
+
+void ByteArray::writeInt32(int32_t value) {
+    writeUint32(EncodeZigzag32(value));
+}
+
+void ByteArray::writeUint32(uint32_t value) {
+    uint8_t tmp[5];     // 每个字节 7 位，最高位表示后面还有
+    uint8_t i = 0;
+    while(value >= 0x80) {
+        tmp[i++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    tmp[i++] = value;
+    write(tmp, i);
+}
+
+void ByteArray::writeInt64(int64_t value) {
+    writeUint64(EncodeZigzag64(value));
+}
+
+void ByteArray::writeUint64(uint64_t value) {
+    uint8_t tmp[10];
+    uint8_t i = 0;
+    while(value >= 0x80) {
+        tmp[i++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    tmp[i++] = value;
+    write(tmp, i);
+}
+
+void ByteArray::writeFloat(float value) {
+    uint32_t v;
+    memcpy(&v, &value, sizeof(value));
+    writeFuint32(v);
+}
+
+void ByteArray::writeDouble(double value) {
+    uint64_t v;
+    memcpy(&v, &value, sizeof(value));
+    writeFuint64(v);
+}
+
+void ByteArray::writeStringF16(const std::string &value) {
+    writeFuint16(value.size());
+    write(value.c_str(), value.size());
+}
+
+void ByteArray::writeStringF32(const std::string &value) {
+    writeFuint32(value.size());
+    write(value.c_str(), value.size());
+}
+
+void ByteArray::writeStringF64(const std::string &value) {
+    writeFuint64(value.size());
+    write(value.c_str(), value.size());
+}
+
+void ByteArray::writeStringVint(const std::string &value) {
+    writeUint64(value.size());
+    write(value.c_str(), value.size());
+}
+
+void ByteArray::writeStringWithoutLength(const std::string &value) {
+    write(value.c_str(), value.size());
+}
+
+int8_t ByteArray::readFint8() {
+    int8_t v;
+    read(&v, sizeof(v));
+    return v;
+}
+
+uint8_t ByteArray::readFuint8() {
+    uint8_t v;
+    read(&v, sizeof(v));
+    return v;
+}
+
+#define XX(type) \
+    type v; \
+    read(&v, sizeof(v)); \
+    if(m_endian == SYLAR_BYTE_ORDER) { \
+        return v; \
+    } else { \
+        return byteswap(v); \
+    }
+
+int16_t ByteArray::readFint16() {
+    XX(int16_t);
+}
+
+uint16_t ByteArray::readFuint16() {
+    XX(uint16_t);
+}
+
+int32_t ByteArray::readFint32() {
+    XX(int32_t);
+}
+
+uint32_t ByteArray::readFuint32() {
+    XX(uint32_t);
+}
+
+int64_t ByteArray::readFint64() {
+    XX(int64_t);
+}
+
+uint64_t ByteArray::readFuint64() {
+    XX(uint64_t);
+}
+
+#undef XX
+
+int32_t ByteArray::readInt32() {
+    return DecodeZigzag32(readUint32());
+}
+
+uint32_t ByteArray::readUint32() {
+    uint32_t result = 0;
+    for(int i = 0; i < 32; i += 7) {
+        uint8_t b = readFuint8();
+        result |= ((uint32_t)(b & 0x7F)) << i;
+        if(b < 0x80) {
+            break;
+        }
+    }
+    return result;
+}
+
+int64_t ByteArray::readInt64() {
+    return DecodeZigzag64(readUint64());
+}
+
+uint64_t ByteArray::readUint64() {
+    uint64_t result = 0;
+    for(int i = 0; i < 64; i += 7) {
+        uint8_t b = readFuint8();
+        result |= ((uint64_t)(b & 0x7F)) << i;
+        if(b < 0x80) {
+            break;
+        }
+    }
+    return result;
+}
+
+float ByteArray::readFloat() {
+    uint32_t v = readFuint32();
+    float value;
+    memcpy(&value, &v, sizeof(v));
+    return value;
+}
+
+double ByteArray::readDouble() {
+    uint64_t v = readFuint64();
+    double value;
+    memcpy(&value, &v, sizeof(v));
+    return value;
+}
+
+#define XX(len) \
+    std::string buff; \
+    buff.resize(len); \
+    read(&buff[0], len); \
+    return buff;
+
+std::string ByteArray::readStringF16() {
+    uint16_t len = readFuint16();
+    XX(len);
+}
+
+std::string ByteArray::readStringF32() {
+    uint32_t len = readFuint32();
+    if(len > getReadSize()) {   // 先检查，不要按错误的长度分配内存
+        throw std::out_of_range("not enough len");
+    }
+    XX(len);
+}
+
+std::string ByteArray::readStringF64() {
+    uint64_t len = readFuint64();
+    if(len > getReadSize()) {   // 先检查，不要按错误的长度分配内存
+        throw std::out_of_range("not enough len");
+    }
+    XX(len);
+}
+
+std::string ByteArray::readStringVint() {
+    uint64_t len = readUint64();
+    if(len > getReadSize()) {
+        throw std::out_of_range("not enough len");
+    }
+    XX(len);
+}
+
+#undef XX
+
+void ByteArray::clear() {
+    m_position = m_size = 0;
+    m_capacity = m_baseSize;
+    Node *tmp = m_root->next;
+    while(tmp) {
+        m_cur = tmp;
+        tmp = tmp->next;
+        delete m_cur;
+    }
+    m_cur = m_root;
+    m_tail = m_root;
+    m_root->next = nullptr;
+}
+
+void ByteArray::write(const void *buf, size_t size) {
+    if(size == 0) {
+        return;
+    }
+    addCapacity(size);
+
+    size_t npos = m_position % m_baseSize;  // 在当前块里的偏移
+    size_t ncap = m_cur->size - npos;       // 当前块还剩多少
+    size_t bpos = 0;
+    while(size > 0) {
+        size_t n = std::min(ncap, size);
+        memcpy(m_cur->ptr + npos, (const char *)buf + bpos, n);
+        m_position += n;
+        bpos += n;
+        size -= n;
+        if(n == ncap) {     // 当前块写满了
+            m_cur = m_cur->next;
+            if(m_cur) {
+                ncap = m_cur->size;
+                npos = 0;
+            }
+        }
+    }
+
+    if(m_position > m_size) {
+        m_size = m_position;
+    }
+}
+
+void ByteArray::read(void *buf, size_t size) {
+    if(size > getReadSize()) {
+        throw std::out_of_range("not enough len");
+    }
+
+    size_t npos = m_position % m_baseSize;
+    size_t ncap = m_cur ? m_cur->size - npos : 0;
+    size_t bpos = 0;
+    while(size > 0) {
+        size_t n = std::min(ncap, size);
+        memcpy((char *)buf + bpos, m_cur->ptr + npos, n);
+        m_position += n;
+        bpos += n;
+        size -= n;
+        if(n == ncap) {
+            m_cur = m_cur->next;
+            if(m_cur) {
+                ncap = m_cur->size;
+                npos = 0;
+            }
+        }
+    }
+}
+
+void ByteArray::read(void *buf, size_t size, size_t position) const {
+    if(position > m_size || size > m_size - position) {
+        throw std::out_of_range("not enough len");
+    }
+
+    Node *cur = locate(position);
+    size_t npos = position % m_baseSize;
+    size_t ncap = cur ? cur->size - npos : 0;
+    size_t bpos = 0;
+    while(size > 0) {
+        size_t n = std::min(ncap, size);
+        memcpy((char *)buf + bpos, cur->ptr + npos, n);
+        bpos += n;
+        size -= n;
+        if(n == ncap) {
+            cur = cur->next;
+            if(cur) {
+                ncap = cur->size;
+                npos = 0;
+            }
+        }
+    }
+}
+
+ByteArray::Node *ByteArray::locate(size_t position) const {
+    Node *cur = m_root;
+    for(size_t i = position / m_baseSize; i > 0 && cur; --i) {
+        cur = cur->next;
+    }
+    return cur;
+}
+
+void ByteArray::setPosition(size_t v) {
+    if(v > m_capacity) {
+        throw std::out_of_range("set_position out of range");
+    }
+    m_position = v;
+    if(m_position > m_size) {
+        m_size = m_position;
+    }
+    m_cur = locate(v);
+}
+
+bool ByteArray::writeToFile(const std::string &name) const {
+    std::ofstream ofs;
+    ofs.open(name, std::ios::trunc | std::ios::binary);
+    if(!ofs) {
+        SYLAR_LOG_ERROR(g_logger) << "writeToFile name=" << name
+                                  << " error, errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+
+    std::vector<iovec> iovs;    // 按块写，不用先拼成一整块
+    getReadBuffers(iovs);
+    for(auto &i : iovs) {
+        ofs.write((const char *)i.iov_base, i.iov_len);
+    }
+    return true;
+}
+
+bool ByteArray::readFromFile(const std::string &name) {
+    std::ifstream ifs;
+    ifs.open(name, std::ios::binary);
+    if(!ifs) {
+        SYLAR_LOG_ERROR(g_logger) << "readFromFile name=" << name
+                                  << " error, errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+
+    std::vector<char> buff(m_baseSize);
+    while(!ifs.eof()) {
+        ifs.read(&buff[0], m_baseSize);
+        write(&buff[0], ifs.gcount());
+    }
+    return true;
+}
+
+void ByteArray::addCapacity(size_t size) {
+    if(size == 0) {
+        return;
+    }
+    size_t old_cap = getCapacity();
+    if(old_cap >= size) {
+        return;
+    }
+
+    size = size - old_cap;
+    size_t count = (size + m_baseSize - 1) / m_baseSize;
+    Node *first = nullptr;
+    for(size_t i = 0; i < count; ++i) {
+        m_tail->next = new Node(m_baseSize);
+        m_tail = m_tail->next;
+        if(!first) {
+            first = m_tail;
+        }
+        m_capacity += m_baseSize;
+    }
+
+    if(old_cap == 0) {  // position 刚好在原来的末尾
+        m_cur = first;
+    }
+}
+
+std::string ByteArray::toString() const {
+    std::string str;
+    str.resize(getReadSize());
+    if(str.empty()) {
+        return str;
+    }
+    read(&str[0], str.size(), m_position);
+    return str;
+}
+
+std::string ByteArray::toHexString() const {
+    std::string str = toString();
+    std::stringstream ss;
+
+    for(size_t i = 0; i < str.size(); ++i) {
+        if(i > 0 && i % 32 == 0) {
+            ss << std::endl;
+        }
+        ss << std::setw(2) << std::setfill('0') << std::hex
+           << (int)(uint8_t)str[i] << " ";
+    }
+
+    return ss.str();
+}
+
+uint64_t ByteArray::getReadBuffers(std::vector<iovec> &buffers, uint64_t len) const {
+    return getReadBuffers(buffers, len, m_position);
+}
+
+uint64_t ByteArray::getReadBuffers(std::vector<iovec> &buffers, uint64_t len, uint64_t position) const {
+    if(position >= m_size) {
+        return 0;
+    }
+    len = std::min(len, (uint64_t)(m_size - position));
+    if(len == 0) {
+        return 0;
+    }
+
+    uint64_t size = len;
+    size_t npos = position % m_baseSize;
+    Node *cur = locate(position);
+    size_t ncap = cur->size - npos;
+    iovec iov;
+    while(len > 0) {
+        iov.iov_base = cur->ptr + npos;
+        iov.iov_len = std::min((uint64_t)ncap, len);
+        len -= iov.iov_len;
+        cur = cur->next;
+        if(cur) {
+            ncap = cur->size;
+            npos = 0;
+        }
+        buffers.push_back(iov);
+    }
+    return size;
+}
+
+uint64_t ByteArray::getWriteBuffers(std::vector<iovec> &buffers, uint64_t len) {
+    if(len == 0) {
+        return 0;
+    }
+    addCapacity(len);
+    uint64_t size = len;
+
+    size_t npos = m_position % m_baseSize;
+    size_t ncap = m_cur->size - npos;
+    iovec iov;
+    Node *cur = m_cur;
+    while(len > 0) {
+        iov.iov_base = cur->ptr + npos;
+        iov.iov_len = std::min((uint64_t)ncap, len);
+        len -= iov.iov_len;
+        cur = cur->next;
+        if(cur) {
+            ncap = cur->size;
+            npos = 0;
+        }
+        buffers.push_back(iov);
+    }
+    return size;
+}
+
+}
@@ -0,0 +1,167 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/15 09:40
+* @version: 1.0
+* @description: 二进制数组，链式的定长内存块，支持定长、varint、zigzag 编码和 iovec 收发
+********************************************************************************/
+
+
+#ifndef SYLAR_BYTEARRAY_H
+#define SYLAR_BYTEARRAY_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+namespace sylar {
+
+/**
+ * @brief 二进制数组
+ * 数据放在一串大小相同的内存块里，写满了再挂新的块，不用整体拷贝扩容；
+ * 默认大小的块从线程本地的池子里取，释放的时候还回去。
+ * 读写共用一个位置 position，写完之后 setPosition 回到开头再读。
+ * 定长整数默认按网络字节序（大端）写入
+ */
+class ByteArray {
+public:
+    typedef std::shared_ptr<ByteArray> ptr;
+
+    /**
+     * @brief 内存块
+     */
+    struct Node {
+        Node(size_t s);
+        Node();
+        ~Node();
+
+        char *ptr;
+        Node *next;
+        size_t size;
+    };
+
+    /**
+     * @param[in] base_size 每个内存块的大小
+     */
+    ByteArray(size_t base_size = 4096);
+    ~ByteArray();
+
+    ByteArray(const ByteArray &) = delete;
+    ByteArray &operator=(const ByteArray &) = delete;
+
+    // 定长
+    void writeFint8(int8_t value);
+    void writeFuint8(uint8_t value);
+    void writeFint16(int16_t value);
+    void writeFuint16(uint16_t value);
+    void writeFint32(int32_t value);
+    void writeFuint32(uint32_t value);
+    void writeFint64(int64_t value);
+    void writeFuint64(uint64_t value);
+
+    // 变长，有符号的先 zigzag 再 varint，小的负数也只占很少的字节
+    void writeInt32(int32_t value);
+    void writeUint32(uint32_t value);
+    void writeInt64(int64_t value);
+    void writeUint64(uint64_t value);
+
+    void writeFloat(float value);
+    void writeDouble(double value);
+
+    // 字符串，前面带 16/32/64 位定长或者 varint 的长度
+    void writeStringF16(const std::string &value);
+    void writeStringF32(const std::string &value);
+    void writeStringF64(const std::string &value);
+    void writeStringVint(const std::string &value);
+    void writeStringWithoutLength(const std::string &value);
+
+    /**
+     * @brief 读取，剩下的数据不够的时候抛 std::out_of_range
+     */
+    int8_t readFint8();
+    uint8_t readFuint8();
+    int16_t readFint16();
+    uint16_t readFuint16();
+    int32_t readFint32();
+    uint32_t readFuint32();
+    int64_t readFint64();
+    uint64_t readFuint64();
+
+    int32_t readInt32();
+    uint32_t readUint32();
+    int64_t readInt64();
+    uint64_t readUint64();
+
+    float readFloat();
+    double readDouble();
+
+    std::string readStringF16();
+    std::string readStringF32();
+    std::string readStringF64();
+    std::string readStringVint();
+
+    void clear();   // 清空数据，只留第一个内存块
+
+    void write(const void *buf, size_t size);
+    void read(void *buf, size_t size);
+    /**
+     * @brief 从指定位置读，不改变 position
+     */
+    void read(void *buf, size_t size, size_t position) const;
+
+    size_t getPosition() const { return m_position; }
+    /**
+     * @brief 设置读写位置，超过已经写入的大小时数据大小跟着变大（用于 getWriteBuffers 收完数据之后）
+     * 超过容量抛 std::out_of_range
+     */
+    void setPosition(size_t v);
+
+    bool writeToFile(const std::string &name) const;    // 从 position 开始的数据写到文件
+    bool readFromFile(const std::string &name);         // 读整个文件写到 position 处
+
+    size_t getBaseSize() const { return m_baseSize; }
+    size_t getReadSize() const { return m_size - m_position; }  // 还可以读多少
+    size_t getSize() const { return m_size; }
+
+    bool isLittleEndian() const;
+    void setIsLittleEndian(bool val);
+
+    std::string toString() const;       // 从 position 开始的数据
+    std::string toHexString() const;
+
+    /**
+     * @brief 从 position 开始的 len 字节对应的内存块，用于 writev/sendmsg，不改变 position
+     * @return 实际的长度
+     */
+    uint64_t getReadBuffers(std::vector<iovec> &buffers, uint64_t len = ~0ull) const;
+    uint64_t getReadBuffers(std::vector<iovec> &buffers, uint64_t len, uint64_t position) const;
+    /**
+     * @brief 从 position 开始的 len 字节可写空间，不够的时候先扩容，用于 readv/recvmsg 直接收到块里
+     * 收完之后调用方 setPosition(getPosition() + n)
+     */
+    uint64_t getWriteBuffers(std::vector<iovec> &buffers, uint64_t len);
+
+private:
+    void addCapacity(size_t size);  // 保证从 position 开始至少还能写 size 字节
+    size_t getCapacity() const { return m_capacity - m_position; }
+
+    Node *locate(size_t position) const;    // position 所在的块，刚好在末尾的时候是 nullptr
+
+private:
+    size_t m_baseSize;      // 每个内存块的大小
+    size_t m_position;      // 当前读写位置
+    size_t m_capacity;      // 总容量
+    size_t m_size;          // 数据大小
+    int8_t m_endian;        // 定长整数的字节序，默认大端
+    Node *m_root;           // 第一个内存块
+    Node *m_cur;            // position 所在的内存块
+    Node *m_tail;           // 最后一个内存块，扩容直接挂在后面
+};
+
+}
+
+#endif //SYLAR_BYTEARRAY_H
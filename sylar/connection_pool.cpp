@@ -0,0 +1,411 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/25 10:00
+* @version: 1.0
+* @description: 出站连接池：每个后端地址一个池，空闲连接复用、定时淘汰和健康检查，借不到的时候协程等待
+********************************************************************************/
+
+#include "connection_pool.h"
+#include "config.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint32_t>::ptr g_pool_min_idle =
+        sylar::Config::Lookup("connection_pool.min_idle", (uint32_t)0, "connection pool min idle connections");
+static sylar::ConfigVar<uint32_t>::ptr g_pool_max_idle =
+        sylar::Config::Lookup("connection_pool.max_idle", (uint32_t)8, "connection pool max idle connections");
+static sylar::ConfigVar<uint32_t>::ptr g_pool_max_size =
+        sylar::Config::Lookup("connection_pool.max_size", (uint32_t)64, "connection pool max connections");
+static sylar::ConfigVar<uint32_t>::ptr g_pool_max_pipeline =
+        sylar::Config::Lookup("connection_pool.max_pipeline", (uint32_t)1,
+                              "max concurrent borrowers of one pooled connection");
+static sylar::ConfigVar<uint64_t>::ptr g_pool_idle_timeout =
+        sylar::Config::Lookup("connection_pool.idle_timeout", (uint64_t)(60 * 1000),
+                              "connection pool idle connection timeout ms");
+static sylar::ConfigVar<uint64_t>::ptr g_pool_check_interval =
+        sylar::Config::Lookup("connection_pool.check_interval", (uint64_t)(5 * 1000),
+                              "connection pool eviction and health check interval ms");
+static sylar::ConfigVar<uint64_t>::ptr g_pool_connect_timeout =
+        sylar::Config::Lookup("connection_pool.connect_timeout", (uint64_t)1000,
+                              "connection pool connect timeout ms");
+static sylar::ConfigVar<uint64_t>::ptr g_pool_io_timeout =
+        sylar::Config::Lookup("connection_pool.io_timeout", (uint64_t)(60 * 1000),
+                              "connection pool send/recv timeout ms");
+
+ConnectionPool::Options::Options()
+        :min_idle(g_pool_min_idle->getValue())
+        ,max_idle(g_pool_max_idle->getValue())
+        ,max_size(g_pool_max_size->getValue())
+        ,max_pipeline(g_pool_max_pipeline->getValue())
+        ,idle_timeout(g_pool_idle_timeout->getValue())
+        ,check_interval(g_pool_check_interval->getValue())
+        ,connect_timeout(g_pool_connect_timeout->getValue())
+        ,io_timeout(g_pool_io_timeout->getValue()) {
+}
+
+ConnectionPool::ptr ConnectionPool::Create(const sockaddr *addr, socklen_t addrlen,
+                                           const Options &options, IOManager *iom) {
+    SYLAR_ASSERT(iom);
+    ConnectionPool::ptr pool(new ConnectionPool(addr, addrlen, options, iom));
+    pool->start();
+    return pool;
+}
+
+ConnectionPool::ConnectionPool(const sockaddr *addr, socklen_t addrlen, const Options &options, IOManager *iom)
+        :m_iom(iom)
+        ,m_addrlen(std::min(addrlen, (socklen_t)sizeof(m_addr)))
+        ,m_options(options) {
+    memset(&m_addr, 0, sizeof(m_addr));
+    memcpy(&m_addr, addr, m_addrlen);
+    m_options.max_size = std::max(m_options.max_size, (uint32_t)1);
+    m_options.max_pipeline = std::max(m_options.max_pipeline, (uint32_t)1);
+    m_options.min_idle = std::min(m_options.min_idle, m_options.max_size);
+    m_options.max_idle = std::max(m_options.max_idle, m_options.min_idle);
+}
+
+ConnectionPool::~ConnectionPool() {
+    close();
+}
+
+void ConnectionPool::start() {
+    if(!m_options.check_interval) {
+        return;
+    }
+    std::weak_ptr<ConnectionPool> weak(shared_from_this());
+    auto check = [weak]() {
+        ConnectionPool::ptr self = weak.lock();
+        if(self) {
+            self->onCheck();
+        }
+    };
+    m_timer = m_iom->addTimer(m_options.check_interval, check, true);
+    if(m_options.min_idle) {    // 马上预热，不等第一次定时器
+        m_iom->schedule(check);
+    }
+}
+
+PoolConnection::ptr ConnectionPool::checkout(uint64_t timeout_ms) {
+    uint64_t deadline = timeout_ms == ~0ull ? ~0ull : sylar::GetMonotonicMS() + timeout_ms;
+    MutexType::Lock lock(m_mutex);
+    while(!m_closed) {
+        while(!m_idle.empty()) {
+            PoolConnection::ptr conn = m_idle.front();
+            m_idle.pop_front();
+            if(conn->m_socket->checkConnected()) {
+                return wrap(conn);
+            }
+            ++m_evicted;    // 空闲的时候对端关了
+            destroy(conn);
+        }
+
+        if(m_total < m_options.max_size) {
+            ++m_total;      // 先占住名额，连接的时候不持有锁
+            lock.unlock();
+            PoolConnection::ptr conn = connect();
+            lock.lock();
+            if(!conn) {
+                --m_total;
+                wakeWaiter(nullptr);
+                return nullptr;
+            }
+            if(m_closed) {
+                destroy(conn);
+                return nullptr;
+            }
+            return wrap(conn);
+        }
+
+        if(m_options.max_pipeline > 1) {    // 连接数到上限了，挑一条借出去最少的复用
+            PoolConnection::ptr best;
+            for(auto &i : m_active) {
+                if(!i->m_broken && i->m_inflight < m_options.max_pipeline
+                   && (!best || i->m_inflight < best->m_inflight)) {
+                    best = i;
+                }
+            }
+            if(best) {
+                return wrap(best);
+            }
+        }
+
+        uint64_t now = sylar::GetMonotonicMS();
+        if(!timeout_ms || now >= deadline || !Scheduler::GetThis()) {
+            ++m_timeouts;
+            return nullptr;
+        }
+        Waiter::ptr waiter(new Waiter);
+        waiter->scheduler = Scheduler::GetThis();
+        waiter->fiber = Fiber::GetThis();
+        m_waiters.push_back(waiter);
+        Timer::ptr timer;
+        if(deadline != ~0ull) {
+            std::weak_ptr<ConnectionPool> weak(shared_from_this());
+            timer = m_iom->addTimer(deadline - now, [weak, waiter]() {
+                ConnectionPool::ptr self = weak.lock();
+                if(!self) {
+                    return;
+                }
+                MutexType::Lock lock(self->m_mutex);
+                if(waiter->done) {
+                    return;
+                }
+                waiter->done = true;
+                waiter->timeout = true;
+                self->m_waiters.remove(waiter);
+                waiter->scheduler->schedule(waiter->fiber);
+            });
+        }
+        lock.unlock();
+        Fiber::YieldToHold();
+        if(timer) {
+            timer->cancel();
+        }
+        lock.lock();
+        if(waiter->conn) {  // 归还的人已经替我们登记成借出
+            PoolConnection::ptr conn = waiter->conn;
+            lock.unlock();
+            ConnectionPool::ptr self = shared_from_this();
+            return PoolConnection::ptr(conn.get(), [self, conn](PoolConnection *) {
+                self->release(conn);
+            });
+        }
+        if(waiter->timeout) {
+            ++m_timeouts;
+            return nullptr;
+        }
+        // 有连接关掉了，回去重新尝试新建
+    }
+    return nullptr;
+}
+
+PoolConnection::ptr ConnectionPool::connect() {
+    Socket::ptr sock = Socket::CreateTCP(m_addr.ss_family);
+    if(!sock->connect((const sockaddr *)&m_addr, m_addrlen, m_options.connect_timeout)) {
+        ++m_connectFails;
+        SYLAR_LOG_WARN(g_logger) << "connection pool connect "
+                                 << Socket::AddressToString((const sockaddr *)&m_addr, m_addrlen)
+                                 << " fail errno=" << errno << " errstr=" << strerror(errno);
+        return nullptr;
+    }
+    if(m_addr.ss_family != AF_UNIX) {
+        sock->setNoDelay();
+    }
+    sock->setRecvTimeout(m_options.io_timeout);
+    sock->setSendTimeout(m_options.io_timeout);
+
+    Factory factory;
+    {
+        MutexType::Lock lock(m_mutex);
+        factory = m_factory;
+    }
+    PoolConnection::ptr conn = factory ? factory(sock) : std::make_shared<PoolConnection>(sock);
+    conn->m_createTime = conn->m_lastActive = sylar::GetMonotonicMS();
+    ++m_created;
+    return conn;
+}
+
+PoolConnection::ptr ConnectionPool::wrap(PoolConnection::ptr conn) {
+    if(conn->m_inflight++ == 0) {
+        m_active.push_back(conn);
+    }
+    ConnectionPool::ptr self = shared_from_this();
+    return PoolConnection::ptr(conn.get(), [self, conn](PoolConnection *) {
+        self->release(conn);
+    });
+}
+
+void ConnectionPool::release(PoolConnection::ptr conn) {
+    MutexType::Lock lock(m_mutex);
+    SYLAR_ASSERT(conn->m_inflight > 0);
+    bool usable = !m_closed && !conn->m_broken && conn->m_socket->isConnected();
+    if(--conn->m_inflight > 0) {    // 还有别的协程在用，空出来一个复用的位置
+        if(usable && m_options.max_pipeline > 1) {
+            wakeWaiter(conn);
+        }
+        return;
+    }
+    auto it = std::find(m_active.begin(), m_active.end(), conn);
+    if(it != m_active.end()) {
+        *it = m_active.back();
+        m_active.pop_back();
+    }
+    if(!usable) {
+        destroy(conn);
+        wakeWaiter(nullptr);
+        return;
+    }
+    conn->m_lastActive = sylar::GetMonotonicMS();
+    if(wakeWaiter(conn)) {
+        return;
+    }
+    if(m_idle.size() >= m_options.max_idle) {
+        destroy(conn);
+        return;
+    }
+    m_idle.push_front(conn);
+}
+
+bool ConnectionPool::wakeWaiter(PoolConnection::ptr conn) {
+    while(!m_waiters.empty()) {
+        Waiter::ptr waiter = m_waiters.front();
+        m_waiters.pop_front();
+        if(waiter->done) {
+            continue;
+        }
+        waiter->done = true;
+        if(conn && conn->m_inflight++ == 0) {
+            m_active.push_back(conn);
+        }
+        waiter->conn = conn;
+        waiter->scheduler->schedule(waiter->fiber);
+        return true;
+    }
+    return false;
+}
+
+void ConnectionPool::destroy(PoolConnection::ptr conn) {
+    --m_total;
+    conn->m_socket->close();
+}
+
+void ConnectionPool::onCheck() {
+    std::list<PoolConnection::ptr> conns;
+    HealthCheck health_check;
+    {
+        MutexType::Lock lock(m_mutex);
+        if(m_closed || m_checking) {
+            return;
+        }
+        m_checking = true;
+        uint64_t now = sylar::GetMonotonicMS();
+        while(m_idle.size() > m_options.min_idle    // 后面是最久没用的
+              && now - m_idle.back()->m_lastActive >= m_options.idle_timeout) {
+            ++m_evicted;
+            destroy(m_idle.back());
+            m_idle.pop_back();
+        }
+        conns.swap(m_idle);     // 拿出来检查，检查的时候不持有锁
+        health_check = m_healthCheck;
+    }
+
+    std::vector<bool> alive;
+    alive.reserve(conns.size());
+    for(auto &i : conns) {
+        alive.push_back(i->m_socket->checkConnected() && (!health_check || health_check(i)));
+    }
+
+    uint32_t need = 0;
+    {
+        MutexType::Lock lock(m_mutex);
+        size_t idx = 0;
+        for(auto &i : conns) {
+            if(!alive[idx++] || m_closed || i->m_broken) {
+                ++m_evicted;
+                destroy(i);
+                wakeWaiter(nullptr);
+            } else if(!wakeWaiter(i)) {
+                if(m_idle.size() < m_options.max_idle) {
+                    m_idle.push_back(i);    // 检查期间归还的更新，放前面
+                } else {
+                    destroy(i);
+                }
+            }
+        }
+        while(!m_closed && m_idle.size() + need < m_options.min_idle && m_total < m_options.max_size) {
+            ++m_total;
+            ++need;
+        }
+    }
+
+    for(uint32_t i = 0; i < need; ++i) {    // 补足 min_idle
+        PoolConnection::ptr conn = connect();
+        MutexType::Lock lock(m_mutex);
+        if(!conn) {
+            --m_total;
+            wakeWaiter(nullptr);
+        } else if(m_closed) {
+            destroy(conn);
+        } else if(!wakeWaiter(conn)) {
+            m_idle.push_front(conn);
+        }
+    }
+
+    MutexType::Lock lock(m_mutex);
+    m_checking = false;
+}
+
+void ConnectionPool::close() {
+    MutexType::Lock lock(m_mutex);
+    if(m_closed) {
+        return;
+    }
+    m_closed = true;
+    if(m_timer) {
+        m_timer->cancel();
+        m_timer.reset();
+    }
+    for(auto &i : m_idle) {
+        destroy(i);
+    }
+    m_idle.clear();
+    while(wakeWaiter(nullptr));
+}
+
+void ConnectionPool::setFactory(Factory v) {
+    MutexType::Lock lock(m_mutex);
+    m_factory = v;
+}
+
+void ConnectionPool::setHealthCheck(HealthCheck v) {
+    MutexType::Lock lock(m_mutex);
+    m_healthCheck = v;
+}
+
+uint32_t ConnectionPool::getTotal() {
+    MutexType::Lock lock(m_mutex);
+    return m_total;
+}
+
+uint32_t ConnectionPool::getIdle() {
+    MutexType::Lock lock(m_mutex);
+    return m_idle.size();
+}
+
+uint32_t ConnectionPool::getWaiting() {
+    MutexType::Lock lock(m_mutex);
+    return m_waiters.size();
+}
+
+std::ostream &ConnectionPool::dump(std::ostream &os) {
+    MutexType::Lock lock(m_mutex);
+    os << "[ConnectionPool address=" << Socket::AddressToString((const sockaddr *)&m_addr, m_addrlen)
+       << " total=" << m_total
+       << " idle=" << m_idle.size()
+       << " active=" << m_active.size()
+       << " waiting=" << m_waiters.size()
+       << " created=" << m_created
+       << " connect_fails=" << m_connectFails
+       << " evicted=" << m_evicted
+       << " timeouts=" << m_timeouts
+       << " closed=" << m_closed << "]";
+    return os;
+}
+
+std::string ConnectionPool::toString() {
+    std::stringstream ss;
+    dump(ss);
+    return ss.str();
+}
+
+}
@@ -0,0 +1,186 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/25 10:00
+* @version: 1.0
+* @description: 出站连接池：每个后端地址一个池，空闲连接复用、定时淘汰和健康检查，借不到的时候协程等待
+********************************************************************************/
+
+
+#ifndef SYLAR_CONNECTION_POOL_H
+#define SYLAR_CONNECTION_POOL_H
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+#include "iomanager.h"
+#include "socket.h"
+#include "thread.h"
+
+namespace sylar {
+
+class ConnectionPool;
+
+/**
+ * @brief 池里的一条连接
+ * 协议层可以继承它，把连接上的状态（接收缓冲区、pipelining 的请求顺序）放在里面，
+ * 通过 ConnectionPool::setFactory 让连接池创建子类
+ */
+class PoolConnection {
+friend class ConnectionPool;
+public:
+    typedef std::shared_ptr<PoolConnection> ptr;
+
+    PoolConnection(Socket::ptr sock) : m_socket(sock) {}
+    virtual ~PoolConnection() {}
+
+    Socket::ptr getSocket() const { return m_socket; }
+
+    /**
+     * @brief 标记连接不能再用了（协议出错、对端要求关闭），归还的时候直接关闭，不再借给别人
+     */
+    void setBroken() { m_broken = true; }
+    bool isBroken() const { return m_broken; }
+
+    /**
+     * @brief 创建时间、最后一次归还的时间(单调时钟，毫秒)
+     */
+    uint64_t getCreateTime() const { return m_createTime; }
+    uint64_t getLastActiveTime() const { return m_lastActive; }
+
+private:
+    Socket::ptr m_socket;
+    std::atomic<bool> m_broken{false};
+    uint32_t m_inflight = 0;    // 借出去的次数，多路复用的时候可以大于 1，连接池的锁保护
+    uint64_t m_createTime = 0;
+    uint64_t m_lastActive = 0;
+};
+
+/**
+ * @brief 一个后端地址的连接池
+ * checkout 的顺序：最近归还的空闲连接 -> 没到上限就新建 -> 多路复用借出去的连接 -> 让出协程排队等待。
+ * 借到的指针释放的时候自动归还；归还的时候有人在等就直接交给等待者，不经过空闲队列。
+ * 定时器每隔 check_interval 检查一遍空闲连接：对端已经关闭的、超过 idle_timeout 没用的（保留 min_idle 个）关掉，
+ * 然后补足 min_idle 个空闲连接。
+ *
+ * max_pipeline 大于 1 的时候，连接数到了上限之后同一条连接可以同时借给多个协程，
+ * 协议层自己保证请求按顺序写、响应按顺序读（见 http::HttpConnection）
+ */
+class ConnectionPool : public std::enable_shared_from_this<ConnectionPool> {
+public:
+    typedef std::shared_ptr<ConnectionPool> ptr;
+    typedef Mutex MutexType;
+    typedef std::function<PoolConnection::ptr(Socket::ptr sock)> Factory;
+    /**
+     * @brief 空闲连接的健康检查，返回 false 的连接被关闭；在定时器的协程里调用，可以收发数据
+     */
+    typedef std::function<bool(PoolConnection::ptr conn)> HealthCheck;
+
+    struct Options {
+        Options();  // 默认值取 connection_pool.* 配置
+
+        uint32_t min_idle;          // 最少保持的空闲连接
+        uint32_t max_idle;          // 最多保留的空闲连接，多出来的归还的时候关掉
+        uint32_t max_size;          // 连接总数上限，包括借出去的
+        uint32_t max_pipeline;      // 一条连接最多同时借给几个协程，1 表示不复用
+        uint64_t idle_timeout;      // 空闲多久之后关掉(毫秒)
+        uint64_t check_interval;    // 淘汰、健康检查的间隔(毫秒)
+        uint64_t connect_timeout;   // 建立连接的超时(毫秒)
+        uint64_t io_timeout;        // 新连接的收发超时(毫秒)，~0ull 不超时
+    };
+
+    /**
+     * @param[in] iom 定时器和等待者恢复用的 IOManager
+     */
+    static ConnectionPool::ptr Create(const sockaddr *addr, socklen_t addrlen,
+                                      const Options &options = Options(),
+                                      IOManager *iom = IOManager::GetThis());
+    static ConnectionPool::ptr Create(const Address &addr, const Options &options = Options(),
+                                      IOManager *iom = IOManager::GetThis()) {
+        return Create(addr.getAddr(), addr.getAddrLen(), options, iom);
+    }
+    ~ConnectionPool();
+
+    /**
+     * @brief 借一条连接，没有可用的时候让出协程等待
+     * @param[in] timeout_ms 最多等多久(毫秒)，0 不等待，~0ull 一直等
+     * @return 超时、连接失败或者连接池已经关闭返回 nullptr；返回的指针释放的时候自动归还
+     */
+    PoolConnection::ptr checkout(uint64_t timeout_ms = ~0ull);
+
+    /**
+     * @brief 关掉空闲连接，唤醒所有等待者，之后借不到连接；借出去的连接归还的时候关闭
+     */
+    void close();
+
+    void setFactory(Factory v);
+    void setHealthCheck(HealthCheck v);
+
+    const Options &getOptions() const { return m_options; }
+    const sockaddr *getAddress() const { return (const sockaddr *)&m_addr; }
+    socklen_t getAddressLen() const { return m_addrlen; }
+
+    uint32_t getTotal();        // 连接总数，包括正在建立的
+    uint32_t getIdle();
+    uint32_t getWaiting();
+    uint64_t getCreatedCount() const { return m_created; }
+    uint64_t getConnectFailCount() const { return m_connectFails; }
+    uint64_t getEvictedCount() const { return m_evicted; }  // 空闲超时、健康检查失败关掉的
+    uint64_t getTimeoutCount() const { return m_timeouts; } // checkout 超时的次数
+
+    std::ostream &dump(std::ostream &os);
+    std::string toString();
+
+private:
+    struct Waiter {
+        typedef std::shared_ptr<Waiter> ptr;
+        Scheduler *scheduler = nullptr;
+        Fiber::ptr fiber;
+        PoolConnection::ptr conn;   // 归还的连接直接交给它
+        bool done = false;          // 已经被唤醒过了，超时和归还只有一个生效
+        bool timeout = false;
+    };
+
+    ConnectionPool(const sockaddr *addr, socklen_t addrlen, const Options &options, IOManager *iom);
+
+    void start();
+    PoolConnection::ptr connect();
+    PoolConnection::ptr wrap(PoolConnection::ptr conn);
+    void release(PoolConnection::ptr conn);
+    /**
+     * @brief 唤醒第一个等待者，conn 为空的时候它回去重新尝试（有连接关掉了，可以新建）
+     */
+    bool wakeWaiter(PoolConnection::ptr conn);
+    void destroy(PoolConnection::ptr conn);
+    void onCheck();
+
+private:
+    MutexType m_mutex;
+    IOManager *m_iom;
+    sockaddr_storage m_addr;
+    socklen_t m_addrlen;
+    Options m_options;
+    Factory m_factory;
+    HealthCheck m_healthCheck;
+    Timer::ptr m_timer;
+    bool m_closed = false;
+    bool m_checking = false;
+
+    uint32_t m_total = 0;
+    std::list<PoolConnection::ptr> m_idle;          // 前面是最近归还的
+    std::vector<PoolConnection::ptr> m_active;      // 借出去的，多路复用的时候从这里挑
+    std::list<Waiter::ptr> m_waiters;
+
+    std::atomic<uint64_t> m_created{0};
+    std::atomic<uint64_t> m_connectFails{0};
+    std::atomic<uint64_t> m_evicted{0};
+    std::atomic<uint64_t> m_timeouts{0};
+};
+
+}
+
+#endif //SYLAR_CONNECTION_POOL_H
@@ -0,0 +1,78 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/15 09:40
+* @version: 1.0
+* @description: 字节序转换
+********************************************************************************/
+
+
+#ifndef SYLAR_ENDIAN_H
+#define SYLAR_ENDIAN_H
+
+#define SYLAR_LITTLE_ENDIAN 1
+#define SYLAR_BIG_ENDIAN 2
+
+#include <endian.h>
+#include <byteswap.h>
+#include <cstdint>
+#include <type_traits>
+
+namespace sylar {
+
+template<class T>
+typename std::enable_if<sizeof(T) == sizeof(uint8_t), T>::type
+byteswap(T value) {
+    return value;
+}
+
+template<class T>
+typename std::enable_if<sizeof(T) == sizeof(uint16_t), T>::type
+byteswap(T value) {
+    return (T)bswap_16((uint16_t)value);
+}
+
+template<class T>
+typename std::enable_if<sizeof(T) == sizeof(uint32_t), T>::type
+byteswap(T value) {
+    return (T)bswap_32((uint32_t)value);
+}
+
+template<class T>
+typename std::enable_if<sizeof(T) == sizeof(uint64_t), T>::type
+byteswap(T value) {
+    return (T)bswap_64((uint64_t)value);
+}
+
+#if BYTE_ORDER == BIG_ENDIAN
+#define SYLAR_BYTE_ORDER SYLAR_BIG_ENDIAN
+#else
+#define SYLAR_BYTE_ORDER SYLAR_LITTLE_ENDIAN
+#endif
+
+#if SYLAR_BYTE_ORDER == SYLAR_BIG_ENDIAN
+template<class T>
+T byteswapOnLittleEndian(T t) {     // 只在小端机器上转换，用于主机序和网络序（大端）之间转换
+    return t;
+}
+
+template<class T>
+T byteswapOnBigEndian(T t) {
+    return byteswap(t);
+}
+#else
+template<class T>
+T byteswapOnLittleEndian(T t) {
+    return byteswap(t);
+}
+
+template<class T>
+T byteswapOnBigEndian(T t) {
+    return t;
+}
+#endif
+
+}
+
+#endif //SYLAR_ENDIAN_H
@@ -0,0 +1,142 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/9 10:37
+* @version: 1.0
+* @description: 文件句柄管理
+********************************************************************************/
+
+#include "fd_manager.h"
+#include "hook.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+
+namespace sylar {
+
+FdCtx::FdCtx(int fd, bool take_over)
+        : m_isInit(false)
+        , m_isSocket(false)
+        , m_sysNonblock(false)
+        , m_userNonblock(false)
+        , m_isClosed(false)
+        , m_fd(fd)
+        , m_recvTimeout(-1)
+        , m_sendTimeout(-1) {
+    init(take_over);
+}
+
+FdCtx::~FdCtx() {
+}
+
+static uint64_t GetSockTimeout(int fd, int type) {
+    struct timeval tv;
+    socklen_t len = sizeof(tv);
+    if(getsockopt(fd, SOL_SOCKET, type, &tv, &len) == -1
+       || (tv.tv_sec == 0 && tv.tv_usec == 0)) {
+        return -1;
+    }
+    return tv.tv_sec * 1000ull + tv.tv_usec / 1000;
+}
+
+bool FdCtx::init(bool take_over) {
+    if(m_isInit) {
+        return true;
+    }
+
+    struct stat fd_stat;
+    if(-1 == fstat(m_fd, &fd_stat)) {
+        m_isInit = false;
+        m_isSocket = false;
+    } else {
+        m_isInit = true;
+        m_isSocket = S_ISSOCK(fd_stat.st_mode);
+    }
+
+    if(m_isSocket && take_over) {   // 自己创建的 socket 设成非阻塞，阻塞的语义由 hook 模拟
+        int flags = fcntl_f(m_fd, F_GETFL, 0);
+        if(flags == -1) {   // 拿不到 flags 的不接管，不然会把 -1 当成带 O_NONBLOCK
+            m_sysNonblock = false;
+        } else if(flags & O_NONBLOCK) {     // 创建的时候已经是非阻塞了，说明是用户要的
+            m_userNonblock = true;
+            m_sysNonblock = true;
+        } else {
+            m_sysNonblock = fcntl_f(m_fd, F_SETFL, flags | O_NONBLOCK) != -1;
+        }
+    } else {    // 外面来的 fd 可能和别人共用，不动它的 flags
+        m_sysNonblock = false;
+    }
+    if(m_isSocket) {
+        m_recvTimeout = GetSockTimeout(m_fd, SO_RCVTIMEO);  // 之前可能已经设置过超时
+        m_sendTimeout = GetSockTimeout(m_fd, SO_SNDTIMEO);
+    }
+
+    return m_isInit;
+}
+
+void FdCtx::setTimeout(int type, uint64_t v) {
+    if(type == SO_RCVTIMEO) {
+        m_recvTimeout = v;
+    } else {
+        m_sendTimeout = v;
+    }
+}
+
+uint64_t FdCtx::getTimeout(int type) {
+    if(type == SO_RCVTIMEO) {
+        return m_recvTimeout;
+    } else {
+        return m_sendTimeout;
+    }
+}
+
+FdManager::FdManager() {
+    m_datas.resize(64);
+}
+
+FdCtx::ptr FdManager::get(int fd, bool auto_create, bool take_over) {
+    if(fd < 0) {
+        return nullptr;
+    }
+    RWMutexType::ReadLock lock(m_mutex);
+    if((int)m_datas.size() <= fd) {
+        if(!auto_create) {
+            return nullptr;
+        }
+    } else {
+        if(m_datas[fd] && !m_datas[fd]->isClose()) {
+            return m_datas[fd];
+        }
+        if(!auto_create) {
+            return nullptr;
+        }
+    }
+    lock.unlock();
+
+    RWMutexType::WriteLock lock2(m_mutex);
+    if((int)m_datas.size() <= fd) {
+        m_datas.resize(fd * 1.5);
+    }
+    if(!m_datas[fd] || m_datas[fd]->isClose()) {    // 拿写锁的过程中可能已经被别人建好了
+        m_datas[fd].reset(new FdCtx(fd, take_over));
+    }
+    return m_datas[fd];
+}
+
+void FdManager::del(int fd) {
+    {   // 所有的 close 都会走到这里，大部分 fd 没有上下文，先用读锁看一下
+        RWMutexType::ReadLock lock(m_mutex);
+        if(fd < 0 || (int)m_datas.size() <= fd || !m_datas[fd]) {
+            return;
+        }
+    }
+    RWMutexType::WriteLock lock(m_mutex);
+    if((int)m_datas.size() <= fd || !m_datas[fd]) {
+        return;
+    }
+    m_datas[fd]->setClose(true);    // 外面还拿着 FdCtx::ptr 的能看到已经关闭了
+    m_datas[fd].reset();
+}
+
+}
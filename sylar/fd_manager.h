@@ -0,0 +1,103 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/9 10:37
+* @version: 1.0
+* @description: 文件句柄管理
+********************************************************************************/
+
+
+#ifndef SYLAR_FD_MANAGER_H
+#define SYLAR_FD_MANAGER_H
+
+#include <memory>
+#include <vector>
+#include <atomic>
+#include "thread.h"
+#include "singleton.h"
+
+namespace sylar {
+
+/**
+ * @brief 文件句柄上下文
+ * 缓存 fd 的元数据：是不是 socket、用户有没有设置非阻塞、收发超时、是否已经关闭
+ * hook 每次读写直接查这里，不用再 fstat/fcntl/getsockopt
+ * 只有 hook 的 socket/accept 创建的 socket 才会被接管（设成非阻塞，阻塞语义由 hook 模拟）；
+ * 其它地方来的 fd（继承的、别的库创建的、关着 hook 的时候创建的）可能和别的代码共用，
+ * 不改它的 O_NONBLOCK，hook 直接调用原始函数
+ * 构造之后会被别的线程改的（非阻塞标志、关闭标志、超时）都是原子的，不和别的字段挤在一个字节里
+ */
+class FdCtx : public std::enable_shared_from_this<FdCtx> {
+public:
+    typedef std::shared_ptr<FdCtx> ptr;
+
+    /**
+     * @param[in] take_over 是不是 socket 的话设成非阻塞，由 hook 接管
+     */
+    FdCtx(int fd, bool take_over = false);
+    ~FdCtx();
+
+    bool isInit() const { return m_isInit; }
+    bool isSocket() const { return m_isSocket; }
+    bool isClose() const { return m_isClosed; }
+
+    void setClose(bool v) { m_isClosed = v; }
+
+    void setUserNonblock(bool v) { m_userNonblock = v; }    // 用户主动设置的非阻塞
+    bool getUserNonblock() const { return m_userNonblock; }
+
+    void setSysNonblock(bool v) { m_sysNonblock = v; }  // hook 设置的非阻塞
+    bool getSysNonblock() const { return m_sysNonblock; }
+
+    /**
+     * @brief 设置超时时间
+     * @param[in] type SO_RCVTIMEO 或者 SO_SNDTIMEO
+     * @param[in] v 毫秒，~0ull 表示不超时
+     */
+    void setTimeout(int type, uint64_t v);
+    uint64_t getTimeout(int type);
+
+private:
+    bool init(bool take_over);
+
+private:
+    bool m_isInit;      // 只在构造的时候写
+    bool m_isSocket;
+    std::atomic<bool> m_sysNonblock;
+    std::atomic<bool> m_userNonblock;
+    std::atomic<bool> m_isClosed;
+    int m_fd;
+    std::atomic<uint64_t> m_recvTimeout;
+    std::atomic<uint64_t> m_sendTimeout;
+};
+
+/**
+ * @brief 文件句柄管理类，按 fd 下标索引
+ * 查找只加读锁，不够大的时候和 IOManager::contextResize 一样按 1.5 倍扩容
+ */
+class FdManager {
+public:
+    typedef RWMutex RWMutexType;
+
+    FdManager();
+
+    /**
+     * @brief 获取句柄上下文
+     * @param[in] auto_create 不存在或者已经关闭的时候是否新建
+     * @param[in] take_over 新建的时候是否接管，只有 hook 的 socket/accept 传 true
+     */
+    FdCtx::ptr get(int fd, bool auto_create = false, bool take_over = false);
+
+    void del(int fd);   // 关闭的时候让缓存失效，fd 号会被复用
+
+private:
+    RWMutexType m_mutex;
+    std::vector<FdCtx::ptr> m_datas;
+};
+
+typedef Singleton<FdManager> FdMgr;
+
+}
+
+#endif //SYLAR_FD_MANAGER_H
@@ -181,7 +181,9 @@ void Fiber::YieldToReady() {
 
 void Fiber::YieldToHold() {
     Fiber::ptr cur = GetThis();
-    cur->m_state = HOLD;
+    // 不能在这里设置 HOLD：等待的事件可能已经在别的线程上触发了，看到 HOLD 就会把还没切出去的协程
+    // 再切进去，两个线程跑同一个栈。保持 EXEC 直到切回调度协程，由调度器改成 HOLD
+    SYLAR_ASSERT(cur->m_state == EXEC);
     cur->swapOut();
 }
 
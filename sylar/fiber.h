@@ -11,6 +11,7 @@
 #ifndef SYLAR_FIBER_H
 #define SYLAR_FIBER_H
 
+#include <atomic>
 #include <memory>
 #include <ucontext.h>
 #include <functional>
@@ -53,6 +54,7 @@ public:
     void back();
 
     uint64_t getId() const { return m_id; }
+    // YieldToHold 让出的协程在调度器改成 HOLD 之前还是 EXEC，EXEC 不代表正在执行
     State getState() const { return m_state; }
 
 public:
@@ -62,7 +64,9 @@ public:
     static Fiber::ptr GetThis();
     //协程切换到后台，并且设置为Ready状态
     static void YieldToReady();
-    //协程切换到后台，并且设置为Hold状态
+    //协程切换到后台挂起，等别人放回调度器。不在这里设置 HOLD，切出去的时候还是 EXEC，
+    //由把它切进来的调度器在切回来之后改成 HOLD，在这之前放回队列也不会被别的线程切进去。
+    //不经过调度器、自己 swapIn 的协程切回来之后还是 EXEC，不能再 swapIn，这种用 YieldToReady
     static void YieldToHold();
     //总协程数
     static uint64_t TotalFibers();
@@ -74,7 +78,7 @@ public:
 private:
     uint64_t m_id = 0;  // 协程 id
     uint32_t m_stack_size = 0;   // 协程栈大小
-    State m_state = INIT;   // 协程状态
+    std::atomic<State> m_state{INIT};   // 协程状态，调度线程加锁读、执行线程不加锁写
 
     ucontext_t m_ctx;   // 协程上下文
     void *m_stack = nullptr;    // 协程栈
@@ -0,0 +1,184 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/28 10:00
+* @version: 1.0
+* @description: 普通文件的异步 IO：epoll 对普通文件永远就绪，读写、fsync 交给 io_uring 或者专门的阻塞 IO 线程，协程让出等结果
+********************************************************************************/
+
+#include "file_io.h"
+#include "config.h"
+#include "iomanager.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace sylar {
+
+/**
+ * 文件日志在别的编译单元的静态初始化里就可能用到线程池，那时下面的全局变量还没初始化，配置项在第一次用的时候查
+ */
+static sylar::ConfigVar<uint32_t>::ptr FileIOThreads() {
+    static sylar::ConfigVar<uint32_t>::ptr s_var =
+            sylar::Config::Lookup("file_io.threads", (uint32_t)2, "blocking file io thread count");
+    return s_var;
+}
+
+static sylar::ConfigVar<uint32_t>::ptr FileIOMaxQueue() {
+    static sylar::ConfigVar<uint32_t>::ptr s_var =
+            sylar::Config::Lookup("file_io.max_queue", (uint32_t)1024, "blocking file io max queued tasks");
+    return s_var;
+}
+
+// 启动的时候就注册上，加载配置文件的时候找得到
+static sylar::ConfigVar<uint32_t>::ptr g_file_io_threads = FileIOThreads();
+static sylar::ConfigVar<uint32_t>::ptr g_file_io_max_queue = FileIOMaxQueue();
+
+BlockingExecutor *AsyncFile::GetExecutor() {
+    static GlobalExecutorHolder<BlockingExecutor> s_holder(new BlockingExecutor(
+            std::max(FileIOThreads()->getValue(), (uint32_t)1), FileIOMaxQueue()->getValue(), "file_io"));
+    return s_holder.get();
+}
+
+/**
+ * @brief 开启了 io_uring 的时候直接提交，没有开启或者队列满了返回 false，交给线程池
+ */
+static bool UringFileIO(uint8_t opcode, int fd, const void *buf, size_t count, off_t offset,
+                        uint32_t fsync_flags, ssize_t &rt) {
+    if(!InSchedulerFiber()) {
+        return false;
+    }
+    IOManager *iom = dynamic_cast<IOManager *>(Scheduler::GetThis());
+    if(!iom || !iom->hasIOUring()) {
+        return false;
+    }
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = opcode;
+    sqe.fd = fd;
+    sqe.addr = (uint64_t)buf;
+    sqe.len = count;
+    sqe.off = (uint64_t)offset;     // -1 表示用文件自己的读写位置
+    sqe.fsync_flags = fsync_flags;
+    int res = iom->submitUring(sqe);
+    if(res == -EAGAIN || res == -ENOSYS) {
+        return false;
+    }
+    if(res < 0) {
+        errno = -res;
+        rt = -1;
+    } else {
+        rt = res;
+    }
+    return true;
+}
+
+AsyncFile::ptr AsyncFile::Open(const std::string &path, int flags, mode_t mode) {
+    int fd = blocking(GetExecutor(), [&path, flags, mode]() {
+        return ::open(path.c_str(), flags | O_CLOEXEC, mode);
+    });
+    if(fd < 0) {
+        return nullptr;
+    }
+    return std::make_shared<AsyncFile>(fd);
+}
+
+AsyncFile::~AsyncFile() {
+    if(m_fd >= 0) {     // 析构的时候不让出协程，直接关闭
+        ::close(m_fd);
+    }
+}
+
+ssize_t AsyncFile::read(void *buf, size_t count) {
+    return pread(buf, count, -1);
+}
+
+ssize_t AsyncFile::write(const void *buf, size_t count) {
+    return pwrite(buf, count, -1);
+}
+
+ssize_t AsyncFile::pread(void *buf, size_t count, off_t offset) {
+    ssize_t rt = -1;
+    if(UringFileIO(IORING_OP_READ, m_fd, buf, count, offset, 0, rt)) {
+        return rt;
+    }
+    int fd = m_fd;
+    return blocking(GetExecutor(), [fd, buf, count, offset]() {
+        return offset < 0 ? ::read(fd, buf, count) : ::pread(fd, buf, count, offset);
+    });
+}
+
+ssize_t AsyncFile::pwrite(const void *buf, size_t count, off_t offset) {
+    ssize_t rt = -1;
+    if(UringFileIO(IORING_OP_WRITE, m_fd, buf, count, offset, 0, rt)) {
+        return rt;
+    }
+    int fd = m_fd;
+    return blocking(GetExecutor(), [fd, buf, count, offset]() {
+        return offset < 0 ? ::write(fd, buf, count) : ::pwrite(fd, buf, count, offset);
+    });
+}
+
+ssize_t AsyncFile::readAll(void *buf, size_t count, off_t offset) {
+    size_t done = 0;
+    while(done < count) {
+        ssize_t n = pread((char *)buf + done, count - done, offset < 0 ? -1 : offset + done);
+        if(n < 0) {
+            return -1;
+        }
+        if(n == 0) {
+            break;
+        }
+        done += n;
+    }
+    return done;
+}
+
+ssize_t AsyncFile::writeAll(const void *buf, size_t count, off_t offset) {
+    size_t done = 0;
+    while(done < count) {
+        ssize_t n = pwrite((const char *)buf + done, count - done, offset < 0 ? -1 : offset + done);
+        if(n < 0) {
+            return -1;
+        }
+        done += n;
+    }
+    return done;
+}
+
+int AsyncFile::sync(bool datasync) {
+    ssize_t rt = -1;
+    if(UringFileIO(IORING_OP_FSYNC, m_fd, nullptr, 0, 0, datasync ? IORING_FSYNC_DATASYNC : 0, rt)) {
+        return rt;
+    }
+    int fd = m_fd;
+    return blocking(GetExecutor(), [fd, datasync]() {
+        return datasync ? ::fdatasync(fd) : ::fsync(fd);
+    });
+}
+
+off_t AsyncFile::size() {
+    struct stat st;
+    int fd = m_fd;
+    if(blocking(GetExecutor(), [fd, &st]() { return ::fstat(fd, &st); })) {
+        return -1;
+    }
+    return st.st_size;
+}
+
+int AsyncFile::close() {
+    if(m_fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    int fd = m_fd;
+    m_fd = -1;
+    return blocking(GetExecutor(), [fd]() { return ::close(fd); });
+}
+
+}
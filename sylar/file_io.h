@@ -0,0 +1,80 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/28 10:00
+* @version: 1.0
+* @description: 普通文件的异步 IO：epoll 对普通文件永远就绪，读写、fsync 交给 io_uring 或者专门的阻塞 IO 线程，协程让出等结果
+********************************************************************************/
+
+
+#ifndef SYLAR_FILE_IO_H
+#define SYLAR_FILE_IO_H
+
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include "blocking.h"
+
+namespace sylar {
+
+/**
+ * @brief 异步读写的普通文件
+ * 当前 IOManager 开启了 io_uring（iomanager.io_uring）时直接提交带偏移的读写、fsync，
+ * 否则交给文件 IO 专用的 BlockingExecutor（GetExecutor），和 blocking() 的全局线程池分开，
+ * 慢的 DNS、压缩不会挡住写日志。不在协程里调用的时候直接执行系统调用。
+ * 返回值和 errno 和对应的系统调用一样
+ */
+class AsyncFile {
+public:
+    typedef std::shared_ptr<AsyncFile> ptr;
+
+    /**
+     * @brief 打开文件，open 本身也可能碰磁盘，同样不在 IO 线程上执行
+     * @return 失败返回 nullptr，errno 为 open 的错误
+     */
+    static AsyncFile::ptr Open(const std::string &path, int flags, mode_t mode = 0644);
+
+    explicit AsyncFile(int fd) : m_fd(fd) {}
+    ~AsyncFile();
+
+    AsyncFile(const AsyncFile &) = delete;
+    AsyncFile &operator=(const AsyncFile &) = delete;
+
+    /**
+     * @brief read/write 用文件自己的读写位置，O_APPEND 打开的文件写到末尾；pread/pwrite 的 offset 为 -1 时同样
+     */
+    ssize_t read(void *buf, size_t count);
+    ssize_t write(const void *buf, size_t count);
+    ssize_t pread(void *buf, size_t count, off_t offset);
+    ssize_t pwrite(const void *buf, size_t count, off_t offset);
+    /**
+     * @brief 读满 count 字节或者读到文件结束，写完 count 字节，中途出错返回 -1
+     */
+    ssize_t readAll(void *buf, size_t count, off_t offset);
+    ssize_t writeAll(const void *buf, size_t count, off_t offset);
+
+    /**
+     * @param[in] datasync 只同步数据（fdatasync）
+     */
+    int sync(bool datasync = false);
+    off_t size();
+    /**
+     * @brief 关闭文件，析构的时候没关闭的话直接在当前线程关闭
+     */
+    int close();
+
+    int getFd() const { return m_fd; }
+
+    /**
+     * @brief 文件 IO 的线程池，第一次使用的时候按 file_io.threads、file_io.max_queue 创建
+     */
+    static BlockingExecutor *GetExecutor();
+
+private:
+    int m_fd = -1;
+};
+
+}
+
+#endif //SYLAR_FILE_IO_H
@@ -0,0 +1,414 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/7 14:03
+* @version: 1.0
+* @description: hook 系统调用，阻塞的 IO 在协程里自动变成异步的
+********************************************************************************/
+
+#include "hook.h"
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <cstdarg>
+#include <cerrno>
+
+#include "config.h"
+#include "fd_manager.h"
+#include "fiber.h"
+#include "iomanager.h"
+#include "log.h"
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<int>::ptr g_tcp_connect_timeout =
+        sylar::Config::Lookup("tcp.connect.timeout", 5000, "tcp connect timeout");
+
+static thread_local bool t_hook_enable = false;
+
+#define HOOK_FUN(XX) \
+    XX(sleep) \
+    XX(usleep) \
+    XX(nanosleep) \
+    XX(connect) \
+    XX(accept) \
+    XX(read) \
+    XX(readv) \
+    XX(recv) \
+    XX(recvfrom) \
+    XX(recvmsg) \
+    XX(write) \
+    XX(writev) \
+    XX(send) \
+    XX(sendto) \
+    XX(sendmsg) \
+    XX(close) \
+    XX(socket) \
+    XX(fcntl) \
+    XX(ioctl) \
+    XX(setsockopt)
+
+void hook_init() {
+    static bool is_inited = false;
+    if(is_inited) {
+        return;
+    }
+// 从动态库里取出原始的函数地址，sleep_f = (sleep_fun)dlsym(RTLD_NEXT, "sleep");
+#define XX(name) name ## _f = (name ## _fun)dlsym(RTLD_NEXT, #name);
+    HOOK_FUN(XX);
+#undef XX
+    is_inited = true;
+}
+
+static uint64_t s_connect_timeout = -1;
+
+struct _HookIniter {    // 在 main 之前初始化好原始函数
+    _HookIniter() {
+        hook_init();
+        s_connect_timeout = g_tcp_connect_timeout->getValue();
+
+        g_tcp_connect_timeout->addListener([](const int &old_value, const int &new_value) {
+            SYLAR_LOG_INFO(g_logger) << "tcp connect timeout changed from "
+                                     << old_value << " to " << new_value;
+            s_connect_timeout = new_value;
+        });
+    }
+};
+
+static _HookIniter s_hook_initer;
+
+bool is_hook_enable() {
+    return t_hook_enable;
+}
+
+void set_hook_enable(bool flag) {
+    t_hook_enable = flag;
+}
+
+/**
+ * @brief 当前是否可以用协程的方式等待：开启了 hook 并且在 IOManager 的线程里
+ */
+static sylar::IOManager *GetHookIOManager() {
+    if(!t_hook_enable) {
+        return nullptr;
+    }
+    return dynamic_cast<sylar::IOManager *>(sylar::Scheduler::GetThis());
+}
+
+/**
+ * @brief 通用的 IO 处理：先直接调用，EAGAIN 的时候注册事件让出协程，回来之后重试
+ * @param[in] timeout_so SO_RCVTIMEO 或者 SO_SNDTIMEO
+ */
+template<typename OriginFun, typename... Args>
+static ssize_t do_io(int fd, OriginFun fun, const char *hook_fun_name,
+                     uint32_t event, int timeout_so, Args &&... args) {
+    sylar::IOManager *iom = GetHookIOManager();
+    if(!iom) {
+        return fun(fd, std::forward<Args>(args)...);
+    }
+
+    // 不是 hook 创建的 fd 第一次用的时候建上下文（不接管），之后都走缓存
+    sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd, true);
+    if(!ctx) {
+        return fun(fd, std::forward<Args>(args)...);
+    }
+    if(ctx->isClose()) {
+        errno = EBADF;
+        return -1;
+    }
+    // 没有接管的 fd（非 socket、外面创建的 socket），或者用户自己设置的非阻塞，语义交给用户
+    if(!ctx->getSysNonblock() || ctx->getUserNonblock()) {
+        return fun(fd, std::forward<Args>(args)...);
+    }
+
+    uint64_t timeout = ctx->getTimeout(timeout_so);
+
+    ssize_t n = -1;
+    while(true) {
+        n = fun(fd, std::forward<Args>(args)...);
+        while(n == -1 && errno == EINTR) {
+            n = fun(fd, std::forward<Args>(args)...);
+        }
+        if(n == -1 && errno == EAGAIN) {
+            if(iom->waitEvent(fd, (sylar::IOManager::Event)event, timeout)) {
+                if(errno != ETIMEDOUT) {
+                    SYLAR_LOG_ERROR(g_logger) << hook_fun_name << " waitEvent("
+                                              << fd << ", " << event << ") errno=" << errno;
+                }
+                return -1;
+            }
+            continue;   // 就绪了，重新读写
+        }
+        break;
+    }
+    return n;
+}
+
+/**
+ * @brief sleep 系列：加一个定时器把当前协程放回调度器，然后让出
+ */
+static bool fiber_sleep(uint64_t ms) {
+    sylar::IOManager *iom = GetHookIOManager();
+    if(!iom) {
+        return false;
+    }
+    sylar::Fiber::ptr fiber = sylar::Fiber::GetThis();
+    iom->addWheelTimer(ms, [iom, fiber]() {
+        iom->schedule(fiber);
+    });
+    sylar::Fiber::YieldToHold();
+    return true;
+}
+
+}
+
+extern "C" {
+#define XX(name) name ## _fun name ## _f = nullptr;
+    HOOK_FUN(XX);
+#undef XX
+
+unsigned int sleep(unsigned int seconds) {
+    if(!sylar::fiber_sleep(seconds * 1000ull)) {
+        return sleep_f(seconds);
+    }
+    return 0;
+}
+
+int usleep(useconds_t usec) {
+    if(!sylar::fiber_sleep(usec / 1000)) {
+        return usleep_f(usec);
+    }
+    return 0;
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem) {
+    if(!sylar::fiber_sleep(req->tv_sec * 1000ull + req->tv_nsec / 1000 / 1000)) {
+        return nanosleep_f(req, rem);
+    }
+    return 0;
+}
+
+int connect_with_timeout(int fd, const struct sockaddr *addr, socklen_t addrlen, uint64_t timeout_ms) {
+    sylar::IOManager *iom = sylar::GetHookIOManager();
+    if(!iom) {
+        return connect_f(fd, addr, addrlen);
+    }
+    sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd, true);
+    if(!ctx || ctx->isClose()) {
+        errno = EBADF;
+        return -1;
+    }
+    if(!ctx->getSysNonblock() || ctx->getUserNonblock()) {
+        return connect_f(fd, addr, addrlen);
+    }
+
+    int n = connect_f(fd, addr, addrlen);
+    if(n == 0) {
+        return 0;
+    } else if(n != -1 || errno != EINPROGRESS) {
+        return n;
+    }
+
+    if(iom->waitEvent(fd, sylar::IOManager::WRITE, timeout_ms)) {
+        return -1;
+    }
+
+    int error = 0;
+    socklen_t len = sizeof(int);
+    if(-1 == getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len)) {
+        return -1;
+    }
+    if(!error) {
+        return 0;
+    } else {
+        errno = error;
+        return -1;
+    }
+}
+
+int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
+    return connect_with_timeout(sockfd, addr, addrlen, sylar::s_connect_timeout);
+}
+
+int socket(int domain, int type, int protocol) {
+    int fd = socket_f(domain, type, protocol);
+    if(fd == -1 || !sylar::is_hook_enable()) {
+        return fd;
+    }
+    sylar::FdMgr::GetInstance()->del(fd);   // 不是通过 hook 关掉的 fd 可能还留着旧的上下文
+    sylar::FdMgr::GetInstance()->get(fd, true, true);
+    return fd;
+}
+
+int accept(int s, struct sockaddr *addr, socklen_t *addrlen) {
+    int fd = (int)sylar::do_io(s, accept_f, "accept", sylar::IOManager::READ, SO_RCVTIMEO, addr, addrlen);
+    if(fd >= 0 && sylar::is_hook_enable()) {
+        sylar::FdMgr::GetInstance()->del(fd);
+        sylar::FdMgr::GetInstance()->get(fd, true, true);
+    }
+    return fd;
+}
+
+ssize_t read(int fd, void *buf, size_t count) {
+    return sylar::do_io(fd, read_f, "read", sylar::IOManager::READ, SO_RCVTIMEO, buf, count);
+}
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
+    return sylar::do_io(fd, readv_f, "readv", sylar::IOManager::READ, SO_RCVTIMEO, iov, iovcnt);
+}
+
+ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
+    return sylar::do_io(sockfd, recv_f, "recv", sylar::IOManager::READ, SO_RCVTIMEO, buf, len, flags);
+}
+
+ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen) {
+    return sylar::do_io(sockfd, recvfrom_f, "recvfrom", sylar::IOManager::READ, SO_RCVTIMEO,
+                        buf, len, flags, src_addr, addrlen);
+}
+
+ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
+    return sylar::do_io(sockfd, recvmsg_f, "recvmsg", sylar::IOManager::READ, SO_RCVTIMEO, msg, flags);
+}
+
+ssize_t write(int fd, const void *buf, size_t count) {
+    return sylar::do_io(fd, write_f, "write", sylar::IOManager::WRITE, SO_SNDTIMEO, buf, count);
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
+    return sylar::do_io(fd, writev_f, "writev", sylar::IOManager::WRITE, SO_SNDTIMEO, iov, iovcnt);
+}
+
+ssize_t send(int s, const void *msg, size_t len, int flags) {
+    return sylar::do_io(s, send_f, "send", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, len, flags);
+}
+
+ssize_t sendto(int s, const void *msg, size_t len, int flags, const struct sockaddr *to, socklen_t tolen) {
+    return sylar::do_io(s, sendto_f, "sendto", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, len, flags, to, tolen);
+}
+
+ssize_t sendmsg(int s, const struct msghdr *msg, int flags) {
+    return sylar::do_io(s, sendmsg_f, "sendmsg", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, flags);
+}
+
+int close(int fd) {
+    // 关掉之前把等在这个 fd 上的协程都唤醒、从 epoll 里删掉；不在 IOManager 线程里关的也要做，
+    // 否则常驻注册模式下 fd 号复用的时候不会重新注册
+    sylar::IOManager::OnFdClose(fd);
+    sylar::FdMgr::GetInstance()->del(fd);   // 不管有没有开启 hook 都要让缓存失效，fd 号会被复用
+    return close_f(fd);
+}
+
+int fcntl(int fd, int cmd, ... /* arg */ ) {
+    va_list va;
+    va_start(va, cmd);
+    switch(cmd) {
+        case F_SETFL: { // 记住用户要不要非阻塞，实际的 fd 保持 hook 设置的非阻塞
+            int arg = va_arg(va, int);
+            va_end(va);
+            sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd);
+            if(!ctx || ctx->isClose() || !ctx->getSysNonblock()) {  // 没有接管的原样设置
+                return fcntl_f(fd, cmd, arg);
+            }
+            ctx->setUserNonblock(arg & O_NONBLOCK);
+            if(ctx->getSysNonblock()) {
+                arg |= O_NONBLOCK;
+            } else {
+                arg &= ~O_NONBLOCK;
+            }
+            return fcntl_f(fd, cmd, arg);
+        }
+        case F_GETFL: { // 返回用户看到的 flags
+            va_end(va);
+            int arg = fcntl_f(fd, cmd);
+            sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd);
+            if(arg == -1 || !ctx || ctx->isClose() || !ctx->getSysNonblock()) {
+                return arg;
+            }
+            if(ctx->getUserNonblock()) {
+                return arg | O_NONBLOCK;
+            } else {
+                return arg & ~O_NONBLOCK;
+            }
+        }
+        case F_DUPFD:
+        case F_DUPFD_CLOEXEC:
+        case F_SETFD:
+        case F_SETOWN:
+        case F_SETSIG:
+        case F_SETLEASE:
+        case F_NOTIFY:
+#ifdef F_SETPIPE_SZ
+        case F_SETPIPE_SZ:
+#endif
+        {
+            int arg = va_arg(va, int);
+            va_end(va);
+            return fcntl_f(fd, cmd, arg);
+        }
+        case F_GETFD:
+        case F_GETOWN:
+        case F_GETSIG:
+        case F_GETLEASE:
+#ifdef F_GETPIPE_SZ
+        case F_GETPIPE_SZ:
+#endif
+        {
+            va_end(va);
+            return fcntl_f(fd, cmd);
+        }
+        case F_SETLK:
+        case F_SETLKW:
+        case F_GETLK: {
+            struct flock *arg = va_arg(va, struct flock*);
+            va_end(va);
+            return fcntl_f(fd, cmd, arg);
+        }
+        case F_GETOWN_EX:
+        case F_SETOWN_EX: {
+            struct f_owner_exlock *arg = va_arg(va, struct f_owner_exlock*);
+            va_end(va);
+            return fcntl_f(fd, cmd, arg);
+        }
+        default: {  // 其它命令按指针参数透传
+            void *arg = va_arg(va, void*);
+            va_end(va);
+            return fcntl_f(fd, cmd, arg);
+        }
+    }
+}
+
+int ioctl(int d, unsigned long int request, ...) {
+    va_list va;
+    va_start(va, request);
+    void *arg = va_arg(va, void*);
+    va_end(va);
+
+    if(FIONBIO == request) {
+        bool user_nonblock = !!*(int *)arg;
+        sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(d);
+        if(!ctx || ctx->isClose() || !ctx->getSysNonblock()) {
+            return ioctl_f(d, request, arg);
+        }
+        ctx->setUserNonblock(user_nonblock);
+        int sys_nonblock = ctx->getSysNonblock() ? 1 : 0;   // 实际的 fd 保持 hook 设置的状态
+        return ioctl_f(d, request, &sys_nonblock);
+    }
+    return ioctl_f(d, request, arg);
+}
+
+int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t optlen) {
+    if(level == SOL_SOCKET && (optname == SO_RCVTIMEO || optname == SO_SNDTIMEO)) {
+        sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(sockfd);
+        if(ctx && optlen >= (socklen_t)sizeof(timeval)) {   // 超时缓存下来，hook 读写的时候不用再 getsockopt
+            const timeval *v = (const timeval *)optval;
+            uint64_t ms = v->tv_sec * 1000ull + v->tv_usec / 1000;
+            ctx->setTimeout(optname, ms ? ms : ~0ull);
+        }
+    }
+    return setsockopt_f(sockfd, level, optname, optval, optlen);
+}
+
+}
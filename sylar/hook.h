@@ -0,0 +1,107 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/7 14:03
+* @version: 1.0
+* @description: hook 系统调用，阻塞的 IO 在协程里自动变成异步的
+********************************************************************************/
+
+
+#ifndef SYLAR_HOOK_H
+#define SYLAR_HOOK_H
+
+#include <unistd.h>
+#include <ctime>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+namespace sylar {
+
+/**
+ * hook 是按线程开启的，默认关闭
+ * 开启之后，在 IOManager 的线程里调用 read/write/recv/send/accept/connect/sleep 等函数，
+ * 遇到 EAGAIN 时注册 epoll 事件然后让出协程，就绪或者超时之后再回来重试，整个线程不会被阻塞
+ * 超时时间使用 socket 上的 SO_RCVTIMEO/SO_SNDTIMEO，fd 的元数据缓存在 FdManager 里
+ */
+bool is_hook_enable();
+
+void set_hook_enable(bool flag);
+
+}
+
+extern "C" {
+
+// 原始的系统调用，hook 开启的时候也可以通过这些指针直接调用
+typedef unsigned int (*sleep_fun)(unsigned int seconds);
+extern sleep_fun sleep_f;
+
+typedef int (*usleep_fun)(useconds_t usec);
+extern usleep_fun usleep_f;
+
+typedef int (*nanosleep_fun)(const struct timespec *req, struct timespec *rem);
+extern nanosleep_fun nanosleep_f;
+
+typedef int (*connect_fun)(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
+extern connect_fun connect_f;
+
+typedef int (*accept_fun)(int s, struct sockaddr *addr, socklen_t *addrlen);
+extern accept_fun accept_f;
+
+typedef ssize_t (*read_fun)(int fd, void *buf, size_t count);
+extern read_fun read_f;
+
+typedef ssize_t (*readv_fun)(int fd, const struct iovec *iov, int iovcnt);
+extern readv_fun readv_f;
+
+typedef ssize_t (*recv_fun)(int sockfd, void *buf, size_t len, int flags);
+extern recv_fun recv_f;
+
+typedef ssize_t (*recvfrom_fun)(int sockfd, void *buf, size_t len, int flags,
+                                struct sockaddr *src_addr, socklen_t *addrlen);
+extern recvfrom_fun recvfrom_f;
+
+typedef ssize_t (*recvmsg_fun)(int sockfd, struct msghdr *msg, int flags);
+extern recvmsg_fun recvmsg_f;
+
+typedef ssize_t (*write_fun)(int fd, const void *buf, size_t count);
+extern write_fun write_f;
+
+typedef ssize_t (*writev_fun)(int fd, const struct iovec *iov, int iovcnt);
+extern writev_fun writev_f;
+
+typedef ssize_t (*send_fun)(int s, const void *msg, size_t len, int flags);
+extern send_fun send_f;
+
+typedef ssize_t (*sendto_fun)(int s, const void *msg, size_t len, int flags,
+                              const struct sockaddr *to, socklen_t tolen);
+extern sendto_fun sendto_f;
+
+typedef ssize_t (*sendmsg_fun)(int s, const struct msghdr *msg, int flags);
+extern sendmsg_fun sendmsg_f;
+
+typedef int (*close_fun)(int fd);
+extern close_fun close_f;
+
+typedef int (*socket_fun)(int domain, int type, int protocol);
+extern socket_fun socket_f;
+
+typedef int (*fcntl_fun)(int fd, int cmd, ... /* arg */ );
+extern fcntl_fun fcntl_f;
+
+typedef int (*ioctl_fun)(int d, unsigned long int request, ...);
+extern ioctl_fun ioctl_f;
+
+typedef int (*setsockopt_fun)(int sockfd, int level, int optname, const void *optval, socklen_t optlen);
+extern setsockopt_fun setsockopt_f;
+
+/**
+ * @brief 带超时的 connect，timeout_ms 为 -1 表示不超时
+ */
+extern int connect_with_timeout(int fd, const struct sockaddr *addr, socklen_t addrlen, uint64_t timeout_ms);
+
+}
+
+#endif //SYLAR_HOOK_H
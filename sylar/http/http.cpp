@@ -0,0 +1,242 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/20 09:10
+* @version: 1.0
+* @description: http 公共定义：方法、状态码、指向接收缓冲区的字符串引用
+********************************************************************************/
+
+#include "http.h"
+#include "http_parser.h"
+#include <cstdio>
+#include <sstream>
+#include <strings.h>
+
+namespace sylar {
+namespace http {
+
+HttpMethod StringToHttpMethod(const std::string &m) {
+    return CharsToHttpMethod(m.c_str(), m.size());
+}
+
+static const char *s_method_string[] = {
+#define XX(num, name, string) #string,
+    HTTP_METHOD_MAP(XX)
+#undef XX
+};
+
+HttpMethod CharsToHttpMethod(const char *m, size_t len) {
+    for(size_t i = 0; i < sizeof(s_method_string) / sizeof(s_method_string[0]); ++i) {
+        if(strlen(s_method_string[i]) == len && memcmp(s_method_string[i], m, len) == 0) {   // 方法名区分大小写
+            return (HttpMethod)i;
+        }
+    }
+    return HttpMethod::INVALID_METHOD;
+}
+
+const char *HttpMethodToString(const HttpMethod &m) {
+    uint32_t idx = (uint32_t)m;
+    if(idx >= (sizeof(s_method_string) / sizeof(s_method_string[0]))) {
+        return "<unknown>";
+    }
+    return s_method_string[idx];
+}
+
+const char *HttpStatusToString(const HttpStatus &s) {
+    switch(s) {
+#define XX(code, name, msg) \
+        case HttpStatus::name: \
+            return #msg;
+        HTTP_STATUS_MAP(XX);
+#undef XX
+        default:
+            return "<unknown>";
+    }
+}
+
+bool StringRef::equalsIgnoreCase(const char *s, size_t len) const {
+    return len == size && strncasecmp(data, s, len) == 0;
+}
+
+std::ostream &operator<<(std::ostream &os, const StringRef &s) {
+    return os.write(s.data, s.size);
+}
+
+HttpMethod HttpRequest::getMethod() const {
+    return m_parser->getMethod();
+}
+
+uint8_t HttpRequest::getVersion() const {
+    return m_parser->getVersion();
+}
+
+StringRef HttpRequest::getUri() const {
+    return m_parser->getUri();
+}
+
+StringRef HttpRequest::getPath() const {
+    return m_parser->getPath();
+}
+
+StringRef HttpRequest::getQuery() const {
+    return m_parser->getQuery();
+}
+
+StringRef HttpRequest::getFragment() const {
+    return m_parser->getFragment();
+}
+
+StringRef HttpRequest::getHeader(const char *key) const {
+    return m_parser->getHeader(key);
+}
+
+bool HttpRequest::hasHeader(const char *key, StringRef *val) const {
+    StringRef v;
+    if(!m_parser->getHeader(key, v)) {
+        return false;
+    }
+    if(val) {
+        *val = v;
+    }
+    return true;
+}
+
+size_t HttpRequest::getHeaderCount() const {
+    return m_parser->getHeaderCount();
+}
+
+StringRef HttpRequest::getHeaderName(size_t i) const {
+    return m_parser->getHeaderName(i);
+}
+
+StringRef HttpRequest::getHeaderValue(size_t i) const {
+    return m_parser->getHeaderValue(i);
+}
+
+uint64_t HttpRequest::getBodyLength() const {
+    return m_parser->getBodyLength();
+}
+
+std::string HttpRequest::getBody() const {
+    return m_parser->getBody();
+}
+
+bool HttpRequest::isClose() const {
+    return !m_parser->isKeepAlive();
+}
+
+std::ostream &HttpRequest::dump(std::ostream &os) const {
+    os << m_parser->getMethodString() << " " << getUri() << " HTTP/"
+       << (uint32_t)(getVersion() >> 4) << "." << (uint32_t)(getVersion() & 0x0F) << "\r\n";
+    for(size_t i = 0; i < getHeaderCount(); ++i) {
+        os << getHeaderName(i) << ": " << getHeaderValue(i) << "\r\n";
+    }
+    os << "\r\n";
+    for(size_t i = 0; i < m_parser->getBodySliceCount(); ++i) {
+        os << m_parser->getBodySlice(i);
+    }
+    return os;
+}
+
+std::string HttpRequest::toString() const {
+    std::stringstream ss;
+    dump(ss);
+    return ss.str();
+}
+
+HttpResponse::HttpResponse(uint8_t version, bool close)
+        :m_version(version)
+        ,m_close(close) {
+}
+
+void HttpResponse::reset(uint8_t version, bool close) {
+    m_status = HttpStatus::OK;
+    m_version = version;
+    m_close = close;
+    m_headOnly = false;
+    m_reason.clear();
+    m_headers.clear();
+    m_body.clear();
+}
+
+void HttpResponse::setHeader(const std::string &key, const std::string &val) {
+    for(auto &i : m_headers) {
+        if(strcasecmp(i.first.c_str(), key.c_str()) == 0) {
+            i.second = val;
+            return;
+        }
+    }
+    m_headers.emplace_back(key, val);
+}
+
+std::string HttpResponse::getHeader(const std::string &key, const std::string &def) const {
+    for(auto &i : m_headers) {
+        if(strcasecmp(i.first.c_str(), key.c_str()) == 0) {
+            return i.second;
+        }
+    }
+    return def;
+}
+
+void HttpResponse::delHeader(const std::string &key) {
+    for(auto it = m_headers.begin(); it != m_headers.end();) {
+        if(strcasecmp(it->first.c_str(), key.c_str()) == 0) {
+            it = m_headers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void HttpResponse::writeHeader(std::string &out) const {
+    char line[64];
+    int n = snprintf(line, sizeof(line), "HTTP/%u.%u %u ", (uint32_t)(m_version >> 4),
+                     (uint32_t)(m_version & 0x0F), (uint32_t)m_status);
+    out.append(line, n);
+    out.append(m_reason.empty() ? HttpStatusToString(m_status) : m_reason.c_str());
+    out.append("\r\n");
+    for(auto &i : m_headers) {
+        if(strcasecmp(i.first.c_str(), "Content-Length") == 0
+           || strcasecmp(i.first.c_str(), "Connection") == 0) {
+            continue;
+        }
+        out.append(i.first);
+        out.append(": ");
+        out.append(i.second);
+        out.append("\r\n");
+    }
+    uint32_t status = (uint32_t)m_status;
+    if(status >= 200 && status != 204 && status != 304) {   // 1xx、204 不能带 Content-Length，304 没有 body，不带
+        n = snprintf(line, sizeof(line), "Content-Length: %zu\r\n", m_body.size());
+        out.append(line, n);
+    }
+    out.append(m_close ? "Connection: close\r\n\r\n" : "Connection: keep-alive\r\n\r\n");
+}
+
+std::ostream &HttpResponse::dump(std::ostream &os) const {
+    std::string header;
+    writeHeader(header);
+    os << header;
+    if(!m_headOnly) {
+        os << m_body;
+    }
+    return os;
+}
+
+std::string HttpResponse::toString() const {
+    std::stringstream ss;
+    dump(ss);
+    return ss.str();
+}
+
+std::ostream &operator<<(std::ostream &os, const HttpRequest &req) {
+    return req.dump(os);
+}
+
+std::ostream &operator<<(std::ostream &os, const HttpResponse &rsp) {
+    return rsp.dump(os);
+}
+
+}
+}
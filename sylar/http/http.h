@@ -0,0 +1,239 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/20 09:10
+* @version: 1.0
+* @description: http 公共定义：方法、状态码、指向接收缓冲区的字符串引用
+********************************************************************************/
+
+
+#ifndef SYLAR_HTTP_HTTP_H
+#define SYLAR_HTTP_HTTP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sylar {
+namespace http {
+
+/* Request Methods */
+#define HTTP_METHOD_MAP(XX)         \
+  XX(0,  DELETE,      DELETE)       \
+  XX(1,  GET,         GET)          \
+  XX(2,  HEAD,        HEAD)         \
+  XX(3,  POST,        POST)         \
+  XX(4,  PUT,         PUT)          \
+  XX(5,  CONNECT,     CONNECT)      \
+  XX(6,  OPTIONS,     OPTIONS)      \
+  XX(7,  TRACE,       TRACE)        \
+  XX(8,  COPY,        COPY)         \
+  XX(9,  LOCK,        LOCK)         \
+  XX(10, MKCOL,       MKCOL)        \
+  XX(11, MOVE,        MOVE)         \
+  XX(12, PROPFIND,    PROPFIND)     \
+  XX(13, PROPPATCH,   PROPPATCH)    \
+  XX(14, SEARCH,      SEARCH)       \
+  XX(15, UNLOCK,      UNLOCK)       \
+  XX(16, PATCH,       PATCH)        \
+  XX(17, PURGE,       PURGE)        \
+
+/* Status Codes */
+#define HTTP_STATUS_MAP(XX)                                                 \
+  XX(100, CONTINUE,                        Continue)                        \
+  XX(101, SWITCHING_PROTOCOLS,             Switching Protocols)             \
+  XX(200, OK,                              OK)                              \
+  XX(201, CREATED,                         Created)                         \
+  XX(202, ACCEPTED,                        Accepted)                        \
+  XX(203, NON_AUTHORITATIVE_INFORMATION,   Non-Authoritative Information)   \
+  XX(204, NO_CONTENT,                      No Content)                      \
+  XX(205, RESET_CONTENT,                   Reset Content)                   \
+  XX(206, PARTIAL_CONTENT,                 Partial Content)                 \
+  XX(300, MULTIPLE_CHOICES,                Multiple Choices)                \
+  XX(301, MOVED_PERMANENTLY,               Moved Permanently)               \
+  XX(302, FOUND,                           Found)                           \
+  XX(303, SEE_OTHER,                       See Other)                       \
+  XX(304, NOT_MODIFIED,                    Not Modified)                    \
+  XX(307, TEMPORARY_REDIRECT,              Temporary Redirect)              \
+  XX(308, PERMANENT_REDIRECT,              Permanent Redirect)              \
+  XX(400, BAD_REQUEST,                     Bad Request)                     \
+  XX(401, UNAUTHORIZED,                    Unauthorized)                    \
+  XX(403, FORBIDDEN,                       Forbidden)                       \
+  XX(404, NOT_FOUND,                       Not Found)                       \
+  XX(405, METHOD_NOT_ALLOWED,              Method Not Allowed)              \
+  XX(406, NOT_ACCEPTABLE,                  Not Acceptable)                  \
+  XX(408, REQUEST_TIMEOUT,                 Request Timeout)                 \
+  XX(409, CONFLICT,                        Conflict)                        \
+  XX(411, LENGTH_REQUIRED,                 Length Required)                 \
+  XX(413, PAYLOAD_TOO_LARGE,               Payload Too Large)               \
+  XX(414, URI_TOO_LONG,                    URI Too Long)                    \
+  XX(415, UNSUPPORTED_MEDIA_TYPE,          Unsupported Media Type)          \
+  XX(429, TOO_MANY_REQUESTS,               Too Many Requests)               \
+  XX(431, REQUEST_HEADER_FIELDS_TOO_LARGE, Request Header Fields Too Large) \
+  XX(500, INTERNAL_SERVER_ERROR,           Internal Server Error)           \
+  XX(501, NOT_IMPLEMENTED,                 Not Implemented)                 \
+  XX(502, BAD_GATEWAY,                     Bad Gateway)                     \
+  XX(503, SERVICE_UNAVAILABLE,             Service Unavailable)             \
+  XX(504, GATEWAY_TIMEOUT,                 Gateway Timeout)                 \
+  XX(505, HTTP_VERSION_NOT_SUPPORTED,      HTTP Version Not Supported)      \
+
+enum class HttpMethod {
+#define XX(num, name, string) name = num,
+    HTTP_METHOD_MAP(XX)
+#undef XX
+    INVALID_METHOD
+};
+
+enum class HttpStatus {
+#define XX(code, name, desc) name = code,
+    HTTP_STATUS_MAP(XX)
+#undef XX
+};
+
+HttpMethod StringToHttpMethod(const std::string &m);
+HttpMethod CharsToHttpMethod(const char *m, size_t len);
+const char *HttpMethodToString(const HttpMethod &m);
+const char *HttpStatusToString(const HttpStatus &s);
+
+/**
+ * @brief 指向接收缓冲区的一段字符串，不拷贝数据（C++11 没有 string_view）
+ * 只在缓冲区没有被修改、移动之前有效
+ */
+struct StringRef {
+    const char *data = nullptr;
+    size_t size = 0;
+
+    StringRef() = default;
+    StringRef(const char *d, size_t s) : data(d), size(s) {}
+
+    bool empty() const { return size == 0; }
+    std::string toString() const { return std::string(data, size); }
+
+    bool operator==(const char *s) const { return strlen(s) == size && memcmp(data, s, size) == 0; }
+    bool operator!=(const char *s) const { return !(*this == s); }
+    bool operator==(const std::string &s) const { return s.size() == size && memcmp(data, s.c_str(), size) == 0; }
+    bool equalsIgnoreCase(const char *s, size_t len) const;
+    bool equalsIgnoreCase(const char *s) const { return equalsIgnoreCase(s, strlen(s)); }
+};
+
+std::ostream &operator<<(std::ostream &os, const StringRef &s);
+
+class HttpParser;
+
+/**
+ * @brief HTTP 请求，只是解析器结果的视图，字符串都指向连接的接收缓冲区
+ * 在 servlet 返回之前有效，要保存的话拷贝出来
+ */
+class HttpRequest {
+public:
+    typedef std::shared_ptr<HttpRequest> ptr;
+
+    HttpRequest(const HttpParser *parser = nullptr) : m_parser(parser) {}
+
+    void setParser(const HttpParser *v) { m_parser = v; }
+
+    HttpMethod getMethod() const;
+    uint8_t getVersion() const;
+    StringRef getUri() const;
+    StringRef getPath() const;
+    StringRef getQuery() const;
+    StringRef getFragment() const;
+
+    /**
+     * @brief 头部，不区分大小写，没有的时候返回空
+     */
+    StringRef getHeader(const char *key) const;
+    bool hasHeader(const char *key, StringRef *val = nullptr) const;
+    size_t getHeaderCount() const;
+    StringRef getHeaderName(size_t i) const;
+    StringRef getHeaderValue(size_t i) const;
+
+    uint64_t getBodyLength() const;
+    std::string getBody() const;    // chunked 的时候拷贝拼起来
+
+    bool isClose() const;   // 按版本和 Connection 头部，处理完之后是否要关闭连接
+
+    std::ostream &dump(std::ostream &os) const;
+    std::string toString() const;
+
+private:
+    const HttpParser *m_parser;
+};
+
+/**
+ * @brief HTTP 响应，序列化的时候自动加上 Content-Length 和 Connection
+ */
+class HttpResponse {
+public:
+    typedef std::shared_ptr<HttpResponse> ptr;
+    typedef std::vector<std::pair<std::string, std::string> > HeaderList;
+
+    HttpResponse(uint8_t version = 0x11, bool close = true);
+
+    /**
+     * @brief 复用对象处理下一个请求，头部、body 的内存保留
+     */
+    void reset(uint8_t version, bool close);
+
+    HttpStatus getStatus() const { return m_status; }
+    void setStatus(HttpStatus v) { m_status = v; }
+    uint8_t getVersion() const { return m_version; }
+    void setVersion(uint8_t v) { m_version = v; }
+    bool isClose() const { return m_close; }
+    void setClose(bool v) { m_close = v; }
+    const std::string &getReason() const { return m_reason; }
+    void setReason(const std::string &v) { m_reason = v; }  // 为空的时候用状态码的默认描述
+
+    const std::string &getBody() const { return m_body; }
+    std::string &getBody() { return m_body; }
+    void setBody(const std::string &v) { m_body = v; }
+    void appendBody(const char *data, size_t len) { m_body.append(data, len); }
+    /**
+     * @brief HEAD 请求的响应只发头部，Content-Length 还是 body 的长度
+     */
+    bool isHeadOnly() const { return m_headOnly; }
+    void setHeadOnly(bool v) { m_headOnly = v; }
+
+    /**
+     * @brief 设置头部，同名（不区分大小写）的替换
+     */
+    void setHeader(const std::string &key, const std::string &val);
+    /**
+     * @brief 直接追加，不检查重复，Set-Cookie 之类可以出现多次的头部用
+     */
+    void addHeader(const std::string &key, const std::string &val) { m_headers.emplace_back(key, val); }
+    std::string getHeader(const std::string &key, const std::string &def = "") const;
+    void delHeader(const std::string &key);
+    const HeaderList &getHeaders() const { return m_headers; }
+
+    /**
+     * @brief 状态行和头部追加到 out，以空行结尾
+     */
+    void writeHeader(std::string &out) const;
+
+    std::ostream &dump(std::ostream &os) const;
+    std::string toString() const;
+
+private:
+    HttpStatus m_status = HttpStatus::OK;
+    uint8_t m_version;
+    bool m_close;
+    bool m_headOnly = false;
+    std::string m_reason;
+    HeaderList m_headers;
+    std::string m_body;
+};
+
+std::ostream &operator<<(std::ostream &os, const HttpRequest &req);
+std::ostream &operator<<(std::ostream &os, const HttpResponse &rsp);
+
+}
+}
+
+#endif //SYLAR_HTTP_HTTP_H
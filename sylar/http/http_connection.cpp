@@ -0,0 +1,223 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/25 14:00
+* @version: 1.0
+* @description: http 客户端连接和连接池，同一条连接上可以 pipelining 多个请求
+********************************************************************************/
+
+#include "http_connection.h"
+#include "../log.h"
+#include "../macro.h"
+
+#include <cstring>
+#include <sstream>
+#include <strings.h>
+
+namespace sylar {
+namespace http {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+std::string HttpResult::getHeader(const std::string &key, const std::string &def) const {
+    for(auto &i : headers) {
+        if(!strcasecmp(i.first.c_str(), key.c_str())) {
+            return i.second;
+        }
+    }
+    return def;
+}
+
+std::string HttpResult::toString() const {
+    std::stringstream ss;
+    ss << "[HttpResult result=" << result
+       << " error=" << error
+       << " status=" << (uint32_t)status
+       << " keepalive=" << keepalive
+       << " body_length=" << body.size() << "]";
+    return ss.str();
+}
+
+HttpConnection::HttpConnection(Socket::ptr sock)
+        :PoolConnection(sock)
+        ,m_parser(HttpParser::RESPONSE) {
+    m_buffer.resize(4 * 1024);
+}
+
+std::string HttpConnection::BuildRequest(HttpMethod method, const std::string &uri, const std::string &host,
+                                         const std::map<std::string, std::string> &headers,
+                                         const std::string &body) {
+    std::string req;
+    req.reserve(64 + uri.size() + body.size());
+    req.append(HttpMethodToString(method)).append(" ").append(uri.empty() ? "/" : uri).append(" HTTP/1.1\r\n");
+    bool has_host = false;
+    for(auto &i : headers) {
+        if(!strcasecmp(i.first.c_str(), "content-length")) {
+            continue;
+        }
+        if(!strcasecmp(i.first.c_str(), "host")) {
+            has_host = true;
+        }
+        req.append(i.first).append(": ").append(i.second).append("\r\n");
+    }
+    if(!has_host && !host.empty()) {
+        req.append("Host: ").append(host).append("\r\n");
+    }
+    if(!body.empty()) {
+        req.append("Content-Length: ").append(std::to_string(body.size())).append("\r\n");
+    }
+    req.append("\r\n").append(body);
+    return req;
+}
+
+void HttpConnection::waitTurn(Turn &turn, uint64_t ticket) {
+    MutexType::Lock lock(m_mutex);
+    if(turn.current == ticket) {
+        return;
+    }
+    SYLAR_ASSERT2(Scheduler::GetThis(), "pipelined http requests must run in fibers");
+    turn.waiters[ticket] = std::make_pair(Scheduler::GetThis(), Fiber::GetThis());
+    lock.unlock();
+    Fiber::YieldToHold();
+}
+
+void HttpConnection::nextTurn(Turn &turn) {
+    MutexType::Lock lock(m_mutex);
+    ++turn.current;
+    auto it = turn.waiters.find(turn.current);
+    if(it != turn.waiters.end()) {
+        it->second.first->schedule(it->second.second);
+        turn.waiters.erase(it);
+    }
+}
+
+HttpResult::ptr HttpConnection::request(const std::string &request, bool head) {
+    uint64_t ticket = 0;
+    {
+        MutexType::Lock lock(m_mutex);
+        ticket = m_tickets++;
+    }
+    ++m_requests;
+
+    HttpResult::ptr result;
+    waitTurn(m_send, ticket);
+    if(isBroken()) {
+        result = std::make_shared<HttpResult>(HttpResult::BROKEN, "connection broken");
+    } else {
+        size_t offset = 0;
+        while(offset < request.size()) {
+            ssize_t n = getSocket()->send(request.c_str() + offset, request.size() - offset);
+            if(n <= 0) {
+                result = std::make_shared<HttpResult>(HttpResult::SEND_FAIL,
+                        std::string("send fail errstr=") + strerror(errno));
+                setBroken();
+                break;
+            }
+            offset += n;
+        }
+    }
+    nextTurn(m_send);   // 下一个请求可以发了，不用等这个请求的响应
+
+    waitTurn(m_recv, ticket);
+    if(!result) {
+        if(isBroken()) {
+            result = std::make_shared<HttpResult>(HttpResult::BROKEN, "connection broken");
+        } else {
+            result = recvResponse(head);
+            if(result->result != HttpResult::OK || !result->keepalive) {
+                setBroken();
+            }
+        }
+    }
+    nextTurn(m_recv);
+    return result;
+}
+
+HttpResult::ptr HttpConnection::recvResponse(bool head) {
+    m_parser.setNoBody(head);
+    size_t consumed = 0;
+    while(true) {
+        if(m_start < m_end) {
+            ssize_t n = m_parser.execute(&m_buffer[m_start], m_end - m_start);
+            if(n < 0) {
+                return std::make_shared<HttpResult>(HttpResult::PARSE_FAIL, m_parser.getErrorString());
+            }
+            if(m_parser.isFinished()) {
+                consumed = n;
+                break;
+            }
+        }
+        if(m_start > 0) {   // 解析结果是相对消息开头的偏移，搬到最前面不影响
+            memmove(&m_buffer[0], &m_buffer[m_start], m_end - m_start);
+            m_end -= m_start;
+            m_start = 0;
+        }
+        if(m_end == m_buffer.size()) {
+            m_buffer.resize(m_buffer.size() * 2);
+        }
+        ssize_t n = getSocket()->recv(&m_buffer[m_end], m_buffer.size() - m_end);
+        if(n == 0 && m_parser.finish()) {   // body 读到连接关闭为止
+            consumed = m_end - m_start;
+            setBroken();
+            break;
+        }
+        if(n <= 0) {
+            return std::make_shared<HttpResult>(HttpResult::RECV_FAIL, n == 0 ? std::string("connection closed")
+                                                : std::string("recv fail errstr=") + strerror(errno));
+        }
+        m_end += n;
+    }
+
+    HttpResult::ptr result = std::make_shared<HttpResult>();
+    result->status = m_parser.getStatus();
+    result->keepalive = m_parser.isKeepAlive();
+    result->headers.reserve(m_parser.getHeaderCount());
+    for(size_t i = 0; i < m_parser.getHeaderCount(); ++i) {
+        result->headers.push_back(std::make_pair(m_parser.getHeaderName(i).toString(),
+                                                 m_parser.getHeaderValue(i).toString()));
+    }
+    result->body = m_parser.getBody();
+
+    m_start += consumed;
+    m_parser.reset();
+    if(m_start == m_end) {
+        m_start = m_end = 0;
+    }
+    return result;
+}
+
+HttpConnectionPool::HttpConnectionPool(const std::string &host, const sockaddr *addr, socklen_t addrlen,
+                                       const ConnectionPool::Options &options, IOManager *iom)
+        :m_host(host)
+        ,m_pool(ConnectionPool::Create(addr, addrlen, options, iom)) {
+    m_pool->setFactory([](Socket::ptr sock) {
+        return std::make_shared<HttpConnection>(sock);
+    });
+}
+
+HttpResult::ptr HttpConnectionPool::doGet(const std::string &uri, const std::map<std::string, std::string> &headers,
+                                          uint64_t timeout_ms) {
+    return doRequest(HttpMethod::GET, uri, headers, "", timeout_ms);
+}
+
+HttpResult::ptr HttpConnectionPool::doPost(const std::string &uri, const std::string &body,
+                                           const std::map<std::string, std::string> &headers,
+                                           uint64_t timeout_ms) {
+    return doRequest(HttpMethod::POST, uri, headers, body, timeout_ms);
+}
+
+HttpResult::ptr HttpConnectionPool::doRequest(HttpMethod method, const std::string &uri,
+                                              const std::map<std::string, std::string> &headers,
+                                              const std::string &body, uint64_t timeout_ms) {
+    PoolConnection::ptr conn = m_pool->checkout(timeout_ms);
+    if(!conn) {
+        return std::make_shared<HttpResult>(HttpResult::INVALID_CONNECTION, "checkout fail host=" + m_host);
+    }
+    HttpConnection::ptr http = std::static_pointer_cast<HttpConnection>(conn);
+    return http->request(HttpConnection::BuildRequest(method, uri, m_host, headers, body),
+                         method == HttpMethod::HEAD);
+}
+
+}
+}
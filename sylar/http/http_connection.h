@@ -0,0 +1,150 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/25 14:00
+* @version: 1.0
+* @description: http 客户端连接和连接池，同一条连接上可以 pipelining 多个请求
+********************************************************************************/
+
+
+#ifndef SYLAR_HTTP_HTTP_CONNECTION_H
+#define SYLAR_HTTP_HTTP_CONNECTION_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "http.h"
+#include "http_parser.h"
+#include "../connection_pool.h"
+
+namespace sylar {
+namespace http {
+
+/**
+ * @brief 客户端收到的响应，头部和 body 拷贝出来，连接可以接着用
+ */
+struct HttpResult {
+    typedef std::shared_ptr<HttpResult> ptr;
+
+    enum Error {
+        OK = 0,
+        INVALID_CONNECTION, // 借不到连接：超时、连不上、连接池已经关闭
+        BROKEN,             // 连接上前面的请求出错了，这个请求没有发出去或者没有读响应
+        SEND_FAIL,
+        RECV_FAIL,          // 超时或者对端关闭
+        PARSE_FAIL,
+    };
+
+    HttpResult(Error r = OK, const std::string &e = "") : result(r), error(e) {}
+
+    /**
+     * @brief 按名字找头部，不区分大小写，没有的时候返回 def
+     */
+    std::string getHeader(const std::string &key, const std::string &def = "") const;
+    std::string toString() const;
+
+    Error result;
+    std::string error;
+    HttpStatus status = HttpStatus::OK;
+    bool keepalive = false;
+    std::vector<std::pair<std::string, std::string> > headers;
+    std::string body;
+};
+
+/**
+ * @brief 客户端的 http 连接
+ * 多个协程可以同时在一条连接上调用 request：按取号顺序写请求、按同样的顺序读响应（HTTP/1.1 pipelining），
+ * 后面的请求可以在前面的响应回来之前发出去。一个请求出错或者响应要求关闭之后连接标记为不可用，
+ * 排在后面的请求返回 BROKEN
+ */
+class HttpConnection : public PoolConnection {
+public:
+    typedef std::shared_ptr<HttpConnection> ptr;
+    typedef Mutex MutexType;
+
+    HttpConnection(Socket::ptr sock);
+
+    /**
+     * @brief 发一个请求，等它的响应
+     * @param[in] request 完整的请求报文，见 BuildRequest
+     * @param[in] head 是不是 HEAD 请求，响应没有 body
+     */
+    HttpResult::ptr request(const std::string &request, bool head = false);
+
+    uint64_t getRequestCount() const { return m_requests; }
+
+    /**
+     * @brief 拼请求报文，没有 Host 头部的时候用 host，body 不为空的时候加 Content-Length
+     */
+    static std::string BuildRequest(HttpMethod method, const std::string &uri, const std::string &host,
+                                    const std::map<std::string, std::string> &headers = {},
+                                    const std::string &body = "");
+
+private:
+    /**
+     * @brief 按号排队，轮到 current 的协程执行，其他的让出协程等着
+     */
+    struct Turn {
+        uint64_t current = 0;
+        std::map<uint64_t, std::pair<Scheduler *, Fiber::ptr> > waiters;
+    };
+
+    void waitTurn(Turn &turn, uint64_t ticket);
+    void nextTurn(Turn &turn);
+    HttpResult::ptr recvResponse(bool head);
+
+private:
+    MutexType m_mutex;
+    uint64_t m_tickets = 0;
+    Turn m_send;
+    Turn m_recv;
+    std::atomic<uint64_t> m_requests{0};
+
+    // 只有轮到读响应的协程访问
+    HttpParser m_parser;
+    std::string m_buffer;
+    size_t m_start = 0;
+    size_t m_end = 0;
+};
+
+/**
+ * @brief 一个后端的 http 连接池，连接用完自动归还
+ * max_pipeline 大于 1 的时候连接数到上限之后多个请求复用同一条连接
+ */
+class HttpConnectionPool {
+public:
+    typedef std::shared_ptr<HttpConnectionPool> ptr;
+
+    /**
+     * @param[in] host 请求的 Host 头部
+     */
+    HttpConnectionPool(const std::string &host, const sockaddr *addr, socklen_t addrlen,
+                       const ConnectionPool::Options &options = ConnectionPool::Options(),
+                       IOManager *iom = IOManager::GetThis());
+
+    /**
+     * @param[in] timeout_ms 等待借连接的超时(毫秒)，收发超时见 ConnectionPool::Options::io_timeout
+     */
+    HttpResult::ptr doGet(const std::string &uri, const std::map<std::string, std::string> &headers = {},
+                          uint64_t timeout_ms = ~0ull);
+    HttpResult::ptr doPost(const std::string &uri, const std::string &body,
+                           const std::map<std::string, std::string> &headers = {},
+                           uint64_t timeout_ms = ~0ull);
+    HttpResult::ptr doRequest(HttpMethod method, const std::string &uri,
+                              const std::map<std::string, std::string> &headers,
+                              const std::string &body, uint64_t timeout_ms = ~0ull);
+
+    ConnectionPool::ptr getPool() const { return m_pool; }
+    const std::string &getHost() const { return m_host; }
+
+private:
+    std::string m_host;
+    ConnectionPool::ptr m_pool;
+};
+
+}
+}
+
+#endif //SYLAR_HTTP_HTTP_CONNECTION_H
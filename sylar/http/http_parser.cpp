@@ -0,0 +1,753 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/20 09:40
+* @version: 1.0
+* @description: 增量、零拷贝的 HTTP/1.1 请求/响应解析器，SSE4.2/AVX2 查找分隔符
+********************************************************************************/
+
+#include "http_parser.h"
+#include "../config.h"
+#include "../log.h"
+
+#include <algorithm>
+#include <strings.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SYLAR_HTTP_X86 1
+#include <immintrin.h>
+#endif
+
+namespace sylar {
+namespace http {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint64_t>::ptr g_http_max_header_size =
+        sylar::Config::Lookup("http.parser.max_header_size", (uint64_t)(64 * 1024),
+                              "http max start line + headers size");
+
+static sylar::ConfigVar<uint64_t>::ptr g_http_max_body_size =
+        sylar::Config::Lookup("http.parser.max_body_size", (uint64_t)(64 * 1024 * 1024),
+                              "http max body size");
+
+static sylar::ConfigVar<uint32_t>::ptr g_http_max_headers =
+        sylar::Config::Lookup("http.parser.max_headers", (uint32_t)100,
+                              "http max header count, trailers included");
+
+static uint64_t s_max_header_size = 0;
+static uint64_t s_max_body_size = 0;
+static uint32_t s_max_headers = 0;
+
+/**
+ * 查找的字符集合用 [lo, hi] 区间表示，pcmpestri 直接用，补齐 16 字节方便整块加载
+ * 行尾：\t 以外的控制字符，遇到的是 \r、\n 就是行尾，其它的是非法字符
+ * 请求目标：控制字符和空格
+ */
+static const char s_line_ranges[16] = "\x00\x08\x0a\x1f\x7f\x7f";
+static const size_t s_line_ranges_count = 3;
+static const char s_uri_ranges[16] = "\x00\x20\x7f\x7f";
+static const size_t s_uri_ranges_count = 2;
+
+typedef const char *(*FindRangesFun)(const char *p, const char *end, const char *ranges, size_t count);
+
+static inline bool InRanges(unsigned char c, const char *ranges, size_t count) {
+    for(size_t i = 0; i < count; ++i) {
+        if((unsigned char)(c - (unsigned char)ranges[i * 2])
+           <= (unsigned char)((unsigned char)ranges[i * 2 + 1] - (unsigned char)ranges[i * 2])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief [p, end) 里第一个落在区间里的字节，没有返回 end
+ */
+static const char *FindRangesScalar(const char *p, const char *end, const char *ranges, size_t count) {
+    for(; p < end; ++p) {
+        if(InRanges(*p, ranges, count)) {
+            return p;
+        }
+    }
+    return end;
+}
+
+#ifdef SYLAR_HTTP_X86
+__attribute__((target("sse4.2")))
+static const char *FindRangesSSE42(const char *p, const char *end, const char *ranges, size_t count) {
+    __m128i r = _mm_loadu_si128((const __m128i *)ranges);
+    while(end - p >= 16) {
+        __m128i b = _mm_loadu_si128((const __m128i *)p);
+        int idx = _mm_cmpestri(r, (int)count * 2, b, 16,
+                               _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+        if(idx != 16) {
+            return p + idx;
+        }
+        p += 16;
+    }
+    return FindRangesScalar(p, end, ranges, count);
+}
+
+/**
+ * AVX2 没有 pcmpestri，区间判断用无符号比较：c - lo <= hi - lo，即 min(c - lo, hi - lo) == c - lo
+ */
+__attribute__((target("avx2")))
+static const char *FindRangesAVX2(const char *p, const char *end, const char *ranges, size_t count) {
+    // 最多三个区间，不够的用第一个补齐，循环里不用再判断个数
+    size_t idx[3] = {0, count > 1 ? 1u : 0u, count > 2 ? 2u : 0u};
+    const __m256i lo0 = _mm256_set1_epi8(ranges[idx[0] * 2]);
+    const __m256i lo1 = _mm256_set1_epi8(ranges[idx[1] * 2]);
+    const __m256i lo2 = _mm256_set1_epi8(ranges[idx[2] * 2]);
+    const __m256i w0 = _mm256_set1_epi8((char)(ranges[idx[0] * 2 + 1] - ranges[idx[0] * 2]));
+    const __m256i w1 = _mm256_set1_epi8((char)(ranges[idx[1] * 2 + 1] - ranges[idx[1] * 2]));
+    const __m256i w2 = _mm256_set1_epi8((char)(ranges[idx[2] * 2 + 1] - ranges[idx[2] * 2]));
+    while(end - p >= 32) {
+        __m256i b = _mm256_loadu_si256((const __m256i *)p);
+        __m256i d0 = _mm256_sub_epi8(b, lo0);
+        __m256i d1 = _mm256_sub_epi8(b, lo1);
+        __m256i d2 = _mm256_sub_epi8(b, lo2);
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(d0, w0), d0),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(d1, w1), d1),
+                                                      _mm256_cmpeq_epi8(_mm256_min_epu8(d2, w2), d2)));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(hit);
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    // 头部的行大多很短，剩下的不到 32 字节用 pcmpestri（AVX2 的 CPU 都支持），在这里写是为了用 VEX 编码，
+    // 调用 FindRangesSSE42 会有 AVX/SSE 切换的开销
+    __m128i r = _mm_loadu_si128((const __m128i *)ranges);
+    if(end - p >= 16) {
+        __m128i b = _mm_loadu_si128((const __m128i *)p);
+        int i = _mm_cmpestri(r, (int)count * 2, b, 16,
+                             _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+        if(i != 16) {
+            return p + i;
+        }
+        p += 16;
+    }
+    return FindRangesScalar(p, end, ranges, count);
+}
+#endif
+
+static HttpParser::ScanImpl DetectScanImpl() {
+#ifdef SYLAR_HTTP_X86
+    __builtin_cpu_init();   // 在 main 之前调用，要先初始化
+    if(__builtin_cpu_supports("avx2")) {
+        return HttpParser::AVX2;
+    }
+    if(__builtin_cpu_supports("sse4.2")) {
+        return HttpParser::SSE42;
+    }
+#endif
+    return HttpParser::SCALAR;
+}
+
+static HttpParser::ScanImpl s_scan_impl = HttpParser::SCALAR;
+static FindRangesFun s_find_ranges = FindRangesScalar;
+
+struct _HttpParserIniter {
+    _HttpParserIniter() {
+        s_max_header_size = g_http_max_header_size->getValue();
+        g_http_max_header_size->addListener([](const uint64_t &old_value, const uint64_t &new_value) {
+            s_max_header_size = new_value;
+        });
+        s_max_body_size = g_http_max_body_size->getValue();
+        g_http_max_body_size->addListener([](const uint64_t &old_value, const uint64_t &new_value) {
+            s_max_body_size = new_value;
+        });
+        s_max_headers = g_http_max_headers->getValue();
+        g_http_max_headers->addListener([](const uint32_t &old_value, const uint32_t &new_value) {
+            s_max_headers = new_value;
+        });
+        HttpParser::SetScanImpl(DetectScanImpl());
+    }
+};
+
+static _HttpParserIniter s_http_parser_initer;
+
+HttpParser::ScanImpl HttpParser::GetScanImpl() {
+    return s_scan_impl;
+}
+
+bool HttpParser::SetScanImpl(ScanImpl impl) {
+    switch(impl) {
+        case SCALAR:
+            s_find_ranges = FindRangesScalar;
+            break;
+#ifdef SYLAR_HTTP_X86
+        case SSE42:
+            if(!__builtin_cpu_supports("sse4.2")) {
+                return false;
+            }
+            s_find_ranges = FindRangesSSE42;
+            break;
+        case AVX2:
+            if(!__builtin_cpu_supports("avx2")) {
+                return false;
+            }
+            s_find_ranges = FindRangesAVX2;
+            break;
+#endif
+        default:
+            return false;
+    }
+    s_scan_impl = impl;
+    return true;
+}
+
+const char *HttpParser::ScanImplToString(ScanImpl impl) {
+    switch(impl) {
+        case SCALAR:
+            return "scalar";
+        case SSE42:
+            return "sse4.2";
+        case AVX2:
+            return "avx2";
+        default:
+            return "unknown";
+    }
+}
+
+/**
+ * tchar = "!" / "#" / "$" / "%" / "&" / "'" / "*" / "+" / "-" / "." / "^" / "_" / "`" / "|" / "~" / DIGIT / ALPHA
+ */
+static bool IsTokenChar(unsigned char c) {
+    static bool s_table[256];
+    static bool s_inited = [](){
+        for(int c = 0; c < 256; ++c) {
+            s_table[c] = (c < 0x80 && isalnum(c)) || (c < 0x80 && strchr("!#$%&'*+-.^_`|~", c) && c != 0);
+        }
+        return true;
+    }();
+    (void)s_inited;
+    return s_table[c];
+}
+
+static inline bool IsDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline int HexValue(char c) {
+    if(IsDigit(c)) {
+        return c - '0';
+    }
+    c |= 0x20;
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+static bool IsTokenChars(const char *p, const char *end) {
+    if(p == end) {
+        return false;
+    }
+    for(; p < end; ++p) {
+        if(!IsTokenChar(*p)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+HttpParser::HttpParser(Type type)
+        :m_type(type) {
+}
+
+void HttpParser::reset() {
+    m_state = START_LINE;
+    m_error = OK;
+    m_data = nullptr;
+    m_pos = 0;
+    m_scanned = 0;
+    m_method = HttpMethod::INVALID_METHOD;
+    m_version = 0;
+    m_status = 0;
+    m_keepAlive = false;
+    m_chunked = false;
+    m_noBody = false;
+    m_contentLength = ~0ull;
+    m_remaining = 0;
+    m_bodyLength = 0;
+    m_trailerBegin = 0;
+    m_methodSlice = m_uri = m_path = m_query = m_fragment = m_reason = Slice();
+    m_headers.clear();
+    m_body.clear();
+}
+
+const char *HttpParser::getErrorString() const {
+    switch(m_error) {
+#define XX(name) case name: return #name;
+        XX(OK)
+        XX(INVALID_METHOD)
+        XX(INVALID_URI)
+        XX(INVALID_VERSION)
+        XX(INVALID_STATUS)
+        XX(INVALID_HEADER)
+        XX(HEADER_TOO_LARGE)
+        XX(INVALID_CONTENT_LENGTH)
+        XX(INVALID_TRANSFER_ENCODING)
+        XX(INVALID_CHUNK)
+        XX(BODY_TOO_LARGE)
+        XX(UNEXPECTED_EOF)
+#undef XX
+        default:
+            return "UNKNOWN";
+    }
+}
+
+ssize_t HttpParser::fail(Error error) {
+    m_error = error;
+    m_state = ERROR;
+    SYLAR_LOG_DEBUG(g_logger) << "http parse error=" << getErrorString() << " pos=" << m_pos;
+    return -1;
+}
+
+const char *HttpParser::sectionBegin(const char *line) const {
+    // 起始行和头部一起算，trailer 从最后一个 chunk 之后算，chunk-size 行只算单行
+    switch(m_state) {
+        case START_LINE:
+        case HEADER_LINE:
+            return m_data;
+        case TRAILER_LINE:
+            return m_data + m_trailerBegin;
+        default:
+            return line;
+    }
+}
+
+int HttpParser::nextLine(const char *end, const char *&eol, const char *&next, Error error) {
+    const char *line = m_data + m_pos;
+    const char *p = m_data + std::max(m_pos, m_scanned);
+    const char *ctl = s_find_ranges(p, end, s_line_ranges, s_line_ranges_count);
+    if(ctl == end) {
+        m_scanned = end - m_data;
+        if((uint64_t)(end - sectionBegin(line)) > s_max_header_size) {
+            fail(HEADER_TOO_LARGE);
+            return -1;
+        }
+        return 0;
+    }
+    if(*ctl == '\n') {
+        eol = ctl;
+        next = ctl + 1;
+    } else if(*ctl == '\r') {
+        if(ctl + 1 == end) {    // \r 后面的 \n 还没收到
+            m_scanned = ctl - m_data;
+            return 0;
+        }
+        if(ctl[1] != '\n') {
+            fail(error);
+            return -1;
+        }
+        eol = ctl;
+        next = ctl + 2;
+    } else {
+        fail(error);
+        return -1;
+    }
+    if((uint64_t)(next - sectionBegin(line)) > s_max_header_size) {
+        fail(HEADER_TOO_LARGE);
+        return -1;
+    }
+    m_scanned = 0;
+    return 1;
+}
+
+bool HttpParser::parseRequestLine(const char *p, const char *eol) {
+    // method SP request-target SP HTTP-version
+    const char *sp = (const char *)memchr(p, ' ', eol - p);
+    if(!sp) {   // 整行没有空格，不是方法的问题
+        fail(INVALID_URI);
+        return false;
+    }
+    if(!IsTokenChars(p, sp)) {
+        fail(INVALID_METHOD);
+        return false;
+    }
+    m_methodSlice = slice(p, sp - p);
+    m_method = CharsToHttpMethod(p, sp - p);
+    if(m_method == HttpMethod::INVALID_METHOD) {
+        fail(INVALID_METHOD);
+        return false;
+    }
+
+    const char *uri = sp + 1;
+    const char *uri_end = s_find_ranges(uri, eol, s_uri_ranges, s_uri_ranges_count);
+    if(uri_end == uri || uri_end == eol || *uri_end != ' ') {
+        fail(INVALID_URI);
+        return false;
+    }
+    m_uri = slice(uri, uri_end - uri);
+    const char *fragment = (const char *)memchr(uri, '#', uri_end - uri);
+    const char *path_end = fragment ? fragment : uri_end;
+    const char *query = (const char *)memchr(uri, '?', path_end - uri);
+    m_path = slice(uri, (query ? query : path_end) - uri);
+    if(query) {
+        m_query = slice(query + 1, path_end - query - 1);
+    }
+    if(fragment) {
+        m_fragment = slice(fragment + 1, uri_end - fragment - 1);
+    }
+
+    const char *version = uri_end + 1;
+    if(eol - version != 8 || memcmp(version, "HTTP/", 5) || !IsDigit(version[5])
+       || version[6] != '.' || !IsDigit(version[7])) {
+        fail(INVALID_VERSION);
+        return false;
+    }
+    m_version = ((version[5] - '0') << 4) | (version[7] - '0');
+    if(m_version != 0x11 && m_version != 0x10) {
+        fail(INVALID_VERSION);
+        return false;
+    }
+    return true;
+}
+
+bool HttpParser::parseStatusLine(const char *p, const char *eol) {
+    // HTTP-version SP status-code SP [ reason-phrase ]，有的实现没有最后的空格
+    if(eol - p < 12 || memcmp(p, "HTTP/", 5) || !IsDigit(p[5]) || p[6] != '.' || !IsDigit(p[7])
+       || p[8] != ' ') {
+        fail(INVALID_VERSION);
+        return false;
+    }
+    m_version = ((p[5] - '0') << 4) | (p[7] - '0');
+    if(m_version != 0x11 && m_version != 0x10) {
+        fail(INVALID_VERSION);
+        return false;
+    }
+    const char *code = p + 9;
+    if(!IsDigit(code[0]) || !IsDigit(code[1]) || !IsDigit(code[2])
+       || (code + 3 != eol && code[3] != ' ')) {
+        fail(INVALID_STATUS);
+        return false;
+    }
+    m_status = (code[0] - '0') * 100 + (code[1] - '0') * 10 + (code[2] - '0');
+    if(m_status < 100) {
+        fail(INVALID_STATUS);
+        return false;
+    }
+    const char *reason = std::min(code + 4, eol);
+    m_reason = slice(reason, eol - reason);
+    return true;
+}
+
+bool HttpParser::parseHeaderLine(const char *p, const char *eol) {
+    // field-name ":" OWS field-value OWS，不支持折行
+    const char *colon = (const char *)memchr(p, ':', eol - p);
+    if(!colon || !IsTokenChars(p, colon)) {
+        fail(INVALID_HEADER);
+        return false;
+    }
+    const char *value = colon + 1;
+    while(value < eol && (*value == ' ' || *value == '\t')) {
+        ++value;
+    }
+    const char *value_end = eol;
+    while(value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+        --value_end;
+    }
+    if(m_headers.size() >= s_max_headers) {
+        fail(HEADER_TOO_LARGE);
+        return false;
+    }
+    Header h;
+    h.name = slice(p, colon - p);
+    h.value = slice(value, value_end - value);
+    m_headers.push_back(h);
+    return true;
+}
+
+/**
+ * @brief 逗号分隔的列表里有没有 token，不区分大小写
+ */
+static bool HasToken(const StringRef &list, const char *token) {
+    size_t len = strlen(token);
+    const char *p = list.data;
+    const char *end = list.data + list.size;
+    while(p < end) {
+        const char *comma = (const char *)memchr(p, ',', end - p);
+        const char *item_end = comma ? comma : end;
+        while(p < item_end && (*p == ' ' || *p == '\t')) {
+            ++p;
+        }
+        const char *e = item_end;
+        while(e > p && (e[-1] == ' ' || e[-1] == '\t')) {
+            --e;
+        }
+        if((size_t)(e - p) == len && strncasecmp(p, token, len) == 0) {
+            return true;
+        }
+        p = item_end + 1;
+    }
+    return false;
+}
+
+bool HttpParser::headersComplete() {
+    bool has_te = false;
+    bool has_cl = false;
+    m_keepAlive = m_version == 0x11;
+    for(auto &h : m_headers) {
+        StringRef name = ref(h.name);
+        StringRef value = ref(h.value);
+        if(name.equalsIgnoreCase("Content-Length")) {
+            if(value.empty() || value.size > 19) {
+                fail(INVALID_CONTENT_LENGTH);
+                return false;
+            }
+            uint64_t len = 0;
+            for(size_t i = 0; i < value.size; ++i) {
+                if(!IsDigit(value.data[i])) {
+                    fail(INVALID_CONTENT_LENGTH);
+                    return false;
+                }
+                len = len * 10 + (value.data[i] - '0');
+            }
+            if(has_cl && len != m_contentLength) {  // 多个不一样的长度，可能是请求走私
+                fail(INVALID_CONTENT_LENGTH);
+                return false;
+            }
+            has_cl = true;
+            m_contentLength = len;
+        } else if(name.equalsIgnoreCase("Transfer-Encoding")) {
+            has_te = true;
+            // chunked 必须是最后一个编码
+            const char *e = value.data + value.size;
+            const char *p = e;
+            while(p > value.data && p[-1] != ',') {
+                --p;
+            }
+            while(p < e && (*p == ' ' || *p == '\t')) {
+                ++p;
+            }
+            m_chunked = StringRef(p, e - p).equalsIgnoreCase("chunked");
+        } else if(name.equalsIgnoreCase("Connection")) {
+            if(HasToken(value, "close")) {
+                m_keepAlive = false;
+            } else if(HasToken(value, "keep-alive")) {
+                m_keepAlive = true;
+            }
+        }
+    }
+
+    if(has_te && has_cl) {      // 两个都有的时候拒绝，不猜用哪一个
+        fail(INVALID_TRANSFER_ENCODING);
+        return false;
+    }
+    if(m_type == RESPONSE && (m_noBody || m_status < 200 || m_status == 204 || m_status == 304)) {
+        m_state = DONE;
+        return true;
+    }
+    if(has_te) {
+        if(m_chunked) {
+            m_state = CHUNK_SIZE;
+            return true;
+        }
+        if(m_type == REQUEST) {     // 请求的 body 长度没法确定
+            fail(INVALID_TRANSFER_ENCODING);
+            return false;
+        }
+        m_keepAlive = false;
+        m_state = BODY_EOF;
+        return true;
+    }
+    if(has_cl) {
+        if(m_contentLength > s_max_body_size) {
+            fail(BODY_TOO_LARGE);
+            return false;
+        }
+        m_remaining = m_contentLength;
+        m_state = m_remaining ? BODY_IDENTITY : DONE;
+        return true;
+    }
+    if(m_type == RESPONSE) {    // 响应没有长度，读到连接关闭
+        m_keepAlive = false;
+        m_state = BODY_EOF;
+        return true;
+    }
+    m_state = DONE;
+    return true;
+}
+
+void HttpParser::addBody(const char *p, size_t len) {
+    if(!m_body.empty() && m_body.back().offset + m_body.back().length == (uint32_t)(p - m_data)) {
+        m_body.back().length += len;
+    } else {
+        m_body.push_back(slice(p, len));
+    }
+    m_bodyLength += len;
+}
+
+ssize_t HttpParser::execute(const char *data, size_t len) {
+    if(m_state == ERROR) {
+        return -1;
+    }
+    m_data = data;
+    const char *end = data + len;
+    const char *eol = nullptr;
+    const char *next = nullptr;
+    while(m_state != DONE) {
+        switch(m_state) {
+            case START_LINE: {
+                // 请求行里的非法字节不一定在方法里，按请求目标出错处理（400），不当成不支持的方法（501）
+                int rt = nextLine(end, eol, next, m_type == REQUEST ? INVALID_URI : INVALID_VERSION);
+                if(rt <= 0) {
+                    return rt < 0 ? -1 : (ssize_t)m_pos;
+                }
+                const char *p = data + m_pos;
+                m_pos = next - data;
+                if(eol == p) {  // 请求行之前的空行忽略
+                    continue;
+                }
+                if(!(m_type == REQUEST ? parseRequestLine(p, eol) : parseStatusLine(p, eol))) {
+                    return -1;
+                }
+                m_state = HEADER_LINE;
+                break;
+            }
+            case HEADER_LINE:
+            case TRAILER_LINE: {
+                int rt = nextLine(end, eol, next, INVALID_HEADER);
+                if(rt <= 0) {
+                    return rt < 0 ? -1 : (ssize_t)m_pos;
+                }
+                const char *p = data + m_pos;
+                m_pos = next - data;
+                if(eol == p) {  // 空行，头部结束
+                    if(m_state == TRAILER_LINE) {
+                        m_state = DONE;
+                    } else if(!headersComplete()) {
+                        return -1;
+                    }
+                    continue;
+                }
+                if(*p == ' ' || *p == '\t') {   // 废弃的折行
+                    return fail(INVALID_HEADER);
+                }
+                if(!parseHeaderLine(p, eol)) {
+                    return -1;
+                }
+                break;
+            }
+            case BODY_IDENTITY:
+            case CHUNK_DATA: {
+                size_t n = std::min((uint64_t)(len - m_pos), m_remaining);
+                if(n) {
+                    addBody(data + m_pos, n);
+                    m_pos += n;
+                    m_remaining -= n;
+                }
+                if(m_remaining) {
+                    return m_pos;
+                }
+                m_state = m_state == BODY_IDENTITY ? DONE : CHUNK_DATA_END;
+                break;
+            }
+            case BODY_EOF: {
+                size_t n = len - m_pos;
+                if(m_bodyLength + n > s_max_body_size) {
+                    return fail(BODY_TOO_LARGE);
+                }
+                if(n) {
+                    addBody(data + m_pos, n);
+                    m_pos = len;
+                }
+                return m_pos;
+            }
+            case CHUNK_SIZE: {
+                // chunk-size [ chunk-ext ] CRLF
+                int rt = nextLine(end, eol, next, INVALID_CHUNK);
+                if(rt <= 0) {
+                    return rt < 0 ? -1 : (ssize_t)m_pos;
+                }
+                const char *p = data + m_pos;
+                uint64_t size = 0;
+                int digits = 0;
+                for(int v = 0; p < eol && (v = HexValue(*p)) >= 0; ++p, ++digits) {
+                    size = size * 16 + v;
+                }
+                while(p < eol && (*p == ' ' || *p == '\t')) {
+                    ++p;
+                }
+                if(digits == 0 || digits > 15 || (p < eol && *p != ';')) {
+                    return fail(INVALID_CHUNK);
+                }
+                if(m_bodyLength + size > s_max_body_size) {
+                    return fail(BODY_TOO_LARGE);
+                }
+                m_pos = next - data;
+                m_remaining = size;
+                m_trailerBegin = m_pos;
+                m_state = size ? CHUNK_DATA : TRAILER_LINE;
+                break;
+            }
+            case CHUNK_DATA_END: {
+                if(m_pos == len) {
+                    return m_pos;
+                }
+                if(data[m_pos] == '\n') {
+                    m_pos += 1;
+                } else if(data[m_pos] == '\r') {
+                    if(m_pos + 1 == len) {
+                        return m_pos;
+                    }
+                    if(data[m_pos + 1] != '\n') {
+                        return fail(INVALID_CHUNK);
+                    }
+                    m_pos += 2;
+                } else {
+                    return fail(INVALID_CHUNK);
+                }
+                m_state = CHUNK_SIZE;
+                break;
+            }
+            default:
+                return fail(m_error == OK ? INVALID_HEADER : m_error);
+        }
+    }
+    return m_pos;
+}
+
+bool HttpParser::finish() {
+    if(m_state == BODY_EOF) {
+        m_state = DONE;
+        return true;
+    }
+    if(m_state == DONE) {
+        return true;
+    }
+    if(m_state != ERROR && !(m_state == START_LINE && m_pos == 0 && m_scanned == 0)) {
+        fail(UNEXPECTED_EOF);
+    }
+    return false;
+}
+
+bool HttpParser::getHeader(const char *name, StringRef &value) const {
+    size_t len = strlen(name);
+    for(auto &h : m_headers) {
+        if(ref(h.name).equalsIgnoreCase(name, len)) {
+            value = ref(h.value);
+            return true;
+        }
+    }
+    return false;
+}
+
+StringRef HttpParser::getHeader(const char *name) const {
+    StringRef value;
+    getHeader(name, value);
+    return value;
+}
+
+std::string HttpParser::getBody() const {
+    std::string body;
+    body.reserve(m_bodyLength);
+    for(auto &s : m_body) {
+        body.append(m_data + s.offset, s.length);
+    }
+    return body;
+}
+
+}
+}
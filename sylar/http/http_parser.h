@@ -0,0 +1,220 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/20 09:40
+* @version: 1.0
+* @description: 增量、零拷贝的 HTTP/1.1 请求/响应解析器，SSE4.2/AVX2 查找分隔符
+********************************************************************************/
+
+
+#ifndef SYLAR_HTTP_HTTP_PARSER_H
+#define SYLAR_HTTP_HTTP_PARSER_H
+
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+#include "http.h"
+
+namespace sylar {
+namespace http {
+
+/**
+ * @brief HTTP/1.x 解析器，请求和响应共用
+ *
+ * 用法：接收缓冲区里一条消息从 data 开始，每收到一批数据就用同一个 data、更长的 len 调用 execute，
+ * 已经解析过的行不会重新解析；isFinished 之后 [data, data + execute 的返回值) 是完整的一条消息，
+ * pipelining 的时候 reset 之后从这个位置开始解析下一条。
+ *
+ * 零拷贝：解析结果只记录相对 data 的偏移，取值的时候按最后一次 execute 传进来的 data 算出 StringRef，
+ * 所以缓冲区扩容、搬移之后照常可用，只要消息的字节不变。chunked 的 body 是多段，按段取或者拷贝拼起来。
+ *
+ * 找行尾、请求目标的结尾用 SIMD：启动的时候检查 CPU，AVX2 一次 32 字节，SSE4.2 用 pcmpestri 一次 16 字节，
+ * 都不支持或者不是 x86 的时候逐字节查找
+ */
+class HttpParser {
+public:
+    typedef std::shared_ptr<HttpParser> ptr;
+
+    enum Type {
+        REQUEST,
+        RESPONSE,
+    };
+
+    enum Error {
+        OK = 0,
+        INVALID_METHOD,
+        INVALID_URI,
+        INVALID_VERSION,
+        INVALID_STATUS,
+        INVALID_HEADER,
+        HEADER_TOO_LARGE,
+        INVALID_CONTENT_LENGTH,
+        INVALID_TRANSFER_ENCODING,
+        INVALID_CHUNK,
+        BODY_TOO_LARGE,
+        UNEXPECTED_EOF,
+    };
+
+    /**
+     * @brief 分隔符查找的实现
+     */
+    enum ScanImpl {
+        SCALAR,
+        SSE42,
+        AVX2,
+    };
+
+    /**
+     * @brief 相对消息开头的一段
+     */
+    struct Slice {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+
+    struct Header {
+        Slice name;
+        Slice value;
+    };
+
+    HttpParser(Type type = REQUEST);
+
+    /**
+     * @brief 解析 [data, data + len)，data 是消息的开头
+     * @return 已经解析到的位置（相对 data），完成的时候就是整条消息的长度；出错返回 -1，看 getError
+     */
+    ssize_t execute(const char *data, size_t len);
+
+    /**
+     * @brief 连接关闭了。没有长度的响应 body 读到连接关闭为止，这时候才算完成
+     * @return 消息完成返回 true，消息不完整返回 false 并设置 UNEXPECTED_EOF（一个字节都没有收到的时候不算错误）
+     */
+    bool finish();
+
+    /**
+     * @brief 开始解析下一条消息，pipelining 的时候 data 移到上一条的结尾
+     */
+    void reset();
+
+    bool isFinished() const { return m_state == DONE; }
+    bool hasError() const { return m_error != OK; }
+    /**
+     * @brief 请求头、状态行和头部都解析完了，body 可能还没收完
+     */
+    bool isHeaderComplete() const { return m_state >= BODY_IDENTITY && m_state != ERROR; }
+    Error getError() const { return m_error; }
+    const char *getErrorString() const;
+
+    /**
+     * @brief 响应 HEAD 请求的时候没有 body，要在 execute 之前设置
+     */
+    void setNoBody(bool v) { m_noBody = v; }
+
+    Type getType() const { return m_type; }
+    HttpMethod getMethod() const { return m_method; }
+    uint8_t getVersion() const { return m_version; }    // 0x11 表示 HTTP/1.1
+    HttpStatus getStatus() const { return (HttpStatus)m_status; }
+    bool isKeepAlive() const { return m_keepAlive; }
+    bool isChunked() const { return m_chunked; }
+    uint64_t getContentLength() const { return m_contentLength; }   // 没有 Content-Length 的时候是 ~0ull
+
+    StringRef getMethodString() const { return ref(m_methodSlice); }
+    StringRef getUri() const { return ref(m_uri); }         // 请求目标原样
+    StringRef getPath() const { return ref(m_path); }
+    StringRef getQuery() const { return ref(m_query); }
+    StringRef getFragment() const { return ref(m_fragment); }
+    StringRef getReason() const { return ref(m_reason); }
+
+    size_t getHeaderCount() const { return m_headers.size(); }
+    StringRef getHeaderName(size_t i) const { return ref(m_headers[i].name); }
+    StringRef getHeaderValue(size_t i) const { return ref(m_headers[i].value); }
+    /**
+     * @brief 头部按名字查找，不区分大小写，重复的头部返回第一个
+     */
+    bool getHeader(const char *name, StringRef &value) const;
+    StringRef getHeader(const char *name) const;
+    const std::vector<Header> &getHeaders() const { return m_headers; }
+
+    /**
+     * @brief body 的各段，非 chunked 的时候只有一段
+     */
+    size_t getBodySliceCount() const { return m_body.size(); }
+    StringRef getBodySlice(size_t i) const { return ref(m_body[i]); }
+    uint64_t getBodyLength() const { return m_bodyLength; }
+    std::string getBody() const;    // 拷贝拼起来
+
+    /**
+     * @brief 当前使用的查找实现
+     */
+    static ScanImpl GetScanImpl();
+    /**
+     * @brief 切换查找实现，CPU 不支持的时候返回 false，给测试、基准比较用
+     */
+    static bool SetScanImpl(ScanImpl impl);
+    static const char *ScanImplToString(ScanImpl impl);
+
+private:
+    enum State {
+        START_LINE,
+        HEADER_LINE,
+        BODY_IDENTITY,
+        BODY_EOF,
+        CHUNK_SIZE,
+        CHUNK_DATA,
+        CHUNK_DATA_END,
+        TRAILER_LINE,
+        DONE,
+        ERROR,
+    };
+
+    StringRef ref(const Slice &s) const { return StringRef(m_data + s.offset, s.length); }
+    Slice slice(const char *p, size_t len) const { Slice s; s.offset = p - m_data; s.length = len; return s; }
+
+    ssize_t fail(Error error);
+    /**
+     * @brief 从 m_pos 开始找一行，行里不能有 \t 以外的控制字符
+     * @return 1 找到了，eol 是行内容的结尾，next 是下一行的开头；0 数据不够；-1 出错
+     */
+    const char *sectionBegin(const char *line) const;
+    int nextLine(const char *end, const char *&eol, const char *&next, Error error);
+    bool parseRequestLine(const char *p, const char *eol);
+    bool parseStatusLine(const char *p, const char *eol);
+    bool parseHeaderLine(const char *p, const char *eol);
+    bool headersComplete();
+    void addBody(const char *p, size_t len);
+
+private:
+    Type m_type;
+    State m_state = START_LINE;
+    Error m_error = OK;
+    const char *m_data = nullptr;
+    size_t m_pos = 0;       // 下一个要解析的位置
+    size_t m_scanned = 0;   // 当前行已经确认没有行尾的位置，数据不够的时候下次从这里接着找
+
+    HttpMethod m_method = HttpMethod::INVALID_METHOD;
+    uint8_t m_version = 0;
+    uint32_t m_status = 0;
+    bool m_keepAlive = false;
+    bool m_chunked = false;
+    bool m_noBody = false;
+    uint64_t m_contentLength = ~0ull;
+    uint64_t m_remaining = 0;   // 当前 body 或者 chunk 还剩多少字节
+    uint64_t m_bodyLength = 0;
+    size_t m_trailerBegin = 0;  // trailer 开始的位置，trailer 总长度也受 max_header_size 限制
+
+    Slice m_methodSlice;
+    Slice m_uri;
+    Slice m_path;
+    Slice m_query;
+    Slice m_fragment;
+    Slice m_reason;
+    std::vector<Header> m_headers;
+    std::vector<Slice> m_body;
+};
+
+}
+}
+
+#endif //SYLAR_HTTP_HTTP_PARSER_H
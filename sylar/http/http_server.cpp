@@ -0,0 +1,78 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/21 16:00
+* @version: 1.0
+* @description: HTTP/1.1 服务器：长连接、pipelining、响应合并发送、servlet 分发
+********************************************************************************/
+
+#include "http_server.h"
+#include "../log.h"
+
+namespace sylar {
+namespace http {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+HttpServer::HttpServer(bool keepalive, IOManager *worker)
+        :TcpServer(worker)
+        ,m_isKeepalive(keepalive) {
+    m_dispatch.reset(new ServletDispatch);
+}
+
+void HttpServer::setName(const std::string &v) {
+    TcpServer::setName(v);
+    m_dispatch->setDefault(std::make_shared<NotFoundServlet>(v));
+}
+
+/**
+ * @brief 解析错误对应的状态码
+ */
+static HttpStatus ParseErrorToStatus(HttpParser::Error error) {
+    switch(error) {
+        case HttpParser::HEADER_TOO_LARGE:
+            return HttpStatus::REQUEST_HEADER_FIELDS_TOO_LARGE;
+        case HttpParser::BODY_TOO_LARGE:
+            return HttpStatus::PAYLOAD_TOO_LARGE;
+        case HttpParser::INVALID_VERSION:
+            return HttpStatus::HTTP_VERSION_NOT_SUPPORTED;
+        case HttpParser::INVALID_METHOD:
+            return HttpStatus::NOT_IMPLEMENTED;
+        default:
+            return HttpStatus::BAD_REQUEST;
+    }
+}
+
+void HttpServer::handleClient(Socket::ptr client) {
+    SYLAR_LOG_DEBUG(g_logger) << "handleClient " << *client;
+    HttpSession::ptr session(new HttpSession(client));
+    while(true) {
+        HttpRequest::ptr req = session->recvRequest();
+        if(!req) {
+            HttpParser::Error error = session->getParseError();
+            if(error != HttpParser::OK && error != HttpParser::UNEXPECTED_EOF) {
+                HttpResponse::ptr rsp = session->getResponse();
+                rsp->setStatus(ParseErrorToStatus(error));
+                rsp->setHeader("Server", getName());
+                session->sendResponse(rsp);
+            }
+            break;
+        }
+
+        HttpResponse::ptr rsp = session->getResponse();
+        if(!m_isKeepalive) {
+            rsp->setClose(true);
+        }
+        rsp->setHeader("Server", getName());
+        m_dispatch->handle(req, rsp, session);
+        if(!session->sendResponse(rsp) || rsp->isClose()) {
+            break;
+        }
+    }
+    session->flush();
+    client->close();
+}
+
+}
+}
@@ -0,0 +1,51 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/21 16:00
+* @version: 1.0
+* @description: HTTP/1.1 服务器：长连接、pipelining、响应合并发送、servlet 分发
+********************************************************************************/
+
+
+#ifndef SYLAR_HTTP_HTTP_SERVER_H
+#define SYLAR_HTTP_HTTP_SERVER_H
+
+#include "../tcp_server.h"
+#include "http_session.h"
+#include "servlet.h"
+
+namespace sylar {
+namespace http {
+
+/**
+ * @brief HTTP 服务器
+ * 每个连接一个协程，循环 recvRequest -> 分发到 servlet -> sendResponse，
+ * 连接在 accept 它的线程上处理（见 TcpServer）
+ */
+class HttpServer : public TcpServer {
+public:
+    typedef std::shared_ptr<HttpServer> ptr;
+
+    /**
+     * @param[in] keepalive 是否支持长连接，false 的时候每个响应之后关闭连接
+     */
+    HttpServer(bool keepalive = true, IOManager *worker = IOManager::GetThis());
+
+    ServletDispatch::ptr getServletDispatch() const { return m_dispatch; }
+    void setServletDispatch(ServletDispatch::ptr v) { m_dispatch = v; }
+
+    void setName(const std::string &v) override;
+
+protected:
+    void handleClient(Socket::ptr client) override;
+
+private:
+    bool m_isKeepalive;
+    ServletDispatch::ptr m_dispatch;
+};
+
+}
+}
+
+#endif //SYLAR_HTTP_HTTP_SERVER_H
@@ -0,0 +1,188 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/21 14:00
+* @version: 1.0
+* @description: 服务端的 http 连接：接收缓冲区里就地解析请求，响应攒一批一次 writev 发出去
+********************************************************************************/
+
+#include "http_session.h"
+#include "../config.h"
+#include "../log.h"
+#include "../macro.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+namespace sylar {
+namespace http {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint64_t>::ptr g_http_server_buffer_size =
+        sylar::Config::Lookup("http.server.buffer_size", (uint64_t)(4 * 1024),
+                              "http session initial receive buffer size");
+
+static sylar::ConfigVar<uint32_t>::ptr g_http_server_max_batch =
+        sylar::Config::Lookup("http.server.max_batch", (uint32_t)64,
+                              "max pipelined responses coalesced into one writev");
+
+static uint64_t s_buffer_size = 4 * 1024;
+static uint32_t s_max_batch = 64;
+
+struct _HttpSessionIniter {
+    _HttpSessionIniter() {
+        s_buffer_size = g_http_server_buffer_size->getValue();
+        g_http_server_buffer_size->addListener([](const uint64_t &old_value, const uint64_t &new_value) {
+            s_buffer_size = new_value;
+        });
+        s_max_batch = g_http_server_max_batch->getValue();
+        g_http_server_max_batch->addListener([](const uint32_t &old_value, const uint32_t &new_value) {
+            s_max_batch = new_value;
+        });
+    }
+};
+
+static _HttpSessionIniter s_http_session_initer;
+
+HttpSession::HttpSession(Socket::ptr sock)
+        :m_socket(sock)
+        ,m_parser(HttpParser::REQUEST)
+        ,m_request(new HttpRequest(&m_parser)) {
+    m_buffer.resize(std::max(s_buffer_size, (uint64_t)64));
+}
+
+HttpSession::~HttpSession() {
+}
+
+HttpRequest::ptr HttpSession::recvRequest() {
+    if(m_consumed) {    // 上一个请求处理完了，解析下一个
+        m_start += m_consumed;
+        m_consumed = 0;
+        m_parser.reset();
+    }
+    while(true) {
+        if(m_start < m_end) {
+            ssize_t n = m_parser.execute(&m_buffer[m_start], m_end - m_start);
+            if(n < 0) {
+                SYLAR_LOG_DEBUG(g_logger) << "http parse error=" << m_parser.getErrorString()
+                                          << " " << *m_socket;
+                return nullptr;
+            }
+            if(m_parser.isFinished()) {
+                m_consumed = n;
+                ++m_requests;
+                return m_request;
+            }
+        }
+
+        // 缓冲区里没有完整的请求了，先把攒着的响应发出去再等数据
+        if(!flush()) {
+            return nullptr;
+        }
+        size_t init_size = std::max(s_buffer_size, (uint64_t)64);
+        if(m_start == m_end) {
+            m_start = m_end = 0;
+            if(m_buffer.size() > init_size * 4) {   // 大请求撑大的缓冲区还回去
+                std::string(init_size, '\0').swap(m_buffer);
+            }
+        } else if(m_start > 0) {    // 解析结果是相对消息开头的偏移，搬到最前面不影响
+            memmove(&m_buffer[0], &m_buffer[m_start], m_end - m_start);
+            m_end -= m_start;
+            m_start = 0;
+        }
+        if(m_end == m_buffer.size()) {
+            m_buffer.resize(m_buffer.size() * 2);
+        }
+        ssize_t n = m_socket->recv(&m_buffer[m_end], m_buffer.size() - m_end);
+        if(n <= 0) {
+            if(m_end > m_start) {
+                m_parser.finish();  // 请求收了一半，记下 UNEXPECTED_EOF
+            }
+            return nullptr;
+        }
+        m_end += n;
+    }
+}
+
+HttpResponse::ptr HttpSession::getResponse() {
+    if(m_queued == m_responses.size()) {
+        m_responses.push_back(std::make_shared<HttpResponse>());
+    }
+    HttpResponse::ptr rsp = m_responses[m_queued];
+    if(m_parser.isFinished()) {
+        rsp->reset(m_parser.getVersion(), !m_parser.isKeepAlive());
+        rsp->setHeadOnly(m_parser.getMethod() == HttpMethod::HEAD);
+    } else {    // 解析出错的时候回错误响应
+        rsp->reset(0x11, true);
+    }
+    return rsp;
+}
+
+bool HttpSession::sendResponse(HttpResponse::ptr rsp) {
+    SYLAR_ASSERT(m_queued < m_responses.size() && m_responses[m_queued] == rsp);
+    rsp->writeHeader(m_headers);
+    m_headerEnds.push_back(m_headers.size());
+    ++m_queued;
+    if(m_queued >= s_max_batch) {
+        return flush();
+    }
+    return true;
+}
+
+bool HttpSession::flush() {
+    if(!m_queued) {
+        return true;
+    }
+    std::vector<iovec> iovs;
+    iovs.reserve(m_queued * 2);
+    size_t begin = 0;
+    for(size_t i = 0; i < m_queued; ++i) {
+        iovec iov;
+        iov.iov_base = &m_headers[begin];
+        iov.iov_len = m_headerEnds[i] - begin;
+        iovs.push_back(iov);
+        begin = m_headerEnds[i];
+
+        HttpResponse::ptr &rsp = m_responses[i];
+        uint32_t status = (uint32_t)rsp->getStatus();
+        if(rsp->isHeadOnly() || status < 200 || status == 204 || status == 304 || rsp->getBody().empty()) {
+            continue;
+        }
+        iov.iov_base = (void *)rsp->getBody().c_str();
+        iov.iov_len = rsp->getBody().size();
+        iovs.push_back(iov);
+    }
+    ++m_flushes;
+
+    bool ok = true;
+    size_t idx = 0;
+    while(idx < iovs.size()) {
+        ssize_t n = m_socket->send(&iovs[idx], std::min(iovs.size() - idx, (size_t)IOV_MAX));
+        if(n <= 0) {
+            SYLAR_LOG_DEBUG(g_logger) << "http flush fail errno=" << errno << " errstr=" << strerror(errno)
+                                      << " " << *m_socket;
+            ok = false;
+            break;
+        }
+        while(n > 0) {  // 发了一部分，跳过已经发完的，调整发了一半的那个
+            if((size_t)n >= iovs[idx].iov_len) {
+                n -= iovs[idx].iov_len;
+                ++idx;
+            } else {
+                iovs[idx].iov_base = (char *)iovs[idx].iov_base + n;
+                iovs[idx].iov_len -= n;
+                n = 0;
+            }
+        }
+    }
+    m_queued = 0;   // 发完之后才能复用，iovec 指向头部和 body
+    m_headers.clear();
+    m_headerEnds.clear();
+    return ok;
+}
+
+}
+}
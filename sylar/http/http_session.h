@@ -0,0 +1,86 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/21 14:00
+* @version: 1.0
+* @description: 服务端的 http 连接：接收缓冲区里就地解析请求，响应攒一批一次 writev 发出去
+********************************************************************************/
+
+
+#ifndef SYLAR_HTTP_HTTP_SESSION_H
+#define SYLAR_HTTP_HTTP_SESSION_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "http.h"
+#include "http_parser.h"
+#include "../socket.h"
+
+namespace sylar {
+namespace http {
+
+/**
+ * @brief 服务端的 http 连接
+ * 请求在接收缓冲区里就地解析，HttpRequest 直接指向缓冲区；缓冲区里还有完整的请求（pipelining）就先处理，
+ * 响应放进队列，等缓冲区里没有完整请求、要去 recv 之前，整批响应一次 sendmsg 发出去。
+ * 每个排队的响应是单独的 HttpResponse 对象，body 不用拷贝，对象在连接内复用
+ */
+class HttpSession : public std::enable_shared_from_this<HttpSession> {
+public:
+    typedef std::shared_ptr<HttpSession> ptr;
+
+    HttpSession(Socket::ptr sock);
+    ~HttpSession();
+
+    /**
+     * @brief 取下一个请求，缓冲区里没有完整请求的时候先 flush 攒着的响应再接收
+     * @return 连接关闭、超时或者解析出错返回 nullptr，出错的时候 getParseError 不是 OK
+     */
+    HttpRequest::ptr recvRequest();
+
+    /**
+     * @brief 当前请求的响应对象，已经按请求的版本和 keep-alive 初始化好
+     */
+    HttpResponse::ptr getResponse();
+
+    /**
+     * @brief 当前请求的响应放进队列，攒够 http.server.max_batch 个的时候马上发送
+     * @return 发送失败返回 false
+     */
+    bool sendResponse(HttpResponse::ptr rsp);
+
+    /**
+     * @brief 排队的响应一次 sendmsg 发出去（超过 IOV_MAX 的时候分几次）
+     */
+    bool flush();
+
+    HttpParser::Error getParseError() const { return m_parser.getError(); }
+    Socket::ptr getSocket() const { return m_socket; }
+    uint64_t getRequestCount() const { return m_requests; }
+    uint64_t getFlushCount() const { return m_flushes; }  // sendmsg 批次，和请求数比较能看出合并效果
+
+private:
+    Socket::ptr m_socket;
+    HttpParser m_parser;
+    HttpRequest::ptr m_request;
+
+    std::string m_buffer;   // 接收缓冲区，[m_start, m_end) 是还没处理完的数据
+    size_t m_start = 0;
+    size_t m_end = 0;
+    size_t m_consumed = 0;  // 上一个请求的长度，下次 recvRequest 的时候跳过
+
+    std::vector<HttpResponse::ptr> m_responses; // 排队的响应，对象复用
+    size_t m_queued = 0;
+    std::string m_headers;                      // 排队响应的头部拼在一起
+    std::vector<size_t> m_headerEnds;           // 每个响应头部在 m_headers 里的结尾
+
+    uint64_t m_requests = 0;
+    uint64_t m_flushes = 0;
+};
+
+}
+}
+
+#endif //SYLAR_HTTP_HTTP_SESSION_H
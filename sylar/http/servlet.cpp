@@ -0,0 +1,226 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/21 10:00
+* @version: 1.0
+* @description: servlet 和按路径分发，精确、前缀、通配路由编译成一棵字典树
+********************************************************************************/
+
+#include "servlet.h"
+#include <algorithm>
+#include <fnmatch.h>
+
+namespace sylar {
+namespace http {
+
+FunctionServlet::FunctionServlet(callback cb)
+        :Servlet("FunctionServlet")
+        ,m_cb(cb) {
+}
+
+int32_t FunctionServlet::handle(HttpRequest::ptr request, HttpResponse::ptr response,
+                                std::shared_ptr<HttpSession> session) {
+    return m_cb(request, response, session);
+}
+
+NotFoundServlet::NotFoundServlet(const std::string &name)
+        :Servlet("NotFoundServlet") {
+    m_content = "<html><head><title>404 Not Found"
+                "</title></head><body><center><h1>404 Not Found</h1></center>"
+                "<hr><center>" + name + "</center></body></html>";
+}
+
+int32_t NotFoundServlet::handle(HttpRequest::ptr request, HttpResponse::ptr response,
+                                std::shared_ptr<HttpSession> session) {
+    response->setStatus(HttpStatus::NOT_FOUND);
+    response->setHeader("Content-Type", "text/html");
+    response->setBody(m_content);
+    return 0;
+}
+
+ServletDispatch::ServletDispatch()
+        :Servlet("ServletDispatch") {
+    m_default.reset(new NotFoundServlet("sylar/1.0"));
+    m_nodes.resize(1);
+}
+
+int32_t ServletDispatch::handle(HttpRequest::ptr request, HttpResponse::ptr response,
+                                std::shared_ptr<HttpSession> session) {
+    Servlet::ptr slt = getMatchedServlet(request->getPath());
+    if(slt) {
+        slt->handle(request, response, session);
+    }
+    return 0;
+}
+
+void ServletDispatch::addServlet(const std::string &uri, Servlet::ptr slt) {
+    RWMutexType::WriteLock lock(m_mutex);
+    m_datas[uri] = slt;
+    compile();
+}
+
+void ServletDispatch::addServlet(const std::string &uri, FunctionServlet::callback cb) {
+    addServlet(uri, std::make_shared<FunctionServlet>(cb));
+}
+
+void ServletDispatch::addPrefixServlet(const std::string &prefix, Servlet::ptr slt) {
+    RWMutexType::WriteLock lock(m_mutex);
+    m_prefixes[prefix] = slt;
+    compile();
+}
+
+void ServletDispatch::addPrefixServlet(const std::string &prefix, FunctionServlet::callback cb) {
+    addPrefixServlet(prefix, std::make_shared<FunctionServlet>(cb));
+}
+
+void ServletDispatch::addGlobServlet(const std::string &pattern, Servlet::ptr slt) {
+    RWMutexType::WriteLock lock(m_mutex);
+    for(auto it = m_globs.begin(); it != m_globs.end(); ++it) {
+        if(it->first == pattern) {
+            m_globs.erase(it);
+            break;
+        }
+    }
+    m_globs.push_back(std::make_pair(pattern, slt));
+    compile();
+}
+
+void ServletDispatch::addGlobServlet(const std::string &pattern, FunctionServlet::callback cb) {
+    addGlobServlet(pattern, std::make_shared<FunctionServlet>(cb));
+}
+
+void ServletDispatch::delServlet(const std::string &uri) {
+    RWMutexType::WriteLock lock(m_mutex);
+    m_datas.erase(uri);
+    compile();
+}
+
+void ServletDispatch::delPrefixServlet(const std::string &prefix) {
+    RWMutexType::WriteLock lock(m_mutex);
+    m_prefixes.erase(prefix);
+    compile();
+}
+
+void ServletDispatch::delGlobServlet(const std::string &pattern) {
+    RWMutexType::WriteLock lock(m_mutex);
+    for(auto it = m_globs.begin(); it != m_globs.end(); ++it) {
+        if(it->first == pattern) {
+            m_globs.erase(it);
+            break;
+        }
+    }
+    compile();
+}
+
+Servlet::ptr ServletDispatch::getDefault() {
+    RWMutexType::ReadLock lock(m_mutex);
+    return m_default;
+}
+
+void ServletDispatch::setDefault(Servlet::ptr v) {
+    RWMutexType::WriteLock lock(m_mutex);
+    m_default = v;
+}
+
+Servlet::ptr ServletDispatch::getServlet(const std::string &uri) {
+    RWMutexType::ReadLock lock(m_mutex);
+    auto it = m_datas.find(uri);
+    return it == m_datas.end() ? nullptr : it->second;
+}
+
+Servlet::ptr ServletDispatch::getPrefixServlet(const std::string &prefix) {
+    RWMutexType::ReadLock lock(m_mutex);
+    auto it = m_prefixes.find(prefix);
+    return it == m_prefixes.end() ? nullptr : it->second;
+}
+
+Servlet::ptr ServletDispatch::getGlobServlet(const std::string &pattern) {
+    RWMutexType::ReadLock lock(m_mutex);
+    for(auto &i : m_globs) {
+        if(i.first == pattern) {
+            return i.second;
+        }
+    }
+    return nullptr;
+}
+
+uint32_t ServletDispatch::insertPath(const std::string &path) {
+    uint32_t idx = 0;
+    for(char c : path) {
+        auto &children = m_nodes[idx].children;
+        auto it = std::lower_bound(children.begin(), children.end(), std::make_pair(c, (uint32_t)0));
+        if(it != children.end() && it->first == c) {
+            idx = it->second;
+            continue;
+        }
+        uint32_t child = m_nodes.size();
+        children.insert(it, std::make_pair(c, child));
+        m_nodes.emplace_back();     // 之后 children 引用失效，不能再用
+        idx = child;
+    }
+    return idx;
+}
+
+void ServletDispatch::compile() {
+    m_nodes.clear();
+    m_nodes.resize(1);
+    for(auto &i : m_datas) {
+        m_nodes[insertPath(i.first)].exact = i.second;
+    }
+    for(auto &i : m_prefixes) {
+        m_nodes[insertPath(i.first)].prefix = i.second;
+    }
+    for(size_t i = 0; i < m_globs.size(); ++i) {
+        const std::string &pattern = m_globs[i].first;
+        size_t literal = pattern.find_first_of("*?[\\");
+        m_nodes[insertPath(pattern.substr(0, literal))].globs.push_back(i);
+    }
+}
+
+Servlet::ptr ServletDispatch::getMatchedServlet(const StringRef &path) {
+    RWMutexType::ReadLock lock(m_mutex);
+    const Node *prefix = nullptr;   // 最长的前缀
+    const Servlet::ptr *glob = nullptr; // 字面前缀最长的通配
+    std::string cpath;              // fnmatch 要 '\0' 结尾，有通配候选的时候才拷贝
+
+    uint32_t idx = 0;
+    size_t i = 0;
+    while(true) {
+        const Node &node = m_nodes[idx];
+        if(node.prefix) {
+            prefix = &node;
+        }
+        for(uint32_t g : node.globs) {  // 越深的字面前缀越长，覆盖前面找到的
+            if(cpath.empty()) {
+                cpath.assign(path.data, path.size);
+            }
+            if(fnmatch(m_globs[g].first.c_str(), cpath.c_str(), 0) == 0) {
+                glob = &m_globs[g].second;
+                break;
+            }
+        }
+        if(i == path.size) {
+            if(node.exact) {
+                return node.exact;
+            }
+            break;
+        }
+        char c = path.data[i++];
+        auto it = std::lower_bound(node.children.begin(), node.children.end(), std::make_pair(c, (uint32_t)0));
+        if(it == node.children.end() || it->first != c) {
+            break;
+        }
+        idx = it->second;
+    }
+    if(glob) {
+        return *glob;
+    }
+    if(prefix) {
+        return prefix->prefix;
+    }
+    return m_default;
+}
+
+}
+}
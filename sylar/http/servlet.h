@@ -0,0 +1,143 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/21 10:00
+* @version: 1.0
+* @description: servlet 和按路径分发，精确、前缀、通配路由编译成一棵字典树
+********************************************************************************/
+
+
+#ifndef SYLAR_HTTP_SERVLET_H
+#define SYLAR_HTTP_SERVLET_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "http.h"
+#include "../thread.h"
+
+namespace sylar {
+namespace http {
+
+class HttpSession;
+
+class Servlet {
+public:
+    typedef std::shared_ptr<Servlet> ptr;
+
+    Servlet(const std::string &name) : m_name(name) {}
+    virtual ~Servlet() {}
+
+    /**
+     * @brief 处理请求，request 只在返回之前有效
+     */
+    virtual int32_t handle(HttpRequest::ptr request, HttpResponse::ptr response,
+                           std::shared_ptr<HttpSession> session) = 0;
+
+    const std::string &getName() const { return m_name; }
+
+protected:
+    std::string m_name;
+};
+
+class FunctionServlet : public Servlet {
+public:
+    typedef std::shared_ptr<FunctionServlet> ptr;
+    typedef std::function<int32_t(HttpRequest::ptr request, HttpResponse::ptr response,
+                                  std::shared_ptr<HttpSession> session)> callback;
+
+    FunctionServlet(callback cb);
+    int32_t handle(HttpRequest::ptr request, HttpResponse::ptr response,
+                   std::shared_ptr<HttpSession> session) override;
+
+private:
+    callback m_cb;
+};
+
+class NotFoundServlet : public Servlet {
+public:
+    typedef std::shared_ptr<NotFoundServlet> ptr;
+
+    NotFoundServlet(const std::string &name);
+    int32_t handle(HttpRequest::ptr request, HttpResponse::ptr response,
+                   std::shared_ptr<HttpSession> session) override;
+
+private:
+    std::string m_content;
+};
+
+/**
+ * @brief 按路径分发
+ * 三种路由：精确（/a/b）、前缀（/static/ 开头的都匹配）、通配（fnmatch，/api/v?/info）。
+ * 优先级：精确 > 通配 > 前缀 > 默认；多个通配都匹配的时候字面前缀长的优先，一样长的先注册的优先；
+ * 多个前缀都匹配的时候最长的优先。
+ *
+ * 每次修改路由之后重新编译一棵字符字典树：精确和前缀路由挂在路径结尾的节点上，通配路由挂在
+ * 第一个通配符之前的字面前缀的节点上。查找的时候沿着请求路径走一遍，一路收集前缀和通配候选，
+ * 不用挨个比较所有路由，也不用为了查找拷贝路径
+ */
+class ServletDispatch : public Servlet {
+public:
+    typedef std::shared_ptr<ServletDispatch> ptr;
+    typedef RWMutex RWMutexType;
+
+    ServletDispatch();
+    int32_t handle(HttpRequest::ptr request, HttpResponse::ptr response,
+                   std::shared_ptr<HttpSession> session) override;
+
+    void addServlet(const std::string &uri, Servlet::ptr slt);
+    void addServlet(const std::string &uri, FunctionServlet::callback cb);
+    void addPrefixServlet(const std::string &prefix, Servlet::ptr slt);
+    void addPrefixServlet(const std::string &prefix, FunctionServlet::callback cb);
+    void addGlobServlet(const std::string &pattern, Servlet::ptr slt);
+    void addGlobServlet(const std::string &pattern, FunctionServlet::callback cb);
+
+    void delServlet(const std::string &uri);
+    void delPrefixServlet(const std::string &prefix);
+    void delGlobServlet(const std::string &pattern);
+
+    Servlet::ptr getDefault();
+    void setDefault(Servlet::ptr v);
+
+    Servlet::ptr getServlet(const std::string &uri);
+    Servlet::ptr getPrefixServlet(const std::string &prefix);
+    Servlet::ptr getGlobServlet(const std::string &pattern);
+
+    /**
+     * @brief 按优先级找到处理 path 的 servlet，都不匹配的时候返回默认的
+     */
+    Servlet::ptr getMatchedServlet(const StringRef &path);
+    Servlet::ptr getMatchedServlet(const std::string &path) {
+        return getMatchedServlet(StringRef(path.c_str(), path.size()));
+    }
+
+private:
+    struct Node {
+        std::vector<std::pair<char, uint32_t> > children;   // 按字符排序
+        Servlet::ptr exact;
+        Servlet::ptr prefix;
+        std::vector<uint32_t> globs;    // m_globs 的下标，按注册顺序
+    };
+
+    uint32_t insertPath(const std::string &path);
+    /**
+     * @brief 路由修改之后重新编译字典树，调用者持有写锁
+     */
+    void compile();
+
+private:
+    RWMutexType m_mutex;
+    std::map<std::string, Servlet::ptr> m_datas;    // 精确
+    std::map<std::string, Servlet::ptr> m_prefixes; // 前缀
+    std::vector<std::pair<std::string, Servlet::ptr> > m_globs; // 通配，按注册顺序
+    std::vector<Node> m_nodes;  // 编译好的字典树，0 是根
+    Servlet::ptr m_default;
+};
+
+}
+}
+
+#endif //SYLAR_HTTP_SERVLET_H
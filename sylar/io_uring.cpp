@@ -0,0 +1,207 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/12 11:05
+* @version: 1.0
+* @description: io_uring 封装，直接使用系统调用，不依赖 liburing
+********************************************************************************/
+
+#include "io_uring.h"
+#include "log.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static int io_uring_setup(unsigned entries, io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+IOUring::ptr IOUring::Create(uint32_t entries) {
+    IOUring::ptr ring(new IOUring);
+    if(!ring->init(entries)) {
+        return nullptr;
+    }
+    return ring;
+}
+
+IOUring::IOUring() {
+}
+
+IOUring::~IOUring() {
+    if(m_sqes) {
+        munmap(m_sqes, m_sqesSize);
+    }
+    if(m_cqPtr && m_cqPtr != m_sqPtr) {
+        munmap(m_cqPtr, m_cqSize);
+    }
+    if(m_sqPtr) {
+        munmap(m_sqPtr, m_sqSize);
+    }
+    if(m_eventFd != -1) {
+        close(m_eventFd);
+    }
+    if(m_ringFd != -1) {
+        close(m_ringFd);
+    }
+}
+
+bool IOUring::init(uint32_t entries) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    m_ringFd = io_uring_setup(entries, &p);
+    if(m_ringFd < 0) {
+        SYLAR_LOG_WARN(g_logger) << "io_uring_setup(" << entries << ") errno=" << errno
+                                 << " " << strerror(errno);
+        m_ringFd = -1;
+        return false;
+    }
+    if(!(p.features & IORING_FEAT_NODROP)) {    // 完成队列满了会丢事件，协程就再也醒不过来了
+        SYLAR_LOG_WARN(g_logger) << "io_uring without IORING_FEAT_NODROP";
+        return false;
+    }
+
+    // 检查需要用到的操作内核是否都支持
+    size_t probe_len = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    std::vector<char> probe_buf(probe_len, 0);
+    io_uring_probe *probe = (io_uring_probe *)&probe_buf[0];
+    if(io_uring_register(m_ringFd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        SYLAR_LOG_WARN(g_logger) << "io_uring probe errno=" << errno << " " << strerror(errno);
+        return false;
+    }
+    static const int s_ops[] = {IORING_OP_READ, IORING_OP_WRITE, IORING_OP_READV, IORING_OP_WRITEV,
+                                IORING_OP_ACCEPT, IORING_OP_CONNECT, IORING_OP_LINK_TIMEOUT};
+    for(auto op : s_ops) {
+        if(op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            SYLAR_LOG_WARN(g_logger) << "io_uring op " << op << " not supported";
+            return false;
+        }
+    }
+
+    m_sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m_cqSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+    if(single_mmap) {
+        m_sqSize = m_cqSize = std::max(m_sqSize, m_cqSize);
+    }
+
+    m_sqPtr = mmap(nullptr, m_sqSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+    if(m_sqPtr == MAP_FAILED) {
+        m_sqPtr = nullptr;
+        return false;
+    }
+    if(single_mmap) {
+        m_cqPtr = m_sqPtr;
+    } else {
+        m_cqPtr = mmap(nullptr, m_cqSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING);
+        if(m_cqPtr == MAP_FAILED) {
+            m_cqPtr = nullptr;
+            return false;
+        }
+    }
+    m_sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = (io_uring_sqe *)mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+    if(m_sqes == MAP_FAILED) {
+        m_sqes = nullptr;
+        return false;
+    }
+
+    char *sq = (char *)m_sqPtr;
+    m_sqHead = (unsigned *)(sq + p.sq_off.head);
+    m_sqTail = (unsigned *)(sq + p.sq_off.tail);
+    m_sqMask = (unsigned *)(sq + p.sq_off.ring_mask);
+    m_sqFlags = (unsigned *)(sq + p.sq_off.flags);
+    m_sqArray = (unsigned *)(sq + p.sq_off.array);
+    m_sqEntries = p.sq_entries;
+
+    char *cq = (char *)m_cqPtr;
+    m_cqHead = (unsigned *)(cq + p.cq_off.head);
+    m_cqTail = (unsigned *)(cq + p.cq_off.tail);
+    m_cqMask = (unsigned *)(cq + p.cq_off.ring_mask);
+    m_cqes = (io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(m_eventFd < 0) {
+        m_eventFd = -1;
+        return false;
+    }
+    if(io_uring_register(m_ringFd, IORING_REGISTER_EVENTFD, &m_eventFd, 1) < 0) {
+        SYLAR_LOG_WARN(g_logger) << "io_uring register eventfd errno=" << errno
+                                 << " " << strerror(errno);
+        return false;
+    }
+    SYLAR_LOG_INFO(g_logger) << "io_uring sq_entries=" << p.sq_entries
+                             << " cq_entries=" << p.cq_entries;
+    return true;
+}
+
+bool IOUring::push(const io_uring_sqe *sqes, size_t n, bool &first) {
+    MutexType::Lock lock(m_sqMutex);
+    unsigned tail = *m_sqTail;
+    unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if(tail - head + n > m_sqEntries) {
+        return false;
+    }
+    for(size_t i = 0; i < n; ++i) {
+        unsigned idx = tail & *m_sqMask;
+        m_sqes[idx] = sqes[i];
+        m_sqArray[idx] = idx;
+        ++tail;
+    }
+    __atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+    first = m_unsubmitted == 0;
+    m_unsubmitted += n;
+    return true;
+}
+
+int IOUring::submit() {
+    MutexType::Lock lock(m_sqMutex);
+    if(!m_unsubmitted) {
+        return 0;
+    }
+    int rt = 0;
+    do {
+        rt = io_uring_enter(m_ringFd, m_unsubmitted, 0, 0);
+    } while(rt < 0 && errno == EINTR);
+    if(rt < 0) {    // EAGAIN/EBUSY 内核资源不够，留着下次再提交
+        SYLAR_LOG_ERROR(g_logger) << "io_uring_enter submit=" << m_unsubmitted
+                                  << " errno=" << errno << " " << strerror(errno);
+        return rt;
+    }
+    m_unsubmitted -= rt;
+    return rt;
+}
+
+void IOUring::reap(std::vector<io_uring_cqe> &cqes) {
+    MutexType::Lock lock(m_cqMutex);
+    if(__atomic_load_n(m_sqFlags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW) {
+        io_uring_enter(m_ringFd, 0, 0, IORING_ENTER_GETEVENTS); // 让内核把溢出的完成事件刷回完成队列
+    }
+    unsigned head = *m_cqHead;
+    unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    while(head != tail) {
+        cqes.push_back(m_cqes[head & *m_cqMask]);
+        ++head;
+    }
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+}
+
+}
@@ -0,0 +1,86 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/12 11:05
+* @version: 1.0
+* @description: io_uring 封装，直接使用系统调用，不依赖 liburing
+********************************************************************************/
+
+
+#ifndef SYLAR_IO_URING_H
+#define SYLAR_IO_URING_H
+
+#include <memory>
+#include <vector>
+#include <linux/io_uring.h>
+#include "thread.h"
+
+namespace sylar {
+
+/**
+ * @brief io_uring 提交队列、完成队列的封装
+ * 提交的时候先放进 SQ，攒一批再一次 io_uring_enter 提交
+ * 完成的时候内核写 eventfd，IOManager 把 eventfd 放在 epoll 里，和其它事件一起处理
+ */
+class IOUring {
+public:
+    typedef std::shared_ptr<IOUring> ptr;
+    typedef Mutex MutexType;
+
+    /**
+     * @brief 创建 io_uring，内核不支持（或者缺少需要的操作）的时候返回 nullptr
+     */
+    static IOUring::ptr Create(uint32_t entries);
+
+    ~IOUring();
+
+    int getEventFd() const { return m_eventFd; }
+
+    /**
+     * @brief 把 sqe 放进提交队列，n 个 sqe 要么都放进去，要么都不放
+     * @param[out] first 放之前队列里是否没有待提交的 sqe
+     * @return 队列满了返回 false，需要先 submit
+     */
+    bool push(const io_uring_sqe *sqes, size_t n, bool &first);
+
+    int submit();   // 提交所有待提交的 sqe，返回提交的个数
+
+    size_t getUnsubmitted() const { return m_unsubmitted; }
+
+    void reap(std::vector<io_uring_cqe> &cqes); // 取出所有已完成的 cqe
+
+private:
+    IOUring();
+
+    bool init(uint32_t entries);
+
+private:
+    int m_ringFd = -1;
+    int m_eventFd = -1;
+
+    MutexType m_sqMutex;
+    std::atomic<size_t> m_unsubmitted = {0};
+    void *m_sqPtr = nullptr;
+    size_t m_sqSize = 0;
+    unsigned *m_sqHead = nullptr;
+    unsigned *m_sqTail = nullptr;
+    unsigned *m_sqMask = nullptr;
+    unsigned *m_sqFlags = nullptr;
+    unsigned *m_sqArray = nullptr;
+    unsigned m_sqEntries = 0;
+    io_uring_sqe *m_sqes = nullptr;
+    size_t m_sqesSize = 0;
+
+    MutexType m_cqMutex;
+    void *m_cqPtr = nullptr;
+    size_t m_cqSize = 0;
+    unsigned *m_cqHead = nullptr;
+    unsigned *m_cqTail = nullptr;
+    unsigned *m_cqMask = nullptr;
+    io_uring_cqe *m_cqes = nullptr;
+};
+
+}
+
+#endif //SYLAR_IO_URING_H
@@ -11,17 +11,67 @@
 #include "iomanager.h"
 #include "macro.h"
 #include "log.h"
+#include "config.h"
+#include "hook.h"
 
 #include <cerrno>
 #include <fcntl.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <cstring>
 #include <unistd.h>
+#include <algorithm>
+#include <sstream>
+#include <cstdlib>
+#include <new>
 
 namespace sylar {
 
 static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+static sylar::ConfigVar<bool>::ptr g_iomanager_io_uring =
+        sylar::Config::Lookup("iomanager.io_uring", false, "use io_uring for async io");
+
+static sylar::ConfigVar<uint32_t>::ptr g_iomanager_io_uring_entries =
+        sylar::Config::Lookup("iomanager.io_uring.entries", (uint32_t)256, "io_uring submission queue entries");
+
+static sylar::ConfigVar<uint32_t>::ptr g_iomanager_io_uring_batch =
+        sylar::Config::Lookup("iomanager.io_uring.batch", (uint32_t)32,
+                              "submit io_uring immediately when so many sqes are pending");
+
+static sylar::ConfigVar<bool>::ptr g_iomanager_persistent_et =
+        sylar::Config::Lookup("iomanager.persistent_et", false,
+                              "register fds once with EPOLLIN|EPOLLOUT|EPOLLET, track readiness in user space");
+
+static sylar::ConfigVar<uint32_t>::ptr g_iomanager_epoll_min_events =
+        sylar::Config::Lookup("iomanager.epoll.min_events", (uint32_t)64, "min epoll_wait batch size per thread");
+
+static sylar::ConfigVar<uint32_t>::ptr g_iomanager_epoll_max_events =
+        sylar::Config::Lookup("iomanager.epoll.max_events", (uint32_t)1024, "max epoll_wait batch size per thread");
+
+static sylar::ConfigVar<bool>::ptr g_iomanager_multi_reactor =
+        sylar::Config::Lookup("iomanager.multi_reactor", false, "one epoll instance per worker thread");
+
+static sylar::ConfigVar<std::string>::ptr g_iomanager_reactor_assign =
+        sylar::Config::Lookup("iomanager.reactor.assign", std::string("round_robin"),
+                              "how fds are assigned to reactors: round_robin, hash, caller");
+
+static sylar::ConfigVar<uint32_t>::ptr g_iomanager_busy_poll_threads =
+        sylar::Config::Lookup("iomanager.busy_poll.threads", (uint32_t)0,
+                              "number of worker threads that spin on epoll_wait(0) before blocking");
+
+static sylar::ConfigVar<uint32_t>::ptr g_iomanager_busy_poll_spin_us =
+        sylar::Config::Lookup("iomanager.busy_poll.spin_us", (uint32_t)50,
+                              "busy poll spin budget in microseconds before falling back to blocking");
+
+static sylar::ConfigVar<uint32_t>::ptr g_iomanager_busy_poll_socket_us =
+        sylar::Config::Lookup("iomanager.busy_poll.socket_us", (uint32_t)0,
+                              "SO_BUSY_POLL value set on sockets when first registered, 0 disables");
+
+static thread_local TimingWheel* t_wheel = nullptr;     // 当前线程的时间轮
+static thread_local IOManager* t_wheel_owner = nullptr; // 时间轮属于哪个 IOManager
+static thread_local int t_reactor = -1;                 // 当前线程负责的 reactor，属于 t_wheel_owner
+
 IOManager::FdContext::EventContext& IOManager::FdContext::getContext(IOManager::Event event) {
     switch(event) {
         case IOManager::READ:
@@ -36,15 +86,26 @@ IOManager::FdContext::EventContext& IOManager::FdContext::getContext(IOManager::
 void IOManager::FdContext::resetContext(EventContext& ctx) {
     ctx.scheduler = nullptr;
     ctx.fiber.reset();
+    delete ctx.cb;
     ctx.cb = nullptr;
 }
 
-void IOManager::FdContext::triggerEvent(IOManager::Event event) {
+void IOManager::FdContext::triggerEvent(IOManager::Event event, Scheduler* batch_owner, EventBatch* batch) {
     SYLAR_ASSERT(events & event);
-    events = (Event)(events & ~event);
+    events.store((Event)(events & ~event), std::memory_order_relaxed);
     EventContext& ctx = getContext(event);
-    if(ctx.cb) {
-        ctx.scheduler->schedule(&ctx.cb);
+    if(batch && ctx.scheduler == batch_owner) {
+        if(ctx.cb) {
+            batch->cbs.push_back(std::move(*ctx.cb));
+            delete ctx.cb;
+            ctx.cb = nullptr;
+        } else {
+            batch->fibers.push_back(std::move(ctx.fiber));
+        }
+    } else if(ctx.cb) {
+        ctx.scheduler->schedule(ctx.cb);    // 内容被换走了，剩下一个空的
+        delete ctx.cb;
+        ctx.cb = nullptr;
     } else {
         ctx.scheduler->schedule(&ctx.fiber);
     }
@@ -54,66 +115,203 @@ void IOManager::FdContext::triggerEvent(IOManager::Event event) {
 
 IOManager::IOManager(size_t threads, bool use_caller, const std::string& name)
         :Scheduler(threads, use_caller, name) {// 初始化父类
-    m_epfd = epoll_create(5000);
-    SYLAR_ASSERT(m_epfd > 0);
-
-    int rt = pipe(m_tickleFds);
-    SYLAR_ASSERT(!rt);
+    size_t reactors = 1;
+    if(g_iomanager_multi_reactor->getValue()) { // 每个工作线程一个，use_caller 的线程只在 stop 的时候帮 0 号收事件
+        reactors = std::max(m_threadCount, (size_t)1);
+    }
+    const std::string& assign = g_iomanager_reactor_assign->getValue();
+    if(assign == "hash") {
+        m_assign = HASH;
+    } else if(assign == "caller") {
+        m_assign = CALLER;
+    } else {
+        m_assign = ROUND_ROBIN;
+    }
 
+    int rt = 0;
     epoll_event event;
-    memset(&event, 0, sizeof(epoll_event));
-    event.events = EPOLLIN | EPOLLET;   // 边缘触发，只触发一次
-    event.data.fd = m_tickleFds[0];     // 读端
+    for(size_t i = 0; i < reactors; ++i) {
+        Reactor* reactor = new Reactor;
+        reactor->epfd = epoll_create(5000);
+        SYLAR_ASSERT(reactor->epfd > 0);
+
+        reactor->tickleFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);   // 计数器，多次写入合并成一次读
+        SYLAR_ASSERT(reactor->tickleFd >= 0);
+
+        memset(&event, 0, sizeof(epoll_event));
+        event.events = EPOLLIN | EPOLLET;   // 边缘触发，只触发一次
+        event.data.fd = reactor->tickleFd;
 
-    rt = fcntl(m_tickleFds[0], F_SETFL, O_NONBLOCK);    // 设置为非阻塞
-    SYLAR_ASSERT(!rt);
+        rt = epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, reactor->tickleFd, &event);  // 添加到 epoll 中
+        SYLAR_ASSERT(!rt);
+        m_reactors.push_back(reactor);
+    }
+
+    m_persistentEt = g_iomanager_persistent_et->getValue();
+    m_minEpollEvents = std::max(g_iomanager_epoll_min_events->getValue(), (uint32_t)1);
+    m_maxEpollEvents = std::max((size_t)g_iomanager_epoll_max_events->getValue(), m_minEpollEvents);
+    for(size_t i = 0; i < WAKEUP_BUCKETS; ++i) {
+        m_wakeupHist[i] = 0;
+    }
+    m_busyPollThreads = g_iomanager_busy_poll_threads->getValue();
+    m_busyPollSpinUs = g_iomanager_busy_poll_spin_us->getValue();
+    m_busyPollSocketUs = g_iomanager_busy_poll_socket_us->getValue();
 
-    rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFds[0], &event);  // 添加到 epoll 中
-    SYLAR_ASSERT(!rt);
+    if(g_iomanager_io_uring->getValue()) {
+        m_uring = IOUring::Create(g_iomanager_io_uring_entries->getValue());
+        if(m_uring) {   // 完成的时候内核写 eventfd，和其它事件一起在 epoll_wait 里收
+            memset(&event, 0, sizeof(epoll_event));
+            event.events = EPOLLIN | EPOLLET;
+            event.data.fd = m_uring->getEventFd();
+            rt = epoll_ctl(m_reactors[0]->epfd, EPOLL_CTL_ADD, m_uring->getEventFd(), &event);
+            SYLAR_ASSERT(!rt);
+        } else {
+            SYLAR_LOG_WARN(g_logger) << "name=" << name << " io_uring not supported, fallback to epoll";
+        }
+    }
 
-    contextResize(32);
+    for(size_t i = 0; i < FD_MAX_SEGMENTS; ++i) {
+        m_fdSegments[i] = nullptr;
+    }
+    getFdContext(0, true);  // 第一段先分配好
+    {
+        RWMutex::WriteLock lock(GetInstancesMutex());
+        GetInstances().push_back(this);
+    }
 
     start();
 }
 
 IOManager::~IOManager() {
     stop();
-    close(m_epfd);
-    close(m_tickleFds[0]);
-    close(m_tickleFds[1]);
+    {   // 之后关 epoll/eventfd 也会走 OnFdClose，先摘掉自己
+        RWMutex::WriteLock lock(GetInstancesMutex());
+        auto& instances = GetInstances();
+        instances.erase(std::remove(instances.begin(), instances.end(), this), instances.end());
+    }
+    for(auto reactor : m_reactors) {
+        close(reactor->epfd);
+        close(reactor->tickleFd);
+        delete reactor;
+    }
 
-    for(size_t i = 0; i < m_fdContexts.size(); ++i) {   // 释放资源
-        if(m_fdContexts[i]) {
-            delete m_fdContexts[i];
-        }
+    for(size_t i = 0; i < FD_MAX_SEGMENTS; ++i) {   // 释放资源
+        FreeSegment(m_fdSegments[i].load());
     }
 }
 
-void IOManager::contextResize(size_t size) {
-    m_fdContexts.resize(size);
+IOManager::FdContext* IOManager::AllocSegment(int base) {
+    void* mem = nullptr;    // C++11 的 new[] 不保证超过 16 字节的对齐
+    if(posix_memalign(&mem, alignof(FdContext), sizeof(FdContext) * FD_SEGMENT_SIZE)) {
+        throw std::bad_alloc();
+    }
+    FdContext* segment = (FdContext*)mem;
+    for(size_t i = 0; i < FD_SEGMENT_SIZE; ++i) {
+        new (&segment[i]) FdContext;
+        segment[i].fd = base + i;
+    }
+    return segment;
+}
 
-    for(size_t i = 0; i < m_fdContexts.size(); ++i) {
-        if(!m_fdContexts[i]) {
-            m_fdContexts[i] = new FdContext;
-            m_fdContexts[i]->fd = i;
+void IOManager::FreeSegment(FdContext* segment) {
+    if(!segment) {
+        return;
+    }
+    for(size_t i = 0; i < FD_SEGMENT_SIZE; ++i) {
+        segment[i].~FdContext();
+    }
+    free(segment);
+}
+
+IOManager::FdContext* IOManager::getFdContext(int fd, bool auto_create) {
+    if(fd < 0 || (size_t)fd >= FD_SEGMENT_SIZE * FD_MAX_SEGMENTS) {
+        return nullptr;
+    }
+    std::atomic<FdContext*>& slot = m_fdSegments[fd >> FD_SEGMENT_BITS];
+    FdContext* segment = slot.load(std::memory_order_acquire);
+    if(!segment) {
+        if(!auto_create) {
+            return nullptr;
+        }
+        FdContext* new_segment = AllocSegment(fd & ~(int)(FD_SEGMENT_SIZE - 1));
+        if(slot.compare_exchange_strong(segment, new_segment, std::memory_order_acq_rel)) {
+            segment = new_segment;
+        } else {    // 别的线程抢先分配了，用它的
+            FreeSegment(new_segment);
         }
     }
+    return &segment[fd & (FD_SEGMENT_SIZE - 1)];
 }
 
 int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
-    FdContext* fd_ctx = nullptr;
-    RWMutexType::ReadLock lock(m_mutex);
-    if((int)m_fdContexts.size() > fd) {
-        fd_ctx = m_fdContexts[fd];
-        lock.unlock();
-    } else {
-        lock.unlock();
-        RWMutexType::WriteLock lock2(m_mutex);
-        contextResize(fd * 1.5);
-        fd_ctx = m_fdContexts[fd];
+    FdContext* fd_ctx = getFdContext(fd, true);
+    if(!fd_ctx) {
+        SYLAR_LOG_ERROR(g_logger) << "addEvent invalid fd=" << fd;
+        return -1;
+    }
+
+    if(m_persistentEt) {
+        FdContext::MutexType::Lock lock2(fd_ctx->mutex);
+        if(fd_ctx->registered) {    // 常驻注册模式下注册过的不用系统调用，只拿自旋锁
+            attachEvent(fd_ctx, event, cb);
+            return 0;
+        }
     }
 
+    // 要改内核里的注册：先拿 fd 对应的互斥锁排队，epoll_ctl、setsockopt 的时候不拿自旋锁
+    Mutex::Lock ctl_lock(getCtlMutex(fd));
     FdContext::MutexType::Lock lock2(fd_ctx->mutex);
+    if(m_persistentEt && fd_ctx->registered) {  // 排队的时候别人已经注册了
+        attachEvent(fd_ctx, event, cb);
+        return 0;
+    }
+    bool new_reactor = fd_ctx->reactor < 0;
+    if(new_reactor) {
+        fd_ctx->reactor.store(assignReactor(fd), std::memory_order_relaxed);
+    }
+    int epfd = m_reactors[fd_ctx->reactor]->epfd;
+    int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    epoll_event epevent;
+    epevent.events = EPOLLET | fd_ctx->events | event;
+    if(m_persistentEt) {    // 常驻注册模式下只在第一次注册
+        op = EPOLL_CTL_ADD;
+        epevent.events = EPOLLET | EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+    }
+    epevent.data.ptr = fd_ctx;
+    lock2.unlock(); // 注册相关的 events、registered、reactor 只有拿着 ctl 锁的才会改
+
+#ifdef SO_BUSY_POLL
+    if(new_reactor && m_busyPollSocketUs) { // 不是 socket 或者没有 CAP_NET_ADMIN 的时候会失败，不影响使用
+        int us = (int)m_busyPollSocketUs;
+        setsockopt_f(fd, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us));
+    }
+#endif
+    int rt = epoll_ctl(epfd, op, fd, &epevent);
+    if(rt) {
+        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", "
+                                  << op << "," << fd << "," << epevent.events << "):"
+                                  << rt << " (" << errno << ") (" << strerror(errno) << ")";
+        return -1;
+    }
+
+    lock2.lock();
+    fd_ctx->registered.store(m_persistentEt, std::memory_order_relaxed);
+    attachEvent(fd_ctx, event, cb);
+    return 0;
+}
+
+void IOManager::triggerReady(FdContext* fd_ctx, int events, EventBatch& batch) {
+    if(events & READ) {
+        fd_ctx->triggerEvent(READ, this, &batch);
+        --m_pendingEventCount;
+    }
+    if(events & WRITE) {
+        fd_ctx->triggerEvent(WRITE, this, &batch);
+        --m_pendingEventCount;
+    }
+}
+
+void IOManager::attachEvent(FdContext* fd_ctx, Event event, std::function<void()>& cb) {
     /**
      * 这一部分代码使用按位与运算符 `&` 来检查 `FdContext` 对象的 `events`
      * 字段中是否已经存在指定的事件。如果 `events` 字段与 `event` 参数按位与的结果不为零，
@@ -124,27 +322,14 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
      * 将记录错误消息并触发断言。
      */
     if(fd_ctx->events & event) {
-        SYLAR_LOG_ERROR(g_logger) << "addEvent assert fd=" << fd
+        SYLAR_LOG_ERROR(g_logger) << "addEvent assert fd=" << fd_ctx->fd
                                   << " event=" << event
                                   << " fd_ctx.event=" << fd_ctx->events;
         SYLAR_ASSERT(!(fd_ctx->events & event));
     }
 
-    int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
-    epoll_event epevent;
-    epevent.events = EPOLLET | fd_ctx->events | event;
-    epevent.data.ptr = fd_ctx;
-
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if(rt) {
-        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                                  << op << "," << fd << "," << epevent.events << "):"
-                                  << rt << " (" << errno << ") (" << strerror(errno) << ")";
-        return -1;
-    }
-
     ++m_pendingEventCount;
-    fd_ctx->events = (Event)(fd_ctx->events | event);
+    fd_ctx->events.store((Event)(fd_ctx->events | event), std::memory_order_relaxed);
     /**
      * FdContext::EventContext& event_ctx = fd_ctx->getContext(event);
      * 这一行代码调用了 FdContext 对象的 getContext 方法，并将返回的 EventContext 对象的引用存储在 event_ctx 变量中。
@@ -174,73 +359,92 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
      * 而原来的 event_ctx.cb 值将存储在 cb 变量中。
      */
     if(cb) {
-        event_ctx.cb.swap(cb);
+        event_ctx.cb = new std::function<void()>();
+        event_ctx.cb->swap(cb);
     } else {
         event_ctx.fiber = Fiber::GetThis();
         SYLAR_ASSERT(event_ctx.fiber->getState() == Fiber::EXEC);
     }
-    return 0;
+    if(fd_ctx->ready & event) { // 注册之前已经就绪过，不用等下一次边缘
+        fd_ctx->ready = (Event)(fd_ctx->ready & ~event);
+        fd_ctx->triggerEvent(event);
+        --m_pendingEventCount;
+    }
 }
 
 bool IOManager::delEvent(int fd, Event event) {
-    RWMutexType::ReadLock lock(m_mutex);
-    if((int)m_fdContexts.size() <= fd) {
+    FdContext* fd_ctx = getFdContext(fd, false);
+    if(!fd_ctx) {
         return false;
     }
-    FdContext* fd_ctx = m_fdContexts[fd];
-    lock.unlock();
 
+    Mutex::Lock ctl_lock(getCtlMutex(fd));
     FdContext::MutexType::Lock lock2(fd_ctx->mutex);
     if(!(fd_ctx->events & event)) { // 没有这个事件
         return false;
     }
 
     Event new_events = (Event)(fd_ctx->events & ~event);    // 事件与运算，去掉事件
-    int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-    epoll_event epevent;
-    epevent.events = EPOLLET | new_events;
-    epevent.data.ptr = fd_ctx;
+    if(!m_persistentEt) {
+        int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+        epoll_event epevent;
+        epevent.events = EPOLLET | new_events;
+        epevent.data.ptr = fd_ctx;
 
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if(rt) {
-        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                                  << op << "," << fd << "," << epevent.events << "):"
-                                  << rt << " (" << errno << ") (" << strerror(errno) << ")";
-        return false;
+        int epfd = m_reactors[fd_ctx->reactor]->epfd;
+        lock2.unlock();
+        int rt = epoll_ctl(epfd, op, fd, &epevent);
+        if(rt) {
+            SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", "
+                                      << op << "," << fd << "," << epevent.events << "):"
+                                      << rt << " (" << errno << ") (" << strerror(errno) << ")";
+            return false;
+        }
+        lock2.lock();
+        if(op == EPOLL_CTL_DEL && m_reactors.size() == 1) {  // 已经不在 epoll 里了，见 cancelAll
+            fd_ctx->reactor.store(-1, std::memory_order_relaxed);
+        }
     }
 
     --m_pendingEventCount;
-    fd_ctx->events = new_events;
+    fd_ctx->events.store(new_events, std::memory_order_relaxed);
     FdContext::EventContext& event_ctx = fd_ctx->getContext(event);
     fd_ctx->resetContext(event_ctx);
     return true;
 }
 
 bool IOManager::cancelEvent(int fd, Event event) {
-    RWMutexType::ReadLock lock(m_mutex);
-    if((int)m_fdContexts.size() <= fd) {
+    FdContext* fd_ctx = getFdContext(fd, false);
+    if(!fd_ctx) {
         return false;
     }
-    FdContext* fd_ctx = m_fdContexts[fd];
-    lock.unlock();
 
+    Mutex::Lock ctl_lock(getCtlMutex(fd));
     FdContext::MutexType::Lock lock2(fd_ctx->mutex);
     if(!(fd_ctx->events & event)) {
         return false;
     }
 
     Event new_events = (Event)(fd_ctx->events & ~event);
-    int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-    epoll_event epevent;
-    epevent.events = EPOLLET | new_events;
-    epevent.data.ptr = fd_ctx;
+    if(!m_persistentEt) {
+        int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+        epoll_event epevent;
+        epevent.events = EPOLLET | new_events;
+        epevent.data.ptr = fd_ctx;
 
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if(rt) {
-        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                                  << op << "," << fd << "," << epevent.events << "):"
-                                  << rt << " (" << errno << ") (" << strerror(errno) << ")";
-        return false;
+        int epfd = m_reactors[fd_ctx->reactor]->epfd;
+        lock2.unlock();
+        int rt = epoll_ctl(epfd, op, fd, &epevent);
+        if(rt) {
+            SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", "
+                                      << op << "," << fd << "," << epevent.events << "):"
+                                      << rt << " (" << errno << ") (" << strerror(errno) << ")";
+            return false;
+        }
+        lock2.lock();
+        if(op == EPOLL_CTL_DEL && m_reactors.size() == 1) {  // 已经不在 epoll 里了，见 cancelAll
+            fd_ctx->reactor.store(-1, std::memory_order_relaxed);
+        }
     }
 
     fd_ctx->triggerEvent(event);
@@ -249,26 +453,47 @@ bool IOManager::cancelEvent(int fd, Event event) {
 }
 
 bool IOManager::cancelAll(int fd) {
-    RWMutexType::ReadLock lock(m_mutex);
-    if((int)m_fdContexts.size() <= fd) {
+    if(m_uring && m_uringInflight.load(std::memory_order_relaxed)) {
+        uringCancel(fd);
+    }
+    FdContext* fd_ctx = getFdContext(fd, false);
+    if(!fd_ctx) {
         return false;
     }
-    FdContext* fd_ctx = m_fdContexts[fd];
-    lock.unlock();
-
-    FdContext::MutexType::Lock lock2(fd_ctx->mutex);
-    if(!fd_ctx->events) {
+    // 第一段是预先分配的，没用过的 fd 也有上下文。OnFdClose 对每个 IOManager、每次 close 都会进来，
+    // 什么都没挂的直接返回，不去碰锁。fd 关闭和在这个 fd 上加事件本来就不能并发，不加锁读也不会漏
+    // 只有一个 reactor 的时候没有线程亲和可言，普通模式下事件删光就重置 reactor，用过的 fd 也能走这里；
+    // 多 reactor 的时候 fd 一直固定在分配到的线程上，直到 close
+    if(fd_ctx->events.load(std::memory_order_relaxed) == NONE
+       && !fd_ctx->registered.load(std::memory_order_relaxed)
+       && fd_ctx->reactor.load(std::memory_order_relaxed) < 0) {
         return false;
     }
 
+    Mutex::Lock ctl_lock(getCtlMutex(fd));
+    FdContext::MutexType::Lock lock2(fd_ctx->mutex);
+    // 常驻注册模式下注册过的（fd 要关了，号码会被复用，下次 addEvent 重新注册），普通模式下还有事件的，从 epoll 里删掉
+    bool del = m_persistentEt ? fd_ctx->registered.load() : fd_ctx->events != NONE;
+    int rt = 0;
     int op = EPOLL_CTL_DEL;
     epoll_event epevent;
     epevent.events = 0;
     epevent.data.ptr = fd_ctx;
-
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if(rt) {
-        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+    int epfd = -1;
+    if(del) {
+        epfd = m_reactors[fd_ctx->reactor]->epfd;
+        lock2.unlock();
+        rt = epoll_ctl(epfd, op, fd, &epevent);
+        lock2.lock();
+    }
+    fd_ctx->ready = NONE;   // 删掉之前 idle 可能又记了就绪
+    fd_ctx->registered.store(false, std::memory_order_relaxed);
+    fd_ctx->reactor.store(-1, std::memory_order_relaxed);   // fd 号复用的时候重新分配
+    if(!fd_ctx->events) {
+        return false;
+    }
+    if(rt && !m_persistentEt) {
+        SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", "
                                   << op << "," << fd << "," << epevent.events << "):"
                                   << rt << " (" << errno << ") (" << strerror(errno) << ")";
         return false;
@@ -287,6 +512,412 @@ bool IOManager::cancelAll(int fd) {
     return true;
 }
 
+RWMutex& IOManager::GetInstancesMutex() {
+    static RWMutex s_mutex;
+    return s_mutex;
+}
+
+std::vector<IOManager*>& IOManager::GetInstances() {
+    static std::vector<IOManager*> s_instances;
+    return s_instances;
+}
+
+void IOManager::OnFdClose(int fd) {
+    RWMutex::ReadLock lock(GetInstancesMutex());
+    for(auto iom : GetInstances()) {    // 在这个 IOManager 上什么都没挂的，cancelAll 不加锁直接返回
+        iom->cancelAll(fd);
+    }
+}
+
+bool IOManager::bindFd(int fd, size_t reactor) {
+    FdContext* fd_ctx = getFdContext(fd, true);
+    if(!fd_ctx || reactor >= m_reactors.size()) {
+        return false;
+    }
+    Mutex::Lock ctl_lock(getCtlMutex(fd));
+    FdContext::MutexType::Lock lock(fd_ctx->mutex);
+    if(fd_ctx->events || fd_ctx->registered) {  // 已经在别的 epoll 里了
+        return false;
+    }
+    fd_ctx->reactor.store(reactor, std::memory_order_relaxed);
+    return true;
+}
+
+int IOManager::getCurrentReactor() const {
+    return t_wheel_owner == this ? t_reactor : -1;
+}
+
+int IOManager::assignReactor(int fd) {
+    if(m_reactors.size() == 1) {
+        return 0;
+    }
+    if(m_assign == HASH) {
+        return fd % m_reactors.size();
+    }
+    if(m_assign == CALLER && t_wheel_owner == this && t_reactor >= 0) {
+        return t_reactor;
+    }
+    return m_reactorNext++ % m_reactors.size();
+}
+
+int IOManager::claimReactor() {
+    if(m_reactors.size() == 1 || sylar::GetThreadId() == m_rootThread) {
+        return 0;   // 共用一个，或者 use_caller 的线程在 stop 的时候帮 0 号收事件
+    }
+    int idx = m_reactorClaim++ % m_reactors.size();
+    m_reactors[idx]->thread = sylar::GetThreadId();
+    return idx;
+}
+
+bool IOManager::consumeReady(int fd, Event event) {
+    FdContext* fd_ctx = getFdContext(fd, false);
+    if(!fd_ctx) {
+        return false;
+    }
+
+    FdContext::MutexType::Lock lock2(fd_ctx->mutex);
+    if(!(fd_ctx->ready & event)) {
+        return false;
+    }
+    fd_ctx->ready = (Event)(fd_ctx->ready & ~event);
+    return true;
+}
+
+int IOManager::waitEvent(int fd, Event event, uint64_t timeout_ms) {
+    if(m_persistentEt && consumeReady(fd, event)) { // 已经就绪过了，不用让出协程
+        return 0;
+    }
+    std::shared_ptr<int> cancelled(new int(0));  // 超时的时候记录错误码
+    TimingWheel::Timer::ptr timer;
+    if(timeout_ms != ~0ull) {   // IO 超时大多会在到期之前被取消，放在时间轮上
+        std::weak_ptr<int> weak_cancelled(cancelled);
+        timer = addWheelTimer(timeout_ms, [weak_cancelled, fd, event, this](){
+            auto t = weak_cancelled.lock();
+            if(!t || *t) {
+                return;
+            }
+            *t = ETIMEDOUT;
+            cancelEvent(fd, event); // 强制触发事件，把等待的协程唤醒
+        });
+    }
+
+    if(addEvent(fd, event)) {
+        if(timer) {
+            timer->cancel();
+        }
+        return -1;
+    }
+    Fiber::YieldToHold();
+    if(timer) {
+        timer->cancel();
+    }
+    if(*cancelled) {
+        errno = *cancelled;
+        return -1;
+    }
+    return 0;
+}
+
+#ifndef IORING_ASYNC_CANCEL_FD  // 老的内核头文件没有按 fd 取消
+#define IORING_ASYNC_CANCEL_ALL (1U << 0)
+#define IORING_ASYNC_CANCEL_FD  (1U << 1)
+#endif
+
+namespace {
+
+struct UringWaiter {    // 放在等待协程的栈上，完成之前协程不会返回
+    Scheduler* scheduler = nullptr;
+    Fiber::ptr fiber;
+    int res = 0;
+};
+
+}
+
+static ssize_t UringResult(int res) {
+    if(res < 0) {
+        errno = -res;
+        return -1;
+    }
+    return res;
+}
+
+template<typename OriginFun, typename... Args>
+static ssize_t EpollIO(IOManager* iom, int fd, IOManager::Event event, uint64_t timeout_ms,
+                       OriginFun fun, Args&&... args) {
+    while(true) {
+        ssize_t n = fun(fd, std::forward<Args>(args)...);
+        while(n == -1 && errno == EINTR) {
+            n = fun(fd, std::forward<Args>(args)...);
+        }
+        if(n == -1 && errno == EAGAIN) {
+            if(iom->waitEvent(fd, event, timeout_ms)) {
+                return -1;
+            }
+            continue;
+        }
+        return n;
+    }
+}
+
+int IOManager::uringSubmit(io_uring_sqe &sqe, uint64_t timeout_ms) {
+    UringWaiter waiter;
+    uint64_t deadline = timeout_ms == ~0ull ? ~0ull : GetMonotonicUS() + timeout_ms * 1000;
+    waiter.scheduler = Scheduler::GetThis();
+    waiter.fiber = Fiber::GetThis();
+    sqe.user_data = (uint64_t)&waiter;
+
+    io_uring_sqe sqes[2];
+    sqes[0] = sqe;
+    size_t n = 1;
+    __kernel_timespec ts;   // 内核在提交的时候读取，协程挂起期间一直有效
+    if(timeout_ms != ~0ull) {   // 链接一个超时，到期由内核取消前面的操作，结果为 -ECANCELED
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = timeout_ms % 1000 * 1000000;
+        sqes[0].flags |= IOSQE_IO_LINK;
+        memset(&sqes[1], 0, sizeof(io_uring_sqe));
+        sqes[1].opcode = IORING_OP_LINK_TIMEOUT;
+        sqes[1].fd = -1;
+        sqes[1].addr = (uint64_t)&ts;
+        sqes[1].len = 1;
+        sqes[1].user_data = 0;
+        n = 2;
+    }
+
+    // 先计数再入队：别的线程可能马上提交并收割到完成事件，那时计数必须已经加上
+    ++m_pendingEventCount;
+    ++m_uringInflight;
+    bool first = false;
+    while(!m_uring->push(sqes, n, first)) { // 提交队列满了，先把攒着的提交掉
+        if(m_uring->submit() <= 0) {
+            --m_pendingEventCount;
+            --m_uringInflight;
+            return -EAGAIN; // 内核那边也满了，调用方退回 epoll
+        }
+    }
+    // 攒着的 sqe 由 idle 在 epoll_wait 之前提交。没有空闲线程的时候忙的线程要做完手上的事情才回到 idle，
+    // 不能让第一个 sqe 一直等下去，直接提交
+    if(m_uring->getUnsubmitted() >= g_iomanager_io_uring_batch->getValue() || (first && !hasIdleThreads())) {
+        m_uring->submit();
+    } else if(first) {  // 叫醒一个空闲线程来提交
+        tickle();
+    }
+
+    Fiber::YieldToHold();
+    // 链接的超时到期和 cancelAll 取消的结果都是 -ECANCELED，过了期限的算超时
+    if(waiter.res == -ECANCELED && deadline != ~0ull && GetMonotonicUS() >= deadline) {
+        return -ETIMEDOUT;
+    }
+    return waiter.res;
+}
+
+void IOManager::uringCancel(int fd) {
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_ASYNC_CANCEL;
+    sqe.fd = fd;
+    sqe.cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe.user_data = 0;  // 自己的完成事件和链接的超时一样跳过；老内核不支持按 fd 取消，返回 -EINVAL
+    bool first = false;
+    while(!m_uring->push(&sqe, 1, first)) {
+        if(m_uring->submit() <= 0) {
+            return;
+        }
+    }
+    m_uring->submit();  // 内核在提交的时候按 fd 找文件，fd 关掉之后就找不到了
+}
+
+int IOManager::submitUring(io_uring_sqe &sqe, uint64_t timeout_ms) {
+    if(!m_uring) {
+        return -ENOSYS;
+    }
+    return uringSubmit(sqe, timeout_ms);
+}
+
+void IOManager::reapUring(std::vector<io_uring_cqe> &cqes, EventBatch &batch) {
+    m_uring->reap(cqes);
+    for(auto &cqe : cqes) {
+        if(!cqe.user_data) {    // 链接的超时自己的完成事件
+            continue;
+        }
+        UringWaiter* waiter = (UringWaiter*)cqe.user_data;
+        waiter->res = cqe.res;
+        if(waiter->scheduler == this) { // 之后协程随时可能返回，waiter 不能再碰
+            batch.fibers.push_back(std::move(waiter->fiber));
+        } else {
+            waiter->scheduler->schedule(&waiter->fiber);
+        }
+        --m_pendingEventCount;
+        --m_uringInflight;
+    }
+    cqes.clear();
+}
+
+ssize_t IOManager::asyncRead(int fd, void *buf, size_t count, uint64_t timeout_ms) {
+    if(m_uring) {
+        io_uring_sqe sqe;
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = fd;
+        sqe.addr = (uint64_t)buf;
+        sqe.len = count;
+        sqe.off = (uint64_t)-1; // 当前偏移
+        int res = uringSubmit(sqe, timeout_ms);
+        if(res != -EAGAIN) {    // 老内核对非阻塞 fd 可能直接返回 EAGAIN，交给 epoll
+            return UringResult(res);
+        }
+    }
+    return EpollIO(this, fd, READ, timeout_ms, read_f, buf, count);
+}
+
+ssize_t IOManager::asyncReadv(int fd, const iovec *iov, int iovcnt, uint64_t timeout_ms) {
+    if(m_uring) {
+        io_uring_sqe sqe;
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READV;
+        sqe.fd = fd;
+        sqe.addr = (uint64_t)iov;
+        sqe.len = iovcnt;
+        sqe.off = (uint64_t)-1;
+        int res = uringSubmit(sqe, timeout_ms);
+        if(res != -EAGAIN) {
+            return UringResult(res);
+        }
+    }
+    return EpollIO(this, fd, READ, timeout_ms, readv_f, iov, iovcnt);
+}
+
+ssize_t IOManager::asyncWrite(int fd, const void *buf, size_t count, uint64_t timeout_ms) {
+    if(m_uring) {
+        io_uring_sqe sqe;
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_WRITE;
+        sqe.fd = fd;
+        sqe.addr = (uint64_t)buf;
+        sqe.len = count;
+        sqe.off = (uint64_t)-1;
+        int res = uringSubmit(sqe, timeout_ms);
+        if(res != -EAGAIN) {
+            return UringResult(res);
+        }
+    }
+    return EpollIO(this, fd, WRITE, timeout_ms, write_f, buf, count);
+}
+
+ssize_t IOManager::asyncWritev(int fd, const iovec *iov, int iovcnt, uint64_t timeout_ms) {
+    if(m_uring) {
+        io_uring_sqe sqe;
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_WRITEV;
+        sqe.fd = fd;
+        sqe.addr = (uint64_t)iov;
+        sqe.len = iovcnt;
+        sqe.off = (uint64_t)-1;
+        int res = uringSubmit(sqe, timeout_ms);
+        if(res != -EAGAIN) {
+            return UringResult(res);
+        }
+    }
+    return EpollIO(this, fd, WRITE, timeout_ms, writev_f, iov, iovcnt);
+}
+
+int IOManager::asyncAccept(int fd, sockaddr *addr, socklen_t *addrlen, int flags, uint64_t timeout_ms) {
+    if(m_uring) {
+        io_uring_sqe sqe;
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_ACCEPT;
+        sqe.fd = fd;
+        sqe.addr = (uint64_t)addr;
+        sqe.addr2 = (uint64_t)addrlen;
+        sqe.accept_flags = flags;
+        int res = uringSubmit(sqe, timeout_ms);
+        if(res != -EAGAIN) {
+            return (int)UringResult(res);
+        }
+    }
+    return (int)EpollIO(this, fd, READ, timeout_ms, ::accept4, addr, addrlen, flags);
+}
+
+int IOManager::asyncConnect(int fd, const sockaddr *addr, socklen_t addrlen, uint64_t timeout_ms) {
+    int n = -1;
+    if(m_uring) {
+        io_uring_sqe sqe;
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_CONNECT;
+        sqe.fd = fd;
+        sqe.addr = (uint64_t)addr;
+        sqe.off = addrlen;
+        int res = uringSubmit(sqe, timeout_ms);
+        if(res == -EINPROGRESS) {   // 老内核对非阻塞 socket 不会等连接完成
+            errno = EINPROGRESS;
+        } else if(res != -EAGAIN) {
+            return (int)UringResult(res);
+        } else {
+            n = connect_f(fd, addr, addrlen);
+        }
+    } else {
+        n = connect_f(fd, addr, addrlen);
+    }
+    if(n == 0 || errno != EINPROGRESS) {
+        return n;
+    }
+
+    if(waitEvent(fd, WRITE, timeout_ms)) {
+        return -1;
+    }
+    int error = 0;
+    socklen_t len = sizeof(int);
+    if(-1 == getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len)) {
+        return -1;
+    }
+    if(error) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+void IOManager::getWakeupHistogram(std::vector<uint64_t> &hist) const {
+    hist.resize(WAKEUP_BUCKETS);
+    for(size_t i = 0; i < WAKEUP_BUCKETS; ++i) {
+        hist[i] = m_wakeupHist[i];
+    }
+}
+
+std::string IOManager::dumpWakeupHistogram() const {
+    std::stringstream ss;
+    ss << "[IOManager name=" << getName() << " events per wakeup:";
+    for(size_t i = 0; i < WAKEUP_BUCKETS; ++i) {
+        if(i <= 1) {
+            ss << " " << i << "=";
+        } else if(i == WAKEUP_BUCKETS - 1) {
+            ss << " >=" << (1 << (i - 1)) << "=";
+        } else {
+            ss << " " << (1 << (i - 1)) << "~" << (1 << i) - 1 << "=";
+        }
+        ss << m_wakeupHist[i];
+    }
+    ss << "]";
+    return ss.str();
+}
+
+void IOManager::getBusyPollStats(BusyPollStats &stats) const {
+    stats.threads = m_busyPollClaim.load() < m_busyPollThreads ? m_busyPollClaim.load() : m_busyPollThreads;
+    stats.spin_us = m_busySpinUs;
+    stats.polls = m_busyPolls;
+    stats.hits = m_busyPollHits;
+    stats.misses = m_busyPollMisses;
+}
+
+std::string IOManager::dumpBusyPollStats() const {
+    BusyPollStats stats;
+    getBusyPollStats(stats);
+    std::stringstream ss;
+    ss << "[IOManager name=" << getName() << " busy poll threads=" << stats.threads
+       << " spin_us=" << stats.spin_us << " polls=" << stats.polls
+       << " hits=" << stats.hits << " misses=" << stats.misses << "]";
+    return ss.str();
+}
+
 IOManager* IOManager::GetThis() {
     /**
      * 这种转换是合理的，因为 IOManager 类继承自 Scheduler 类。
@@ -303,50 +934,227 @@ IOManager* IOManager::GetThis() {
 }
 
 void IOManager::tickle() {
-    if(hasIdleThreads()) {  // 如果有空闲线程，就不用唤醒，没有的话，就不用发送了，因为没有线程去接收
+    if(!hasIdleThreads()) {  // 没有空闲线程，就不用发送了，因为没有线程阻塞在 epoll_wait 上，忙的线程做完手上的事情会自己去取任务
+        return;
+    }
+    for(auto reactor : m_reactors) {    // 队列是共用的，不知道谁该醒，空闲的都叫一遍
+        if(reactor->idleCount > 0) {
+            wakeReactor(reactor);
+        }
+    }
+}
+
+void IOManager::wakeReactor(Reactor* reactor) {
+    if(reactor->wakePending.exchange(true)) {   // 上一次还没被读走，对方醒来之后会去看队列，不用再写
+        return;
+    }
+    uint64_t one = 1;
+    int rt = write(reactor->tickleFd, &one, sizeof(one));
+    SYLAR_ASSERT(rt == sizeof(one));
+}
+
+void IOManager::tickleThread(int thread) {
+    if(m_reactors.size() == 1) {
+        tickle();
         return;
     }
-    int rt = write(m_tickleFds[1], "T", 1); // 向管道写入一个字节
-    SYLAR_ASSERT(rt == 1);
+    for(auto reactor : m_reactors) {    // 只叫醒负责它的 reactor，它在忙就不用叫，忙完自己会来取
+        if(reactor->thread == thread) {
+            if(reactor->idleCount > 0) {
+                wakeReactor(reactor);
+            }
+            return;
+        }
+    }
+    tickle();   // 不是工作线程，比如 use_caller 的线程
 }
 
 bool IOManager::stopping() {
-    return Scheduler::stopping()
-           && m_pendingEventCount == 0;
+    uint64_t timeout = 0;
+    return stopping(timeout);
+}
+
+bool IOManager::stopping(uint64_t &timeout) {
+    timeout = getNextTimer();
+    return timeout == ~0ull // 还有定时器没执行，不能退出
+           && m_pendingEventCount == 0
+           && !hasWheelTimer()
+           && Scheduler::stopping();
+}
+
+TimingWheel::Timer::ptr IOManager::addWheelTimer(uint64_t ms, std::function<void()> cb,
+                                                 bool recurring) {
+    if(t_wheel && t_wheel_owner == this) {  // 自己线程的时间轮，当前线程忙完进 idle 的时候会重新计算超时
+        return t_wheel->addTimer(ms, cb, recurring);
+    }
+    uint64_t now_ms = sylar::GetMonotonicMS();
+    bool earlier = m_sharedWheel.getNextTimeout(now_ms) > ms;
+    TimingWheel::Timer::ptr timer = m_sharedWheel.addTimer(ms, cb, recurring);
+    if(earlier) {   // 比共享时间轮上原来最早的还早，唤醒一个 idle 线程重新计算超时
+        tickle();
+    }
+    return timer;
+}
+
+bool IOManager::hasWheelTimer() {
+    if(m_sharedWheel.size()) {
+        return true;
+    }
+    Mutex::Lock lock(m_wheelMutex);
+    for(auto &i : m_wheels) {
+        if(i->size()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t IOManager::advanceWheels(TimingWheel *local, std::vector<std::function<void()> > &cbs) {
+    uint64_t now_ms = sylar::GetMonotonicMS();
+    local->advance(now_ms, cbs);
+    m_sharedWheel.advance(now_ms, cbs);
+    return std::min(local->getNextTimeout(now_ms), m_sharedWheel.getNextTimeout(now_ms));
+}
+
+void IOManager::onTimerInsertedAtFront() {
+    tickle();   // 唤醒 epoll_wait，按新的超时时间重新等待
 }
 
 void IOManager::idle() {
-    epoll_event* events = new epoll_event[64]();    // 协程，不在栈上分配大数组
-    std::shared_ptr<epoll_event> shared_events(events, [](epoll_event* ptr){
-        delete[] ptr;
-    });
+    /**
+     * 协程，不在栈上分配大数组。每个线程自己调整一次取多少个事件：
+     * 取满了说明还有没取到的，翻倍；连续多次不到四分之一，减半
+     */
+    size_t max_events = m_minEpollEvents;
+    size_t sparse_count = 0;
+    std::vector<epoll_event> events(max_events);
 
+    t_wheel = new TimingWheel;  // 当前线程的时间轮，idle 退出的时候清空，IOManager 析构的时候释放
+    t_wheel_owner = this;
+    {
+        Mutex::Lock lock(m_wheelMutex);
+        m_wheels.push_back(t_wheel);
+        m_ownedWheels.emplace_back(t_wheel);
+    }
+    t_reactor = claimReactor();
+    Reactor* reactor = m_reactors[t_reactor];
+    bool multi_reactor = m_reactors.size() > 1;
+    bool busy_poll = false;     // 前 iomanager.busy_poll.threads 个工作线程自旋，其它线程照常阻塞
+    if(m_busyPollThreads && m_busyPollSpinUs && sylar::GetThreadId() != m_rootThread) {
+        busy_poll = m_busyPollClaim++ < m_busyPollThreads;
+    }
+
+    EventBatch batch;
+    std::vector<io_uring_cqe> cqes;
     while(true) {
-        if(stopping()) {
+        uint64_t next_timeout = 0;
+        if(stopping(next_timeout)) {
             SYLAR_LOG_INFO(g_logger) << "name=" << getName() << " idle stopping exit";
+            tickle();   // 唤醒合并了，stop 的多次 tickle 可能只叫醒一个线程，一个接一个传下去
             break;
         }
 
+        uint64_t wheel_timeout = advanceWheels(t_wheel, batch.cbs);    // 醒来的时候已经到期的先放进队列
+        if(!batch.cbs.empty()) {
+            schedule(batch.fibers, batch.cbs);
+            wheel_timeout = 0;  // 有活干了，不阻塞，只收一下已经就绪的事件
+        }
+        next_timeout = std::min(next_timeout, wheel_timeout);
+
+        if(m_uring) {   // 攒着的 sqe 在睡下去之前一次提交
+            m_uring->submit();
+        }
+
         int rt = 0;
-        do {
+        if(busy_poll && next_timeout) {
+            /**
+             * 先用 epoll_wait(0) 自旋一段时间，事件来了不用经过睡眠、唤醒，省掉调度延迟；
+             * 代价是自旋期间一直占着 CPU，花掉的时间记在 m_busySpinUs 里。
+             * 自旋期间也算空闲线程，tickle 照样能叫醒
+             */
+            uint64_t budget = std::min((uint64_t)m_busyPollSpinUs,
+                                       next_timeout == ~0ull ? ~(uint64_t)0 : next_timeout * 1000);
+            uint64_t start = sylar::GetMonotonicUS();
+            uint64_t elapse = 0;
+            uint64_t polls = 0;
+            ++reactor->idleCount;
+            do {
+                rt = epoll_wait(reactor->epfd, &events[0], max_events, 0);
+                ++polls;
+                if(rt < 0 && errno == EINTR) {
+                    rt = 0;
+                }
+                elapse = sylar::GetMonotonicUS() - start;
+            } while(rt == 0 && elapse < budget);
+            --reactor->idleCount;
+            m_busySpinUs += elapse;
+            m_busyPolls += polls;
+            if(rt > 0) {
+                ++m_busyPollHits;
+            } else {
+                ++m_busyPollMisses;     // 预算花完了，退回阻塞
+                if(next_timeout != ~0ull) {
+                    next_timeout = next_timeout > elapse / 1000 ? next_timeout - elapse / 1000 : 0;
+                }
+            }
+        }
+        while(rt == 0) {    // 自旋已经收到事件的时候不再阻塞
             static const int MAX_TIMEOUT = 5000;    // ms 级
-            rt = epoll_wait(m_epfd, events, 64, MAX_TIMEOUT);
+            if(next_timeout != ~0ull) { // 最近的定时器决定等多久
+                next_timeout = next_timeout > (uint64_t)MAX_TIMEOUT
+                               ? MAX_TIMEOUT : next_timeout;
+            } else {
+                next_timeout = MAX_TIMEOUT;
+            }
+            ++reactor->idleCount;
+            rt = epoll_wait(reactor->epfd, &events[0], max_events, (int)next_timeout);
+            --reactor->idleCount;
             if(rt < 0 && errno == EINTR) {
+                rt = 0;
             } else {
                 break;
             }
-        } while(true);
+        }
+
+        if(rt >= 0) {
+            ++m_wakeupHist[std::min((size_t)(rt ? 64 - __builtin_clzll(rt) : 0), WAKEUP_BUCKETS - 1)];
+            if((size_t)rt == max_events && max_events < m_maxEpollEvents) {
+                max_events = std::min(max_events * 2, m_maxEpollEvents);
+                events.resize(max_events);  // 已经取到的事件会保留下来
+                sparse_count = 0;
+            } else if((size_t)rt < max_events / 4 && max_events > m_minEpollEvents) {
+                if(++sparse_count >= 16) {
+                    max_events = std::max(max_events / 2, m_minEpollEvents);
+                    sparse_count = 0;
+                }
+            } else {
+                sparse_count = 0;
+            }
+        }
+
+        listExpiredCb(batch.cbs);   // 到期的定时器和就绪的事件一起，最后一次性放进队列
+        advanceWheels(t_wheel, batch.cbs);
 
         for(int i = 0; i < rt; ++i) {
             epoll_event& event = events[i];
-            if(event.data.fd == m_tickleFds[0]) {   // 外部有发消息过来，被唤醒了
-                uint8_t dummy;
-                while(read(m_tickleFds[0], &dummy, 1) == 1);    // 读完所有的数据，读干净
+            if(event.data.fd == reactor->tickleFd) {    // 外部有发消息过来，被唤醒了
+                /**
+                 * eventfd 一次读走整个计数器。先读再清标记：
+                 * 反过来的话，中间写进来的那次会被这次读走，标记却一直留着，之后的 tickle 全被跳过
+                 */
+                uint64_t dummy;
+                while(read(reactor->tickleFd, &dummy, sizeof(dummy)) < 0 && errno == EINTR);
+                reactor->wakePending = false;
+                continue;
+            }
+            if(m_uring && event.data.fd == m_uring->getEventFd()) {    // io_uring 有操作完成了
+                uint64_t dummy;
+                while(read(m_uring->getEventFd(), &dummy, sizeof(dummy)) < 0 && errno == EINTR);
+                reapUring(cqes, batch);
                 continue;
             }
 
             FdContext* fd_ctx = (FdContext*)event.data.ptr;
-            FdContext::MutexType::Lock lock(fd_ctx->mutex);
             /**
              * 在循环的每次迭代中，该方法检查 epoll_event 对象的 events 字段是否包含 EPOLLERR 或 EPOLLHUP 标志。
              * 如果是，则将 EPOLLIN 和 EPOLLOUT 标志添加到 events 字段中。
@@ -359,38 +1167,48 @@ void IOManager::idle() {
                 event.events |= EPOLLIN | EPOLLOUT;
             }
             int real_events = NONE;
-            if(event.events & EPOLLIN) {
+            if(event.events & (EPOLLIN | EPOLLRDHUP)) {
                 real_events |= READ;
             }
             if(event.events & EPOLLOUT) {
                 real_events |= WRITE;
             }
 
-            if((fd_ctx->events & real_events) == NONE) {
+            if(m_persistentEt) {    // 注册一直保留，没人等的就绪记下来，等的人来了直接返回；没有系统调用，只拿自旋锁
+                FdContext::MutexType::Lock lock(fd_ctx->mutex);
+                fd_ctx->ready = (Event)(fd_ctx->ready | (real_events & ~fd_ctx->events));
+                triggerReady(fd_ctx, real_events & fd_ctx->events, batch);
+                continue;
+            }
+
+            // 触发之后要 epoll_ctl 改注册，和 addEvent 一样先拿 ctl 锁排队，系统调用的时候不拿自旋锁
+            Mutex::Lock ctl_lock(getCtlMutex(fd_ctx->fd));
+            FdContext::MutexType::Lock lock(fd_ctx->mutex);
+            real_events &= fd_ctx->events;  // EPOLLERR/EPOLLHUP 会带上没有注册的方向
+            if(real_events == NONE) {
                 continue;
             }
 
             int left_events = (fd_ctx->events & ~real_events);  // 剩下的事件
             int op = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
             event.events = EPOLLET | left_events;
+            lock.unlock();
 
-            int rt2 = epoll_ctl(m_epfd, op, fd_ctx->fd, &event);
+            int rt2 = epoll_ctl(reactor->epfd, op, fd_ctx->fd, &event);
             if(rt2) {
-                SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+                SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << reactor->epfd << ", "
                                           << op << "," << fd_ctx->fd << "," << event.events << "):"
                                           << rt2 << " (" << errno << ") (" << strerror(errno) << ")";
                 continue;
             }
-
-            if(real_events & READ) {
-                fd_ctx->triggerEvent(READ);
-                --m_pendingEventCount;
-            }
-            if(real_events & WRITE) {
-                fd_ctx->triggerEvent(WRITE);
-                --m_pendingEventCount;
+            lock.lock();
+            if(op == EPOLL_CTL_DEL && m_reactors.size() == 1) {
+                fd_ctx->reactor.store(-1, std::memory_order_relaxed);
             }
+            triggerReady(fd_ctx, real_events, batch);
         }
+        // 一次加锁，最多唤醒一次；多 reactor 模式下固定在当前线程上执行，缓存是热的
+        schedule(batch.fibers, batch.cbs, multi_reactor ? sylar::GetThreadId() : -1);
 
         Fiber::ptr cur = Fiber::GetThis();
         auto raw_ptr = cur.get();
@@ -398,6 +1216,15 @@ void IOManager::idle() {
 
         raw_ptr->swapOut(); // 交出执行权
     }
+
+    {
+        Mutex::Lock lock(m_wheelMutex);
+        m_wheels.erase(std::find(m_wheels.begin(), m_wheels.end(), t_wheel));
+    }
+    t_wheel->clear();
+    t_wheel = nullptr;
+    t_wheel_owner = nullptr;
+    t_reactor = -1;
 }
 
 }
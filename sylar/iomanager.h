@@ -12,38 +12,83 @@
 #define SYLAR_IOMANAGER_H
 
 #include "scheduler.h"
+#include "timer.h"
+#include "timing_wheel.h"
+#include "io_uring.h"
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 namespace sylar {
 
-class IOManager : public Scheduler {
+class IOManager : public Scheduler, public TimerManager {
 public:
     typedef std::shared_ptr<IOManager> ptr;
-    typedef RWMutex RWMutexType;
 
     enum Event {
         NONE    = 0x0,
         READ    = 0x1, //EPOLLIN
         WRITE   = 0x4, //EPOLLOUT
     };
+    enum ReactorAssign {
+        ROUND_ROBIN = 0,    // 依次分给各个 reactor
+        HASH        = 1,    // fd % reactor 数量
+        CALLER      = 2,    // 注册事件的线程自己的 reactor，不是本 IOManager 的线程时退化为轮询
+    };
 private:
-    struct FdContext {  // 针对事件的上下文，针对 epoll 是 fd 操作
-        typedef Mutex MutexType;
+    /**
+     * @brief 一个 epoll 实例和它的唤醒 eventfd
+     * 默认所有线程共用一个；多 reactor 模式下每个工作线程一个，fd 第一次注册的时候分配，
+     * 就绪的协程固定回到该 reactor 的线程上执行
+     */
+    struct Reactor {
+        int epfd = -1;
+        int tickleFd = -1;
+        std::atomic<bool> wakePending = {false};    // 已经写过 eventfd 还没被读走，再 tickle 不用写
+        std::atomic<int> idleCount = {0};   // 阻塞在 epoll_wait 上的线程数
+        std::atomic<int> thread = {-1};     // 多 reactor 模式下负责它的线程
+    };
+
+    struct EventBatch {     // 一次 epoll_wait 唤醒的协程、回调和到期的定时器，攒起来一次放进队列
+        std::vector<Fiber::ptr> fibers;
+        std::vector<std::function<void()> > cbs;
+    };
+
+    /**
+     * @brief 针对事件的上下文，针对 epoll 是 fd 操作
+     * 按段整块分配、按缓存行对齐，锁、fd、事件状态和读事件在第一个缓存行里
+     */
+    struct alignas(64) FdContext {
+        typedef Spinlock MutexType;     // 只保护下面几条赋值，系统调用在 IOManager::getCtlMutex 里做
         struct EventContext {   // 每种事件有相应的实例，多线程，多协程，多个协程调度器
-            Scheduler* scheduler = nullptr; //事件执行的scheduler
-            Fiber::ptr fiber;               //事件协程
-            std::function<void()> cb;       //事件的回调函数
+            Scheduler* scheduler = nullptr;     //事件执行的scheduler
+            Fiber::ptr fiber;                   //事件协程
+            std::function<void()>* cb = nullptr;    //事件的回调函数，只有用回调的时候才分配
+
+            EventContext() = default;
+            EventContext(const EventContext&) = delete;
+            EventContext& operator=(const EventContext&) = delete;
+            ~EventContext() { delete cb; }
         };
 
         EventContext& getContext(Event event);
         void resetContext(EventContext& ctx);
-        void triggerEvent(Event event);
+        /**
+         * @brief 触发事件，batch 不为空且事件属于 batch_owner 时放进 batch，由调用方统一调度
+         */
+        void triggerEvent(Event event, Scheduler* batch_owner = nullptr, EventBatch* batch = nullptr);
 
+        MutexType mutex;
+        int fd = 0;             //事件关联的句柄
+        std::atomic<Event> events = {NONE};     //已经注册的事件
+        Event ready = NONE;     //常驻注册模式下，就绪了但还没人等的事件
         EventContext read;      //读事件
         EventContext write;     //写事件
-        int fd = 0;             //事件关联的句柄
-        Event events = NONE;    //已经注册的事件
-        MutexType mutex;
+        // 这两个和 events 在锁里写，cancelAll 不拿锁读，所以是原子的
+        std::atomic<bool> registered = {false}; //常驻注册模式下，是否已经加到 epoll 里
+        std::atomic<int> reactor = {-1};        //注册在哪个 reactor 上，-1 表示还没有分配
     };
+    static_assert(sizeof(void*) != 8 || sizeof(FdContext) <= 128,
+                  "FdContext should stay within two cache lines");
 
 public:
     IOManager(size_t threads = 1, bool use_caller = true, const std::string& name = "");
@@ -54,23 +99,175 @@ public:
     bool delEvent(int fd, Event event);
     bool cancelEvent(int fd, Event event);
 
-    bool cancelAll(int fd); // 取消所有事件
+    /**
+     * @brief 取消所有事件
+     * 常驻注册模式（iomanager.persistent_et）下同时把 fd 从 epoll 里删掉，关闭 fd 之前必须调用，
+     * 否则 fd 号被复用之后不会重新注册。close（hook 的）会通过 OnFdClose 调用
+     * 开启了 io_uring 的时候同时用 IORING_OP_ASYNC_CANCEL 按 fd 取消还在进行的操作（需要 5.19 以上的内核），
+     * 结果为 -1，errno 为 ECANCELED
+     */
+    bool cancelAll(int fd);
+
+    /**
+     * @brief fd 要关闭了，对所有活着的 IOManager 调用 cancelAll
+     * close 不管有没有开启 hook、在不在 IOManager 线程里都会调用；直接用 close_f 关闭的要自己先 cancelAll
+     */
+    static void OnFdClose(int fd);
+
+    /**
+     * @brief 在当前协程里等待 fd 上的事件，让出协程直到就绪或者超时
+     * @param[in] timeout_ms 超时时间(毫秒)，~0ull 表示不超时
+     * @return 0 就绪，-1 注册失败或者超时（超时 errno 为 ETIMEDOUT）
+     */
+    int waitEvent(int fd, Event event, uint64_t timeout_ms = ~0ull);
+
+    /**
+     * @brief 基于完成的 IO，当前协程让出直到操作完成或者超时，语义和对应的系统调用一样
+     * 开启了 io_uring（iomanager.io_uring）时一次提交直接拿到结果，不需要 epoll_ctl 和额外的读写；
+     * 内核不支持时退回 epoll：先直接调用，EAGAIN 再 waitEvent。走 epoll 的时候 fd 需要是非阻塞的
+     * @param[in] timeout_ms 超时时间(毫秒)，~0ull 表示不超时
+     * @return 失败返回 -1 并设置 errno，超时 errno 为 ETIMEDOUT
+     */
+    ssize_t asyncRead(int fd, void *buf, size_t count, uint64_t timeout_ms = ~0ull);
+    ssize_t asyncReadv(int fd, const iovec *iov, int iovcnt, uint64_t timeout_ms = ~0ull);
+    ssize_t asyncWrite(int fd, const void *buf, size_t count, uint64_t timeout_ms = ~0ull);
+    ssize_t asyncWritev(int fd, const iovec *iov, int iovcnt, uint64_t timeout_ms = ~0ull);
+    // 新连接默认非阻塞，这样退回 epoll 的时候也能继续用 async 系列
+    int asyncAccept(int fd, sockaddr *addr, socklen_t *addrlen,
+                    int flags = SOCK_NONBLOCK | SOCK_CLOEXEC, uint64_t timeout_ms = ~0ull);
+    int asyncConnect(int fd, const sockaddr *addr, socklen_t addrlen, uint64_t timeout_ms = ~0ull);
+
+    bool hasIOUring() const { return !!m_uring; }
+    /**
+     * @brief 提交一个 sqe，当前协程让出直到完成或者超时，用于上面没有封装的操作（带偏移的文件读写、fsync）
+     * @return cqe 的结果，失败是负的错误码；没有开启 io_uring 返回 -ENOSYS，队列满了返回 -EAGAIN
+     */
+    int submitUring(io_uring_sqe &sqe, uint64_t timeout_ms = ~0ull);
+
+    size_t getReactorCount() const { return m_reactors.size(); }
+    /**
+     * @brief 显式指定 fd 使用哪个 reactor，只能在 fd 上没有注册事件的时候调用
+     * 用于把连接交给特定的线程处理，其它时候由 iomanager.reactor.assign 决定
+     */
+    bool bindFd(int fd, size_t reactor);
+    /**
+     * @brief 当前线程负责的 reactor 下标，不是本 IOManager 的线程或者还没进过 idle 的时候返回 -1
+     * 和 bindFd 一起把 fd 固定在当前线程上
+     */
+    int getCurrentReactor() const;
+
+    static const size_t WAKEUP_BUCKETS = 12;    // 0, 1, 2~3, 4~7, ..., >=1024
+    /**
+     * @brief 每次 epoll_wait 返回的事件数分布，第 i 个桶是 [2^(i-1), 2^i)，第 0 个桶是 0
+     */
+    void getWakeupHistogram(std::vector<uint64_t> &hist) const;
+    std::string dumpWakeupHistogram() const;
+
+    /**
+     * @brief 忙轮询的统计，spin_us 是自旋花掉的 CPU 时间
+     * hits 是自旋期间等到了事件的次数，misses 是预算花完退回阻塞的次数
+     */
+    struct BusyPollStats {
+        uint64_t threads = 0;
+        uint64_t spin_us = 0;
+        uint64_t polls = 0;     // epoll_wait(0) 的次数
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+    void getBusyPollStats(BusyPollStats &stats) const;
+    std::string dumpBusyPollStats() const;
+
+    /**
+     * @brief 在时间轮上添加定时器，O(1) 添加、取消、刷新，适合大量会被取消、刷新的超时
+     * 在 IOManager 的线程里调用时放在当前线程自己的时间轮上，由该线程的 idle 推进；
+     * 其它线程调用时放在共享的时间轮上。
+     * 跨线程把定时器 reset 得更早，可能要等到所在线程下一次醒来才会触发
+     */
+    TimingWheel::Timer::ptr addWheelTimer(uint64_t ms, std::function<void()> cb,
+                                          bool recurring = false);
 
     static IOManager* GetThis();
 
 protected:
     void tickle() override;
+    void tickleThread(int thread) override;
+    void wakeReactor(Reactor* reactor);     // 写 eventfd 叫醒阻塞在该 reactor 上的线程
     bool stopping() override;
     void idle() override;
+    void onTimerInsertedAtFront() override;
+
+    bool stopping(uint64_t &timeout);   // 顺便返回最近的定时器超时时间
 
-    void contextResize(size_t size);
+    bool hasWheelTimer();
+    uint64_t advanceWheels(TimingWheel *local, std::vector<std::function<void()> > &cbs); // 推进时间轮，返回下一次需要推进的间隔
+
+    /**
+     * @brief 取 fd 的上下文，分段的两级表，段一旦分配就不再移动，查找只是原子读
+     * @param[in] auto_create 段还没分配的时候是否分配
+     * @return fd 非法或者没有分配时返回 nullptr
+     */
+    FdContext* getFdContext(int fd, bool auto_create);
+    Mutex& getCtlMutex(int fd) { return m_ctlMutexes[fd & (FD_CTL_LOCKS - 1)]; }
+    /**
+     * @brief 在 FdContext 上挂好事件，注册之前已经就绪的直接触发；调用的时候持有 fd_ctx->mutex
+     */
+    void attachEvent(FdContext* fd_ctx, Event event, std::function<void()>& cb);
+    void triggerReady(FdContext* fd_ctx, int events, EventBatch& batch);  // 触发 epoll 返回的事件，同上
+    static FdContext* AllocSegment(int base);
+    static void FreeSegment(FdContext* segment);
+    // 所有活着的 IOManager，OnFdClose 用
+    static RWMutex& GetInstancesMutex();
+    static std::vector<IOManager*>& GetInstances();
+
+    bool consumeReady(int fd, Event event); // 常驻注册模式下取走已经就绪的事件
+    int assignReactor(int fd);  // 按分配策略选一个 reactor
+    int claimReactor();         // idle 开始的时候认领当前线程的 reactor，返回下标
+
+    int uringSubmit(io_uring_sqe &sqe, uint64_t timeout_ms);   // 返回 cqe 的结果，失败是负的错误码
+    void uringCancel(int fd);   // 取消 fd 上还在进行的 io_uring 操作，马上提交
+    void reapUring(std::vector<io_uring_cqe> &cqes, EventBatch &batch);
 private:
-    int m_epfd = 0;
-    int m_tickleFds[2];
+    std::vector<Reactor*> m_reactors;
+    ReactorAssign m_assign = ROUND_ROBIN;
+    std::atomic<size_t> m_reactorClaim = {0};   // 工作线程依次认领 reactor
+    std::atomic<size_t> m_reactorNext = {0};    // 轮询分配
+    bool m_persistentEt = false;    // fd 只注册一次，读写、边缘触发一直保留
+    size_t m_minEpollEvents = 64;   // 每个线程 epoll_wait 一次最多取的事件数，在这两个之间自适应
+    size_t m_maxEpollEvents = 1024;
+    std::atomic<uint64_t> m_wakeupHist[WAKEUP_BUCKETS];
+
+    uint32_t m_busyPollThreads = 0;     // 忙轮询的工作线程数，0 表示不开启
+    uint32_t m_busyPollSpinUs = 0;      // 每次睡下去之前最多自旋多久
+    uint32_t m_busyPollSocketUs = 0;    // 注册 socket 时设置的 SO_BUSY_POLL
+    std::atomic<uint32_t> m_busyPollClaim = {0};
+    std::atomic<uint64_t> m_busySpinUs = {0};
+    std::atomic<uint64_t> m_busyPolls = {0};
+    std::atomic<uint64_t> m_busyPollHits = {0};
+    std::atomic<uint64_t> m_busyPollMisses = {0};
 
     std::atomic<size_t> m_pendingEventCount = {0};  // 正在等待的事件数量
-    RWMutexType m_mutex;
-    std::vector<FdContext*> m_fdContexts;
+    static const size_t FD_SEGMENT_BITS = 10;   // 每段 1024 个 fd
+    static const size_t FD_SEGMENT_SIZE = 1 << FD_SEGMENT_BITS;
+    static const size_t FD_MAX_SEGMENTS = 4096; // 最多 4M 个 fd
+    std::atomic<FdContext*> m_fdSegments[FD_MAX_SEGMENTS];  // 按需 CAS 分配，对齐的整块内存，析构的时候释放
+    /**
+     * 改内核里注册状态（epoll_ctl、setsockopt）的操作按 fd 散列到这些互斥锁上排队，系统调用的时候不拿 FdContext 的自旋锁，
+     * 别的线程最多睡在这里，不会空转。常驻注册模式下已经注册过的 addEvent 和 idle 不用拿
+     */
+    static const size_t FD_CTL_LOCKS = 256;
+    Mutex m_ctlMutexes[FD_CTL_LOCKS];
+
+    IOUring::ptr m_uring;   // 没开启或者内核不支持时为空
+    std::atomic<size_t> m_uringInflight = {0};  // 还没完成的 io_uring 操作数，为 0 的时候 cancelAll 不用提交取消
+
+    Mutex m_wheelMutex;
+    std::vector<TimingWheel*> m_wheels;     // 各个线程自己的时间轮，idle 退出的时候摘掉
+    /**
+     * 所有建过的时间轮，IOManager 析构的时候才释放：别的线程可能正拿着 Timer::m_wheel 去加锁取消、刷新，
+     * idle 退出的时候只清空定时器，不释放时间轮
+     */
+    std::vector<std::unique_ptr<TimingWheel> > m_ownedWheels;
+    TimingWheel m_sharedWheel;              // 非 IOManager 线程添加的定时器
 };
 
 }
@@ -12,6 +12,7 @@
 #include <functional>
 #include "log.h"
 #include "config.h"
+#include "file_io.h"
 
 namespace sylar {
 
@@ -371,16 +372,56 @@ FileLogAppender::FileLogAppender(const std::string &filename)
     }
 }
 
+FileLogAppender::~FileLogAppender() {
+    flush();
+}
+
+// 积压超过这么多的时候写文件的线程跟不上，log 的线程自己写，不再无限制地攒
+static const size_t s_file_log_max_buffer = 4 * 1024 * 1024;
+
 void FileLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
-    m_deleted = checkFileStatus();
+    if(level < m_level) {
+        return;
+    }
+    bool sync = level >= LogLevel::ERROR;
+    bool post = false;
+    {
+        MutexType::Lock lock(m_mutex);
+        m_buffer.append(m_formatter->format(logger, level, event));
+        if(m_buffer.size() >= s_file_log_max_buffer) {
+            sync = true;
+        } else if(!sync && !m_flushPending) {
+            m_flushPending = post = true;
+        }
+    }
+    if(post) {
+        FileLogAppender::ptr self = shared_from_this();
+        if(!AsyncFile::GetExecutor()->post([self]() { self->flush(); })) {   // 队列满了自己写
+            sync = true;
+        }
+    }
+    if(sync) {
+        flush();
+    }
+}
+
+void FileLogAppender::flush() {
+    FileMutexType::Lock lock(m_fileMutex);
+    m_deleted = pollFileStatus();
     uint64_t now = time(nullptr);   // 每秒打开一次、同时配合事件机制，每秒检查一次文件是否被删除
     if(m_last_time != now || m_deleted) {
         m_last_time = now;
-        reopen();
+        openFile();
     }
-    if(level >= m_level) {
-        MutexType::Lock lock(m_mutex);
-        m_filestream << m_formatter->format(logger, level, event);
+    std::string buffer;
+    {
+        MutexType::Lock lock2(m_mutex);
+        buffer.swap(m_buffer);
+        m_flushPending = false;
+    }
+    if(!buffer.empty()) {
+        m_filestream << buffer;
+        m_filestream.flush();
     }
 }
 
@@ -400,7 +441,11 @@ std::string FileLogAppender::toYamlString() {
 }
 
 bool FileLogAppender::checkFileStatus() {
-    MutexType::Lock lock(m_mutex);
+    FileMutexType::Lock lock(m_fileMutex);
+    return pollFileStatus();
+}
+
+bool FileLogAppender::pollFileStatus() {
 
     // 读取通知事件
     int len = epoll_wait(m_epoll_fd, m_epoll_events, MAX_EVENT_NUMBER, 0);
@@ -454,7 +499,11 @@ bool FileLogAppender::checkFileStatus() {
 }
 
 bool FileLogAppender::reopen() {
-    MutexType::Lock lock(m_mutex);
+    FileMutexType::Lock lock(m_fileMutex);
+    return openFile();
+}
+
+bool FileLogAppender::openFile() {
     if(m_filestream) {
         m_filestream.close();
     }
@@ -262,10 +262,14 @@ private:
 };
 
 // 输出到文件的日志输出地
-class FileLogAppender : public LogAppender {
+// log 只把格式化好的日志追加到内存缓冲区，写文件、检查文件状态、重新打开交给文件 IO 线程池，IO 线程不碰磁盘；
+// ERROR 以上的日志、缓冲区积压太多的时候在当前线程直接写，保证崩溃之前的日志落盘
+class FileLogAppender : public LogAppender, public std::enable_shared_from_this<FileLogAppender> {
 public:
     typedef std::shared_ptr<FileLogAppender> ptr; // 智能指针
+    typedef Mutex FileMutexType;
     FileLogAppender(const std::string &filename);
+    ~FileLogAppender();
 
     void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
 
@@ -275,8 +279,17 @@ public:
     bool reopen(); // 重新打开文件
 
     bool checkFileStatus(); // 检查文件状态
+
+    void flush();   // 把缓冲区里的日志写进文件，会阻塞当前线程
+private:
+    bool openFile();    // 下面两个调用之前要拿着 m_fileMutex
+    bool pollFileStatus();
+
 private:
     std::string m_filename; // 文件名
+    FileMutexType m_fileMutex;  // 文件流的锁，写文件的时候不占着 m_mutex
+    std::string m_buffer;   // 还没写进文件的日志，m_mutex 保护
+    bool m_flushPending = false;    // 已经交给线程池还没执行的 flush
     std::ofstream m_filestream; // 文件流
     int m_file_inotify_fd = -1; // 文件描述符
     int m_file_inotify_wd = -1; // 监视器
@@ -0,0 +1,291 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/30 10:00
+* @version: 1.0
+* @description: 域名解析：getaddrinfo 放到专门的线程池里执行，结果按 TTL 缓存，同一个域名同时只查一次
+********************************************************************************/
+
+#include "resolver.h"
+#include "config.h"
+#include "fiber.h"
+#include "log.h"
+#include "scheduler.h"
+#include "util.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <sstream>
+#include <netdb.h>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint32_t>::ptr g_resolver_threads =
+        sylar::Config::Lookup("resolver.threads", (uint32_t)2, "resolver thread count");
+static sylar::ConfigVar<uint32_t>::ptr g_resolver_max_queue =
+        sylar::Config::Lookup("resolver.max_queue", (uint32_t)256, "resolver max queued lookups");
+static sylar::ConfigVar<uint64_t>::ptr g_resolver_ttl =
+        sylar::Config::Lookup("resolver.ttl", (uint64_t)(60 * 1000), "resolver cache ttl ms");
+static sylar::ConfigVar<uint64_t>::ptr g_resolver_negative_ttl =
+        sylar::Config::Lookup("resolver.negative_ttl", (uint64_t)(5 * 1000), "resolver negative cache ttl ms");
+static sylar::ConfigVar<uint32_t>::ptr g_resolver_max_entries =
+        sylar::Config::Lookup("resolver.max_entries", (uint32_t)10000, "resolver max cached names");
+
+Resolver::Options::Options()
+        :threads(g_resolver_threads->getValue())
+        ,max_queue(g_resolver_max_queue->getValue())
+        ,ttl(g_resolver_ttl->getValue())
+        ,negative_ttl(g_resolver_negative_ttl->getValue())
+        ,max_entries(g_resolver_max_entries->getValue()) {
+}
+
+/**
+ * @brief 域名确实不存在、没有这个地址族的记录，可以缓存；其它的（EAI_AGAIN 超时之类）下次重新查
+ */
+static bool IsPermanentError(int error) {
+    return error == EAI_NONAME || error == EAI_NODATA || error == EAI_ADDRFAMILY;
+}
+
+/**
+ * @brief 缓存里的地址端口是 0，给调用方的是设好端口的副本
+ */
+static int AssignResult(int error, const std::vector<IPAddress::ptr> &addrs, uint16_t port,
+                        std::vector<IPAddress::ptr> &result) {
+    if(error) {
+        return error;
+    }
+    result.reserve(addrs.size());
+    for(auto &i : addrs) {
+        result.push_back(i->withPort(port));
+    }
+    return 0;
+}
+
+Resolver::Resolver(const Options &options, const std::string &name)
+        :m_options(options)
+        ,m_executor(std::max(options.threads, (uint32_t)1), options.max_queue, name)
+        ,m_lookup(&Resolver::GetAddrInfo) {
+}
+
+Resolver::~Resolver() {
+    m_executor.stop();
+}
+
+int Resolver::lookup(const std::string &host, std::vector<IPAddress::ptr> &result, uint16_t port, int family) {
+    result.clear();
+    std::string name = host;
+    if(name.size() > 2 && name.front() == '[' && name.back() == ']') {
+        name = name.substr(1, name.size() - 2);
+    }
+    IPAddress::ptr numeric = IPAddress::Create(name, port);
+    if(numeric) {
+        if(family != AF_UNSPEC && numeric->getFamily() != family) {
+            return EAI_ADDRFAMILY;
+        }
+        result.push_back(numeric);
+        return 0;
+    }
+    if(name.empty()) {
+        return EAI_NONAME;
+    }
+
+    ++m_lookups;
+    Key key(name, family);
+    Pending::ptr pending;
+    LookupFunc fun;
+    {
+        MutexType::Lock lock(m_mutex);
+        auto it = m_cache.find(key);
+        if(it != m_cache.end()) {
+            Entry &entry = it->second;
+            if(entry.pending && InSchedulerFiber()) {
+                // 已经有人在查，排队等结果，查完的时候放回原来的调度器
+                pending = entry.pending;
+                pending->waiters.push_back(std::make_pair(Scheduler::GetThis(), Fiber::GetThis()));
+                ++m_coalesced;
+                lock.unlock();
+                Fiber::YieldToHold();
+                return AssignResult(pending->error, pending->addrs, port, result);
+            }
+            if(!entry.pending && GetMonotonicMS() < entry.expire) {
+                ++(entry.error ? m_negativeHits : m_hits);
+                return AssignResult(entry.error, entry.addrs, port, result);
+            }
+        }
+        // 不在协程里的时候不能让出，有人在查也自己查一次
+        if(it == m_cache.end() || !it->second.pending) {
+            pending = std::make_shared<Pending>();
+            m_cache[key].pending = pending;
+        }
+        fun = m_lookup;
+    }
+
+    std::vector<IPAddress::ptr> addrs;
+    int error = blocking(&m_executor, [&fun, &name, family, &addrs]() {
+        try {
+            return fun(name, family, addrs);
+        } catch(std::exception &ex) {
+            SYLAR_LOG_ERROR(g_logger) << "resolver lookup " << name << " exception: " << ex.what();
+        } catch(...) {
+            SYLAR_LOG_ERROR(g_logger) << "resolver lookup " << name << " exception";
+        }
+        return (int)EAI_FAIL;
+    });
+    if(!error && addrs.empty()) {
+        error = EAI_NODATA;
+    }
+    if(error) {
+        addrs.clear();
+        ++m_failures;
+    }
+    ++m_queries;
+
+    std::vector<std::pair<Scheduler *, std::shared_ptr<Fiber> > > waiters;
+    {
+        MutexType::Lock lock(m_mutex);
+        Entry &entry = m_cache[key];
+        if(entry.pending == pending) {  // 查询期间被 remove/clear 之后别人又开始查的，不动它的 pending
+            entry.pending.reset();
+        }
+        uint64_t ttl = !error ? m_options.ttl : (IsPermanentError(error) ? m_options.negative_ttl : 0);
+        if(ttl) {
+            entry.error = error;
+            entry.addrs = addrs;
+            entry.expire = GetMonotonicMS() + ttl;
+        } else if(!entry.pending) {
+            m_cache.erase(key);
+        }
+        evict();
+        if(pending) {
+            pending->error = error;
+            pending->addrs = addrs;
+            waiters.swap(pending->waiters);
+        }
+    }
+    for(auto &i : waiters) {
+        i.first->schedule(i.second);
+    }
+    return AssignResult(error, addrs, port, result);
+}
+
+void Resolver::evict() {
+    if(!m_options.max_entries || m_cache.size() <= m_options.max_entries) {
+        return;
+    }
+    uint64_t now = GetMonotonicMS();
+    for(auto it = m_cache.begin(); it != m_cache.end();) {
+        if(!it->second.pending && it->second.expire <= now) {
+            it = m_cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    while(m_cache.size() > m_options.max_entries) {
+        auto oldest = m_cache.end();
+        for(auto it = m_cache.begin(); it != m_cache.end(); ++it) {
+            if(!it->second.pending && (oldest == m_cache.end() || it->second.expire < oldest->second.expire)) {
+                oldest = it;
+            }
+        }
+        if(oldest == m_cache.end()) {   // 剩下的都在查询
+            break;
+        }
+        m_cache.erase(oldest);
+    }
+}
+
+IPAddress::ptr Resolver::lookupAny(const std::string &host, uint16_t port, int family) {
+    std::vector<IPAddress::ptr> result;
+    if(lookup(host, result, port, family)) {
+        return nullptr;
+    }
+    return result.front();
+}
+
+void Resolver::remove(const std::string &host) {
+    MutexType::Lock lock(m_mutex);
+    for(auto it = m_cache.lower_bound(Key(host, INT_MIN)); it != m_cache.end() && it->first.first == host;) {
+        it = m_cache.erase(it);
+    }
+}
+
+void Resolver::clear() {
+    MutexType::Lock lock(m_mutex);
+    m_cache.clear();
+}
+
+void Resolver::setLookupFunc(LookupFunc v) {
+    MutexType::Lock lock(m_mutex);
+    m_lookup = std::move(v);
+}
+
+void Resolver::getStats(Stats &stats) {
+    {
+        MutexType::Lock lock(m_mutex);
+        stats.entries = m_cache.size();
+    }
+    stats.lookups = m_lookups;
+    stats.hits = m_hits;
+    stats.negative_hits = m_negativeHits;
+    stats.coalesced = m_coalesced;
+    stats.queries = m_queries;
+    stats.failures = m_failures;
+}
+
+std::string Resolver::dumpStats() {
+    Stats stats;
+    getStats(stats);
+    std::stringstream ss;
+    ss << "[Resolver name=" << m_executor.getName()
+       << " entries=" << stats.entries
+       << " lookups=" << stats.lookups
+       << " hits=" << stats.hits
+       << " negative_hits=" << stats.negative_hits
+       << " coalesced=" << stats.coalesced
+       << " queries=" << stats.queries
+       << " failures=" << stats.failures << "] "
+       << m_executor.dumpStats();
+    return ss.str();
+}
+
+int Resolver::GetAddrInfo(const std::string &host, int family, std::vector<IPAddress::ptr> &result) {
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = family;
+    hints.ai_socktype = SOCK_STREAM;    // 每个地址只要一条
+    addrinfo *res = nullptr;
+    int rt = getaddrinfo(host.c_str(), nullptr, &hints, &res);
+    if(rt) {
+        return rt;
+    }
+    for(addrinfo *i = res; i; i = i->ai_next) {
+        IPAddress::ptr addr = std::dynamic_pointer_cast<IPAddress>(Address::Create(i->ai_addr, i->ai_addrlen));
+        if(!addr) {
+            continue;
+        }
+        bool dup = false;
+        for(auto &j : result) {
+            if(*j == *addr) {
+                dup = true;
+                break;
+            }
+        }
+        if(!dup) {
+            result.push_back(addr);
+        }
+    }
+    freeaddrinfo(res);
+    return result.empty() ? EAI_NODATA : 0;
+}
+
+Resolver *Resolver::GetInstance() {
+    static Resolver *s_resolver = new Resolver(Resolver::Options(), "resolver");
+    static GlobalExecutorHolder<Resolver> s_holder(s_resolver, s_resolver->getExecutor());
+    return s_holder.get();
+}
+
+}
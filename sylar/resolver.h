@@ -0,0 +1,153 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/30 10:00
+* @version: 1.0
+* @description: 域名解析：getaddrinfo 放到专门的线程池里执行，结果按 TTL 缓存，同一个域名同时只查一次
+********************************************************************************/
+
+
+#ifndef SYLAR_RESOLVER_H
+#define SYLAR_RESOLVER_H
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "address.h"
+#include "blocking.h"
+#include "thread.h"
+
+namespace sylar {
+
+class Scheduler;
+class Fiber;
+
+/**
+ * @brief 带缓存的域名解析
+ * getaddrinfo 是同步的（读 /etc/hosts、发 DNS 请求），在 IO 线程里调用会卡住所有协程。
+ * 查询放到自己的 BlockingExecutor 里执行，发起查询的协程让出，查完回到原来的调度器。
+ * 结果按 (域名, 地址族) 缓存 ttl 毫秒；域名不存在之类确定的失败缓存 negative_ttl 毫秒，
+ * 临时失败（EAI_AGAIN 等）不缓存。同一个 key 正在查询的时候，后来的协程排队等这次的结果，不再重复查询。
+ * 数字形式的地址直接转换，不经过线程池和缓存
+ */
+class Resolver {
+public:
+    typedef std::shared_ptr<Resolver> ptr;
+    typedef Mutex MutexType;
+    /**
+     * @brief 实际的解析函数，默认是 GetAddrInfo；可以换成桩函数或者自己的 DNS 客户端，在线程池里调用
+     * @param[out] result 解析出来的地址，端口为 0
+     * @return 0 成功，失败返回 EAI_* 错误码
+     */
+    typedef std::function<int(const std::string &host, int family, std::vector<IPAddress::ptr> &result)> LookupFunc;
+
+    struct Options {
+        Options();  // 默认值取 resolver.* 配置
+
+        uint32_t threads;       // 解析线程数
+        uint32_t max_queue;     // 最多排队的查询数
+        uint64_t ttl;           // 成功结果的缓存时间(毫秒)
+        uint64_t negative_ttl;  // 确定失败的缓存时间(毫秒)，0 不缓存
+        uint32_t max_entries;   // 最多缓存多少个 key，满了先淘汰过期的，再淘汰最早过期的
+    };
+
+    Resolver(const Options &options = Options(), const std::string &name = "resolver");
+    ~Resolver();
+
+    Resolver(const Resolver &) = delete;
+    Resolver &operator=(const Resolver &) = delete;
+
+    /**
+     * @brief 解析域名，不在协程里的时候在当前线程查询
+     * @param[in] host 域名或者数字地址，ipv6 可以带方括号
+     * @param[out] result 解析出来的地址，端口都设成 port
+     * @param[in] family AF_UNSPEC、AF_INET 或者 AF_INET6
+     * @return 0 成功，失败返回 EAI_* 错误码（gai_strerror 转成字符串）
+     */
+    int lookup(const std::string &host, std::vector<IPAddress::ptr> &result,
+               uint16_t port = 0, int family = AF_UNSPEC);
+    /**
+     * @brief 解析域名，返回第一个地址，失败返回 nullptr
+     */
+    IPAddress::ptr lookupAny(const std::string &host, uint16_t port = 0, int family = AF_UNSPEC);
+
+    /**
+     * @brief 删掉一个域名的缓存（所有地址族），正在进行的查询不受影响
+     */
+    void remove(const std::string &host);
+    void clear();
+
+    void setLookupFunc(LookupFunc v);
+    const Options &getOptions() const { return m_options; }
+    BlockingExecutor *getExecutor() { return &m_executor; }
+
+    struct Stats {
+        uint64_t lookups = 0;       // 需要解析的域名查询次数（数字地址不算）
+        uint64_t hits = 0;          // 命中成功结果的缓存
+        uint64_t negative_hits = 0; // 命中失败结果的缓存
+        uint64_t coalesced = 0;     // 等别人正在进行的查询
+        uint64_t queries = 0;       // 实际调用解析函数的次数
+        uint64_t failures = 0;      // 解析函数失败的次数
+        uint64_t entries = 0;       // 当前缓存的 key 数
+    };
+    void getStats(Stats &stats);
+    std::string dumpStats();
+
+    /**
+     * @brief 全局的解析器，第一次使用的时候按 resolver.* 配置创建
+     */
+    static Resolver *GetInstance();
+
+    /**
+     * @brief 默认的解析函数，getaddrinfo（SOCK_STREAM）去重之后的结果
+     */
+    static int GetAddrInfo(const std::string &host, int family, std::vector<IPAddress::ptr> &result);
+
+private:
+    typedef std::pair<std::string, int> Key;
+
+    /**
+     * @brief 一次正在进行的查询，查完之后把结果交给排队的协程
+     */
+    struct Pending {
+        typedef std::shared_ptr<Pending> ptr;
+        std::vector<std::pair<Scheduler *, std::shared_ptr<Fiber> > > waiters;
+        int error = 0;
+        std::vector<IPAddress::ptr> addrs;
+    };
+
+    struct Entry {
+        int error = 0;
+        std::vector<IPAddress::ptr> addrs;
+        uint64_t expire = 0;        // 过期时间(单调时钟，毫秒)
+        Pending::ptr pending;       // 正在查询
+    };
+
+    /**
+     * @brief 缓存超过 max_entries 的时候淘汰，调用的时候持有 m_mutex
+     */
+    void evict();
+
+private:
+    Options m_options;
+    BlockingExecutor m_executor;
+    MutexType m_mutex;
+    LookupFunc m_lookup;
+    std::map<Key, Entry> m_cache;
+
+    std::atomic<uint64_t> m_lookups{0};
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_negativeHits{0};
+    std::atomic<uint64_t> m_coalesced{0};
+    std::atomic<uint64_t> m_queries{0};
+    std::atomic<uint64_t> m_failures{0};
+};
+
+}
+
+#endif //SYLAR_RESOLVER_H
@@ -11,6 +11,7 @@
 #include "scheduler.h"
 #include "log.h"
 #include "macro.h"
+#include "hook.h"
 
 namespace sylar {
 
@@ -84,6 +85,20 @@ void Scheduler::start() {
     //}
 }
 
+std::vector<int> Scheduler::getWorkerThreadIds() {
+    MutexType::Lock lock(m_mutex);
+    std::vector<int> ids;
+    for (auto id : m_threadIds) {
+        if (id != m_rootThread) {
+            ids.push_back(id);
+        }
+    }
+    if (ids.empty() && m_rootThread != -1) {
+        ids.push_back(m_rootThread);
+    }
+    return ids;
+}
+
 void Scheduler::stop() {
     m_autoStop = true;
     if (m_rootFiber //  使用了 caller ，所以需要在主协程中停止
@@ -160,12 +175,15 @@ void Scheduler::run() {
     while(true){
         ft.reset();
         bool tickle_me = false;
+        int tickle_thread = -1; // 只有一个线程的任务在等的时候，只叫醒它
         bool is_active = false;
         {
             MutexType::Lock lock(m_mutex);
+            uint64_t now = m_shedTargetUs ? sylar::GetMonotonicUS() : 0;  // 排队时间用单调时钟，系统时间跳变不影响
             auto it = m_fibers.begin();
             while(it != m_fibers.end()){
                 if(it->thread != -1 && it->thread != sylar::GetThreadId()){ // 不是当前线程的协程
+                    tickle_thread = !tickle_me || tickle_thread == it->thread ? it->thread : -1;
                     ++it;
                     tickle_me = true;   // 唤醒其他线程，让其他线程来执行
                     continue;
@@ -177,16 +195,29 @@ void Scheduler::run() {
                     continue;
                 }
 
+                if(m_shedTargetUs && shedNoLock(*it, now)) {   // 过载，排队太久的任务直接丢掉
+                    it = m_fibers.erase(it);
+                    ++m_shedCount;
+                    continue;
+                }
+
                 ft = *it;
                 m_fibers.erase(it);
                 ++m_activeThreadCount;
                 is_active = true;
                 break;
             }
+            if(m_shedTargetUs && m_fibers.empty()) {    // 队列排空过，说明当前窗口没有积压
+                m_intervalMinDelayUs = 0;
+            }
         }
 
         if(tickle_me){
-            tickle();
+            tickle_thread == -1 ? tickle() : tickleThread(tickle_thread);
+        }
+
+        if(is_active && m_hookEnable) { // 任务可能在任意一个线程上恢复，每个线程都要开启
+            set_hook_enable(true);
         }
 
         if(ft.fiber && (ft.fiber->getState() != Fiber::TERM
@@ -198,7 +229,8 @@ void Scheduler::run() {
                 schedule(ft.fiber);
             } else if(ft.fiber->getState() != Fiber::TERM
                       && ft.fiber->getState() != Fiber::EXCEPT){
-                ft.fiber->m_state = Fiber::HOLD;    // 挂起，让出了执行时间
+                // 挂起，让出了执行时间。上下文已经保存好，最后才改成 HOLD，之后别的线程可以恢复它，这里不再看它的状态
+                ft.fiber->m_state = Fiber::HOLD;
             }
             ft.reset();
         } else if(ft.cb) {
@@ -217,7 +249,7 @@ void Scheduler::run() {
                       || cb_fiber->getState() == Fiber::TERM){  // 协程执行完毕，把它释放掉
                 cb_fiber->reset(nullptr);
             } else { // if(cb_fiber->getState() != Fiber::TERM){ // 其它状态就挂起
-                cb_fiber->m_state = Fiber::HOLD;
+                cb_fiber->m_state = Fiber::HOLD;    // 同上，改成 HOLD 之后不再复用它
                 cb_fiber.reset();
             }
         } else {    // 事情做完了，idle协程执行
@@ -241,6 +273,51 @@ void Scheduler::run() {
     }
 }
 
+void Scheduler::setShedding(uint64_t target_us, uint64_t interval_us) {
+    MutexType::Lock lock(m_mutex);
+    m_shedTargetUs = target_us;
+    m_shedIntervalUs = interval_us ? interval_us : 100 * 1000;
+    m_intervalEndUs = 0;
+    m_intervalMinDelayUs = 0;
+    m_overloaded = false;
+}
+
+size_t Scheduler::getQueueSize() {
+    MutexType::Lock lock(m_mutex);
+    return m_fibers.size();
+}
+
+/**
+ * CoDel 风格的过载判断
+ * 只看一个窗口内的最小排队时间：如果整个窗口里面连最快出队的任务都排队超过 target，
+ * 说明队列是持续积压（standing queue），而不是短暂的突发，这时认为过载。
+ * 过载期间，排队超过 target 的可丢弃任务直接丢掉，让后面的任务还能在超时前被执行，
+ * 而不是所有任务一起超时。
+ */
+bool Scheduler::shedNoLock(const FiberAndThread &ft, uint64_t now) {
+    uint64_t sojourn = now > ft.enqueueUs ? now - ft.enqueueUs : 0;
+    if(now >= m_intervalEndUs) {    // 窗口结束，根据窗口内最小排队时间判断是否过载
+        bool overloaded = m_intervalEndUs && m_intervalMinDelayUs > m_shedTargetUs;
+        if(overloaded != m_overloaded) {
+            SYLAR_LOG_WARN(g_logger) << m_name << (overloaded ? " overloaded" : " recovered")
+                                     << " min_delay_us=" << m_intervalMinDelayUs
+                                     << " queue=" << m_fibers.size();
+        }
+        m_overloaded = overloaded;
+        m_intervalEndUs = now + m_shedIntervalUs;
+        m_intervalMinDelayUs = UINT64_MAX;
+    }
+    if(sojourn < m_intervalMinDelayUs) {
+        m_intervalMinDelayUs = sojourn;
+    }
+
+    if(!m_overloaded || !ft.sheddable || sojourn <= m_shedTargetUs) {
+        return false;
+    }
+    // 挂起过的协程有执行现场，不能丢
+    return ft.cb || ft.fiber->getState() == Fiber::INIT;
+}
+
 void Scheduler::tickle() {
     SYLAR_LOG_INFO(g_logger) << "tickle";
 }
@@ -248,7 +325,8 @@ void Scheduler::tickle() {
 bool Scheduler::stopping() {
     MutexType::Lock lock(m_mutex);
     return m_autoStop && m_stopping
-           && m_fibers.empty() && m_activeThreadCount == 0;
+           && m_fibers.empty() && m_activeThreadCount == 0
+           && m_externalWaits == 0;
 }
 
 void Scheduler::idle() {
@@ -11,11 +11,13 @@
 #ifndef SYLAR_SCHEDULER_H
 #define SYLAR_SCHEDULER_H
 
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <list>
 #include "fiber.h"
 #include "thread.h"
+#include "util.h"
 
 namespace sylar {
 
@@ -49,10 +51,33 @@ public:
             need_tickle = scheduleNoLock(fc, thread);
         }
         if (need_tickle) {  // 空的话，唤醒
-            tickle();   // 唤醒
+            thread == -1 ? tickle() : tickleThread(thread);
         }
     }
 
+    /**
+     * @brief 带准入控制的调度，队列已满时直接拒绝
+     * @return 是否成功入队，false 表示被拒绝，调用方应当快速失败
+     * 通过 trySchedule 进来的任务在过载时可能会被 CoDel 丢弃（只丢弃回调或尚未执行过的协程）
+     * 内部的唤醒、重新调度仍然走 schedule，不受容量限制，否则会丢掉挂起中的协程
+     */
+    template<class FiberOrCb>
+    bool trySchedule(FiberOrCb fc, int thread = -1) {
+        bool need_tickle = false;
+        {
+            MutexType::Lock lock(m_mutex);
+            if (m_maxQueueSize && m_fibers.size() >= m_maxQueueSize) {
+                ++m_rejectedCount;
+                return false;
+            }
+            need_tickle = scheduleNoLock(fc, thread, true);
+        }
+        if (need_tickle) {  // 和 schedule 一样，指定了线程的只叫醒那个线程
+            thread == -1 ? tickle() : tickleThread(thread);
+        }
+        return true;
+    }
+
     template<class InputIterator>   // 锁一次、把所有的都放进去，批量操作
     void schedule(InputIterator begin, InputIterator end) {
         bool need_tickle = false;
@@ -68,8 +93,69 @@ public:
         }
     }
 
+    /**
+     * @brief 一次加锁把一批协程和回调放进队列，最多 tickle 一次，调用之后两个容器被清空
+     * IOManager 用它发布一次 epoll_wait 唤醒的所有协程和到期的定时器
+     * @param[in] thread 指定在哪个线程上执行，-1 任意线程
+     */
+    void schedule(std::vector<Fiber::ptr> &fibers, std::vector<std::function<void()> > &cbs,
+                  int thread = -1) {
+        if (fibers.empty() && cbs.empty()) {
+            return;
+        }
+        bool need_tickle = false;
+        {
+            MutexType::Lock lock(m_mutex);
+            for (auto &i : fibers) {
+                need_tickle = scheduleNoLock(&i, thread) || need_tickle;
+            }
+            for (auto &i : cbs) {
+                need_tickle = scheduleNoLock(&i, thread) || need_tickle;
+            }
+        }
+        fibers.clear();
+        cbs.clear();
+        if (need_tickle) {
+            thread == -1 ? tickle() : tickleThread(thread);
+        }
+    }
+
+    /**
+     * @brief 执行任务的线程 id，start 之后有效，配合 schedule(fc, thread) 把任务固定到某个线程上
+     * use_caller 的线程只在 stop 的时候执行任务，不算在里面，除非只有它一个
+     */
+    std::vector<int> getWorkerThreadIds();
+
+    void setMaxQueueSize(size_t v) { m_maxQueueSize = v; }  // 0 表示不限制
+    size_t getMaxQueueSize() const { return m_maxQueueSize; }
+    /**
+     * @brief 设置 CoDel 风格的过载丢弃参数，target_us 为 0 时关闭
+     * @param[in] target_us 可接受的排队时间
+     * @param[in] interval_us 观察窗口，窗口内最小排队时间都超过 target 即认为过载
+     */
+    void setShedding(uint64_t target_us, uint64_t interval_us = 100 * 1000);
+
+    /**
+     * @brief 调度器的线程执行任务的时候开启 hook（见 hook.h），默认不开启
+     */
+    void setHookEnable(bool v) { m_hookEnable = v; }
+    bool isHookEnable() const { return m_hookEnable; }
+
+    size_t getQueueSize();  // 当前排队的任务数
+    uint64_t getRejectedCount() const { return m_rejectedCount; }   // trySchedule 拒绝的任务数
+    uint64_t getShedCount() const { return m_shedCount; }   // 过载时丢弃的任务数
+    bool isOverloaded() const { return m_overloaded; }
+
+    /**
+     * @brief 协程让出之后由调度器以外的线程放回来的时候（比如阻塞调用卸载），让出之前 addExternalWait，
+     * 放回队列之后 delExternalWait。这时协程既不在队列里也不在 epoll 里，不记下来 stop 会以为没事可做，直接退出
+     */
+    void addExternalWait() { ++m_externalWaits; }
+    void delExternalWait() { --m_externalWaits; }
+
 protected:
     virtual void tickle();  // 唤醒，信号量
+    virtual void tickleThread(int thread) { tickle(); } // 唤醒指定的线程，默认唤醒任意一个
     void run(); // 线程执行函数
     virtual bool stopping();   // 子类实现，判断是否可以停止，有其他清理任务的机会
     virtual void idle();   // 子类实现，空闲协程，为了解决协程调度器没有任务做，又不能退出的问题
@@ -79,10 +165,14 @@ protected:
     bool hasIdleThreads() { return m_idleThreadCount > 0;}
 private:
     template<class FiberOrCb>
-    bool scheduleNoLock(FiberOrCb fc, int thread) {
+    bool scheduleNoLock(FiberOrCb fc, int thread, bool sheddable = false) {
         bool need_tickle = m_fibers.empty(); // 是否需要唤醒
         FiberAndThread ft(fc, thread);
         if (ft.fiber || ft.cb) {    // 如果有协程或者函数
+            if (m_shedTargetUs) {   // 开启丢弃时才记录入队时间，省掉一次取时间
+                ft.enqueueUs = sylar::GetMonotonicUS();
+                ft.sheddable = sheddable;
+            }
             m_fibers.push_back(ft); // 将协程或者函数加入到协程队列中
         }
         return need_tickle;
@@ -92,6 +182,8 @@ private:
         Fiber::ptr fiber;   // 智能指针
         std::function<void()> cb;   // 回调函数
         int thread; // 线程id，这个协程在哪个线程上
+        uint64_t enqueueUs = 0; // 入队时间（单调时钟），用于计算排队时间
+        bool sheddable = false; // 过载时是否允许丢弃
 
         FiberAndThread(Fiber::ptr f, int thr)
             : fiber(f), thread(thr) {
@@ -119,8 +211,12 @@ private:
             fiber = nullptr;
             cb = nullptr;
             thread = -1;
+            enqueueUs = 0;
+            sheddable = false;
         }
     };
+
+    bool shedNoLock(const FiberAndThread &ft, uint64_t now);    // 统计排队时间，判断是否需要丢弃
 private:
     MutexType m_mutex;
     std::vector<Thread::ptr> m_threads; // 协程管理的线程？
@@ -128,6 +224,17 @@ private:
     Fiber::ptr m_rootFiber; // 主协程
     std::string m_name; // 协程调度器的名称
 
+    std::atomic<size_t> m_maxQueueSize{0};  // 队列容量，0 不限制；trySchedule 加锁读，设置的时候不加锁
+    uint64_t m_shedTargetUs = 0;    // 可接受的排队时间，0 关闭丢弃
+    uint64_t m_shedIntervalUs = 100 * 1000; // 观察窗口
+    uint64_t m_intervalEndUs = 0;   // 当前窗口结束时间
+    uint64_t m_intervalMinDelayUs = 0;  // 当前窗口内最小排队时间
+    std::atomic<bool> m_overloaded = {false};   // 上一个窗口是否过载
+    std::atomic<uint64_t> m_rejectedCount = {0};
+    std::atomic<uint64_t> m_shedCount = {0};
+    std::atomic<bool> m_hookEnable = {false};   // 执行任务的线程是否开启 hook
+    std::atomic<size_t> m_externalWaits = {0};  // 等调度器以外的线程放回来的协程数
+
 protected:
     std::vector<int> m_threadIds;   // 线程id的列表，我需要随机选择一个线程来执行协程，不需要真正的线程id，比如 100 % 5
     size_t m_threadCount = 0;   // 线程数量
@@ -0,0 +1,696 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/14 10:20
+* @version: 1.0
+* @description: socket 封装，先直接调用系统调用，EAGAIN 的时候让出协程等待
+********************************************************************************/
+
+#include "socket.h"
+#include "hook.h"
+#include "log.h"
+#include "macro.h"
+#include "zero_copy.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include <sys/un.h>
+#include <climits>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+Socket::ptr Socket::CreateTCP(int family) {
+    Socket::ptr sock(new Socket(family, TCP, 0));
+    return sock;
+}
+
+Socket::ptr Socket::CreateUDP(int family) {
+    Socket::ptr sock(new Socket(family, UDP, 0));
+    sock->newSock();
+    sock->m_isConnected = true; // 无连接，创建出来就能收发
+    return sock;
+}
+
+Socket::ptr Socket::CreateTCPSocket() {
+    return CreateTCP(IPv4);
+}
+
+Socket::ptr Socket::CreateUDPSocket() {
+    return CreateUDP(IPv4);
+}
+
+Socket::ptr Socket::CreateTCPSocket6() {
+    return CreateTCP(IPv6);
+}
+
+Socket::ptr Socket::CreateUDPSocket6() {
+    return CreateUDP(IPv6);
+}
+
+Socket::ptr Socket::CreateUnixTCPSocket() {
+    return CreateTCP(UNIX);
+}
+
+Socket::ptr Socket::CreateUnixUDPSocket() {
+    return CreateUDP(UNIX);
+}
+
+Socket::Socket(int family, int type, int protocol)
+        :m_family(family)
+        ,m_type(type)
+        ,m_protocol(protocol) {
+    memset(&m_localAddress, 0, sizeof(m_localAddress));
+    memset(&m_remoteAddress, 0, sizeof(m_remoteAddress));
+}
+
+Socket::~Socket() {
+    close();
+}
+
+bool Socket::getOption(int level, int option, void *result, socklen_t *len) {
+    int rt = getsockopt(m_sock, level, option, result, len);
+    if(rt) {
+        SYLAR_LOG_DEBUG(g_logger) << "getOption sock=" << m_sock
+                                  << " level=" << level << " option=" << option
+                                  << " errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool Socket::setOption(int level, int option, const void *value, socklen_t len) {
+    if(setsockopt_f(m_sock, level, option, value, len)) {
+        SYLAR_LOG_DEBUG(g_logger) << "setOption sock=" << m_sock
+                                  << " level=" << level << " option=" << option
+                                  << " errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool Socket::setNoDelay(bool on) {
+    int val = on ? 1 : 0;
+    return setOption(IPPROTO_TCP, TCP_NODELAY, val);
+}
+
+bool Socket::setReuseAddr(bool on) {
+    int val = on ? 1 : 0;
+    return setOption(SOL_SOCKET, SO_REUSEADDR, val);
+}
+
+bool Socket::setReusePort(bool on) {
+    if(!isValid()) {    // 要在 bind 之前设置
+        newSock();
+    }
+    int val = on ? 1 : 0;
+    return setOption(SOL_SOCKET, SO_REUSEPORT, val);
+}
+
+bool Socket::setKeepAlive(bool on, int idle_s, int interval_s, int count) {
+    int val = on ? 1 : 0;
+    if(!setOption(SOL_SOCKET, SO_KEEPALIVE, val)) {
+        return false;
+    }
+    if(!on) {
+        return true;
+    }
+    if(idle_s > 0 && !setOption(IPPROTO_TCP, TCP_KEEPIDLE, idle_s)) {
+        return false;
+    }
+    if(interval_s > 0 && !setOption(IPPROTO_TCP, TCP_KEEPINTVL, interval_s)) {
+        return false;
+    }
+    if(count > 0 && !setOption(IPPROTO_TCP, TCP_KEEPCNT, count)) {
+        return false;
+    }
+    return true;
+}
+
+int Socket::waitFor(IOManager::Event event, uint64_t timeout_ms) {
+    IOManager *iom = dynamic_cast<IOManager *>(Scheduler::GetThis());    // GetThis 会断言，这里允许不在 IOManager 里
+    if(iom) {
+        m_iom = iom;
+        return iom->waitEvent(m_sock, event, timeout_ms);
+    }
+
+    pollfd pfd;     // 不在协程里，只能阻塞当前线程
+    pfd.fd = m_sock;
+    pfd.events = event == IOManager::READ ? POLLIN : POLLOUT;
+    pfd.revents = 0;
+    int timeout = timeout_ms == ~0ull ? -1 : (int)std::min(timeout_ms, (uint64_t)INT32_MAX);
+    int rt = 0;
+    do {
+        rt = poll(&pfd, 1, timeout);
+    } while(rt < 0 && errno == EINTR);
+    if(rt == 0) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    return rt < 0 ? -1 : 0;
+}
+
+template<typename OriginFun, typename... Args>
+ssize_t Socket::doIO(IOManager::Event event, uint64_t timeout_ms, OriginFun fun, Args &&... args) {
+    if(!isConnected()) {
+        errno = ENOTCONN;
+        return -1;
+    }
+    while(true) {
+        ssize_t n = fun(m_sock, std::forward<Args>(args)...);   // 快路径：数据已经就绪就不用注册事件
+        if(n >= 0) {
+            return n;
+        }
+        if(errno == EINTR) {
+            continue;
+        }
+        if(errno != EAGAIN) {
+            return -1;
+        }
+        if(waitFor(event, timeout_ms)) {
+            return -1;
+        }
+    }
+}
+
+Socket::ptr Socket::accept() {
+    sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    int newsock = -1;
+    while(true) {
+        newsock = ::accept4(m_sock, (sockaddr *)&addr, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(newsock >= 0) {
+            break;
+        }
+        if(errno == EINTR) {
+            continue;
+        }
+        if(errno != EAGAIN || waitFor(IOManager::READ, m_recvTimeout)) {
+            return nullptr; // 和 recv/send 一样不打日志，关闭监听的时候 EINVAL/EBADF 是正常结束，由调用方决定
+        }
+        addrlen = sizeof(addr);
+    }
+
+    Socket::ptr sock(new Socket(m_family, m_type, m_protocol));
+    if(!sock->init(newsock)) {
+        return nullptr;
+    }
+    memcpy(&sock->m_remoteAddress, &addr, addrlen);
+    sock->m_remoteAddressLen = addrlen;
+    return sock;
+}
+
+bool Socket::init(int sock) {
+    m_sock = sock;
+    m_isConnected = true;
+    initSock();
+    getLocalAddress();
+    return true;
+}
+
+bool Socket::bind(const sockaddr *addr, socklen_t addrlen) {
+    if(!isValid()) {
+        newSock();
+        if(!isValid()) {
+            return false;
+        }
+    }
+
+    if(addr->sa_family != m_family) {
+        SYLAR_LOG_ERROR(g_logger) << "bind sock.family(" << m_family
+                                  << ") addr.family(" << addr->sa_family << ") not equal, addr="
+                                  << AddressToString(addr, addrlen);
+        return false;
+    }
+
+    if(::bind(m_sock, addr, addrlen)) {
+        SYLAR_LOG_ERROR(g_logger) << "bind error errno=" << errno << " errstr=" << strerror(errno)
+                                  << " addr=" << AddressToString(addr, addrlen);
+        return false;
+    }
+    m_localAddressLen = 0;  // 端口可能是 0，重新取
+    getLocalAddress();
+    return true;
+}
+
+bool Socket::connect(const sockaddr *addr, socklen_t addrlen, uint64_t timeout_ms) {
+    if(addrlen > sizeof(m_remoteAddress)) {
+        errno = EINVAL;
+        return false;
+    }
+    memcpy(&m_remoteAddress, addr, addrlen);
+    m_remoteAddressLen = addrlen;
+    if(!isValid()) {
+        newSock();
+        if(!isValid()) {
+            return false;
+        }
+    }
+
+    if(addr->sa_family != m_family) {
+        SYLAR_LOG_ERROR(g_logger) << "connect sock.family(" << m_family
+                                  << ") addr.family(" << addr->sa_family << ") not equal, addr="
+                                  << AddressToString(addr, addrlen);
+        return false;
+    }
+
+    int rt = 0;
+    do {
+        rt = connect_f(m_sock, addr, addrlen);
+    } while(rt < 0 && errno == EINTR);
+    if(rt && errno != EINPROGRESS) {
+        SYLAR_LOG_ERROR(g_logger) << "sock=" << m_sock << " connect(" << AddressToString(addr, addrlen)
+                                  << ") error errno=" << errno << " errstr=" << strerror(errno);
+        close();
+        return false;
+    }
+    if(rt) {    // 连接中，等到可写再看结果
+        if(waitFor(IOManager::WRITE, timeout_ms)) {
+            SYLAR_LOG_ERROR(g_logger) << "sock=" << m_sock << " connect(" << AddressToString(addr, addrlen)
+                                      << ") timeout=" << timeout_ms << " errno=" << errno
+                                      << " errstr=" << strerror(errno);
+            int err = errno;
+            close();
+            errno = err;
+            return false;
+        }
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if(getsockopt(m_sock, SOL_SOCKET, SO_ERROR, &error, &len) || error) {
+            error = error ? error : errno;
+            SYLAR_LOG_ERROR(g_logger) << "sock=" << m_sock << " connect(" << AddressToString(addr, addrlen)
+                                      << ") error errno=" << error << " errstr=" << strerror(error);
+            close();
+            errno = error;
+            return false;
+        }
+    }
+    m_isConnected = true;
+    m_localAddressLen = 0;
+    getLocalAddress();
+    return true;
+}
+
+bool Socket::reconnect(uint64_t timeout_ms) {
+    if(!m_remoteAddressLen) {
+        SYLAR_LOG_ERROR(g_logger) << "reconnect m_remoteAddress is null";
+        return false;
+    }
+    sockaddr_storage addr = m_remoteAddress;
+    socklen_t addrlen = m_remoteAddressLen;
+    close();
+    return connect((const sockaddr *)&addr, addrlen, timeout_ms);
+}
+
+bool Socket::listen(int backlog) {
+    if(!isValid()) {
+        SYLAR_LOG_ERROR(g_logger) << "listen error sock=-1";
+        return false;
+    }
+    if(::listen(m_sock, backlog)) {
+        SYLAR_LOG_ERROR(g_logger) << "listen error errno=" << errno
+                                  << " errstr=" << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool Socket::close() {
+    if(!m_isConnected && m_sock == -1) {
+        return true;
+    }
+    m_isConnected = false;
+    if(m_sock != -1) {
+        ::close(m_sock);    // hook 的 close 会对所有 IOManager 调用 cancelAll，从 epoll 里删掉
+        m_sock = -1;
+    }
+    m_localAddressLen = 0;
+    return true;
+}
+
+ssize_t Socket::send(const void *buffer, size_t length, int flags) {
+    return doIO(IOManager::WRITE, m_sendTimeout, send_f, buffer, length, flags | MSG_NOSIGNAL);
+}
+
+ssize_t Socket::send(const iovec *buffers, size_t length, int flags) {
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (iovec *)buffers;
+    msg.msg_iovlen = length;
+    return doIO(IOManager::WRITE, m_sendTimeout, sendmsg_f, &msg, flags | MSG_NOSIGNAL);
+}
+
+ssize_t Socket::sendTo(const void *buffer, size_t length, const sockaddr *to, socklen_t tolen, int flags) {
+    return doIO(IOManager::WRITE, m_sendTimeout, sendto_f, buffer, length, flags | MSG_NOSIGNAL, to, tolen);
+}
+
+ssize_t Socket::sendTo(const iovec *buffers, size_t length, const sockaddr *to, socklen_t tolen, int flags) {
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (iovec *)buffers;
+    msg.msg_iovlen = length;
+    msg.msg_name = (void *)to;
+    msg.msg_namelen = tolen;
+    return doIO(IOManager::WRITE, m_sendTimeout, sendmsg_f, &msg, flags | MSG_NOSIGNAL);
+}
+
+ssize_t Socket::recv(void *buffer, size_t length, int flags) {
+    return doIO(IOManager::READ, m_recvTimeout, recv_f, buffer, length, flags);
+}
+
+ssize_t Socket::recv(iovec *buffers, size_t length, int flags) {
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = buffers;
+    msg.msg_iovlen = length;
+    return doIO(IOManager::READ, m_recvTimeout, recvmsg_f, &msg, flags);
+}
+
+ssize_t Socket::recvFrom(void *buffer, size_t length, sockaddr *from, socklen_t *fromlen, int flags) {
+    return doIO(IOManager::READ, m_recvTimeout, recvfrom_f, buffer, length, flags, from, fromlen);
+}
+
+ssize_t Socket::recvFrom(iovec *buffers, size_t length, sockaddr *from, socklen_t *fromlen, int flags) {
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = buffers;
+    msg.msg_iovlen = length;
+    msg.msg_name = from;
+    msg.msg_namelen = *fromlen;
+    ssize_t n = doIO(IOManager::READ, m_recvTimeout, recvmsg_f, &msg, flags);
+    if(n >= 0) {
+        *fromlen = msg.msg_namelen;
+    }
+    return n;
+}
+
+ssize_t Socket::recv(ByteArray &ba, size_t length, int flags) {
+    if(length == 0) {
+        return 0;
+    }
+    std::vector<iovec> iovs;
+    ba.getWriteBuffers(iovs, std::min(length, ba.getBaseSize() * IOV_MAX));  // 一次最多预留这么多空间
+    if(iovs.size() > IOV_MAX) { // 块的大小不一定都是 base_size，起点也可能不在块头，按个数截断
+        iovs.resize(IOV_MAX);
+    }
+    ssize_t n = recv(&iovs[0], iovs.size(), flags);
+    if(n > 0) {
+        ba.setPosition(ba.getPosition() + n);
+    }
+    return n;
+}
+
+ssize_t Socket::send(ByteArray &ba, size_t length, int flags) {
+    std::vector<iovec> iovs;
+    if(length == 0 || !ba.getReadBuffers(iovs, length)) {
+        return 0;
+    }
+    if(iovs.size() > IOV_MAX) { // sendmsg 超过 IOV_MAX 个 iovec 会 EMSGSIZE，剩下的下次再发
+        iovs.resize(IOV_MAX);
+    }
+    ssize_t n = send(&iovs[0], iovs.size(), flags);
+    if(n > 0) {
+        ba.setPosition(ba.getPosition() + n);
+    }
+    return n;
+}
+
+int Socket::recvBatch(UdpBatch &batch, int flags) {
+    batch.prepareRecv();
+    ssize_t n = doIO(IOManager::READ, m_recvTimeout, ::recvmmsg, &batch.m_msgs[0],
+                     (unsigned int)batch.m_msgs.size(), flags, (timespec *)nullptr);
+    if(n > 0) {
+        batch.m_size = n;
+    }
+    return n;
+}
+
+int Socket::sendBatch(UdpBatch &batch, int flags) {
+    if(batch.empty()) {
+        return 0;
+    }
+    while(batch.m_sent < batch.m_size) {
+        // 中间某个数据报出错的时候 sendmmsg 返回前面发出去的个数，错误留给下一次调用
+        ssize_t n = doIO(IOManager::WRITE, m_sendTimeout, ::sendmmsg, &batch.m_msgs[batch.m_sent],
+                         (unsigned int)(batch.m_size - batch.m_sent), flags | MSG_NOSIGNAL);
+        if(n < 0) {
+            break;
+        }
+        batch.m_sent += n;
+    }
+    return batch.m_sent ? (int)batch.m_sent : -1;
+}
+
+// 一次 GSO 发送最多切成多少段，总长度不能超过一个 IP 包
+static const size_t s_gso_max_segments = 64;
+static const size_t s_gso_max_bytes = 65000;
+
+ssize_t Socket::sendSegments(const void *buffer, size_t length, uint16_t segment_size,
+                             const sockaddr *to, socklen_t tolen) {
+    if(!segment_size) {
+        errno = EINVAL;
+        return -1;
+    }
+    const char *data = (const char *)buffer;
+    size_t sent = 0;
+#ifdef UDP_SEGMENT
+    size_t chunk = std::min(s_gso_max_segments, s_gso_max_bytes / segment_size) * segment_size;
+    while(!m_noGSO && chunk && sent < length) {
+        size_t len = std::min(chunk, length - sent);
+        iovec iov;
+        iov.iov_base = (void *)(data + sent);
+        iov.iov_len = len;
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = (void *)to;
+        msg.msg_namelen = tolen;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        union {
+            cmsghdr align;
+            char buf[CMSG_SPACE(sizeof(uint16_t))];
+        } control;
+        if(len > segment_size) {    // 只有一段的时候就是普通的数据报
+            memset(&control, 0, sizeof(control));
+            msg.msg_control = control.buf;
+            msg.msg_controllen = sizeof(control.buf);
+            cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+        }
+        ssize_t n = doIO(IOManager::WRITE, m_sendTimeout, sendmsg_f, &msg, MSG_NOSIGNAL);
+        if(n < 0) {
+            if(len > segment_size && (errno == EINVAL || errno == EIO
+                                      || errno == ENOPROTOOPT || errno == EOPNOTSUPP)) {
+                SYLAR_LOG_WARN(g_logger) << "sendSegments UDP_SEGMENT not supported sock=" << m_sock
+                                         << " errno=" << errno << " errstr=" << strerror(errno)
+                                         << ", fall back to sendmmsg";
+                m_noGSO = true;
+                break;
+            }
+            return sent ? (ssize_t)sent : -1;
+        }
+        sent += n;  // 数据报要么整个发出去要么失败
+    }
+#endif
+    // 不支持 GSO：切好之后一次 sendmmsg 发一批
+    mmsghdr msgs[s_gso_max_segments];
+    iovec iovs[s_gso_max_segments];
+    while(sent < length) {
+        size_t count = 0;
+        for(size_t offset = sent; count < s_gso_max_segments && offset < length; ++count) {
+            size_t len = std::min((size_t)segment_size, length - offset);
+            iovs[count].iov_base = (void *)(data + offset);
+            iovs[count].iov_len = len;
+            memset(&msgs[count], 0, sizeof(mmsghdr));
+            msgs[count].msg_hdr.msg_name = (void *)to;
+            msgs[count].msg_hdr.msg_namelen = tolen;
+            msgs[count].msg_hdr.msg_iov = &iovs[count];
+            msgs[count].msg_hdr.msg_iovlen = 1;
+            offset += len;
+        }
+        ssize_t n = doIO(IOManager::WRITE, m_sendTimeout, ::sendmmsg, msgs, (unsigned int)count, MSG_NOSIGNAL);
+        if(n < 0) {
+            return sent ? (ssize_t)sent : -1;
+        }
+        for(ssize_t i = 0; i < n; ++i) {
+            sent += msgs[i].msg_len;
+        }
+    }
+    return sent;
+}
+
+bool Socket::setGRO(bool on) {
+#ifdef UDP_GRO
+    int val = on ? 1 : 0;
+    return setOption(SOL_UDP, UDP_GRO, val);
+#else
+    errno = ENOPROTOOPT;
+    return false;
+#endif
+}
+
+ssize_t Socket::sendFile(int file_fd, off_t *offset, size_t count) {
+    return SendFile(m_sock, file_fd, offset, count, m_sendTimeout);
+}
+
+const sockaddr *Socket::getLocalAddress() {
+    if(!m_localAddressLen && isValid()) {
+        socklen_t addrlen = sizeof(m_localAddress);
+        if(getsockname(m_sock, (sockaddr *)&m_localAddress, &addrlen)) {
+            SYLAR_LOG_ERROR(g_logger) << "getsockname error sock=" << m_sock
+                                      << " errno=" << errno << " errstr=" << strerror(errno);
+            return nullptr;
+        }
+        m_localAddressLen = addrlen;
+    }
+    return m_localAddressLen ? (const sockaddr *)&m_localAddress : nullptr;
+}
+
+socklen_t Socket::getLocalAddressLen() {
+    getLocalAddress();
+    return m_localAddressLen;
+}
+
+const sockaddr *Socket::getRemoteAddress() {
+    if(!m_remoteAddressLen && isValid() && m_isConnected) {
+        socklen_t addrlen = sizeof(m_remoteAddress);
+        if(getpeername(m_sock, (sockaddr *)&m_remoteAddress, &addrlen)) {
+            return nullptr; // UDP 没有 connect 的时候没有对端
+        }
+        m_remoteAddressLen = addrlen;
+    }
+    return m_remoteAddressLen ? (const sockaddr *)&m_remoteAddress : nullptr;
+}
+
+socklen_t Socket::getRemoteAddressLen() {
+    getRemoteAddress();
+    return m_remoteAddressLen;
+}
+
+int Socket::getError() {
+    int error = 0;
+    if(!getOption(SOL_SOCKET, SO_ERROR, error)) {
+        error = errno;
+    }
+    return error;
+}
+
+bool Socket::checkConnected() {
+    if(!m_isConnected) {
+        return false;
+    }
+    char c;
+    ssize_t n = recv_f(m_sock, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+std::ostream &Socket::dump(std::ostream &os) {
+    os << "[Socket sock=" << m_sock
+       << " is_connected=" << m_isConnected
+       << " family=" << m_family
+       << " type=" << m_type
+       << " protocol=" << m_protocol;
+    if(getLocalAddress()) {
+        os << " local_address=" << AddressToString(getLocalAddress(), m_localAddressLen);
+    }
+    if(getRemoteAddress()) {
+        os << " remote_address=" << AddressToString(getRemoteAddress(), m_remoteAddressLen);
+    }
+    os << "]";
+    return os;
+}
+
+std::string Socket::toString() {
+    std::stringstream ss;
+    dump(ss);
+    return ss.str();
+}
+
+bool Socket::cancelRead() {
+    return m_iom && m_iom->cancelEvent(m_sock, IOManager::READ);
+}
+
+bool Socket::cancelWrite() {
+    return m_iom && m_iom->cancelEvent(m_sock, IOManager::WRITE);
+}
+
+bool Socket::cancelAccept() {
+    return cancelRead();
+}
+
+bool Socket::cancelAll() {
+    return m_iom && m_iom->cancelAll(m_sock);
+}
+
+std::string Socket::AddressToString(const sockaddr *addr, socklen_t addrlen) {
+    if(!addr) {
+        return "(null)";
+    }
+    char buf[INET6_ADDRSTRLEN] = {0};
+    std::stringstream ss;
+    switch(addr->sa_family) {
+        case AF_INET: {
+            const sockaddr_in *in = (const sockaddr_in *)addr;
+            inet_ntop(AF_INET, &in->sin_addr, buf, sizeof(buf));
+            ss << buf << ":" << ntohs(in->sin_port);
+            break;
+        }
+        case AF_INET6: {
+            const sockaddr_in6 *in6 = (const sockaddr_in6 *)addr;
+            inet_ntop(AF_INET6, &in6->sin6_addr, buf, sizeof(buf));
+            ss << "[" << buf << "]:" << ntohs(in6->sin6_port);
+            break;
+        }
+        case AF_UNIX: {
+            const sockaddr_un *un = (const sockaddr_un *)addr;
+            size_t len = addrlen > offsetof(sockaddr_un, sun_path) ? addrlen - offsetof(sockaddr_un, sun_path) : 0;
+            if(len && un->sun_path[0] == '\0') {    // 抽象命名空间
+                ss << "\\0" << std::string(un->sun_path + 1, len - 1);
+            } else {
+                ss << std::string(un->sun_path, strnlen(un->sun_path, len));
+            }
+            break;
+        }
+        default:
+            ss << "[UnknownAddress family=" << addr->sa_family << "]";
+            break;
+    }
+    return ss.str();
+}
+
+void Socket::initSock() {
+    int val = 1;
+    setOption(SOL_SOCKET, SO_REUSEADDR, val);
+    if(m_type == SOCK_STREAM && m_family != AF_UNIX) {
+        setNoDelay(true);
+    }
+}
+
+void Socket::newSock() {
+    // 不走 hook，fd 一直是非阻塞的，等待由 Socket 自己处理
+    m_sock = socket_f(m_family, m_type | SOCK_NONBLOCK | SOCK_CLOEXEC, m_protocol);
+    if(m_sock != -1) {
+        initSock();
+    } else {
+        SYLAR_LOG_ERROR(g_logger) << "socket(" << m_family << ", " << m_type << ", " << m_protocol
+                                  << ") errno=" << errno << " errstr=" << strerror(errno);
+    }
+}
+
+std::ostream &operator<<(std::ostream &os, Socket &sock) {
+    return sock.dump(os);
+}
+
+}
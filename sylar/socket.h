@@ -0,0 +1,253 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/14 10:20
+* @version: 1.0
+* @description: socket 封装，先直接调用系统调用，EAGAIN 的时候让出协程等待
+********************************************************************************/
+
+
+#ifndef SYLAR_SOCKET_H
+#define SYLAR_SOCKET_H
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "address.h"
+#include "iomanager.h"
+#include "bytearray.h"
+#include "udp_batch.h"
+
+namespace sylar {
+
+/**
+ * @brief socket 封装
+ * fd 一直是非阻塞的，每个操作先直接调用系统调用，只有 EAGAIN 的时候才注册事件、让出协程，
+ * 就绪或者超时（IOManager 的定时器）之后再回来重试。不在 IOManager 里的时候用 poll 等待。
+ * 不依赖 hook，收发超时每个 socket 单独设置
+ */
+class Socket : public std::enable_shared_from_this<Socket> {
+public:
+    typedef std::shared_ptr<Socket> ptr;
+    typedef std::weak_ptr<Socket> weak_ptr;
+
+    enum Type {
+        TCP = SOCK_STREAM,
+        UDP = SOCK_DGRAM,
+    };
+
+    enum Family {
+        IPv4 = AF_INET,
+        IPv6 = AF_INET6,
+        UNIX = AF_UNIX,
+    };
+
+    static Socket::ptr CreateTCP(int family = IPv4);
+    static Socket::ptr CreateUDP(int family = IPv4);
+    static Socket::ptr CreateTCP(const Address &addr) { return CreateTCP(addr.getFamily()); }
+    static Socket::ptr CreateUDP(const Address &addr) { return CreateUDP(addr.getFamily()); }
+
+    static Socket::ptr CreateTCPSocket();
+    static Socket::ptr CreateUDPSocket();
+    static Socket::ptr CreateTCPSocket6();
+    static Socket::ptr CreateUDPSocket6();
+    static Socket::ptr CreateUnixTCPSocket();
+    static Socket::ptr CreateUnixUDPSocket();
+
+    Socket(int family, int type, int protocol = 0);
+    virtual ~Socket();
+
+    Socket(const Socket &) = delete;
+    Socket &operator=(const Socket &) = delete;
+
+    /**
+     * @brief 收发超时(毫秒)，对之后的每一次操作生效，~0ull 表示不超时
+     * accept 用接收超时
+     */
+    uint64_t getSendTimeout() const { return m_sendTimeout; }
+    void setSendTimeout(uint64_t v) { m_sendTimeout = v; }
+    uint64_t getRecvTimeout() const { return m_recvTimeout; }
+    void setRecvTimeout(uint64_t v) { m_recvTimeout = v; }
+
+    bool getOption(int level, int option, void *result, socklen_t *len);
+    template<class T>
+    bool getOption(int level, int option, T &result) {
+        socklen_t length = sizeof(T);
+        return getOption(level, option, &result, &length);
+    }
+
+    bool setOption(int level, int option, const void *value, socklen_t len);
+    template<class T>
+    bool setOption(int level, int option, const T &value) {
+        return setOption(level, option, &value, sizeof(T));
+    }
+
+    bool setNoDelay(bool on = true);    // TCP_NODELAY
+    bool setReuseAddr(bool on = true);  // SO_REUSEADDR
+    bool setReusePort(bool on = true);  // SO_REUSEPORT，多个监听 socket 绑同一个端口，内核分发连接
+    /**
+     * @brief SO_KEEPALIVE，后面几个参数为 0 的时候用系统默认值
+     * @param[in] idle_s 空闲多久开始探测(秒)
+     * @param[in] interval_s 探测间隔(秒)
+     * @param[in] count 探测多少次没回应就断开
+     */
+    bool setKeepAlive(bool on = true, int idle_s = 0, int interval_s = 0, int count = 0);
+
+    /**
+     * @brief 接受一个新连接，新连接同样是非阻塞的
+     * @return 失败或者超时返回 nullptr，errno 为原因（超时 ETIMEDOUT，shutdown/close 之后 EINVAL/EBADF），不打日志
+     */
+    Socket::ptr accept();
+
+    bool bind(const sockaddr *addr, socklen_t addrlen);
+    /**
+     * @brief 连接，EINPROGRESS 的时候让出协程等到可写
+     * @param[in] timeout_ms 超时时间(毫秒)，~0ull 表示不超时
+     */
+    bool connect(const sockaddr *addr, socklen_t addrlen, uint64_t timeout_ms = ~0ull);
+    bool bind(const Address &addr) { return bind(addr.getAddr(), addr.getAddrLen()); }
+    bool connect(const Address &addr, uint64_t timeout_ms = ~0ull) {
+        return connect(addr.getAddr(), addr.getAddrLen(), timeout_ms);
+    }
+    bool reconnect(uint64_t timeout_ms = ~0ull);    // 用上一次 connect 的地址重新连接
+    bool listen(int backlog = SOMAXCONN);
+    bool close();
+
+    /**
+     * @brief 收发数据，语义和对应的系统调用一样，发送默认带 MSG_NOSIGNAL
+     * @return 失败返回 -1 并设置 errno，超时 errno 为 ETIMEDOUT
+     */
+    ssize_t send(const void *buffer, size_t length, int flags = 0);
+    ssize_t send(const iovec *buffers, size_t length, int flags = 0);
+    ssize_t sendTo(const void *buffer, size_t length, const sockaddr *to, socklen_t tolen, int flags = 0);
+    ssize_t sendTo(const iovec *buffers, size_t length, const sockaddr *to, socklen_t tolen, int flags = 0);
+    ssize_t sendTo(const void *buffer, size_t length, const Address &to, int flags = 0) {
+        return sendTo(buffer, length, to.getAddr(), to.getAddrLen(), flags);
+    }
+
+    ssize_t recv(void *buffer, size_t length, int flags = 0);
+    ssize_t recv(iovec *buffers, size_t length, int flags = 0);
+    ssize_t recvFrom(void *buffer, size_t length, sockaddr *from, socklen_t *fromlen, int flags = 0);
+    ssize_t recvFrom(iovec *buffers, size_t length, sockaddr *from, socklen_t *fromlen, int flags = 0);
+
+    /**
+     * @brief 直接收到 ByteArray 的内存块里，一次 recvmsg 最多收 length 字节，收到多少 position 后移多少
+     */
+    ssize_t recv(ByteArray &ba, size_t length, int flags = 0);
+    /**
+     * @brief ByteArray 从 position 开始最多 length 字节，所有块一次 sendmsg 发出去，发出去多少 position 后移多少
+     */
+    ssize_t send(ByteArray &ba, size_t length = ~(size_t)0, int flags = 0);
+
+    /**
+     * @brief recvmmsg 一次收一批数据报，已经到达的都收走（最多 batch.getCapacity() 个），一个都没有的时候才等可读
+     * @return 收到的个数，也就是 batch.size()；失败返回 -1
+     */
+    int recvBatch(UdpBatch &batch, int flags = 0);
+    /**
+     * @brief sendmmsg 把 add 进来的数据报发出去，发送缓冲区满的时候等可写接着发，全部发完才返回
+     * @return 发出去的个数，一个都没发出去返回 -1
+     */
+    int sendBatch(UdpBatch &batch, int flags = 0);
+    /**
+     * @brief UDP GSO：buffer 按 segment_size 切成多个数据报（最后一个可以更短），一次 sendmsg 交给内核切分，
+     * 协议栈只走一遍。内核或者网卡不支持的时候退回 sendmmsg，之后这个 socket 不再尝试
+     * @return 发出去的字节数，失败返回 -1
+     */
+    ssize_t sendSegments(const void *buffer, size_t length, uint16_t segment_size,
+                         const sockaddr *to = nullptr, socklen_t tolen = 0);
+    /**
+     * @brief UDP GRO：内核把同一条流上连续的数据报合并成一个交上来，UdpBatch::getSegmentSize 是合并前每个的大小。
+     * 开启之后接收缓冲区要放得下合并之后的数据（最大 64KB）
+     */
+    bool setGRO(bool on = true);
+
+    /**
+     * @brief sendfile 把文件发出去，数据不经过用户态，一直发到 count 字节或者文件结束，见 sylar::SendFile
+     * @param[in, out] offset 文件偏移，返回的时候是下一个要发的位置；nullptr 用文件自己的读写位置
+     * @return 发出去的字节数，中途失败或者超时返回已经发出去的部分；一个字节都没发出去返回 -1
+     */
+    ssize_t sendFile(int file_fd, off_t *offset, size_t count);
+
+    /**
+     * @brief 本端、对端地址，第一次调用的时候 getsockname/getpeername 然后缓存下来
+     * @return 还没有地址的时候返回 nullptr
+     */
+    const sockaddr *getLocalAddress();
+    socklen_t getLocalAddressLen();
+    const sockaddr *getRemoteAddress();
+    socklen_t getRemoteAddressLen();
+    /**
+     * @brief 本端、对端地址的 Address 副本，还没有地址的时候返回 nullptr
+     */
+    Address::ptr getLocalAddr() { return Address::Create(getLocalAddress(), getLocalAddressLen()); }
+    Address::ptr getRemoteAddr() { return Address::Create(getRemoteAddress(), getRemoteAddressLen()); }
+
+    int getFamily() const { return m_family; }
+    int getType() const { return m_type; }
+    int getProtocol() const { return m_protocol; }
+    bool isConnected() const { return m_isConnected; }
+    bool isValid() const { return m_sock != -1; }
+    int getError();
+    /**
+     * @brief 不阻塞地看一眼连接还能不能用：对端关闭、出错、或者有没人等着的数据都返回 false，
+     * 连接池放回、借出空闲连接的时候用
+     */
+    bool checkConnected();
+    int getSocket() const { return m_sock; }
+
+    std::ostream &dump(std::ostream &os);
+    std::string toString();
+
+    /**
+     * @brief 唤醒等在这个 socket 上的协程，被唤醒的操作返回失败
+     */
+    bool cancelRead();
+    bool cancelWrite();
+    bool cancelAccept();
+    bool cancelAll();
+
+    /**
+     * @brief sockaddr 转成可读的字符串，ipv4 "1.2.3.4:80"，ipv6 "[::1]:80"，unix 是路径
+     */
+    static std::string AddressToString(const sockaddr *addr, socklen_t addrlen);
+
+protected:
+    void initSock();
+    void newSock();
+    virtual bool init(int sock);
+
+    /**
+     * @brief 等待 fd 就绪，在 IOManager 的协程里让出协程，否则 poll
+     * @return 0 就绪，-1 失败或者超时
+     */
+    int waitFor(IOManager::Event event, uint64_t timeout_ms);
+
+    template<typename OriginFun, typename... Args>
+    ssize_t doIO(IOManager::Event event, uint64_t timeout_ms, OriginFun fun, Args &&... args);
+
+private:
+    int m_sock = -1;
+    int m_family;
+    int m_type;
+    int m_protocol;
+    bool m_isConnected = false;
+    bool m_noGSO = false;           // sendSegments 失败过，内核或者网卡不支持 UDP_SEGMENT
+    uint64_t m_recvTimeout = ~0ull;
+    uint64_t m_sendTimeout = ~0ull;
+    IOManager *m_iom = nullptr;     // 注册过事件的 IOManager，取消事件的时候用
+
+    sockaddr_storage m_localAddress;
+    socklen_t m_localAddressLen = 0;
+    sockaddr_storage m_remoteAddress;
+    socklen_t m_remoteAddressLen = 0;
+};
+
+std::ostream &operator<<(std::ostream &os, Socket &sock);
+
+}
+
+#endif //SYLAR_SOCKET_H
@@ -12,14 +12,30 @@
 #define SYLAR_SYLAR_H
 
 // 如果头文件不经常变的话，这种方式还是挺合适的，不会引起联动变化
+#include "address.h"
+#include "blocking.h"
+#include "bytearray.h"
 #include "config.h"
+#include "connection_pool.h"
+#include "endian.h"
+#include "fd_manager.h"
 #include "fiber.h"
+#include "file_io.h"
+#include "hook.h"
 #include "iomanager.h"
+#include "io_uring.h"
 #include "log.h"
 #include "macro.h"
+#include "resolver.h"
 #include "scheduler.h"
 #include "singleton.h"
+#include "socket.h"
+#include "tcp_server.h"
 #include "thread.h"
+#include "timer.h"
+#include "timing_wheel.h"
+#include "udp_batch.h"
 #include "util.h"
+#include "zero_copy.h"
 
 #endif //SYLAR_SYLAR_H
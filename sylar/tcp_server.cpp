@@ -0,0 +1,185 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/16 10:05
+* @version: 1.0
+* @description: TCP 服务器，每个工作线程一个 SO_REUSEPORT 监听 socket
+********************************************************************************/
+
+#include "tcp_server.h"
+#include "config.h"
+#include "fiber.h"
+#include "log.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sstream>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static sylar::ConfigVar<uint64_t>::ptr g_tcp_server_read_timeout =
+        sylar::Config::Lookup("tcp_server.read_timeout", (uint64_t)(60 * 1000 * 2),
+                              "tcp server read timeout");
+
+static sylar::ConfigVar<uint64_t>::ptr g_tcp_server_accept_backoff =
+        sylar::Config::Lookup("tcp_server.accept_backoff", (uint64_t)10,
+                              "tcp server sleep ms before retrying a failed accept (EMFILE/ENFILE/ENOBUFS/ENOMEM)");
+
+TcpServer::TcpServer(IOManager *worker)
+        :m_worker(worker)
+        ,m_recvTimeout(g_tcp_server_read_timeout->getValue())
+        ,m_acceptBackoff(g_tcp_server_accept_backoff->getValue())
+        ,m_name("sylar/1.0.0") {
+}
+
+TcpServer::~TcpServer() {
+    for(auto &i : m_socks) {
+        i->close();
+    }
+    m_socks.clear();
+}
+
+bool TcpServer::bind(const sockaddr *addr, socklen_t addrlen, size_t listeners) {
+    std::vector<int> threads = m_worker->getWorkerThreadIds();
+    if(listeners == 0) {
+        listeners = threads.size();
+    }
+
+    sockaddr_storage bind_addr;     // 端口是 0 的时候，后面的监听 socket 用第一个拿到的端口
+    memcpy(&bind_addr, addr, addrlen);
+    for(size_t i = 0; i < listeners; ++i) {
+        Socket::ptr sock = Socket::CreateTCP(addr->sa_family);
+        if(!sock->setReusePort()
+           || !sock->bind((const sockaddr *)&bind_addr, addrlen)
+           || !sock->listen()) {
+            SYLAR_LOG_ERROR(g_logger) << "bind/listen fail errno=" << errno << " errstr=" << strerror(errno)
+                                      << " addr=" << Socket::AddressToString(addr, addrlen);
+            for(auto &s : m_socks) {
+                s->close();
+            }
+            m_socks.clear();
+            m_threads.clear();
+            return false;
+        }
+        if(i == 0) {
+            memcpy(&bind_addr, sock->getLocalAddress(), sock->getLocalAddressLen());
+        }
+        m_socks.push_back(sock);
+        m_threads.push_back(threads[i % threads.size()]);
+    }
+
+    for(size_t i = 0; i < m_socks.size(); ++i) {
+        SYLAR_LOG_INFO(g_logger) << "type=tcp name=" << m_name << " thread=" << m_threads[i]
+                                 << " server bind success: " << *m_socks[i];
+    }
+    return true;
+}
+
+void TcpServer::startAccept(Socket::ptr sock, int thread) {
+    int reactor = m_worker->getCurrentReactor();    // 多 reactor 模式下，监听 socket 和新连接都在当前线程的 epoll 上
+    if(reactor >= 0) {
+        m_worker->bindFd(sock->getSocket(), reactor);
+    }
+    int failing = 0;        // 正在持续失败的 errno，只在开始和恢复的时候打 ERROR/INFO，中间的重试打 DEBUG
+    uint64_t retries = 0;
+    while(!m_isStop) {
+        /**
+         * accept 先直接调用 accept4，只有 EAGAIN 才让出，积压的连接一次取完；
+         * handleClient 放进同一个线程的队列，等这一轮 accept 完再依次执行
+         */
+        Socket::ptr client = sock->accept();
+        if(!client) {
+            int error = errno;
+            if(m_isStop) {
+                break;
+            }
+            if(error == ECONNABORTED || error == ETIMEDOUT) {   // 连接在 accept 之前被对方重置了，或者只是没有新连接
+                continue;
+            }
+            /**
+             * 一直失败的时候每次重试都打 ERROR，每秒上百行，而且 ERROR 会同步刷盘，
+             * 正好在这个线程最忙的时候做阻塞的磁盘写；换了一种错误才再打一次
+             */
+            if(error != failing) {
+                SYLAR_LOG_ERROR(g_logger) << "accept errno=" << error << " errstr=" << strerror(error)
+                                          << " sock=" << *sock << " retry every " << m_acceptBackoff << "ms";
+                failing = error;
+            } else {
+                SYLAR_LOG_DEBUG(g_logger) << "accept errno=" << error << " retry=" << retries;
+            }
+            ++retries;
+            /**
+             * fd 用完（EMFILE/ENFILE）、内存不够（ENOBUFS/ENOMEM）的时候积压的连接还在，监听 socket 一直可读，
+             * 马上重试只会空转占满这个线程；睡一会儿，让别的协程先把连接处理完、关掉
+             */
+            IOManager *worker = m_worker;
+            Fiber::ptr fiber = Fiber::GetThis();
+            worker->addWheelTimer(m_acceptBackoff, [worker, fiber, thread]() {
+                worker->schedule(fiber, thread);
+            });
+            Fiber::YieldToHold();
+            continue;
+        }
+        if(failing) {
+            SYLAR_LOG_INFO(g_logger) << "accept recovered sock=" << *sock << " after " << retries << " retries";
+            failing = 0;
+            retries = 0;
+        }
+        ++m_acceptCount;
+        client->setRecvTimeout(m_recvTimeout);
+        if(reactor >= 0) {
+            m_worker->bindFd(client->getSocket(), reactor);
+        }
+        m_worker->schedule(std::bind(&TcpServer::handleClient, shared_from_this(), client), thread);
+    }
+    sock->close();
+}
+
+bool TcpServer::start() {
+    if(!m_isStop) {
+        return true;
+    }
+    m_isStop = false;
+    for(size_t i = 0; i < m_socks.size(); ++i) {
+        m_worker->schedule(std::bind(&TcpServer::startAccept, shared_from_this(), m_socks[i], m_threads[i]),
+                           m_threads[i]);
+    }
+    return true;
+}
+
+void TcpServer::stop() {
+    m_isStop = true;
+    /**
+     * 不能在这里 cancelAll + close：accept 协程被唤醒之后不一定在原来的线程上，可能正要重新注册事件，
+     * 关掉之后 fd 号被复用，它就永远等不到了。shutdown 之后监听 socket 一直是 EPOLLHUP，
+     * 已经在等的、马上要注册的都会被唤醒，accept 返回 EINVAL，由 accept 循环自己关闭
+     */
+    for(auto &sock : m_socks) {
+        ::shutdown(sock->getSocket(), SHUT_RDWR);
+    }
+    m_socks.clear();
+    m_threads.clear();
+}
+
+void TcpServer::handleClient(Socket::ptr client) {
+    SYLAR_LOG_INFO(g_logger) << "handleClient: " << *client;
+}
+
+std::string TcpServer::toString(const std::string &prefix) {
+    std::stringstream ss;
+    ss << prefix << "[type=tcp name=" << m_name
+       << " worker=" << (m_worker ? m_worker->getName() : "")
+       << " recv_timeout=" << m_recvTimeout
+       << " accept_count=" << m_acceptCount << "]" << std::endl;
+    std::string pfx = prefix.empty() ? "    " : prefix;
+    for(size_t i = 0; i < m_socks.size(); ++i) {
+        ss << pfx << pfx << "thread=" << m_threads[i] << " " << *m_socks[i] << std::endl;
+    }
+    return ss.str();
+}
+
+}
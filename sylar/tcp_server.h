@@ -0,0 +1,89 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/16 10:05
+* @version: 1.0
+* @description: TCP 服务器，每个工作线程一个 SO_REUSEPORT 监听 socket
+********************************************************************************/
+
+
+#ifndef SYLAR_TCP_SERVER_H
+#define SYLAR_TCP_SERVER_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include "iomanager.h"
+#include "socket.h"
+
+namespace sylar {
+
+/**
+ * @brief TCP 服务器
+ * bind 的时候给每个工作线程建一个 SO_REUSEPORT 的监听 socket，内核把新连接分散到各个监听 socket 上；
+ * 每个监听 socket 的 accept 循环固定在一个线程上，积压的连接一直 accept4 到 EAGAIN 才让出，
+ * 新连接的 handleClient 也放在同一个线程上执行。多 reactor 模式下 fd 绑定到该线程的 reactor
+ * 需要用 shared_ptr 创建
+ */
+class TcpServer : public std::enable_shared_from_this<TcpServer> {
+public:
+    typedef std::shared_ptr<TcpServer> ptr;
+
+    /**
+     * @param[in] worker 执行 accept 和 handleClient 的 IOManager
+     */
+    TcpServer(IOManager *worker = IOManager::GetThis());
+    virtual ~TcpServer();
+
+    TcpServer(const TcpServer &) = delete;
+    TcpServer &operator=(const TcpServer &) = delete;
+
+    /**
+     * @brief 绑定地址，端口为 0 的时候第一个监听 socket 拿到的端口给其它的用
+     * @param[in] listeners 监听 socket 的个数，0 表示每个工作线程一个
+     */
+    virtual bool bind(const sockaddr *addr, socklen_t addrlen, size_t listeners = 0);
+    bool bind(const Address &addr, size_t listeners = 0) {
+        return bind(addr.getAddr(), addr.getAddrLen(), listeners);
+    }
+    virtual bool start();
+    virtual void stop();
+
+    uint64_t getRecvTimeout() const { return m_recvTimeout; }   // 新连接的接收超时(毫秒)
+    void setRecvTimeout(uint64_t v) { m_recvTimeout = v; }
+    const std::string &getName() const { return m_name; }
+    virtual void setName(const std::string &v) { m_name = v; }
+    bool isStop() const { return m_isStop; }
+
+    const std::vector<Socket::ptr> &getSocks() const { return m_socks; }
+    uint64_t getAcceptCount() const { return m_acceptCount; }
+
+    virtual std::string toString(const std::string &prefix = "");
+
+protected:
+    /**
+     * @brief 处理新连接，在 accept 它的线程上执行，默认打印之后关闭
+     */
+    virtual void handleClient(Socket::ptr client);
+
+    /**
+     * @brief 监听 socket 的 accept 循环，固定在 thread 上执行
+     */
+    virtual void startAccept(Socket::ptr sock, int thread);
+
+private:
+    IOManager *m_worker;
+    std::vector<Socket::ptr> m_socks;   // 监听 socket
+    std::vector<int> m_threads;         // 每个监听 socket 固定的线程
+    uint64_t m_recvTimeout;
+    uint64_t m_acceptBackoff;   // accept 失败之后等多久再重试(毫秒)
+    std::string m_name;
+    std::atomic<bool> m_isStop = {true};
+    std::atomic<uint64_t> m_acceptCount = {0};
+};
+
+}
+
+#endif //SYLAR_TCP_SERVER_H
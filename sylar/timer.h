@@ -0,0 +1,103 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/2 10:12
+* @version: 1.0
+* @description: 定时器
+********************************************************************************/
+
+
+#ifndef SYLAR_TIMER_H
+#define SYLAR_TIMER_H
+
+#include <memory>
+#include <set>
+#include <vector>
+#include <functional>
+#include "thread.h"
+
+namespace sylar {
+
+class TimerManager;
+
+/**
+ * @brief 定时器
+ * 只能通过 TimerManager 创建，按照下一次执行的绝对时间排序
+ */
+class Timer : public std::enable_shared_from_this<Timer> {
+friend class TimerManager;
+public:
+    typedef std::shared_ptr<Timer> ptr;
+
+    bool cancel();  // 取消定时器
+    bool refresh(); // 刷新执行时间，从现在开始重新计时
+    /**
+     * @brief 重置定时器时间
+     * @param[in] ms 定时器执行间隔时间(毫秒)
+     * @param[in] from_now 是否从当前时间开始计算
+     */
+    bool reset(uint64_t ms, bool from_now);
+
+private:
+    Timer(uint64_t ms, std::function<void()> cb,
+          bool recurring, TimerManager *manager);
+    Timer(uint64_t next);   // 只用于在 set 中查找
+
+private:
+    bool m_recurring = false;   // 是否循环定时器
+    uint64_t m_ms = 0;          // 执行周期
+    uint64_t m_next = 0;        // 精确的执行时间（单调时钟，毫秒）
+    std::function<void()> m_cb;
+    TimerManager *m_manager = nullptr;
+
+private:
+    struct Comparator {
+        bool operator()(const Timer::ptr &lhs, const Timer::ptr &rhs) const;
+    };
+};
+
+/**
+ * @brief 定时器管理器
+ * 使用有序 set（红黑树）管理，添加、取消、刷新都是 O(log n)，取最近的定时器 O(1)
+ * IOManager 继承它，把最近的超时时间作为 epoll_wait 的超时时间
+ */
+class TimerManager {
+friend class Timer;
+public:
+    typedef RWMutex RWMutexType;
+
+    TimerManager();
+
+    virtual ~TimerManager();
+
+    Timer::ptr addTimer(uint64_t ms, std::function<void()> cb,
+                        bool recurring = false);
+    /**
+     * @brief 添加条件定时器
+     * @param[in] weak_cond 条件，执行的时候条件对象已经释放了就不执行回调
+     */
+    Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> cb,
+                                 std::weak_ptr<void> weak_cond,
+                                 bool recurring = false);
+
+    uint64_t getNextTimer();    // 到最近一个定时器执行的时间间隔(毫秒)，没有定时器返回 ~0ull
+
+    void listExpiredCb(std::vector<std::function<void()> > &cbs);   // 获取需要执行的定时器的回调函数列表
+
+    bool hasTimer();
+
+protected:
+    virtual void onTimerInsertedAtFront() = 0;  // 有新的最早的定时器插入，需要唤醒 epoll_wait 重新计算超时时间
+
+    void addTimer(Timer::ptr val, RWMutexType::WriteLock &lock);
+
+private:
+    RWMutexType m_mutex;
+    std::set<Timer::ptr, Timer::Comparator> m_timers;
+    std::atomic<bool> m_tickled = {false};   // 是否已经触发过 onTimerInsertedAtFront，避免频繁修改的时候重复唤醒
+};
+
+}
+
+#endif //SYLAR_TIMER_H
@@ -0,0 +1,257 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/5 15:20
+* @version: 1.0
+* @description: 分层时间轮
+********************************************************************************/
+
+#include "timing_wheel.h"
+#include "util.h"
+
+namespace sylar {
+
+static void LinkInit(TimingWheel::Link *head) {
+    head->prev = head;
+    head->next = head;
+}
+
+static bool LinkEmpty(const TimingWheel::Link *head) {
+    return head->next == head;
+}
+
+static void LinkPushBack(TimingWheel::Link *head, TimingWheel::Link *node) {
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+static void LinkRemove(TimingWheel::Link *node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = nullptr;
+    node->next = nullptr;
+}
+
+TimingWheel::Timer::Timer(uint64_t ms, std::function<void()> cb, bool recurring)
+        : m_ms(ms)
+        , m_recurring(recurring)
+        , m_cb(cb) {
+    m_link.owner = this;
+    if(m_recurring && !m_ms) {  // 周期为 0 的循环定时器会在一次推进里无限触发
+        m_ms = 1;
+    }
+}
+
+bool TimingWheel::Timer::cancel() {
+    TimingWheel *wheel = m_wheel;
+    if(!wheel) {
+        return false;
+    }
+    Timer::ptr self;    // 在锁外释放，回调里可能有智能指针
+    {
+        MutexType::Lock lock(wheel->m_mutex);
+        if(m_wheel != wheel || !m_link.next) {  // 已经触发或者被取消
+            return false;
+        }
+        wheel->unlinkNoLock(this);
+        m_wheel = nullptr;
+        m_cb = nullptr;
+        self.swap(m_self);
+    }
+    return true;
+}
+
+bool TimingWheel::Timer::refresh() {
+    TimingWheel *wheel = m_wheel;
+    if(!wheel) {
+        return false;
+    }
+    MutexType::Lock lock(wheel->m_mutex);
+    if(m_wheel != wheel || !m_link.next) {
+        return false;
+    }
+    wheel->unlinkNoLock(this);
+    m_expire = sylar::GetMonotonicMS() + m_ms;
+    wheel->addNoLock(this);
+    return true;
+}
+
+bool TimingWheel::Timer::reset(uint64_t ms) {
+    TimingWheel *wheel = m_wheel;
+    if(!wheel) {
+        return false;
+    }
+    MutexType::Lock lock(wheel->m_mutex);
+    if(m_wheel != wheel || !m_link.next) {
+        return false;
+    }
+    wheel->unlinkNoLock(this);
+    m_ms = (m_recurring && !ms) ? 1 : ms;
+    m_expire = sylar::GetMonotonicMS() + m_ms;
+    wheel->addNoLock(this);
+    return true;
+}
+
+TimingWheel::TimingWheel() {
+    m_currentTick = sylar::GetMonotonicMS();
+    for(int i = 0; i < ROOT_SIZE; ++i) {
+        LinkInit(&m_root[i]);
+    }
+    for(int i = 0; i < LEVELS; ++i) {
+        for(int j = 0; j < LEVEL_SIZE; ++j) {
+            LinkInit(&m_levels[i][j]);
+        }
+    }
+}
+
+TimingWheel::~TimingWheel() {
+    clear();
+}
+
+void TimingWheel::clear() {
+    std::vector<Timer::ptr> timers; // 锁外释放，回调里可能有智能指针
+    MutexType::Lock lock(m_mutex);
+    auto drain = [this, &timers](Link *head) {
+        while(!LinkEmpty(head)) {
+            Timer *timer = head->next->owner;
+            unlinkNoLock(timer);
+            timer->m_wheel = nullptr;
+            timers.push_back(std::move(timer->m_self));
+        }
+    };
+    for(int i = 0; i < ROOT_SIZE; ++i) {
+        drain(&m_root[i]);
+    }
+    for(int i = 0; i < LEVELS; ++i) {
+        for(int j = 0; j < LEVEL_SIZE; ++j) {
+            drain(&m_levels[i][j]);
+        }
+    }
+    lock.unlock();
+}
+
+TimingWheel::Timer::ptr TimingWheel::addTimer(uint64_t ms, std::function<void()> cb, bool recurring) {
+    Timer::ptr timer(new Timer(ms, cb, recurring));
+    timer->m_expire = sylar::GetMonotonicMS() + timer->m_ms;
+    MutexType::Lock lock(m_mutex);
+    timer->m_self = timer;
+    timer->m_wheel = this;
+    addNoLock(timer.get());
+    return timer;
+}
+
+/**
+ * 根据离到期还有多少个 tick 决定放在哪一层：
+ * [0, 256) 放第一层，按到期时间的低 8 位选槽
+ * [256, 2^14) 放第二层，按到期时间的 8~13 位选槽，以此类推
+ * 超过 2^26 ms(约 18 小时) 的放在最高层的最远的槽，级联下来的时候再重新计算
+ */
+void TimingWheel::addNoLock(Timer *timer) {
+    uint64_t expire = timer->m_expire;
+    if(expire < m_currentTick) {    // 已经过期，下一个 tick 就触发
+        expire = m_currentTick;
+    }
+    uint64_t idx = expire - m_currentTick;
+    Link *slot = nullptr;
+    if(idx < (uint64_t)ROOT_SIZE) {
+        slot = &m_root[expire & (ROOT_SIZE - 1)];
+    } else {
+        static const uint64_t MAX_IDX = (1ull << (ROOT_BITS + LEVELS * LEVEL_BITS)) - 1;
+        if(idx > MAX_IDX) {
+            expire = m_currentTick + MAX_IDX;
+            idx = MAX_IDX;
+        }
+        for(int i = 0; i < LEVELS; ++i) {
+            if(idx < (1ull << (ROOT_BITS + (i + 1) * LEVEL_BITS))) {
+                slot = &m_levels[i][(expire >> (ROOT_BITS + i * LEVEL_BITS)) & (LEVEL_SIZE - 1)];
+                break;
+            }
+        }
+    }
+    LinkPushBack(slot, &timer->m_link);
+    ++m_size;
+}
+
+void TimingWheel::unlinkNoLock(Timer *timer) {
+    LinkRemove(&timer->m_link);
+    --m_size;
+}
+
+size_t TimingWheel::cascadeNoLock(Link *level, size_t index) {
+    Link tmp;
+    LinkInit(&tmp);
+    Link *head = &level[index];
+    while(!LinkEmpty(head)) {   // 先整体摘下来，重新放的时候可能还放回同一个槽
+        Link *node = head->next;
+        LinkRemove(node);
+        LinkPushBack(&tmp, node);
+    }
+    while(!LinkEmpty(&tmp)) {
+        Timer *timer = tmp.next->owner;
+        LinkRemove(&timer->m_link);
+        --m_size;
+        addNoLock(timer);
+    }
+    return index;
+}
+
+void TimingWheel::advance(uint64_t now_ms, std::vector<std::function<void()> > &cbs) {
+    std::vector<Timer::ptr> expired;    // 锁外释放
+    MutexType::Lock lock(m_mutex);
+    if(!m_size) {   // 没有定时器，直接跳过去
+        if(now_ms >= m_currentTick) {
+            m_currentTick = now_ms + 1;
+        }
+        return;
+    }
+    while(m_currentTick <= now_ms) {
+        size_t index = m_currentTick & (ROOT_SIZE - 1);
+        if(!index) {    // 第一层转完一圈，把高层对应的槽级联下来
+            for(int i = 0; i < LEVELS; ++i) {
+                if(cascadeNoLock(m_levels[i],
+                                 (m_currentTick >> (ROOT_BITS + i * LEVEL_BITS)) & (LEVEL_SIZE - 1))) {
+                    break;
+                }
+            }
+        }
+        ++m_currentTick;
+
+        Link *head = &m_root[index];
+        while(!LinkEmpty(head)) {
+            Timer *timer = head->next->owner;
+            unlinkNoLock(timer);
+            cbs.push_back(timer->m_cb);
+            if(timer->m_recurring) {
+                timer->m_expire = now_ms + timer->m_ms;
+                addNoLock(timer);
+            } else {
+                timer->m_cb = nullptr;
+                timer->m_wheel = nullptr;
+                expired.push_back(std::move(timer->m_self));
+            }
+        }
+        if(!m_size && m_currentTick <= now_ms) {
+            m_currentTick = now_ms + 1;
+        }
+    }
+}
+
+uint64_t TimingWheel::getNextTimeout(uint64_t now_ms) {
+    MutexType::Lock lock(m_mutex);
+    if(!m_size) {
+        return ~0ull;
+    }
+    for(uint64_t tick = m_currentTick;
+        tick == m_currentTick || (tick & (ROOT_SIZE - 1)); ++tick) {    // 只看到第一层这一圈结束
+        if(!LinkEmpty(&m_root[tick & (ROOT_SIZE - 1)])) {
+            return tick > now_ms ? tick - now_ms : 0;
+        }
+    }
+    uint64_t next_cascade = (m_currentTick | (ROOT_SIZE - 1)) + 1;
+    return next_cascade > now_ms ? next_cascade - now_ms : 0;
+}
+
+}
@@ -0,0 +1,107 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/5 15:20
+* @version: 1.0
+* @description: 分层时间轮
+********************************************************************************/
+
+
+#ifndef SYLAR_TIMING_WHEEL_H
+#define SYLAR_TIMING_WHEEL_H
+
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include "thread.h"
+
+namespace sylar {
+
+/**
+ * @brief 分层时间轮，精度 1ms
+ * 4 层，第一层 256 个槽，后面三层各 64 个槽（和 Linux 内核老版本的 timer wheel 一样）
+ * 每个槽是一个侵入式双向链表，添加、取消、刷新都是 O(1)
+ * 连接超时这种场景，大部分定时器在到期之前就被取消或者刷新了，用堆的话每次刷新都要 O(log n) 再加一把全局锁
+ *
+ * 一般每个 IOManager 线程一个时间轮，由该线程的 idle 推进，锁只是为了其它线程偶尔取消、刷新，基本不会有竞争
+ */
+class TimingWheel {
+public:
+    typedef Spinlock MutexType;
+
+    class Timer;
+    struct Link {   // 侵入式链表节点，槽位的头节点 owner 为空
+        Link *prev = nullptr;
+        Link *next = nullptr;
+        Timer *owner = nullptr;
+    };
+
+    class Timer {
+    friend class TimingWheel;
+    public:
+        typedef std::shared_ptr<Timer> ptr;
+
+        bool cancel();  // 取消定时器
+        bool refresh(); // 从现在开始重新计时
+        bool reset(uint64_t ms);    // 修改周期，并从现在开始重新计时
+
+    private:
+        Timer(uint64_t ms, std::function<void()> cb, bool recurring);
+
+    private:
+        Link m_link;    // 挂在槽位链表上的节点
+        uint64_t m_expire = 0;  // 到期的 tick（单调时钟 ms）
+        uint64_t m_ms = 0;
+        bool m_recurring = false;
+        std::function<void()> m_cb;
+        std::atomic<TimingWheel*> m_wheel = {nullptr};  // 所在的时间轮，不在轮上的时候为空
+        Timer::ptr m_self;  // 挂在轮上的时候持有自己，摘下来的时候释放
+    };
+
+    TimingWheel();
+    ~TimingWheel();
+
+    Timer::ptr addTimer(uint64_t ms, std::function<void()> cb, bool recurring = false);
+
+    /**
+     * @brief 推进时间轮到 now_ms（单调时钟，GetMonotonicMS），收集到期的回调
+     */
+    void advance(uint64_t now_ms, std::vector<std::function<void()> > &cbs);
+
+    /**
+     * @brief 到下一次需要推进时间轮的间隔(ms)，没有定时器返回 ~0ull
+     * 第一层没有定时器的时候返回到下一次高层级联的间隔，所以可能会提前醒来
+     */
+    uint64_t getNextTimeout(uint64_t now_ms);
+
+    size_t size() const { return m_size; }
+
+    /**
+     * @brief 摘下所有定时器，不触发；外面持有的 Timer::ptr 之后 cancel 返回 false
+     */
+    void clear();
+
+private:
+    void addNoLock(Timer *timer);
+    void unlinkNoLock(Timer *timer);
+    size_t cascadeNoLock(Link *level, size_t index);
+
+private:
+    static const int ROOT_BITS = 8;
+    static const int LEVEL_BITS = 6;
+    static const int ROOT_SIZE = 1 << ROOT_BITS;
+    static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const int LEVELS = 3;    // 除第一层外的层数
+
+    MutexType m_mutex;
+    uint64_t m_currentTick = 0; // 下一个要处理的 tick
+    std::atomic<size_t> m_size = {0};
+    Link m_root[ROOT_SIZE];
+    Link m_levels[LEVELS][LEVEL_SIZE];
+};
+
+}
+
+#endif //SYLAR_TIMING_WHEEL_H
@@ -0,0 +1,110 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/27 10:00
+* @version: 1.0
+* @description: UDP 批量收发的缓冲区，recvmmsg/sendmmsg 用的数组预先分配好，一批收发不用再分配内存
+********************************************************************************/
+
+#include "udp_batch.h"
+#include "log.h"
+#include "macro.h"
+
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+namespace sylar {
+
+UdpBatch::UdpBatch(size_t count, size_t buffer_size)
+        :m_bufferSize(buffer_size)
+        ,m_buffers(count * buffer_size)
+        ,m_msgs(count)
+        ,m_iovs(count)
+        ,m_addrs(count)
+        ,m_controls(count) {
+    SYLAR_ASSERT(count > 0 && buffer_size > 0);
+    memset(&m_msgs[0], 0, sizeof(mmsghdr) * count);
+    for(size_t i = 0; i < count; ++i) {
+        m_iovs[i].iov_base = getData(i);
+        m_iovs[i].iov_len = m_bufferSize;
+        m_msgs[i].msg_hdr.msg_iov = &m_iovs[i];
+        m_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+bool UdpBatch::add(const void *data, size_t length, const sockaddr *to, socklen_t tolen) {
+    char *buf = prepare();
+    if(!buf || length > m_bufferSize) {
+        return false;
+    }
+    memcpy(buf, data, length);
+    commit(length, to, tolen);
+    return true;
+}
+
+char *UdpBatch::prepare() {
+    return full() ? nullptr : getData(m_size);
+}
+
+void UdpBatch::commit(size_t length, const sockaddr *to, socklen_t tolen) {
+    SYLAR_ASSERT(!full() && length <= m_bufferSize && tolen <= sizeof(sockaddr_storage));
+    msghdr &hdr = m_msgs[m_size].msg_hdr;
+    m_iovs[m_size].iov_len = length;
+    if(to) {
+        memcpy(&m_addrs[m_size], to, tolen);
+        hdr.msg_name = &m_addrs[m_size];
+        hdr.msg_namelen = tolen;
+    } else {
+        hdr.msg_name = nullptr;
+        hdr.msg_namelen = 0;
+    }
+    hdr.msg_control = nullptr;
+    hdr.msg_controllen = 0;
+    hdr.msg_flags = 0;
+    m_msgs[m_size].msg_len = 0;
+    ++m_size;
+}
+
+void UdpBatch::prepareRecv() {
+    m_size = 0;
+    m_sent = 0;
+    for(size_t i = 0; i < m_msgs.size(); ++i) {
+        msghdr &hdr = m_msgs[i].msg_hdr;
+        m_iovs[i].iov_len = m_bufferSize;
+        hdr.msg_name = &m_addrs[i];
+        hdr.msg_namelen = sizeof(sockaddr_storage);
+        hdr.msg_control = m_controls[i].buf;
+        hdr.msg_controllen = sizeof(m_controls[i].buf);
+        hdr.msg_flags = 0;
+        m_msgs[i].msg_len = 0;
+    }
+}
+
+uint16_t UdpBatch::getSegmentSize(size_t i) const {
+#ifdef UDP_GRO
+    msghdr *hdr = const_cast<msghdr *>(&m_msgs[i].msg_hdr);
+    if(!hdr->msg_control) {
+        return 0;
+    }
+    for(cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+        if(cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int size = 0;
+            memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+            return size;
+        }
+    }
+#endif
+    return 0;
+}
+
+size_t UdpBatch::getTotalLength() const {
+    size_t total = 0;
+    for(size_t i = 0; i < m_size; ++i) {
+        total += m_msgs[i].msg_len;
+    }
+    return total;
+}
+
+}
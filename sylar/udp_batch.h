@@ -0,0 +1,110 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/27 10:00
+* @version: 1.0
+* @description: UDP 批量收发的缓冲区，recvmmsg/sendmmsg 用的数组预先分配好，一批收发不用再分配内存
+********************************************************************************/
+
+
+#ifndef SYLAR_UDP_BATCH_H
+#define SYLAR_UDP_BATCH_H
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+namespace sylar {
+
+/**
+ * @brief 一批 UDP 数据报
+ * count 个定长缓冲区连续分配，每个数据报一个 mmsghdr + iovec + 地址 + 控制消息缓冲区，构造之后不再分配内存。
+ * 接收：Socket::recvBatch 收满或者收完已经到达的数据报，size() 是收到的个数；
+ * 发送：add 把数据拷进缓冲区排好，Socket::sendBatch 一次 sendmmsg 发出去。
+ * 同一个对象收、发都可以，但一次只能做一件事
+ */
+class UdpBatch {
+friend class Socket;
+public:
+    typedef std::shared_ptr<UdpBatch> ptr;
+
+    /**
+     * @param[in] count 一批最多多少个数据报
+     * @param[in] buffer_size 每个数据报的缓冲区大小；接收端开启了 GRO 的时候合并之后的数据可能有 64KB
+     */
+    UdpBatch(size_t count = 64, size_t buffer_size = 2048);
+
+    UdpBatch(const UdpBatch &) = delete;
+    UdpBatch &operator=(const UdpBatch &) = delete;
+
+    size_t getCapacity() const { return m_msgs.size(); }
+    size_t getBufferSize() const { return m_bufferSize; }
+    size_t size() const { return m_size; }
+    bool empty() const { return !m_size; }
+    bool full() const { return m_size == m_msgs.size(); }
+    void clear() { m_size = 0; m_sent = 0; }
+
+    /**
+     * @brief 排一个要发送的数据报，数据拷进第 size() 个缓冲区
+     * @param[in] to 目的地址，已经 connect 的 socket 传 nullptr
+     * @return 满了或者数据比缓冲区大返回 false
+     */
+    bool add(const void *data, size_t length, const sockaddr *to = nullptr, socklen_t tolen = 0);
+
+    /**
+     * @brief 直接在第 size() 个缓冲区里填数据，填完之后 commit，省一次拷贝
+     * @return 满了返回 nullptr
+     */
+    char *prepare();
+    void commit(size_t length, const sockaddr *to = nullptr, socklen_t tolen = 0);
+
+    // 第 i 个数据报，接收之后有效
+    char *getData(size_t i) { return &m_buffers[i * m_bufferSize]; }
+    const char *getData(size_t i) const { return &m_buffers[i * m_bufferSize]; }
+    size_t getLength(size_t i) const { return m_msgs[i].msg_len; }
+    const sockaddr *getAddress(size_t i) const { return (const sockaddr *)&m_addrs[i]; }
+    socklen_t getAddressLen(size_t i) const { return m_msgs[i].msg_hdr.msg_namelen; }
+    bool isTruncated(size_t i) const { return m_msgs[i].msg_hdr.msg_flags & MSG_TRUNC; }
+    /**
+     * @brief GRO 合并过的数据报里每一段的大小（最后一段可以更短），没有合并返回 0
+     */
+    uint16_t getSegmentSize(size_t i) const;
+
+    /**
+     * @brief 收到的数据报的总字节数
+     */
+    size_t getTotalLength() const;
+
+private:
+    /**
+     * @brief 接收之前把每个 mmsghdr 的长度字段恢复成缓冲区大小
+     */
+    void prepareRecv();
+
+private:
+    /**
+     * @brief 控制消息缓冲区，放得下一个 UDP_GRO 的 int
+     */
+    struct Control {
+        union {
+            cmsghdr align;
+            char buf[CMSG_SPACE(sizeof(int))];
+        };
+    };
+
+    size_t m_bufferSize;
+    size_t m_size = 0;
+    size_t m_sent = 0;      // 发送了一部分的时候下次从这里开始
+    std::vector<char> m_buffers;
+    std::vector<mmsghdr> m_msgs;
+    std::vector<iovec> m_iovs;
+    std::vector<sockaddr_storage> m_addrs;
+    std::vector<Control> m_controls;
+};
+
+}
+
+#endif //SYLAR_UDP_BATCH_H
@@ -8,6 +8,8 @@
 ********************************************************************************/
 
 #include <execinfo.h>
+#include <sys/time.h>
+#include <time.h>
 #include "log.h"
 #include "util.h"
 #include "fiber.h"
@@ -51,5 +53,26 @@ std::string BacktraceToString(int size, int skip, const std::string &prefix) {
     return ss.str();
 }
 
+uint64_t GetCurrentMS() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return tv.tv_sec * 1000ul + tv.tv_usec / 1000;
+}
+
+uint64_t GetCurrentUS() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return tv.tv_sec * 1000 * 1000ul + tv.tv_usec;
+}
+
+uint64_t GetMonotonicUS() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000ul + ts.tv_nsec / 1000;
+}
+
+uint64_t GetMonotonicMS() {
+    return GetMonotonicUS() / 1000;
+}
 
 }
\ No newline at end of file
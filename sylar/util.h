@@ -29,6 +29,14 @@ void Backtrace(std::vector<std::string> &bt, int size = 64, int skip = 1);
 
 std::string BacktraceToString(int size = 64, int skip = 2, const std::string &prefix = "");
 
+uint64_t GetCurrentMS();    // 当前时间，毫秒
+
+uint64_t GetCurrentUS();    // 当前时间，微秒
+
+uint64_t GetMonotonicUS();  // 单调时钟，微秒，不受系统时间调整影响，计算时间间隔用
+
+uint64_t GetMonotonicMS();  // 单调时钟，毫秒，定时器用
+
 }
 
 #endif //SYLAR_UTIL_H
@@ -0,0 +1,176 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/19 09:30
+* @version: 1.0
+* @description: 零拷贝：sendfile/splice/tee，EAGAIN 的时候让出协程
+********************************************************************************/
+
+#include "zero_copy.h"
+#include "iomanager.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+
+namespace sylar {
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+/**
+ * @brief 等 fd 就绪，在 IOManager 的协程里让出协程，否则 poll
+ */
+static int WaitFd(int fd, IOManager::Event event, uint64_t timeout_ms) {
+    IOManager *iom = dynamic_cast<IOManager *>(Scheduler::GetThis());
+    if(iom) {
+        return iom->waitEvent(fd, event, timeout_ms);
+    }
+
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = event == IOManager::READ ? POLLIN : POLLOUT;
+    pfd.revents = 0;
+    int timeout = timeout_ms == ~0ull ? -1 : (int)std::min(timeout_ms, (uint64_t)INT_MAX);
+    int rt = 0;
+    do {
+        rt = poll(&pfd, 1, timeout);
+    } while(rt < 0 && errno == EINTR);
+    if(rt == 0) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    return rt < 0 ? -1 : 0;
+}
+
+/**
+ * @brief splice/tee 返回 EAGAIN 的时候不知道是哪一端没就绪，先看一眼，输入端有数据就等输出端
+ */
+static int WaitEither(int fd_in, int fd_out, uint64_t timeout_ms) {
+    pollfd pfd[2];
+    pfd[0].fd = fd_in;
+    pfd[0].events = POLLIN;
+    pfd[0].revents = 0;
+    pfd[1].fd = fd_out;
+    pfd[1].events = POLLOUT;
+    pfd[1].revents = 0;
+    if(poll(pfd, 2, 0) < 0 && errno != EINTR) {
+        return -1;
+    }
+    if(!(pfd[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+        return WaitFd(fd_in, IOManager::READ, timeout_ms);
+    }
+    return WaitFd(fd_out, IOManager::WRITE, timeout_ms);
+}
+
+ssize_t SendFile(int out_fd, int in_fd, off_t *offset, size_t count, uint64_t timeout_ms) {
+    size_t sent = 0;
+    while(sent < count) {
+        ssize_t n = sendfile(out_fd, in_fd, offset, count - sent);  // 有 offset 的时候内核会更新它
+        if(n > 0) {
+            sent += n;
+            continue;
+        }
+        if(n == 0) {    // 文件结束
+            break;
+        }
+        if(errno == EINTR) {
+            continue;
+        }
+        if(errno != EAGAIN || WaitFd(out_fd, IOManager::WRITE, timeout_ms)) {
+            return sent ? (ssize_t)sent : -1;   // 已经发出去的不能当成没发
+        }
+    }
+    return sent;
+}
+
+ssize_t Splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len,
+               unsigned int flags, uint64_t timeout_ms) {
+    while(true) {
+        ssize_t n = splice(fd_in, off_in, fd_out, off_out, len, flags | SPLICE_F_NONBLOCK);
+        if(n >= 0) {
+            return n;
+        }
+        if(errno == EINTR) {
+            continue;
+        }
+        if(errno != EAGAIN || WaitEither(fd_in, fd_out, timeout_ms)) {
+            return -1;
+        }
+    }
+}
+
+ssize_t Tee(int fd_in, int fd_out, size_t len, unsigned int flags, uint64_t timeout_ms) {
+    while(true) {
+        ssize_t n = tee(fd_in, fd_out, len, flags | SPLICE_F_NONBLOCK);
+        if(n >= 0) {
+            return n;
+        }
+        if(errno == EINTR) {
+            continue;
+        }
+        if(errno != EAGAIN || WaitEither(fd_in, fd_out, timeout_ms)) {
+            return -1;
+        }
+    }
+}
+
+/**
+ * @brief 内部管道，hook 的 close 会在每个 IOManager 上 cancelAll，和 Socket::close 一样直接关
+ */
+struct SplicePipe {
+    int fds[2] = {-1, -1};
+
+    ~SplicePipe() {
+        for(int fd : fds) {
+            if(fd != -1) {
+                close(fd);
+            }
+        }
+    }
+};
+
+ssize_t SpliceAll(int in_fd, int out_fd, size_t count, uint64_t timeout_ms) {
+    static const size_t PIPE_SIZE = 1 << 20;    // 管道越大，每次搬运的越多
+    SplicePipe pipe;
+    if(pipe2(pipe.fds, O_NONBLOCK | O_CLOEXEC)) {
+        SYLAR_LOG_ERROR(g_logger) << "SpliceAll pipe2 errno=" << errno << " errstr=" << strerror(errno);
+        return -1;
+    }
+    int pipe_size = fcntl(pipe.fds[1], F_SETPIPE_SZ, (int)PIPE_SIZE);   // 超过 pipe-max-size 会失败，用默认大小
+    if(pipe_size < 0) {
+        pipe_size = fcntl(pipe.fds[1], F_GETPIPE_SZ);
+    }
+
+    size_t total = 0;
+    while(total < count) {
+        size_t want = std::min(count - total, (size_t)std::max(pipe_size, 4096));
+        ssize_t n = Splice(in_fd, nullptr, pipe.fds[1], nullptr, want,
+                           SPLICE_F_MOVE | SPLICE_F_MORE, timeout_ms);
+        if(n < 0) {
+            return total ? (ssize_t)total : -1;
+        }
+        if(n == 0) {    // 输入结束
+            break;
+        }
+        size_t pending = n;     // 管道里的数据全部搬出去再读下一批
+        while(pending > 0) {
+            // 最后一段不带 SPLICE_F_MORE，不然 socket 会像 TCP_CORK 一样压着尾巴等后面的数据
+            unsigned int flags = SPLICE_F_MOVE | (total + pending < count ? SPLICE_F_MORE : 0);
+            ssize_t m = Splice(pipe.fds[0], nullptr, out_fd, nullptr, pending, flags, timeout_ms);
+            if(m <= 0) {    // 管道里剩下的随管道一起丢掉，已经写到 out_fd 的照实返回
+                return total ? (ssize_t)total : -1;
+            }
+            pending -= m;
+            total += m;
+        }
+    }
+    return total;
+}
+
+}
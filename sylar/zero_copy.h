@@ -0,0 +1,57 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/19 09:30
+* @version: 1.0
+* @description: 零拷贝：sendfile/splice/tee，EAGAIN 的时候让出协程
+********************************************************************************/
+
+
+#ifndef SYLAR_ZERO_COPY_H
+#define SYLAR_ZERO_COPY_H
+
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/types.h>
+
+namespace sylar {
+
+/**
+ * 数据只在内核里搬运，不经过用户态缓冲区。socket 需要是非阻塞的（Socket 创建的都是），
+ * EAGAIN 的时候在 IOManager 的协程里注册事件让出，不在协程里的时候 poll 等待
+ * 超时是每次等待的超时(毫秒)，~0ull 表示不超时，超时 errno 为 ETIMEDOUT
+ */
+
+/**
+ * @brief 文件发到 socket，一直发到 count 字节或者文件结束
+ * @param[in, out] offset 从哪里开始读文件，返回的时候是下一个要发的位置（出错的时候也是）；
+ *                 为 nullptr 的时候用文件自己的读写位置
+ * @return 发出去的字节数；出错或者超时的时候已经发出去一部分的返回这部分的字节数（errno 是出错的原因），
+ *         一个字节都没发出去返回 -1 并设置 errno
+ */
+ssize_t SendFile(int out_fd, int in_fd, off_t *offset, size_t count, uint64_t timeout_ms = ~0ull);
+
+/**
+ * @brief 一次 splice，至少有一端是管道，搬运了数据就返回，语义和 splice 一样
+ * EAGAIN 的时候看是哪一端没就绪就等哪一端
+ */
+ssize_t Splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len,
+               unsigned int flags = SPLICE_F_MOVE, uint64_t timeout_ms = ~0ull);
+
+/**
+ * @brief 一次 tee，两端都是管道，复制数据不消费，语义和 tee 一样
+ */
+ssize_t Tee(int fd_in, int fd_out, size_t len, unsigned int flags = 0, uint64_t timeout_ms = ~0ull);
+
+/**
+ * @brief 经过一个内部的管道把 in_fd 的数据 splice 到 out_fd，用于 socket 到 socket、文件到 socket 转发
+ * 一直转发到 count 字节或者 in_fd 结束
+ * @return 写到 out_fd 的字节数；出错或者超时的时候已经转发了一部分的返回这部分的字节数（errno 是出错的原因），
+ *         一个字节都没转发返回 -1 并设置 errno
+ */
+ssize_t SpliceAll(int in_fd, int out_fd, size_t count = ~(size_t)0, uint64_t timeout_ms = ~0ull);
+
+}
+
+#endif //SYLAR_ZERO_COPY_H
@@ -0,0 +1,157 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/29 10:00
+* @version: 1.0
+* @description: 阻塞调用卸载测试：返回值、异常和 errno、回到原来的调度器、IO 线程不被卡住、队列上限
+********************************************************************************/
+
+#include "../sylar/sylar.h"
+#include <netdb.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+void test_result() {
+    pid_t tid = sylar::GetThreadId();
+    sylar::Scheduler *scheduler = sylar::Scheduler::GetThis();
+    pid_t worker = sylar::blocking([]() { return sylar::GetThreadId(); });
+    SYLAR_ASSERT(worker != tid && sylar::Scheduler::GetThis() == scheduler);    // 回到原来的调度器，不一定是原来的线程
+
+    std::string s = sylar::blocking([]() { return std::string("hello"); });
+    SYLAR_ASSERT(s == "hello");
+    std::unique_ptr<int> p = sylar::blocking([]() { return std::unique_ptr<int>(new int(42)); });
+    SYLAR_ASSERT(p && *p == 42);
+
+    int called = 0;
+    sylar::blocking([&called]() { ++called; });
+    SYLAR_ASSERT(called == 1);
+
+    // errno 和异常带回调用方
+    int rt = sylar::blocking([]() { return ::close(-1); });
+    SYLAR_ASSERT(rt == -1 && errno == EBADF);
+    bool caught = false;
+    try {
+        sylar::blocking([]() -> int { throw std::runtime_error("boom"); });
+    } catch(std::runtime_error &ex) {
+        caught = std::string(ex.what()) == "boom";
+    }
+    SYLAR_ASSERT(caught);
+
+    // 真正的阻塞调用
+    addrinfo *res = nullptr;
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    rt = sylar::blocking([&res, &hints]() { return getaddrinfo("localhost", "80", &hints, &res); });
+    SYLAR_ASSERT(rt == 0 && res);
+    freeaddrinfo(res);
+    SYLAR_LOG_INFO(g_logger) << "result ok";
+}
+
+/**
+ * @brief 在别的 IOManager 里调用，执行完回到那个 IOManager
+ */
+void test_scheduler(sylar::IOManager *other) {
+    std::atomic<bool> done(false);
+    other->schedule([other, &done]() {
+        for(int i = 0; i < 10; ++i) {
+            sylar::blocking([]() { usleep(1000); });
+            SYLAR_ASSERT(sylar::Scheduler::GetThis() == other);
+        }
+        done = true;
+    });
+    while(!done) {
+        usleep(1000);
+    }
+    SYLAR_LOG_INFO(g_logger) << "scheduler ok";
+}
+
+/**
+ * @brief 阻塞调用执行期间 IO 线程照样跑别的协程
+ */
+void test_not_blocked() {
+    std::atomic<int> ticks(0);
+    std::atomic<bool> stop(false);
+    sylar::IOManager::GetThis()->schedule([&ticks, &stop]() {
+        while(!stop) {
+            usleep(5 * 1000);    // 开启了 hook，只挂起协程
+            ++ticks;
+        }
+    });
+    uint64_t begin = sylar::GetCurrentMS();
+    sylar::blocking([]() { usleep(200 * 1000); });
+    SYLAR_ASSERT(sylar::GetCurrentMS() - begin >= 190);
+    SYLAR_ASSERT2(ticks >= 10, std::to_string(ticks));
+    stop = true;
+    SYLAR_LOG_INFO(g_logger) << "not blocked ok ticks=" << ticks;
+}
+
+void test_queue_limit() {
+    sylar::BlockingExecutor executor(1, 2, "limited");
+
+    // 一个在执行、两个在排队，再 post 就满了
+    sylar::Semaphore gate;
+    SYLAR_ASSERT(executor.post([&gate]() { gate.wait(); }));
+    while(true) {   // 等工作线程把第一个取走
+        sylar::BlockingExecutor::Stats stats;
+        executor.getStats(stats);
+        if(stats.running == 1) {
+            break;
+        }
+        usleep(1000);
+    }
+    SYLAR_ASSERT(executor.post([]() {}) && executor.post([]() {}));
+    SYLAR_ASSERT(!executor.post([]() {}));
+
+    // 满了的时候协程排队等空位，不占着 IO 线程
+    const int N = 10;
+    std::atomic<int> done(0);
+    for(int i = 0; i < N; ++i) {
+        sylar::IOManager::GetThis()->schedule([&executor, &done, i]() {
+            int rt = sylar::blocking(&executor, [i]() { usleep(2000); return i; });
+            SYLAR_ASSERT(rt == i);
+            ++done;
+        });
+    }
+    usleep(20 * 1000);
+    SYLAR_ASSERT(done == 0);
+    gate.notify();
+    while(done < N) {
+        usleep(1000);
+    }
+
+    sylar::BlockingExecutor::Stats stats;
+    executor.getStats(stats);
+    SYLAR_LOG_INFO(g_logger) << executor.dumpStats();
+    SYLAR_ASSERT(stats.tasks == N + 3 && stats.rejected == 1 && stats.full_waits >= N);
+    SYLAR_ASSERT(stats.max_queued == 2 && stats.queued == 0 && stats.running == 0);
+
+    // 停止之后直接在调用方执行
+    executor.stop();
+    pid_t tid = sylar::GetThreadId();
+    SYLAR_ASSERT(sylar::blocking(&executor, []() { return sylar::GetThreadId(); }) == tid);
+    SYLAR_ASSERT(!executor.post([]() {}));
+    SYLAR_LOG_INFO(g_logger) << "queue limit ok";
+}
+
+int main(int argc, char **argv) {
+    // 不在协程里直接执行
+    pid_t tid = sylar::GetThreadId();
+    SYLAR_ASSERT(sylar::blocking([]() { return sylar::GetThreadId(); }) == tid);
+
+    {
+        sylar::IOManager other(1, false, "other");  // 后析构，iom 里的测试跑完之前一直在
+        sylar::IOManager iom(2, false, "blocking_test");
+        iom.setHookEnable(true);
+        iom.schedule([&other]() {
+            test_result();
+            test_scheduler(&other);
+            test_not_blocked();
+            test_queue_limit();
+        });
+    }
+    SYLAR_LOG_INFO(g_logger) << sylar::BlockingExecutor::GetInstance()->dumpStats();
+    return 0;
+}
@@ -0,0 +1,180 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/15 14:30
+* @version: 1.0
+* @description: ByteArray 测试：各种编码写进去再读出来，块大小从 1 字节到默认大小，iovec 收发
+********************************************************************************/
+
+#include "../sylar/sylar.h"
+#include <sys/socket.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+void test() {
+/**
+ * 随机写 len 个值，回到开头读出来比较；再写到文件里读回来比较
+ */
+#define XX(type, len, write_fun, read_fun, base_len) {\
+    std::vector<type> vec; \
+    for(int i = 0; i < len; ++i) { \
+        vec.push_back((type)(((uint64_t)rand() << 32) | rand()) * (i % 2 ? 1 : -1)); \
+    } \
+    sylar::ByteArray::ptr ba(new sylar::ByteArray(base_len)); \
+    for(auto &i : vec) { \
+        ba->write_fun(i); \
+    } \
+    ba->setPosition(0); \
+    for(size_t i = 0; i < vec.size(); ++i) { \
+        type v = ba->read_fun(); \
+        SYLAR_ASSERT(v == vec[i]); \
+    } \
+    SYLAR_ASSERT(ba->getReadSize() == 0); \
+    SYLAR_LOG_INFO(g_logger) << #write_fun "/" #read_fun " (" #type ") len=" << len \
+                             << " base_len=" << base_len << " size=" << ba->getSize(); \
+    ba->setPosition(0); \
+    std::string file = "/tmp/sylar_bytearray_" #type "_" #len "_" #read_fun ".dat"; \
+    SYLAR_ASSERT(ba->writeToFile(file)); \
+    sylar::ByteArray::ptr ba2(new sylar::ByteArray(base_len * 2)); \
+    SYLAR_ASSERT(ba2->readFromFile(file)); \
+    ba2->setPosition(0); \
+    SYLAR_ASSERT(ba->toString() == ba2->toString()); \
+    SYLAR_ASSERT(ba->getPosition() == 0 && ba2->getPosition() == 0); \
+    unlink(file.c_str()); \
+}
+
+    for(int base_len : {1, 3, 4096}) {
+        XX(int8_t, 100, writeFint8, readFint8, base_len);
+        XX(uint8_t, 100, writeFuint8, readFuint8, base_len);
+        XX(int16_t, 100, writeFint16, readFint16, base_len);
+        XX(uint16_t, 100, writeFuint16, readFuint16, base_len);
+        XX(int32_t, 100, writeFint32, readFint32, base_len);
+        XX(uint32_t, 100, writeFuint32, readFuint32, base_len);
+        XX(int64_t, 100, writeFint64, readFint64, base_len);
+        XX(uint64_t, 100, writeFuint64, readFuint64, base_len);
+
+        XX(int32_t, 100, writeInt32, readInt32, base_len);
+        XX(uint32_t, 100, writeUint32, readUint32, base_len);
+        XX(int64_t, 100, writeInt64, readInt64, base_len);
+        XX(uint64_t, 100, writeUint64, readUint64, base_len);
+    }
+#undef XX
+}
+
+/**
+ * varint 和 zigzag 的编码长度，小的负数也只占一个字节
+ */
+void test_varint() {
+    sylar::ByteArray ba;
+    ba.writeInt32(-1);
+    SYLAR_ASSERT(ba.getSize() == 1);
+    ba.writeUint32(127);
+    SYLAR_ASSERT(ba.getSize() == 2);
+    ba.writeUint32(128);
+    SYLAR_ASSERT(ba.getSize() == 4);
+    ba.writeUint64(~0ull);
+    SYLAR_ASSERT(ba.getSize() == 14);
+    ba.writeInt64(INT64_MIN);
+    ba.writeFuint32(0x01020304);    // 默认网络字节序
+    ba.writeFloat(1.5f);
+    ba.writeDouble(-2.25);
+    ba.writeStringF16("f16");
+    ba.writeStringVint("vint");
+
+    ba.setPosition(0);
+    SYLAR_ASSERT(ba.readInt32() == -1);
+    SYLAR_ASSERT(ba.readUint32() == 127);
+    SYLAR_ASSERT(ba.readUint32() == 128);
+    SYLAR_ASSERT(ba.readUint64() == ~0ull);
+    SYLAR_ASSERT(ba.readInt64() == INT64_MIN);
+    size_t pos = ba.getPosition();
+    uint8_t raw[4];
+    ba.read(raw, sizeof(raw), pos);
+    SYLAR_ASSERT(raw[0] == 1 && raw[3] == 4);
+    SYLAR_ASSERT(ba.readFuint32() == 0x01020304);
+    SYLAR_ASSERT(ba.readFloat() == 1.5f);
+    SYLAR_ASSERT(ba.readDouble() == -2.25);
+    SYLAR_ASSERT(ba.readStringF16() == "f16");
+    SYLAR_ASSERT(ba.readStringVint() == "vint");
+
+    bool thrown = false;
+    try {
+        ba.readFuint8();
+    } catch(std::out_of_range &e) {
+        thrown = true;
+    }
+    SYLAR_ASSERT(thrown);
+
+    sylar::ByteArray bad;   // 长度前缀是坏的，不能按它分配内存
+    bad.writeFuint32(0xffffffff);
+    bad.writeStringWithoutLength("abc");
+    bad.setPosition(0);
+    thrown = false;
+    try {
+        bad.readStringF32();
+    } catch(std::out_of_range &e) {
+        thrown = true;
+    }
+    SYLAR_ASSERT(thrown);
+    SYLAR_LOG_INFO(g_logger) << "varint ok: " << ba.getSize() << " bytes";
+}
+
+/**
+ * 收的时候直接收到块里，发的时候所有块一次 sendmsg
+ */
+void test_iovec() {
+    int sv[2];
+    SYLAR_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv));
+
+    class RawSocket : public sylar::Socket {    // 用现成的 fd 初始化
+    public:
+        RawSocket(int fd) : Socket(AF_UNIX, SOCK_STREAM) { init(fd); }
+    };
+    RawSocket sender(sv[0]);
+    RawSocket receiver(sv[1]);
+
+    sylar::ByteArray out(16);   // 小块，一次要几十个 iovec
+    std::string data;
+    for(int i = 0; i < 1000; ++i) {
+        data.push_back('a' + i % 26);
+    }
+    out.writeStringWithoutLength(data);
+    out.setPosition(0);
+    std::vector<iovec> iovs;
+    SYLAR_ASSERT(out.getReadBuffers(iovs) == data.size());
+    SYLAR_LOG_INFO(g_logger) << "send iovecs=" << iovs.size();
+
+    size_t sent = 0;
+    while(out.getReadSize()) {
+        ssize_t n = sender.send(out);
+        SYLAR_ASSERT(n > 0);
+        sent += n;
+    }
+    SYLAR_ASSERT(sent == data.size());
+
+    sylar::ByteArray in(64);
+    size_t recved = 0;
+    while(recved < data.size()) {
+        ssize_t n = receiver.recv(in, data.size() - recved);
+        SYLAR_ASSERT(n > 0);
+        recved += n;
+    }
+    in.setPosition(0);
+    SYLAR_ASSERT(in.toString() == data);
+    SYLAR_ASSERT(receiver.recv(in, 0) == 0 && sender.send(out, 0) == 0);
+
+    // 起点不在块头的时候 IOV_MAX 个块的字节数对应 IOV_MAX + 1 个 iovec，要按个数截断
+    sylar::ByteArray big(16);
+    big.writeStringWithoutLength(std::string(16 * (IOV_MAX + 2), 'x'));
+    big.setPosition(1);
+    SYLAR_ASSERT(sender.send(big) > 0);
+    SYLAR_LOG_INFO(g_logger) << "iovec ok: " << recved << " bytes";
+}
+
+int main(int argc, char **argv) {
+    test();
+    test_varint();
+    test_iovec();
+    return 0;
+}
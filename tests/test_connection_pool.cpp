@@ -0,0 +1,220 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/25 16:00
+* @version: 1.0
+* @description: 连接池测试：复用、等待和超时、淘汰和健康检查、http pipelining 多路复用
+********************************************************************************/
+
+#include "../sylar/sylar.h"
+#include "../sylar/http/http_connection.h"
+#include "../sylar/http/http_server.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+using namespace sylar::http;
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+/**
+ * @brief accept 之后马上关闭连接，模拟对端关掉空闲连接
+ */
+class CloseServer : public sylar::TcpServer {
+public:
+    typedef std::shared_ptr<CloseServer> ptr;
+    CloseServer(sylar::IOManager *worker) : TcpServer(worker) {}
+
+protected:
+    void handleClient(sylar::Socket::ptr client) override {
+        client->close();
+    }
+};
+
+static sockaddr_in bind_server(sylar::TcpServer::ptr server) {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    SYLAR_ASSERT(server->bind((sockaddr *)&addr, sizeof(addr), 1));
+    memcpy(&addr, server->getSocks()[0]->getLocalAddress(), sizeof(addr));
+    server->start();
+    return addr;
+}
+
+static void wait_until(std::function<bool()> cond) {
+    uint64_t deadline = sylar::GetMonotonicMS() + 3000;
+    while(!cond()) {
+        SYLAR_ASSERT(sylar::GetMonotonicMS() < deadline);
+        usleep(1000);   // hook 过的，只挂起协程，别的协程（比如服务器 accept）照样在这个线程上跑
+    }
+}
+
+void test_checkout(const sockaddr_in &addr) {
+    sylar::ConnectionPool::Options options;
+    options.min_idle = 0;
+    options.max_idle = 2;
+    options.max_size = 2;
+    options.check_interval = 0;
+    sylar::ConnectionPool::ptr pool = sylar::ConnectionPool::Create((const sockaddr *)&addr, sizeof(addr), options);
+
+    sylar::PoolConnection::ptr a = pool->checkout();
+    sylar::PoolConnection::ptr b = pool->checkout();
+    SYLAR_ASSERT(a && b && a != b);
+    SYLAR_ASSERT(pool->getCreatedCount() == 2 && pool->getTotal() == 2);
+    SYLAR_ASSERT(!pool->checkout(0));       // 满了不等
+    uint64_t begin = sylar::GetMonotonicMS();
+    SYLAR_ASSERT(!pool->checkout(30));      // 等到超时
+    SYLAR_ASSERT(sylar::GetMonotonicMS() - begin >= 25);
+    SYLAR_ASSERT(pool->getTimeoutCount() == 2);
+
+    // 归还的时候直接交给等着的协程
+    std::atomic<bool> got(false);
+    sylar::Socket::ptr sock_a = a->getSocket();
+    sylar::IOManager::GetThis()->schedule([pool, sock_a, &got]() {
+        sylar::PoolConnection::ptr c = pool->checkout();
+        SYLAR_ASSERT(c && c->getSocket() == sock_a);
+        got = true;
+    });
+    wait_until([pool]() { return pool->getWaiting() == 1; });
+    a.reset();
+    wait_until([&got]() { return (bool)got; });
+    SYLAR_ASSERT(pool->getCreatedCount() == 2);
+
+    // 空闲连接后进先出
+    sylar::Socket::ptr sock_b = b->getSocket();
+    b.reset();
+    wait_until([pool]() { return pool->getIdle() == 2; });
+    SYLAR_ASSERT(pool->checkout()->getSocket() == sock_b);
+
+    SYLAR_LOG_INFO(g_logger) << pool->toString();
+    pool->close();
+    SYLAR_ASSERT(!pool->checkout());
+    SYLAR_ASSERT(pool->getTotal() == 0);
+    SYLAR_LOG_INFO(g_logger) << "checkout ok";
+}
+
+void test_evict(const sockaddr_in &addr, const sockaddr_in &close_addr) {
+    sylar::ConnectionPool::Options options;
+    options.min_idle = 1;
+    options.max_idle = 4;
+    options.max_size = 4;
+    options.idle_timeout = 30;
+    options.check_interval = 10;
+    sylar::ConnectionPool::ptr pool = sylar::ConnectionPool::Create((const sockaddr *)&addr, sizeof(addr), options);
+    wait_until([pool]() { return pool->getIdle() == 1; });     // 预热 min_idle
+
+    {
+        std::vector<sylar::PoolConnection::ptr> conns;
+        for(int i = 0; i < 3; ++i) {
+            conns.push_back(pool->checkout());
+        }
+    }
+    SYLAR_ASSERT(pool->getIdle() == 3);
+    wait_until([pool]() { return pool->getIdle() == 1 && pool->getEvictedCount() >= 2; });   // 空闲超时，留 min_idle 个
+
+    std::atomic<int> checks(0);
+    pool->setHealthCheck([&checks](sylar::PoolConnection::ptr conn) {
+        ++checks;
+        return false;
+    });
+    wait_until([pool, &checks]() {      // 检查失败的关掉，然后补一个新的
+        return checks >= 2 && pool->getCreatedCount() >= 5;
+    });
+    pool->setHealthCheck(nullptr);
+    SYLAR_LOG_INFO(g_logger) << pool->toString();
+    pool->close();
+
+    // 对端关掉了空闲连接，借出去之前能发现
+    options.min_idle = 0;
+    options.check_interval = 0;
+    pool = sylar::ConnectionPool::Create((const sockaddr *)&close_addr, sizeof(close_addr), options);
+    sylar::PoolConnection::ptr conn = pool->checkout();
+    sylar::Socket::ptr sock = conn->getSocket();
+    conn.reset();
+    usleep(20 * 1000);
+    conn = pool->checkout();
+    SYLAR_ASSERT(conn && conn->getSocket() != sock);
+    SYLAR_ASSERT(pool->getEvictedCount() == 1 && pool->getCreatedCount() == 2);
+    conn.reset();
+    pool->close();
+    SYLAR_LOG_INFO(g_logger) << "evict ok";
+}
+
+void test_http_pool(const sockaddr_in &addr) {
+    sylar::ConnectionPool::Options options;
+    options.min_idle = 0;
+    options.max_size = 1;
+    options.max_pipeline = 8;
+    options.check_interval = 0;
+    HttpConnectionPool::ptr pool(new HttpConnectionPool("localhost", (const sockaddr *)&addr, sizeof(addr), options));
+
+    {   // 连接数到上限之后同一条连接借给多个协程
+        sylar::PoolConnection::ptr c1 = pool->getPool()->checkout(0);
+        sylar::PoolConnection::ptr c2 = pool->getPool()->checkout(0);
+        SYLAR_ASSERT(c1 && c2 && c1->getSocket() == c2->getSocket());
+    }
+
+    // 一条连接上 8 个请求同时在路上，响应按顺序对上各自的请求
+    const int N = 8;
+    std::atomic<int> done(0);
+    for(int i = 0; i < N; ++i) {
+        sylar::IOManager::GetThis()->schedule([pool, i, &done]() {
+            std::string uri = "/echo/" + std::to_string(i);
+            HttpResult::ptr rt = pool->doGet(uri);
+            SYLAR_ASSERT2(rt->result == HttpResult::OK, rt->toString());
+            SYLAR_ASSERT(rt->status == HttpStatus::OK && rt->body == uri);
+            SYLAR_ASSERT(rt->getHeader("server") == "sylar/1.0.0");
+            ++done;
+        });
+    }
+    wait_until([&done]() { return done == N; });
+    SYLAR_ASSERT(pool->getPool()->getCreatedCount() == 1);
+
+    HttpResult::ptr rt = pool->doPost("/echo/post", "hello");
+    SYLAR_ASSERT(rt->result == HttpResult::OK && rt->body == "/echo/posthello");
+    rt = pool->doRequest(sylar::http::HttpMethod::HEAD, "/echo/head", {}, "");
+    SYLAR_ASSERT(rt->result == HttpResult::OK && rt->body.empty() && rt->getHeader("content-length") == "10");
+    SYLAR_ASSERT(pool->getPool()->getCreatedCount() == 1);
+
+    // 响应要求关闭之后连接不再复用
+    rt = pool->doGet("/close");
+    SYLAR_ASSERT(rt->result == HttpResult::OK && !rt->keepalive);
+    rt = pool->doGet("/echo/again");
+    SYLAR_ASSERT(rt->result == HttpResult::OK && rt->body == "/echo/again");
+    SYLAR_ASSERT(pool->getPool()->getCreatedCount() == 2);
+    SYLAR_LOG_INFO(g_logger) << pool->getPool()->toString();
+    pool->getPool()->close();
+    SYLAR_LOG_INFO(g_logger) << "http pool ok";
+}
+
+void test_pool() {
+    sylar::IOManager *iom = sylar::IOManager::GetThis();
+    HttpServer::ptr http_server(new HttpServer(true, iom));
+    http_server->getServletDispatch()->addPrefixServlet("/echo/", [](HttpRequest::ptr req, HttpResponse::ptr rsp,
+                                                                     HttpSession::ptr session) {
+        rsp->setBody(req->getPath().toString() + req->getBody());
+        return 0;
+    });
+    http_server->getServletDispatch()->addServlet("/close", [](HttpRequest::ptr req, HttpResponse::ptr rsp,
+                                                               HttpSession::ptr session) {
+        rsp->setClose(true);
+        return 0;
+    });
+    CloseServer::ptr close_server(new CloseServer(iom));
+    sockaddr_in addr = bind_server(http_server);
+    sockaddr_in close_addr = bind_server(close_server);
+
+    test_checkout(addr);
+    test_evict(addr, close_addr);
+    test_http_pool(addr);
+    http_server->stop();
+    close_server->stop();
+}
+
+int main(int argc, char **argv) {
+    sylar::IOManager iom(2, false, "pool");
+    iom.setHookEnable(true);
+    iom.schedule(test_pool);
+    return 0;
+}
@@ -13,9 +13,9 @@ sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
 
 void run_in_fiber() {
     SYLAR_LOG_INFO(g_logger) << "run_in_fiber begin";
-    sylar::Fiber::YieldToHold();
+    sylar::Fiber::YieldToReady();    // 自己 swapIn 的协程，不经过调度器改成 HOLD
     SYLAR_LOG_INFO(g_logger) << "run_in_fiber end";
-    sylar::Fiber::YieldToHold();
+    sylar::Fiber::YieldToReady();
 }
 
 void test_fiber() {
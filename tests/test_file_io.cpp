@@ -0,0 +1,171 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/28 10:00
+* @version: 1.0
+* @description: 普通文件异步 IO 测试：线程池和 io_uring 两种后端、慢磁盘不卡 IO 线程、文件日志异步落盘
+********************************************************************************/
+
+#include "../sylar/sylar.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static std::string make_data(size_t size, int seed) {
+    std::string data(size, 0);
+    for(size_t i = 0; i < size; ++i) {
+        data[i] = 'a' + (i * 7 + seed + i / 4096) % 26;
+    }
+    return data;
+}
+
+static std::string make_path(const std::string &name) {
+    return "/tmp/test_file_io_" + std::to_string(getpid()) + "_" + name;
+}
+
+/**
+ * @brief 读写、偏移、fsync、大小，不在协程里的时候直接执行
+ */
+void test_file(const std::string &name) {
+    std::string path = make_path(name);
+    SYLAR_ASSERT(!sylar::AsyncFile::Open(path + "_missing", O_RDONLY) && errno == ENOENT);
+
+    sylar::AsyncFile::ptr file = sylar::AsyncFile::Open(path, O_CREAT | O_RDWR | O_TRUNC);
+    SYLAR_ASSERT(file);
+    std::string data = make_data(1024 * 1024 + 17, 0);
+    SYLAR_ASSERT(file->writeAll(data.c_str(), data.size(), 0) == (ssize_t)data.size());
+    SYLAR_ASSERT(file->sync() == 0 && file->sync(true) == 0);
+    SYLAR_ASSERT(file->size() == (off_t)data.size());
+
+    std::string buf(data.size() + 100, 0);
+    SYLAR_ASSERT(file->readAll(&buf[0], buf.size(), 0) == (ssize_t)data.size());
+    SYLAR_ASSERT(buf.compare(0, data.size(), data) == 0);
+    SYLAR_ASSERT(file->pread(&buf[0], 10, 4096) == 10 && buf.compare(0, 10, data, 4096, 10) == 0);
+
+    // 文件自己的读写位置
+    SYLAR_ASSERT(file->pwrite("hello", 5, 100) == 5);
+    SYLAR_ASSERT(lseek(file->getFd(), 98, SEEK_SET) == 98);
+    SYLAR_ASSERT(file->read(&buf[0], 9) == 9 && buf.compare(0, 9, data.substr(98, 2) + "hello" + data.substr(105, 2)) == 0);
+    SYLAR_ASSERT(lseek(file->getFd(), 0, SEEK_CUR) == 107);
+    SYLAR_ASSERT(file->close() == 0 && file->close() == -1 && errno == EBADF);
+
+    // O_APPEND 写到末尾
+    file = sylar::AsyncFile::Open(path, O_WRONLY | O_APPEND);
+    SYLAR_ASSERT(file && file->write("tail", 4) == 4 && file->size() == (off_t)data.size() + 4);
+    file.reset();
+    unlink(path.c_str());
+    SYLAR_LOG_INFO(g_logger) << "file " << name << " ok";
+}
+
+/**
+ * @brief 很多协程同时读写，结果各自对得上
+ */
+void test_concurrent(const std::string &name) {
+    std::string path = make_path(name);
+    sylar::AsyncFile::ptr file = sylar::AsyncFile::Open(path, O_CREAT | O_RDWR | O_TRUNC);
+    SYLAR_ASSERT(file);
+    const int N = 32;
+    const size_t SIZE = 64 * 1024;
+    std::atomic<int> done(0);
+    for(int i = 0; i < N; ++i) {
+        sylar::IOManager::GetThis()->schedule([file, i, &done]() {
+            std::string data = make_data(SIZE, i);
+            SYLAR_ASSERT(file->writeAll(data.c_str(), SIZE, i * SIZE) == (ssize_t)SIZE);
+            std::string buf(SIZE, 0);
+            SYLAR_ASSERT(file->readAll(&buf[0], SIZE, i * SIZE) == (ssize_t)SIZE && buf == data);
+            ++done;
+        });
+    }
+    while(done < N) {
+        usleep(1000);
+    }
+    SYLAR_ASSERT(file->size() == (off_t)(N * SIZE));
+    file.reset();
+    unlink(path.c_str());
+    SYLAR_LOG_INFO(g_logger) << "concurrent " << name << " ok";
+}
+
+/**
+ * @brief 线程池里卡住的时候 IO 线程照样跑别的协程
+ */
+void test_slow_disk() {
+    std::atomic<int> ticks(0);
+    std::atomic<bool> stop(false);
+    sylar::IOManager::GetThis()->schedule([&ticks, &stop]() {
+        while(!stop) {
+            usleep(5 * 1000);    // 开启了 hook，只挂起协程
+            ++ticks;
+        }
+    });
+    uint64_t begin = sylar::GetCurrentMS();
+    sylar::AsyncFile::GetExecutor()->run([]() {
+        usleep(200 * 1000);     // 模拟很慢的磁盘
+    });
+    SYLAR_ASSERT(sylar::GetCurrentMS() - begin >= 190);
+    SYLAR_ASSERT2(ticks >= 10, std::to_string(ticks));
+    stop = true;
+    SYLAR_LOG_INFO(g_logger) << "slow disk ok ticks=" << ticks;
+}
+
+static size_t count_lines(const std::string &path) {
+    std::ifstream ifs(path);
+    std::string line;
+    size_t n = 0;
+    while(std::getline(ifs, line)) {
+        ++n;
+    }
+    return n;
+}
+
+void test_log_appender() {
+    std::string path = make_path("log");
+    sylar::Logger::ptr logger = SYLAR_LOG_NAME("test_file_io");
+    sylar::FileLogAppender::ptr appender(new sylar::FileLogAppender(path));
+    appender->setFormatter(sylar::LogFormatter::ptr(new sylar::LogFormatter("%p %m%n")));
+    logger->addAppender(appender);
+
+    const size_t N = 1000;
+    for(size_t i = 0; i < N; ++i) {
+        SYLAR_LOG_INFO(logger) << "line " << i;
+    }
+    SYLAR_LOG_ERROR(logger) << "error";     // 连同前面攒着的一起直接写
+    SYLAR_ASSERT(count_lines(path) == N + 1);
+
+    SYLAR_LOG_INFO(logger) << "async";
+    uint64_t deadline = sylar::GetCurrentMS() + 3000;
+    while(count_lines(path) != N + 2) {
+        SYLAR_ASSERT(sylar::GetCurrentMS() < deadline);
+        usleep(1000);
+    }
+    logger->clearAppenders();
+    unlink(path.c_str());
+    SYLAR_LOG_INFO(g_logger) << "log appender ok";
+}
+
+void run(bool io_uring) {
+    sylar::Config::Lookup<bool>("iomanager.io_uring")->setValue(io_uring);
+    {
+        sylar::IOManager iom(2, false, io_uring ? "io_uring" : "pool");
+        iom.setHookEnable(true);
+        SYLAR_LOG_INFO(g_logger) << "io_uring=" << io_uring << " hasIOUring=" << iom.hasIOUring();
+        iom.schedule([io_uring]() {
+            std::string name = io_uring ? "uring" : "pool";
+            test_file(name);
+            test_concurrent(name);
+            if(!io_uring) {
+                test_slow_disk();
+                test_log_appender();
+            }
+        });
+    }
+    SYLAR_LOG_INFO(g_logger) << sylar::AsyncFile::GetExecutor()->dumpStats();
+}
+
+int main(int argc, char **argv) {
+    test_file("inline");
+    run(false);
+    run(true);
+    return 0;
+}
@@ -0,0 +1,136 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/7 16:21
+* @version: 1.0
+* @description: hook 测试，单线程里用阻塞的写法跑多个协程
+********************************************************************************/
+
+#include "../sylar/sylar.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+
+sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+void test_sleep() {
+    uint64_t start = sylar::GetCurrentMS();
+    {
+        sylar::IOManager iom(1, true, "sleep");
+        iom.setHookEnable(true);
+        iom.schedule([](){
+            sleep(2);
+            SYLAR_LOG_INFO(g_logger) << "sleep 2";
+        });
+        iom.schedule([](){
+            sleep(3);
+            SYLAR_LOG_INFO(g_logger) << "sleep 3";
+        });
+        SYLAR_LOG_INFO(g_logger) << "test_sleep";
+    }
+    uint64_t elapse = sylar::GetCurrentMS() - start;
+    SYLAR_LOG_INFO(g_logger) << "test_sleep elapse=" << elapse;
+    SYLAR_ASSERT(elapse < 4000);    // 两个 sleep 在同一个线程上并发
+}
+
+static int s_port = 0;
+
+void echo_server() {
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = 0;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    SYLAR_ASSERT(!bind(listen_fd, (sockaddr*)&addr, sizeof(addr)));
+    SYLAR_ASSERT(!listen(listen_fd, 16));
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd, (sockaddr*)&addr, &len);
+    s_port = ntohs(addr.sin_port);
+
+    int fd = accept(listen_fd, nullptr, nullptr);   // 阻塞的写法，会让出协程
+    SYLAR_LOG_INFO(g_logger) << "accept fd=" << fd;
+    char buf[64];
+    ssize_t n = 0;
+    while((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        send(fd, buf, n, 0);
+    }
+    close(fd);
+    close(listen_fd);
+}
+
+void echo_client() {
+    while(!s_port) {
+        usleep(1000);
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    SYLAR_ASSERT(sylar::FdMgr::GetInstance()->get(fd)->getSysNonblock());
+    SYLAR_ASSERT(!(fcntl(fd, F_GETFL, 0) & O_NONBLOCK));    // 用户看到的还是阻塞的
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(s_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    SYLAR_ASSERT(!connect(fd, (sockaddr*)&addr, sizeof(addr)));
+
+    struct timeval tv = {0, 100 * 1000};    // 100ms 读超时
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    char buf[64];
+    for(int i = 0; i < 3; ++i) {
+        std::string msg = "hello " + std::to_string(i);
+        send(fd, msg.c_str(), msg.size(), 0);
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        SYLAR_ASSERT(n == (ssize_t)msg.size());
+        SYLAR_LOG_INFO(g_logger) << "echo: " << std::string(buf, n);
+    }
+
+    uint64_t start = sylar::GetCurrentMS();
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);  // 没有数据了，等到超时
+    SYLAR_LOG_INFO(g_logger) << "recv timeout n=" << n << " errno=" << errno
+                             << " elapse=" << sylar::GetCurrentMS() - start;
+    SYLAR_ASSERT(n == -1 && errno == ETIMEDOUT);
+    close(fd);
+}
+
+void test_sock(bool persistent_et) {
+    sylar::Config::Lookup<bool>("iomanager.persistent_et")->setValue(persistent_et);
+    s_port = 0;
+    sylar::IOManager iom(1, true, persistent_et ? "sock_et" : "sock");
+    iom.setHookEnable(true);
+    iom.schedule(echo_server);
+    iom.schedule(echo_client);
+}
+
+/**
+ * @brief 不是 hook 创建的 socket 可能和别的代码共用，hook 读写之后 O_NONBLOCK 不能变
+ */
+void test_shared_fd() {
+    int sv[2];
+    SYLAR_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM, 0, sv));    // socketpair 不走 hook
+    {
+        sylar::IOManager iom(1, true, "shared_fd");
+        iom.setHookEnable(true);
+        iom.schedule([sv]() {
+            SYLAR_ASSERT(write(sv[0], "ping", 4) == 4);
+            char buf[8];
+            SYLAR_ASSERT(read(sv[1], buf, sizeof(buf)) == 4);
+            sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(sv[1]);
+            SYLAR_ASSERT(ctx && ctx->isSocket() && !ctx->getSysNonblock());
+        });
+    }
+    SYLAR_ASSERT(!(fcntl_f(sv[0], F_GETFL, 0) & O_NONBLOCK));
+    SYLAR_ASSERT(!(fcntl_f(sv[1], F_GETFL, 0) & O_NONBLOCK));
+    close(sv[0]);
+    close(sv[1]);
+}
+
+int main(int argc, char **argv) {
+    test_sleep();
+    test_sock(false);
+    test_sock(true);    // fd 只注册一次，就绪状态记在用户态
+    test_shared_fd();
+    return 0;
+}
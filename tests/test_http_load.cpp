@@ -0,0 +1,189 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/21 19:00
+* @version: 1.0
+* @description: http 压测工具：多连接、pipelining，统计 req/s 和 p50/p99 延迟
+*   test_http_load [-c 连接数] [-n 每个连接的请求数] [-p pipeline 深度] [-t 线程数] [-u 路径] [-a ip:port]
+*   不给 -a 的时候在进程里起一个 HttpServer 压自己
+********************************************************************************/
+
+#include "../sylar/sylar.h"
+#include "../sylar/http/http_server.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <unistd.h>
+
+using namespace sylar::http;
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static int s_connections = 16;
+static int s_requests = 2000;
+static int s_pipeline = 1;
+static int s_threads = 2;
+static std::string s_path = "/hello";
+
+static sylar::Mutex s_mutex;
+static std::vector<uint32_t> s_latencies;   // 每个请求的延迟，微秒
+static std::atomic<int> s_failed(0);
+static std::atomic<int> s_done(0);
+
+/**
+ * @brief 一个连接：每次发 pipeline 个请求，收齐响应再发下一批，延迟从这批发出算到对应的响应解析完
+ */
+static void run_client(sockaddr_in addr) {
+    std::vector<uint32_t> latencies;
+    latencies.reserve(s_requests);
+    sylar::Socket::ptr sock = sylar::Socket::CreateTCPSocket();
+    if(!sock->connect((const sockaddr *)&addr, sizeof(addr), 3000)) {
+        ++s_failed;
+        ++s_done;
+        return;
+    }
+    std::string req = "GET " + s_path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    std::string batch;
+    std::string buf(64 * 1024, '\0');
+    size_t start = 0;
+    size_t end = 0;
+    HttpParser parser(HttpParser::RESPONSE);
+
+    int sent = 0;
+    while(sent < s_requests) {
+        int n = std::min(s_pipeline, s_requests - sent);
+        batch.clear();
+        for(int i = 0; i < n; ++i) {
+            batch.append(req);
+        }
+        uint64_t begin = sylar::GetCurrentUS();
+        size_t off = 0;
+        while(off < batch.size()) {
+            ssize_t rt = sock->send(&batch[off], batch.size() - off);
+            if(rt <= 0) {
+                goto fail;
+            }
+            off += rt;
+        }
+        for(int i = 0; i < n;) {
+            ssize_t rt = parser.execute(&buf[start], end - start);
+            if(rt < 0) {
+                goto fail;
+            }
+            if(parser.isFinished()) {
+                latencies.push_back(sylar::GetCurrentUS() - begin);
+                start += rt;
+                parser.reset();
+                ++i;
+                continue;
+            }
+            if(start > 0) {
+                memmove(&buf[0], &buf[start], end - start);
+                end -= start;
+                start = 0;
+            }
+            if(end == buf.size()) {
+                buf.resize(buf.size() * 2);
+            }
+            rt = sock->recv(&buf[end], buf.size() - end);
+            if(rt <= 0) {
+                goto fail;
+            }
+            end += rt;
+        }
+        sent += n;
+    }
+    goto out;
+fail:
+    ++s_failed;
+out:
+    sock->close();
+    {
+        sylar::Mutex::Lock lock(s_mutex);
+        s_latencies.insert(s_latencies.end(), latencies.begin(), latencies.end());
+    }
+    ++s_done;
+}
+
+static uint32_t percentile(const std::vector<uint32_t> &v, double p) {
+    if(v.empty()) {
+        return 0;
+    }
+    size_t idx = std::min(v.size() - 1, (size_t)(v.size() * p));
+    return v[idx];
+}
+
+int main(int argc, char **argv) {
+    std::string target;
+    int opt;
+    while((opt = getopt(argc, argv, "c:n:p:t:u:a:")) != -1) {
+        switch(opt) {
+            case 'c': s_connections = std::max(1, atoi(optarg)); break;
+            case 'n': s_requests = std::max(1, atoi(optarg)); break;
+            case 'p': s_pipeline = std::max(1, atoi(optarg)); break;
+            case 't': s_threads = std::max(1, atoi(optarg)); break;
+            case 'u': s_path = optarg; break;
+            case 'a': target = optarg; break;
+            default:
+                std::cout << "usage: " << argv[0]
+                          << " [-c conns] [-n requests/conn] [-p pipeline] [-t threads] [-u path] [-a ip:port]"
+                          << std::endl;
+                return 1;
+        }
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    if(!target.empty()) {
+        size_t pos = target.rfind(':');
+        if(pos == std::string::npos
+           || inet_pton(AF_INET, target.substr(0, pos).c_str(), &addr.sin_addr) != 1) {
+            std::cout << "invalid address " << target << std::endl;
+            return 1;
+        }
+        addr.sin_port = htons(atoi(target.c_str() + pos + 1));
+    } else {
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    }
+
+    sylar::IOManager iom(s_threads, false, "load");
+    HttpServer::ptr server;
+    if(target.empty()) {
+        server.reset(new HttpServer(true, &iom));
+        server->getServletDispatch()->addServlet(s_path, [](HttpRequest::ptr req, HttpResponse::ptr rsp,
+                                                             HttpSession::ptr session) {
+            rsp->setHeader("Content-Type", "text/plain");
+            rsp->setBody("hello world");
+            return 0;
+        });
+        SYLAR_ASSERT(server->bind((sockaddr *)&addr, sizeof(addr)));
+        memcpy(&addr, server->getSocks()[0]->getLocalAddress(), sizeof(addr));
+        server->start();
+    }
+
+    uint64_t begin = sylar::GetCurrentUS();
+    for(int i = 0; i < s_connections; ++i) {
+        iom.schedule(std::bind(run_client, addr));
+    }
+    while(s_done < s_connections) {
+        usleep(1000);
+    }
+    uint64_t elapsed = std::max(sylar::GetCurrentUS() - begin, (uint64_t)1);
+    if(server) {
+        server->stop();
+    }
+
+    std::sort(s_latencies.begin(), s_latencies.end());
+    std::cout << "connections=" << s_connections << " requests/conn=" << s_requests
+              << " pipeline=" << s_pipeline << " threads=" << s_threads << std::endl
+              << "completed=" << s_latencies.size() << " failed_conns=" << s_failed
+              << " elapsed=" << elapsed / 1000.0 << "ms"
+              << " req/s=" << (uint64_t)(s_latencies.size() * 1000000.0 / elapsed) << std::endl
+              << "latency us: p50=" << percentile(s_latencies, 0.5)
+              << " p99=" << percentile(s_latencies, 0.99)
+              << " max=" << (s_latencies.empty() ? 0 : s_latencies.back()) << std::endl;
+    return s_failed ? 1 : 0;
+}
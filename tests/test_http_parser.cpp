@@ -0,0 +1,259 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/20 15:30
+* @version: 1.0
+* @description: http 解析器测试：增量解析、pipelining、chunked、错误，以及各个查找实现的吞吐量
+********************************************************************************/
+
+#include "../sylar/sylar.h"
+#include "../sylar/http/http_parser.h"
+
+using sylar::http::HttpParser;
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const char s_request[] =
+        "GET /wp-content/uploads/2010/03/hello-kitty-darth-vader-pink.jpg?size=large&v=2#top HTTP/1.1\r\n"
+        "Host: www.kittyhell.com\r\n"
+        "User-Agent: Mozilla/5.0 (Macintosh; U; Intel Mac OS X 10.6; ja-JP-mac; rv:1.9.2.3) "
+        "Gecko/20100401 Firefox/3.6.3 Pathtraq/0.9\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+        "Accept-Language: ja,en-us;q=0.7,en;q=0.3\r\n"
+        "Accept-Encoding: gzip,deflate\r\n"
+        "Accept-Charset: Shift_JIS,utf-8;q=0.7,*;q=0.7\r\n"
+        "Keep-Alive: 115\r\n"
+        "Connection: keep-alive\r\n"
+        "Cookie: wp_ozh_wsa_visits=2; wp_ozh_wsa_visit_lasttime=xxxxxxxxxx; "
+        "__utma=xxxxxxxxx.xxxxxxxxxx.xxxxxxxxxx.xxxxxxxxxx.xxxxxxxxxx.x; "
+        "__utmz=xxxxxxxxx.xxxxxxxxxx.x.x.utmccn=(referral)|utmcsr=reader.livedoor.com|utmcct=/reader/|utmcmd=referral\r\n"
+        "\r\n";
+
+static void check_request(const HttpParser &parser) {
+    SYLAR_ASSERT(parser.isFinished());
+    SYLAR_ASSERT(parser.getMethod() == sylar::http::HttpMethod::GET);
+    SYLAR_ASSERT(parser.getPath() == "/wp-content/uploads/2010/03/hello-kitty-darth-vader-pink.jpg");
+    SYLAR_ASSERT(parser.getQuery() == "size=large&v=2");
+    SYLAR_ASSERT(parser.getFragment() == "top");
+    SYLAR_ASSERT(parser.getVersion() == 0x11);
+    SYLAR_ASSERT(parser.getHeaderCount() == 9);
+    SYLAR_ASSERT(parser.getHeader("host") == "www.kittyhell.com");
+    SYLAR_ASSERT(parser.getHeader("KEEP-ALIVE") == "115");
+    SYLAR_ASSERT(parser.getHeader("x-none").empty());
+    SYLAR_ASSERT(parser.isKeepAlive());
+    SYLAR_ASSERT(parser.getBodyLength() == 0);
+}
+
+/**
+ * 每次多给一个字节，结果要和一次给完一样
+ */
+void test_incremental() {
+    size_t len = sizeof(s_request) - 1;
+    HttpParser parser;
+    SYLAR_ASSERT(parser.execute(s_request, len) == (ssize_t)len);
+    check_request(parser);
+
+    std::string buf;
+    parser.reset();
+    for(size_t i = 0; i < len; ++i) {
+        buf.push_back(s_request[i]);    // 缓冲区会扩容搬移，偏移照样有效
+        ssize_t n = parser.execute(buf.c_str(), buf.size());
+        SYLAR_ASSERT(n >= 0 && n <= (ssize_t)buf.size());
+        SYLAR_ASSERT(parser.isFinished() == (i == len - 1));
+    }
+    check_request(parser);
+    SYLAR_LOG_INFO(g_logger) << "incremental ok, scan=" << HttpParser::ScanImplToString(HttpParser::GetScanImpl());
+}
+
+/**
+ * 一次收到多个请求，带 body 的、chunked 的混在一起
+ */
+void test_pipeline() {
+    std::string buf = "POST /a HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello"
+                      "POST /b HTTP/1.1\r\nTransfer-Encoding: gzip, chunked\r\n\r\n"
+                      "5;ext=1\r\nhello\r\n6\r\n world\r\n0\r\nX-Trailer: t\r\n\r\n"
+                      "GET /c HTTP/1.0\r\n\r\n"
+                      "GET /d HTTP/1.1\r\nConnection: close\r\n\r\n"
+                      "GET /e HTTP/1.1\r\nHo";
+    const char *paths[] = {"/a", "/b", "/c", "/d"};
+    const char *bodies[] = {"hello", "hello world", "", ""};
+    bool keep_alive[] = {true, true, false, false};
+
+    HttpParser parser;
+    size_t offset = 0;
+    for(int i = 0; i < 4; ++i) {
+        parser.reset();
+        ssize_t n = parser.execute(buf.c_str() + offset, buf.size() - offset);
+        SYLAR_ASSERT(n > 0);
+        SYLAR_ASSERT(parser.isFinished());
+        SYLAR_ASSERT(parser.getPath() == paths[i]);
+        SYLAR_ASSERT(parser.getBody() == bodies[i]);
+        SYLAR_ASSERT(parser.isKeepAlive() == keep_alive[i]);
+        offset += n;
+    }
+    SYLAR_ASSERT(parser.getBodySliceCount() == 0);
+
+    parser.reset();     // 最后一个不完整
+    ssize_t n = parser.execute(buf.c_str() + offset, buf.size() - offset);
+    SYLAR_ASSERT(n == (ssize_t)strlen("GET /e HTTP/1.1\r\n"));
+    SYLAR_ASSERT(!parser.isFinished() && !parser.hasError());
+    buf += "st: x\r\n\r\n";
+    SYLAR_ASSERT(parser.execute(buf.c_str() + offset, buf.size() - offset) == (ssize_t)(buf.size() - offset));
+    SYLAR_ASSERT(parser.isFinished() && parser.getHeader("Host") == "x");
+    SYLAR_LOG_INFO(g_logger) << "pipeline ok";
+}
+
+/**
+ * chunked body 一个字节一个字节地到
+ */
+void test_chunked() {
+    std::string msg = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                      "a\r\n0123456789\r\n1A\r\nabcdefghijklmnopqrstuvwxyz\r\n0\r\n\r\n";
+    HttpParser parser(HttpParser::RESPONSE);
+    std::string buf;
+    for(char c : msg) {
+        buf.push_back(c);
+        SYLAR_ASSERT(parser.execute(buf.c_str(), buf.size()) >= 0);
+    }
+    SYLAR_ASSERT(parser.isFinished());
+    SYLAR_ASSERT(parser.getStatus() == sylar::http::HttpStatus::OK);
+    SYLAR_ASSERT(parser.getReason() == "OK");
+    SYLAR_ASSERT(parser.isChunked());
+    SYLAR_ASSERT(parser.getBodySliceCount() == 2);
+    SYLAR_ASSERT(parser.getBody() == "0123456789abcdefghijklmnopqrstuvwxyz");
+
+    // 没有长度的响应读到连接关闭
+    parser.reset();
+    msg = "HTTP/1.0 404 Not Found\r\nServer: x\r\n\r\nnot found";
+    SYLAR_ASSERT(parser.execute(msg.c_str(), msg.size()) == (ssize_t)msg.size());
+    SYLAR_ASSERT(!parser.isFinished());
+    SYLAR_ASSERT(parser.finish());
+    SYLAR_ASSERT(parser.getStatus() == sylar::http::HttpStatus::NOT_FOUND);
+    SYLAR_ASSERT(parser.getBody() == "not found");
+    SYLAR_ASSERT(!parser.isKeepAlive());
+
+    // HEAD 的响应、204 没有 body
+    parser.reset();
+    parser.setNoBody(true);
+    msg = "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n";
+    SYLAR_ASSERT(parser.execute(msg.c_str(), msg.size()) == (ssize_t)msg.size());
+    SYLAR_ASSERT(parser.isFinished() && parser.getContentLength() == 100);
+    parser.reset();
+    msg = "HTTP/1.1 204 No Content\r\n\r\n";
+    SYLAR_ASSERT(parser.execute(msg.c_str(), msg.size()) == (ssize_t)msg.size());
+    SYLAR_ASSERT(parser.isFinished());
+    SYLAR_LOG_INFO(g_logger) << "chunked ok";
+}
+
+void test_error() {
+    struct {
+        const char *msg;
+        HttpParser::Error error;
+    } cases[] = {
+        {"GET  / HTTP/1.1\r\n\r\n", HttpParser::INVALID_URI},
+        {"GE T / HTTP/1.1\r\n\r\n", HttpParser::INVALID_METHOD},
+        {"FOO / HTTP/1.1\r\n\r\n", HttpParser::INVALID_METHOD},
+        {"GET /\x01 HTTP/1.1\r\n\r\n", HttpParser::INVALID_URI},      // 请求行里的控制字符
+        {"G\x01T / HTTP/1.1\r\n\r\n", HttpParser::INVALID_URI},
+        {"GET\r\n\r\n", HttpParser::INVALID_URI},
+        {"GET / HTTP/2.0\r\n\r\n", HttpParser::INVALID_VERSION},
+        {"GET / HTTP/1.1\r\nHost x\r\n\r\n", HttpParser::INVALID_HEADER},
+        {"GET / HTTP/1.1\r\nHost: x\r\n folded\r\n\r\n", HttpParser::INVALID_HEADER},
+        {"GET / HTTP/1.1\r\nHost: a\rb\r\n\r\n", HttpParser::INVALID_HEADER},
+        {"POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n", HttpParser::INVALID_CONTENT_LENGTH},
+        {"POST / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n", HttpParser::INVALID_CONTENT_LENGTH},
+        {"POST / HTTP/1.1\r\nContent-Length: 1\r\nTransfer-Encoding: chunked\r\n\r\n",
+         HttpParser::INVALID_TRANSFER_ENCODING},
+        {"POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n", HttpParser::INVALID_TRANSFER_ENCODING},
+        {"POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nz\r\n", HttpParser::INVALID_CHUNK},
+        {"POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n1\r\nab", HttpParser::INVALID_CHUNK},
+    };
+    for(auto &c : cases) {
+        HttpParser parser;
+        SYLAR_ASSERT(parser.execute(c.msg, strlen(c.msg)) == -1);
+        SYLAR_ASSERT2(parser.getError() == c.error, c.msg);
+        SYLAR_ASSERT(parser.execute(c.msg, strlen(c.msg)) == -1);   // 出错之后不再解析
+    }
+
+    sylar::Config::Lookup<uint64_t>("http.parser.max_header_size")->setValue(64);
+    HttpParser parser;
+    std::string big = "GET / HTTP/1.1\r\nX-Long: " + std::string(100, 'x');
+    SYLAR_ASSERT(parser.execute(big.c_str(), big.size()) == -1);
+    SYLAR_ASSERT(parser.getError() == HttpParser::HEADER_TOO_LARGE);
+
+    parser.reset();     // trailer 每行都不长，但总长度超限
+    big = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n";
+    for(int i = 0; i < 10; ++i) {
+        big += "X-T: 0123456789\r\n";
+    }
+    SYLAR_ASSERT(parser.execute(big.c_str(), big.size()) == -1);
+    SYLAR_ASSERT(parser.getError() == HttpParser::HEADER_TOO_LARGE);
+    sylar::Config::Lookup<uint64_t>("http.parser.max_header_size")->setValue(64 * 1024);
+
+    sylar::Config::Lookup<uint32_t>("http.parser.max_headers")->setValue(4);
+    parser.reset();
+    big = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n";
+    for(int i = 0; i < 4; ++i) {
+        big += "X-T: 1\r\n";
+    }
+    SYLAR_ASSERT(parser.execute(big.c_str(), big.size()) == -1);
+    SYLAR_ASSERT(parser.getError() == HttpParser::HEADER_TOO_LARGE);
+    sylar::Config::Lookup<uint32_t>("http.parser.max_headers")->setValue(100);
+
+    sylar::Config::Lookup<uint64_t>("http.parser.max_body_size")->setValue(10);
+    parser.reset();
+    big = "POST / HTTP/1.1\r\nContent-Length: 11\r\n\r\n";
+    SYLAR_ASSERT(parser.execute(big.c_str(), big.size()) == -1);
+    SYLAR_ASSERT(parser.getError() == HttpParser::BODY_TOO_LARGE);
+    sylar::Config::Lookup<uint64_t>("http.parser.max_body_size")->setValue(64 * 1024 * 1024);
+
+    parser.reset();     // 中途断开
+    SYLAR_ASSERT(parser.execute("GET / HT", 8) == 0);
+    SYLAR_ASSERT(!parser.finish() && parser.getError() == HttpParser::UNEXPECTED_EOF);
+    SYLAR_LOG_INFO(g_logger) << "error ok";
+}
+
+/**
+ * 各个查找实现的解析吞吐量
+ */
+void bench() {
+    static const int ROUNDS = 100000;
+    size_t len = sizeof(s_request) - 1;
+    HttpParser::ScanImpl impls[] = {HttpParser::SCALAR, HttpParser::SSE42, HttpParser::AVX2};
+    HttpParser::ScanImpl detected = HttpParser::GetScanImpl();
+    for(auto impl : impls) {
+        if(!HttpParser::SetScanImpl(impl)) {
+            SYLAR_LOG_INFO(g_logger) << "bench " << HttpParser::ScanImplToString(impl) << " not supported";
+            continue;
+        }
+        HttpParser parser;
+        uint64_t begin = sylar::GetCurrentUS();
+        for(int i = 0; i < ROUNDS; ++i) {
+            parser.reset();
+            parser.execute(s_request, len);
+        }
+        uint64_t us = std::max(sylar::GetCurrentUS() - begin, (uint64_t)1);
+        check_request(parser);
+        SYLAR_LOG_INFO(g_logger) << "bench " << HttpParser::ScanImplToString(impl)
+                                 << " requests=" << ROUNDS << " bytes=" << len
+                                 << " used=" << us / 1000 << "ms"
+                                 << " req/s=" << (uint64_t)ROUNDS * 1000000 / us
+                                 << " MB/s=" << (double)len * ROUNDS / us;
+    }
+    HttpParser::SetScanImpl(detected);
+}
+
+int main(int argc, char **argv) {
+    HttpParser::ScanImpl impls[] = {HttpParser::SCALAR, HttpParser::SSE42, HttpParser::AVX2};
+    for(auto impl : impls) {
+        if(HttpParser::SetScanImpl(impl)) {
+            test_incremental();
+            test_pipeline();
+            test_chunked();
+            test_error();
+        }
+    }
+    bench();
+    return 0;
+}
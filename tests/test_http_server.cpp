@@ -0,0 +1,220 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/21 18:00
+* @version: 1.0
+* @description: http 服务器测试：路由优先级、pipelining 合并发送、长连接、错误请求
+********************************************************************************/
+
+#include "../sylar/sylar.h"
+#include "../sylar/http/http_server.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+using namespace sylar::http;
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static FunctionServlet::callback reply(const std::string &body) {
+    return [body](HttpRequest::ptr req, HttpResponse::ptr rsp, HttpSession::ptr session) {
+        rsp->setBody(body);
+        return 0;
+    };
+}
+
+void test_dispatch() {
+    ServletDispatch dispatch;
+    dispatch.addServlet("/a/b", reply("exact"));
+    dispatch.addPrefixServlet("/a/", reply("prefix"));
+    dispatch.addPrefixServlet("/a/b/c/", reply("prefix2"));
+    dispatch.addGlobServlet("/a/*.png", reply("glob"));
+    dispatch.addGlobServlet("/a/img/*.png", reply("glob2"));
+    dispatch.addGlobServlet("/z/*.txt", reply("glob3"));
+    dispatch.addPrefixServlet("/z", reply("z"));
+
+    struct {
+        const char *path;
+        Servlet::ptr expect;
+    } cases[] = {
+        {"/a/b", dispatch.getServlet("/a/b")},
+        {"/a/bb", dispatch.getPrefixServlet("/a/")},
+        {"/a/b/c/d", dispatch.getPrefixServlet("/a/b/c/")},     // 最长前缀
+        {"/a/b/c", dispatch.getPrefixServlet("/a/")},
+        {"/a/x.png", dispatch.getGlobServlet("/a/*.png")},      // 通配优先于前缀
+        {"/a/img/x.png", dispatch.getGlobServlet("/a/img/*.png")},  // 字面前缀长的通配优先
+        {"/z/1.txt", dispatch.getGlobServlet("/z/*.txt")},
+        {"/z/1", dispatch.getPrefixServlet("/z")},
+        {"/b", dispatch.getDefault()},
+        {"", dispatch.getDefault()},
+    };
+    for(auto &c : cases) {
+        SYLAR_ASSERT2(dispatch.getMatchedServlet(std::string(c.path)) == c.expect, c.path);
+    }
+    dispatch.delGlobServlet("/z/*.txt");
+    SYLAR_ASSERT(dispatch.getMatchedServlet(std::string("/z/1.txt")) == dispatch.getPrefixServlet("/z"));
+    dispatch.delServlet("/a/b");
+    SYLAR_ASSERT(dispatch.getMatchedServlet(std::string("/a/b")) == dispatch.getPrefixServlet("/a/"));
+    SYLAR_LOG_INFO(g_logger) << "dispatch ok";
+}
+
+void test_no_body_status() {
+    HttpStatus statuses[] = {HttpStatus::CONTINUE, HttpStatus::NO_CONTENT, HttpStatus::NOT_MODIFIED};
+    for(auto s : statuses) {
+        HttpResponse rsp(0x11, false);
+        rsp.setStatus(s);
+        std::string header;
+        rsp.writeHeader(header);
+        SYLAR_ASSERT2(header.find("Content-Length") == std::string::npos, header);
+    }
+    HttpResponse rsp(0x11, false);
+    std::string header;
+    rsp.writeHeader(header);
+    SYLAR_ASSERT2(header.find("Content-Length: 0\r\n") != std::string::npos, header);
+    SYLAR_LOG_INFO(g_logger) << "no body status ok";
+}
+
+struct Reply {
+    int status;
+    std::string body;
+    bool keepalive;
+    uint64_t content_length;
+};
+
+/**
+ * @brief 收 count 个响应，head 标记哪些是 HEAD 请求的响应
+ */
+static bool recv_replies(sylar::Socket::ptr sock, std::vector<Reply> &replies, size_t count,
+                         const std::vector<bool> &head = std::vector<bool>()) {
+    std::string buf(64 * 1024, '\0');
+    size_t start = 0;
+    size_t end = 0;
+    HttpParser parser(HttpParser::RESPONSE);
+    while(replies.size() < count) {
+        parser.setNoBody(replies.size() < head.size() && head[replies.size()]);
+        ssize_t n = parser.execute(&buf[start], end - start);
+        if(n < 0) {
+            return false;
+        }
+        if(parser.isFinished()) {
+            replies.push_back({(int)parser.getStatus(), parser.getBody(), parser.isKeepAlive(),
+                               parser.getContentLength()});
+            start += n;
+            parser.reset();
+            continue;
+        }
+        ssize_t rt = sock->recv(&buf[end], buf.size() - end);
+        if(rt <= 0) {
+            return false;
+        }
+        end += rt;
+    }
+    return true;
+}
+
+void test_server() {
+    sylar::IOManager iom(2, false, "http");
+    HttpServer::ptr server(new HttpServer(true, &iom));
+    std::atomic<uint64_t> flushes(~0ull);
+    auto dispatch = server->getServletDispatch();
+    dispatch->addServlet("/hello", reply("hello world"));
+    dispatch->addServlet("/echo", [](HttpRequest::ptr req, HttpResponse::ptr rsp, HttpSession::ptr session) {
+        rsp->setHeader("Content-Type", "text/plain");
+        rsp->setBody(req->getBody());
+        return 0;
+    });
+    dispatch->addServlet("/stats", [&flushes](HttpRequest::ptr req, HttpResponse::ptr rsp, HttpSession::ptr session) {
+        flushes = session->getFlushCount();
+        rsp->setBody(std::to_string(session->getRequestCount()));
+        return 0;
+    });
+    dispatch->addPrefixServlet("/static/", [](HttpRequest::ptr req, HttpResponse::ptr rsp, HttpSession::ptr session) {
+        rsp->setBody(req->getPath().toString());
+        return 0;
+    });
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    SYLAR_ASSERT(server->bind((sockaddr *)&addr, sizeof(addr)));
+    memcpy(&addr, server->getSocks()[0]->getLocalAddress(), sizeof(addr));
+    server->start();
+
+    std::atomic<int> done(0);
+    iom.schedule([&]() {
+        // 一次发出去 5 个请求，响应按顺序、一次 writev 回来
+        sylar::Socket::ptr sock = sylar::Socket::CreateTCPSocket();
+        SYLAR_ASSERT(sock->connect((const sockaddr *)&addr, sizeof(addr), 1000));
+        std::string reqs = "GET /hello HTTP/1.1\r\nHost: x\r\n\r\n"
+                           "POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n2\r\nde\r\n0\r\n\r\n"
+                           "HEAD /hello HTTP/1.1\r\n\r\n"
+                           "GET /static/a/b.js?x=1 HTTP/1.1\r\n\r\n"
+                           "GET /stats HTTP/1.1\r\n\r\n";
+        SYLAR_ASSERT(sock->send(reqs.c_str(), reqs.size()) == (ssize_t)reqs.size());
+        std::vector<Reply> replies;
+        SYLAR_ASSERT(recv_replies(sock, replies, 5, {false, false, true, false, false}));
+        SYLAR_ASSERT(replies[0].status == 200 && replies[0].body == "hello world");
+        SYLAR_ASSERT(replies[1].body == "abcde");
+        SYLAR_ASSERT(replies[2].body.empty() && replies[2].content_length == 11);
+        SYLAR_ASSERT(replies[3].body == "/static/a/b.js");
+        SYLAR_ASSERT(replies[4].body == "5");
+        SYLAR_ASSERT(flushes == 0);     // 前 4 个响应和 /stats 的一起发
+        for(auto &r : replies) {
+            SYLAR_ASSERT(r.keepalive);
+        }
+
+        // 同一个连接接着用，请求分两次到
+        replies.clear();
+        std::string part1 = "GET /nothing HTTP/1.1\r\nHo";
+        std::string part2 = "st: x\r\n\r\nGET /hello HTTP/1.1\r\nConnection: close\r\n\r\n";
+        SYLAR_ASSERT(sock->send(part1.c_str(), part1.size()) == (ssize_t)part1.size());
+        usleep(10 * 1000);
+        SYLAR_ASSERT(sock->send(part2.c_str(), part2.size()) == (ssize_t)part2.size());
+        SYLAR_ASSERT(recv_replies(sock, replies, 2));
+        SYLAR_ASSERT(replies[0].status == 404);
+        SYLAR_ASSERT(replies[1].status == 200 && !replies[1].keepalive);
+        char c;
+        SYLAR_ASSERT(sock->recv(&c, 1) == 0);   // Connection: close 之后服务器关闭连接
+        ++done;
+    });
+    iom.schedule([&]() {
+        // HTTP/1.0 默认短连接
+        sylar::Socket::ptr sock = sylar::Socket::CreateTCPSocket();
+        SYLAR_ASSERT(sock->connect((const sockaddr *)&addr, sizeof(addr), 1000));
+        std::string req = "GET /hello HTTP/1.0\r\n\r\n";
+        SYLAR_ASSERT(sock->send(req.c_str(), req.size()) == (ssize_t)req.size());
+        std::vector<Reply> replies;
+        SYLAR_ASSERT(recv_replies(sock, replies, 1));
+        SYLAR_ASSERT(replies[0].body == "hello world" && !replies[0].keepalive);
+        char c;
+        SYLAR_ASSERT(sock->recv(&c, 1) == 0);
+        ++done;
+    });
+    iom.schedule([&]() {
+        // 错误的请求回 400 并关闭，之前正常的请求照常响应
+        sylar::Socket::ptr sock = sylar::Socket::CreateTCPSocket();
+        SYLAR_ASSERT(sock->connect((const sockaddr *)&addr, sizeof(addr), 1000));
+        std::string req = "GET /hello HTTP/1.1\r\n\r\nGET /hello HTTP/1.1\r\nBad Header\r\n\r\n";
+        SYLAR_ASSERT(sock->send(req.c_str(), req.size()) == (ssize_t)req.size());
+        std::vector<Reply> replies;
+        SYLAR_ASSERT(recv_replies(sock, replies, 2));
+        SYLAR_ASSERT(replies[0].status == 200);
+        SYLAR_ASSERT(replies[1].status == 400 && !replies[1].keepalive);
+        char c;
+        SYLAR_ASSERT(sock->recv(&c, 1) == 0);
+        ++done;
+    });
+    while(done < 3) {
+        usleep(1000);
+    }
+    server->stop();
+    SYLAR_LOG_INFO(g_logger) << "server ok";
+}
+
+int main(int argc, char **argv) {
+    test_dispatch();
+    test_no_body_status();
+    test_server();
+    return 0;
+}
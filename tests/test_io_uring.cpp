@@ -0,0 +1,96 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/12 15:40
+* @version: 1.0
+* @description: 基于完成的 IO 测试，io_uring 和退回 epoll 两种后端各跑一遍
+********************************************************************************/
+
+#include "../sylar/sylar.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static sockaddr_in s_addr;
+static bool s_listening = false;
+
+void echo_server() {
+    sylar::IOManager *iom = sylar::IOManager::GetThis();
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    memset(&s_addr, 0, sizeof(s_addr));
+    s_addr.sin_family = AF_INET;
+    s_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    SYLAR_ASSERT(!bind(listen_fd, (sockaddr*)&s_addr, sizeof(s_addr)));
+    SYLAR_ASSERT(!listen(listen_fd, 16));
+    socklen_t len = sizeof(s_addr);
+    getsockname(listen_fd, (sockaddr*)&s_addr, &len);
+    s_listening = true;
+
+    int fd = iom->asyncAccept(listen_fd, nullptr, nullptr);
+    SYLAR_LOG_INFO(g_logger) << "accept fd=" << fd;
+    SYLAR_ASSERT(fd >= 0);
+    char buf[64];
+    ssize_t n = 0;
+    while((n = iom->asyncRead(fd, buf, sizeof(buf))) > 0) {
+        iovec iov[2];   // 分两段写回去
+        iov[0].iov_base = buf;
+        iov[0].iov_len = n / 2;
+        iov[1].iov_base = buf + n / 2;
+        iov[1].iov_len = n - n / 2;
+        SYLAR_ASSERT(iom->asyncWritev(fd, iov, 2) == n);
+    }
+    close(fd);
+    close(listen_fd);
+}
+
+void echo_client() {
+    sylar::IOManager *iom = sylar::IOManager::GetThis();
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    SYLAR_ASSERT(!iom->asyncConnect(fd, (sockaddr*)&s_addr, sizeof(s_addr), 1000));
+
+    char buf[64];
+    for(int i = 0; i < 3; ++i) {
+        std::string msg = "hello " + std::to_string(i);
+        SYLAR_ASSERT(iom->asyncWrite(fd, msg.c_str(), msg.size()) == (ssize_t)msg.size());
+        ssize_t n = iom->asyncRead(fd, buf, sizeof(buf));
+        SYLAR_ASSERT(n == (ssize_t)msg.size());
+        SYLAR_LOG_INFO(g_logger) << "echo: " << std::string(buf, n);
+    }
+
+    uint64_t start = sylar::GetCurrentMS();
+    ssize_t n = iom->asyncRead(fd, buf, sizeof(buf), 100);  // 没有数据了，等到超时
+    SYLAR_LOG_INFO(g_logger) << "read timeout n=" << n << " errno=" << errno
+                             << " elapse=" << sylar::GetCurrentMS() - start;
+    SYLAR_ASSERT(n == -1 && errno == ETIMEDOUT);
+
+    iom->schedule([fd]() {  // 别的协程把 fd 关掉，等在上面的读要被唤醒
+        usleep(50 * 1000);
+        close(fd);
+    });
+    n = iom->asyncRead(fd, buf, sizeof(buf));
+    SYLAR_LOG_INFO(g_logger) << "read after close n=" << n << " errno=" << errno;
+    SYLAR_ASSERT(n == -1 && (errno == ECANCELED || errno == EBADF));
+}
+
+void test_echo(bool io_uring) {
+    sylar::Config::Lookup<bool>("iomanager.io_uring")->setValue(io_uring);
+    s_listening = false;
+    sylar::IOManager iom(2, true, io_uring ? "io_uring" : "epoll");
+    SYLAR_LOG_INFO(g_logger) << "io_uring=" << io_uring << " hasIOUring=" << iom.hasIOUring();
+    iom.schedule(echo_server);
+    iom.schedule([](){
+        while(!s_listening) {
+            usleep(1000);
+        }
+        echo_client();
+    });
+}
+
+int main(int argc, char **argv) {
+    test_echo(false);
+    test_echo(true);
+    return 0;
+}
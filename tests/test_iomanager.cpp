@@ -16,6 +16,7 @@
 #include <fcntl.h>
 #include <iostream>
 #include <sys/epoll.h>
+#include <set>
 
 sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
 
@@ -63,7 +64,262 @@ void test1() {
     iom.schedule(&test_fiber);
 }
 
+sylar::Timer::ptr s_timer;
+void test_timer() {
+    sylar::IOManager iom(2);
+    uint64_t start = sylar::GetCurrentMS();
+    s_timer = iom.addTimer(100, [start](){
+        static int i = 0;
+        SYLAR_LOG_INFO(g_logger) << "hello timer i=" << i
+                                 << " elapse=" << sylar::GetCurrentMS() - start;
+        if(++i == 3) {
+            s_timer->reset(200, true);
+        }
+        if(i == 5) {
+            s_timer->cancel();
+        }
+    }, true);
+
+    static std::shared_ptr<int> cond(new int(0));   // 要比 iom 活得久
+    iom.addConditionTimer(50, [](){
+        SYLAR_LOG_INFO(g_logger) << "condition timer alive";
+    }, cond);
+    std::shared_ptr<int> dead(new int(0));
+    iom.addConditionTimer(50, [](){
+        SYLAR_ASSERT2(false, "condition released, should not run");
+    }, dead);
+    dead.reset();
+}
+
+/**
+ * 一次 epoll_wait 返回很多就绪的 fd，回调和协程一起批量放进队列
+ */
+void test_batch_trigger() {
+    static const int PIPES = 100;
+    static std::atomic<int> s_count(0);
+    s_count = 0;
+    std::vector<int> fds(PIPES * 2);
+    auto min_events = sylar::Config::Lookup<uint32_t>("iomanager.epoll.min_events");
+    min_events->setValue(4);    // 从很小的批量开始，一次取不完会自动变大
+    {
+        sylar::IOManager iom(2, true, "batch");
+        for(int i = 0; i < PIPES; ++i) {
+            SYLAR_ASSERT(!pipe(&fds[i * 2]));
+            fcntl(fds[i * 2], F_SETFL, O_NONBLOCK);
+            int fd = fds[i * 2];
+            if(i % 2) {
+                iom.addEvent(fd, sylar::IOManager::READ, [](){
+                    ++s_count;
+                });
+            } else {
+                iom.schedule([fd](){
+                    sylar::IOManager::GetThis()->waitEvent(fd, sylar::IOManager::READ);
+                    ++s_count;
+                });
+            }
+        }
+        iom.schedule([fds](){
+            usleep(10 * 1000);  // 等所有的协程都挂起
+            for(int i = 0; i < PIPES; ++i) {
+                SYLAR_ASSERT(write(fds[i * 2 + 1], "x", 1) == 1);
+            }
+        });
+        iom.schedule([&iom](){
+            usleep(50 * 1000);
+            SYLAR_LOG_INFO(g_logger) << iom.dumpWakeupHistogram();
+        });
+    }
+    min_events->setValue(64);
+    SYLAR_LOG_INFO(g_logger) << "batch trigger count=" << s_count;
+    SYLAR_ASSERT(s_count == PIPES);
+    for(auto fd : fds) {
+        close(fd);
+    }
+}
+
+/**
+ * 多 reactor：每个 fd 固定在一个线程的 epoll 上，等在上面的协程每次都在同一个线程上恢复
+ */
+void test_multi_reactor() {
+    static const int PAIRS = 16;
+    static const int ROUNDS = 20;
+    sylar::Config::Lookup<bool>("iomanager.multi_reactor")->setValue(true);
+    std::vector<int> fds(PAIRS * 2);
+    std::vector<std::set<int> > threads(PAIRS);     // 每个 fd 上的协程在哪些线程上恢复过
+    {
+        sylar::IOManager iom(4, false, "reactor");
+        SYLAR_ASSERT(iom.getReactorCount() == 4);
+        for(int i = 0; i < PAIRS; ++i) {
+            SYLAR_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, &fds[i * 2]));
+            int fd = fds[i * 2];
+            std::set<int>* ths = &threads[i];
+            iom.schedule([fd, ths](){
+                int total = 0;
+                char buf[ROUNDS];
+                while(total < ROUNDS) {
+                    sylar::IOManager::GetThis()->waitEvent(fd, sylar::IOManager::READ);
+                    ths->insert(sylar::GetThreadId());
+                    ssize_t n = 0;
+                    while((n = read(fd, buf, sizeof(buf))) > 0) {
+                        total += n;
+                    }
+                }
+            });
+        }
+        for(int r = 0; r < ROUNDS; ++r) {
+            usleep(5 * 1000);
+            for(int i = 0; i < PAIRS; ++i) {
+                SYLAR_ASSERT(write(fds[i * 2 + 1], "x", 1) == 1);
+            }
+        }
+    }
+    sylar::Config::Lookup<bool>("iomanager.multi_reactor")->setValue(false);
+    for(int i = 0; i < PAIRS; ++i) {
+        SYLAR_ASSERT(threads[i].size() == 1);
+    }
+    for(auto fd : fds) {
+        close(fd);
+    }
+    SYLAR_LOG_INFO(g_logger) << "multi reactor ok";
+}
+
+/**
+ * 32 个线程同时在各自的 fd 上 addEvent/delEvent，fd 号分散开，前几轮还会触发 fd 表扩容
+ */
+void test_fd_contention(bool persistent_et) {
+    static const int THREADS = 32;
+    static const int FDS = 16;
+    static const int LOOPS = 20000;
+    sylar::Config::Lookup<bool>("iomanager.persistent_et")->setValue(persistent_et);   // 常驻注册没有 epoll_ctl，只剩查表和加锁
+    sylar::IOManager iom(1, false, "contention");
+
+    int sv[2];
+    SYLAR_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    std::vector<int> fds;
+    for(int i = 0; i < THREADS; ++i) {
+        for(int j = 0; j < FDS; ++j) {
+            int fd = 256 + i * 512 + j;
+            SYLAR_ASSERT(dup2(sv[0], fd) == fd);
+            fds.push_back(fd);
+        }
+    }
+
+    uint64_t start = sylar::GetCurrentUS();
+    std::vector<sylar::Thread::ptr> thrs;
+    for(int i = 0; i < THREADS; ++i) {
+        thrs.push_back(sylar::Thread::ptr(new sylar::Thread([&iom, &fds, i](){
+            for(int n = 0; n < LOOPS; ++n) {
+                int fd = fds[i * FDS + n % FDS];
+                iom.addEvent(fd, sylar::IOManager::READ, [](){});
+                iom.delEvent(fd, sylar::IOManager::READ);
+            }
+        }, "contention_" + std::to_string(i))));
+    }
+    for(auto &i : thrs) {
+        i->join();
+    }
+    uint64_t used = sylar::GetCurrentUS() - start;
+    SYLAR_LOG_INFO(g_logger) << "fd contention persistent_et=" << persistent_et
+                             << " threads=" << THREADS
+                             << " add+del=" << THREADS * LOOPS
+                             << " used=" << used / 1000 << "ms"
+                             << " per_op=" << used * 1000 / (THREADS * LOOPS) << "ns";
+    for(auto fd : fds) {
+        iom.cancelAll(fd);
+        close(fd);
+    }
+    close(sv[0]);
+    close(sv[1]);
+}
+
+/**
+ * 忙轮询：一个工作线程自旋，socketpair 上来回 ping-pong，看自旋花掉的时间和命中次数
+ */
+void test_busy_poll() {
+    static const int ROUNDS = 200;
+    sylar::Config::Lookup<bool>("iomanager.persistent_et")->setValue(false);
+    auto threads = sylar::Config::Lookup<uint32_t>("iomanager.busy_poll.threads");
+    auto spin_us = sylar::Config::Lookup<uint32_t>("iomanager.busy_poll.spin_us");
+    auto socket_us = sylar::Config::Lookup<uint32_t>("iomanager.busy_poll.socket_us");
+    threads->setValue(1);
+    spin_us->setValue(1000);
+    socket_us->setValue(50);
+
+    static std::atomic<bool> s_done(false);
+    s_done = false;
+    int sv[2];
+    SYLAR_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv));
+    uint64_t start = sylar::GetCurrentUS();
+    sylar::IOManager::BusyPollStats stats;
+    {
+        sylar::IOManager iom(2, false, "busy_poll");
+        iom.schedule([sv](){
+            char c;
+            for(int i = 0; i < ROUNDS; ++i) {
+                sylar::IOManager::GetThis()->waitEvent(sv[1], sylar::IOManager::READ);
+                SYLAR_ASSERT(read(sv[1], &c, 1) == 1);
+                SYLAR_ASSERT(write(sv[1], &c, 1) == 1);
+            }
+        });
+        iom.schedule([sv](){
+            char c = 'x';
+            for(int i = 0; i < ROUNDS; ++i) {
+                SYLAR_ASSERT(write(sv[0], &c, 1) == 1);
+                sylar::IOManager::GetThis()->waitEvent(sv[0], sylar::IOManager::READ);
+                SYLAR_ASSERT(read(sv[0], &c, 1) == 1);
+            }
+            s_done = true;
+        });
+        while(!s_done) {
+            usleep(1000);
+        }
+        SYLAR_LOG_INFO(g_logger) << "busy poll rounds=" << ROUNDS
+                                 << " used=" << sylar::GetCurrentUS() - start << "us";
+        iom.getBusyPollStats(stats);
+        SYLAR_LOG_INFO(g_logger) << iom.dumpBusyPollStats();
+    }
+    SYLAR_ASSERT(stats.threads == 1);
+    SYLAR_ASSERT(stats.polls > 0);
+    threads->setValue(0);
+    socket_us->setValue(0);
+    close(sv[0]);
+    close(sv[1]);
+}
+
+/**
+ * 常驻注册模式下 fd 在 IOManager 线程外面关掉，fd 号复用之后要重新注册，不然等不到事件
+ */
+void test_persistent_reuse() {
+    sylar::Config::Lookup<bool>("iomanager.persistent_et")->setValue(true);
+    {
+        sylar::IOManager iom(1, false, "reuse");
+        for(int i = 0; i < 2; ++i) {
+            int sv[2];
+            SYLAR_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv));
+            std::atomic<int> rt(1);
+            iom.schedule([sv, &rt]() {
+                SYLAR_ASSERT(write(sv[1], "x", 1) == 1);
+                rt = sylar::IOManager::GetThis()->waitEvent(sv[0], sylar::IOManager::READ, 1000);
+            });
+            while(rt == 1) {
+                usleep(1000);
+            }
+            SYLAR_ASSERT2(rt == 0, "fd=" + std::to_string(sv[0]));
+            close(sv[0]);   // 主线程没有 IOManager
+            close(sv[1]);
+        }
+    }
+    sylar::Config::Lookup<bool>("iomanager.persistent_et")->setValue(false);
+}
+
 int main(int argc, char** argv) {
+    test_timer();
     test1();
+    test_batch_trigger();
+    test_multi_reactor();
+    test_fd_contention(false);
+    test_fd_contention(true);
+    test_busy_poll();
+    test_persistent_reuse();
     return 0;
 }
\ No newline at end of file
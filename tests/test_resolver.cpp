@@ -0,0 +1,175 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/30 10:00
+* @version: 1.0
+* @description: 地址和域名解析测试：地址转换、/etc/hosts、桩解析函数下的缓存、过期、失败缓存、合并查询
+********************************************************************************/
+
+#include "../sylar/sylar.h"
+#include <netdb.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+void test_address() {
+    sylar::IPAddress::ptr v4 = sylar::IPAddress::Create("127.0.0.1", 80);
+    SYLAR_ASSERT(v4 && v4->getFamily() == AF_INET && v4->getPort() == 80);
+    SYLAR_ASSERT(v4->toString() == "127.0.0.1:80");
+    sylar::IPAddress::ptr v6 = sylar::IPAddress::Create("::1", 8080);
+    SYLAR_ASSERT(v6 && v6->getFamily() == AF_INET6 && v6->toString() == "[::1]:8080");
+    SYLAR_ASSERT(!sylar::IPAddress::Create("localhost") && !sylar::IPv4Address::Create("1.2.3"));
+    SYLAR_ASSERT(sylar::IPv4Address(INADDR_LOOPBACK, 80) == *v4);
+
+    // 换端口是副本
+    sylar::IPAddress::ptr other = v4->withPort(81);
+    SYLAR_ASSERT(other->getPort() == 81 && v4->getPort() == 80);
+    SYLAR_ASSERT(*v4 != *other && *v4 < *other);
+
+    sylar::Address::ptr copy = sylar::Address::Create(v6->getAddr(), v6->getAddrLen());
+    SYLAR_ASSERT(std::dynamic_pointer_cast<sylar::IPv6Address>(copy) && *copy == *v6);
+    SYLAR_ASSERT(!sylar::Address::Create(v6->getAddr(), sizeof(sockaddr_in)));
+
+    sylar::UnixAddress unix_addr("/tmp/sylar.sock");
+    SYLAR_ASSERT(unix_addr.getPath() == "/tmp/sylar.sock" && unix_addr.toString() == "/tmp/sylar.sock");
+    sylar::UnixAddress abstract(std::string("\0sylar", 6));
+    SYLAR_ASSERT(abstract.getPath() == std::string("\0sylar", 6) && abstract.toString() == "\\0sylar");
+    SYLAR_LOG_INFO(g_logger) << "address ok " << *v4 << " " << *v6 << " " << abstract;
+}
+
+/**
+ * @brief 走真正的 getaddrinfo，localhost 在 /etc/hosts 里
+ */
+void test_hosts() {
+    sylar::Resolver *resolver = sylar::Resolver::GetInstance();
+    std::vector<sylar::IPAddress::ptr> result;
+    SYLAR_ASSERT(resolver->lookup("localhost", result, 80, AF_INET) == 0 && !result.empty());
+    SYLAR_ASSERT(result[0]->toString() == "127.0.0.1:80");
+
+    sylar::Resolver::Stats stats;
+    resolver->getStats(stats);
+    uint64_t hits = stats.hits;
+    sylar::IPAddress::ptr addr = resolver->lookupAny("localhost", 443, AF_INET);
+    SYLAR_ASSERT(addr && addr->getPort() == 443);
+    resolver->getStats(stats);
+    SYLAR_ASSERT(stats.hits == hits + 1);
+
+    // 数字地址不查
+    SYLAR_ASSERT(resolver->lookup("[::1]", result, 53) == 0 && result[0]->toString() == "[::1]:53");
+    SYLAR_ASSERT(resolver->lookup("127.0.0.1", result, 0, AF_INET6) == EAI_ADDRFAMILY);
+    SYLAR_ASSERT(resolver->lookup("no-such-host.invalid", result) != 0 && result.empty());
+    SYLAR_LOG_INFO(g_logger) << "hosts ok " << resolver->dumpStats();
+}
+
+/**
+ * @brief 桩解析函数：记录调用次数，每次查询 30ms
+ */
+struct StubResolver {
+    std::atomic<int> calls{0};
+
+    int operator()(const std::string &host, int family, std::vector<sylar::IPAddress::ptr> &result) {
+        ++calls;
+        usleep(30 * 1000);
+        if(host == "missing.test") {
+            return EAI_NONAME;
+        }
+        if(host == "flaky.test") {
+            return EAI_AGAIN;
+        }
+        result.push_back(sylar::IPAddress::Create(host == "a.test" ? "10.0.0.1" : "10.0.0.2"));
+        return 0;
+    }
+};
+
+void test_stub() {
+    sylar::Resolver::Options options;
+    options.threads = 1;
+    options.ttl = 100;
+    options.negative_ttl = 50;
+    options.max_entries = 2;
+    sylar::Resolver resolver(options, "stub_resolver");
+    std::shared_ptr<StubResolver> stub = std::make_shared<StubResolver>();
+    resolver.setLookupFunc([stub](const std::string &host, int family, std::vector<sylar::IPAddress::ptr> &result) {
+        return (*stub)(host, family, result);
+    });
+
+    // 同时查同一个域名只查一次，其它的等这次的结果
+    const int N = 20;
+    std::atomic<int> done(0);
+    for(int i = 0; i < N; ++i) {
+        sylar::IOManager::GetThis()->schedule([&resolver, &done, i]() {
+            sylar::IPAddress::ptr addr = resolver.lookupAny("a.test", 1000 + i);
+            SYLAR_ASSERT(addr && addr->toString() == "10.0.0.1:" + std::to_string(1000 + i));
+            ++done;
+        });
+    }
+    while(done < N) {
+        usleep(1000);   // 开启了 hook，只挂起协程
+    }
+    sylar::Resolver::Stats stats;
+    resolver.getStats(stats);
+    SYLAR_ASSERT2(stub->calls == 1, std::to_string(stub->calls));
+    SYLAR_ASSERT(stats.coalesced + stats.hits == N - 1 && stats.queries == 1);
+
+    // 缓存命中，过期之后重新查
+    SYLAR_ASSERT(resolver.lookupAny("a.test") && stub->calls == 1);
+    usleep(110 * 1000);
+    SYLAR_ASSERT(resolver.lookupAny("a.test") && stub->calls == 2);
+
+    // 确定的失败缓存 negative_ttl，临时失败不缓存
+    std::vector<sylar::IPAddress::ptr> result;
+    SYLAR_ASSERT(resolver.lookup("missing.test", result) == EAI_NONAME && stub->calls == 3);
+    SYLAR_ASSERT(resolver.lookup("missing.test", result) == EAI_NONAME && stub->calls == 3);
+    usleep(60 * 1000);
+    SYLAR_ASSERT(resolver.lookup("missing.test", result) == EAI_NONAME && stub->calls == 4);
+    SYLAR_ASSERT(resolver.lookup("flaky.test", result) == EAI_AGAIN && stub->calls == 5);
+    SYLAR_ASSERT(resolver.lookup("flaky.test", result) == EAI_AGAIN && stub->calls == 6);
+
+    // 最多 2 个 key，超出的时候先淘汰过期的
+    SYLAR_ASSERT(resolver.lookupAny("b.test", 0, AF_INET) && stub->calls == 7);
+    resolver.getStats(stats);
+    SYLAR_ASSERT(stats.entries <= 2 && stats.negative_hits == 1);
+
+    resolver.remove("b.test");
+    SYLAR_ASSERT(resolver.lookupAny("b.test", 0, AF_INET) && stub->calls == 8);
+    SYLAR_LOG_INFO(g_logger) << "stub ok " << resolver.dumpStats();
+}
+
+/**
+ * @brief 解析出来的地址直接用来 bind、connect
+ */
+void test_connect() {
+    sylar::TcpServer::ptr server(new sylar::TcpServer(sylar::IOManager::GetThis()));
+    SYLAR_ASSERT(server->bind(*sylar::IPv4Address::Create("127.0.0.1"), 1));
+    server->start();
+    sylar::Address::ptr local = server->getSocks()[0]->getLocalAddr();
+    uint16_t port = std::dynamic_pointer_cast<sylar::IPAddress>(local)->getPort();
+
+    sylar::IPAddress::ptr addr = sylar::Resolver::GetInstance()->lookupAny("localhost", port, AF_INET);
+    SYLAR_ASSERT(addr && *addr == *local);
+    sylar::Socket::ptr sock = sylar::Socket::CreateTCP(*addr);
+    SYLAR_ASSERT(sock->connect(*addr, 1000));
+    SYLAR_ASSERT(*sock->getRemoteAddr() == *local);
+
+    sylar::UnixAddress unix_addr(std::string("\0sylar_test_resolver_", 21) + std::to_string(getpid()));
+    sylar::Socket::ptr unix_sock = sylar::Socket::CreateUDP(unix_addr);
+    SYLAR_ASSERT(unix_sock->bind(unix_addr) && *unix_sock->getLocalAddr() == unix_addr);
+    server->stop();
+    SYLAR_LOG_INFO(g_logger) << "connect ok " << *sock;
+}
+
+int main(int argc, char **argv) {
+    test_address();
+    // 不在协程里直接查
+    SYLAR_ASSERT(sylar::Resolver::GetInstance()->lookupAny("localhost"));
+
+    sylar::IOManager iom(2, false, "resolver_test");
+    iom.setHookEnable(true);
+    iom.schedule([]() {
+        test_hosts();
+        test_stub();
+        test_connect();
+    });
+    return 0;
+}
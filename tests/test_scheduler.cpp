@@ -21,7 +21,35 @@ void test_fiber() {
     }
 }
 
+void test_admission() {
+    sylar::Scheduler sc(1, false, "admission");
+    sc.setMaxQueueSize(100);
+    sc.setShedding(1000, 10 * 1000);    // 排队超过 1ms 且持续 10ms 认为过载
+
+    static std::atomic<int> s_done{0};
+    int accepted = 0;
+    for(int i = 0; i < 150; ++i) {
+        if(sc.trySchedule([](){
+            usleep(1000);
+            ++s_done;
+        })) {
+            ++accepted;
+        }
+    }
+    SYLAR_LOG_INFO(g_logger) << "accepted=" << accepted
+                             << " rejected=" << sc.getRejectedCount();
+    SYLAR_ASSERT(accepted == 100);
+
+    sc.start();
+    sc.stop();
+    SYLAR_LOG_INFO(g_logger) << "done=" << s_done
+                             << " shed=" << sc.getShedCount()
+                             << " queue=" << sc.getQueueSize();
+    SYLAR_ASSERT(s_done + sc.getShedCount() == 100);
+}
+
 int main(int argc, char** argv) {
+    test_admission();
     SYLAR_LOG_INFO(g_logger) << "main";
     sylar::Scheduler sc(3, false, "test");
     sc.start();
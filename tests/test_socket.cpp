@@ -0,0 +1,132 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/14 15:10
+* @version: 1.0
+* @description: Socket 测试：回显、iovec 收发、超时、连接失败、选项，以及不在协程里的用法
+********************************************************************************/
+
+#include "../sylar/sylar.h"
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static sockaddr_in s_addr;
+static bool s_listening = false;
+
+static sockaddr_in loopback(uint16_t port) {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    return addr;
+}
+
+void echo_server() {
+    sylar::Socket::ptr listener = sylar::Socket::CreateTCPSocket();
+    SYLAR_ASSERT(listener->setReusePort());
+    sockaddr_in addr = loopback(0);
+    SYLAR_ASSERT(listener->bind((sockaddr *)&addr, sizeof(addr)));
+    SYLAR_ASSERT(listener->listen());
+    memcpy(&s_addr, listener->getLocalAddress(), sizeof(s_addr));
+    SYLAR_LOG_INFO(g_logger) << "listen " << *listener;
+    s_listening = true;
+
+    sylar::Socket::ptr client = listener->accept();
+    SYLAR_ASSERT(client);
+    SYLAR_LOG_INFO(g_logger) << "accept " << *client;
+    char head[4];
+    char body[64];
+    while(true) {
+        iovec iov[2];   // 一次 recvmsg 收到两个缓冲区里
+        iov[0].iov_base = head;
+        iov[0].iov_len = sizeof(head);
+        iov[1].iov_base = body;
+        iov[1].iov_len = sizeof(body);
+        ssize_t n = client->recv(iov, 2);
+        if(n <= 0) {
+            break;
+        }
+        iov[1].iov_len = n > (ssize_t)sizeof(head) ? n - sizeof(head) : 0;
+        iov[0].iov_len = n - iov[1].iov_len;
+        SYLAR_ASSERT(client->send(iov, 2) == n);
+    }
+    client->close();
+}
+
+void echo_client() {
+    sylar::Socket::ptr sock = sylar::Socket::CreateTCPSocket();
+    SYLAR_ASSERT(sock->connect((sockaddr *)&s_addr, sizeof(s_addr), 1000));
+    SYLAR_LOG_INFO(g_logger) << "connect " << *sock;
+
+    int nodelay = 0;
+    SYLAR_ASSERT(sock->getOption(IPPROTO_TCP, TCP_NODELAY, nodelay) && nodelay);
+    SYLAR_ASSERT(sock->setKeepAlive(true, 30, 5, 3));
+    int keepidle = 0;
+    SYLAR_ASSERT(sock->getOption(IPPROTO_TCP, TCP_KEEPIDLE, keepidle) && keepidle == 30);
+
+    char buf[64];
+    for(int i = 0; i < 3; ++i) {
+        std::string msg = "hello socket " + std::to_string(i);
+        SYLAR_ASSERT(sock->send(msg.c_str(), msg.size()) == (ssize_t)msg.size());
+        ssize_t n = sock->recv(buf, sizeof(buf));
+        SYLAR_ASSERT(n == (ssize_t)msg.size());
+        SYLAR_LOG_INFO(g_logger) << "echo: " << std::string(buf, n);
+    }
+
+    sock->setRecvTimeout(100);
+    uint64_t start = sylar::GetCurrentMS();
+    ssize_t n = sock->recv(buf, sizeof(buf));   // 没有数据了，等到超时
+    SYLAR_LOG_INFO(g_logger) << "recv timeout n=" << n << " errno=" << errno
+                             << " elapse=" << sylar::GetCurrentMS() - start;
+    SYLAR_ASSERT(n == -1 && errno == ETIMEDOUT);
+    sock->close();
+
+    sylar::Socket::ptr refused = sylar::Socket::CreateTCPSocket();
+    sockaddr_in addr = loopback(1);     // 没有人监听
+    SYLAR_ASSERT(!refused->connect((sockaddr *)&addr, sizeof(addr), 1000));
+    SYLAR_ASSERT(errno == ECONNREFUSED);
+}
+
+void test_echo() {
+    sylar::IOManager iom(2, true, "socket");
+    iom.schedule(echo_server);
+    iom.schedule([](){
+        while(!s_listening) {
+            usleep(1000);
+        }
+        echo_client();
+    });
+}
+
+/**
+ * 不在 IOManager 里的时候用 poll 等待，阻塞当前线程
+ */
+void test_udp_without_iomanager() {
+    sylar::Socket::ptr server = sylar::Socket::CreateUDPSocket();
+    sockaddr_in addr = loopback(0);
+    SYLAR_ASSERT(server->bind((sockaddr *)&addr, sizeof(addr)));
+    server->setRecvTimeout(50);
+
+    char buf[16];
+    sockaddr_in from;
+    socklen_t fromlen = sizeof(from);
+    SYLAR_ASSERT(server->recvFrom(buf, sizeof(buf), (sockaddr *)&from, &fromlen) == -1 && errno == ETIMEDOUT);
+
+    sylar::Socket::ptr client = sylar::Socket::CreateUDPSocket();
+    SYLAR_ASSERT(client->sendTo("ping", 4, server->getLocalAddress(), server->getLocalAddressLen()) == 4);
+    fromlen = sizeof(from);
+    ssize_t n = server->recvFrom(buf, sizeof(buf), (sockaddr *)&from, &fromlen);
+    SYLAR_ASSERT(n == 4 && !memcmp(buf, "ping", 4));
+    SYLAR_LOG_INFO(g_logger) << "udp from " << sylar::Socket::AddressToString((sockaddr *)&from, fromlen);
+}
+
+int main(int argc, char **argv) {
+    test_echo();
+    test_udp_without_iomanager();
+    return 0;
+}
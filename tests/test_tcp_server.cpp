@@ -0,0 +1,142 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/16 14:20
+* @version: 1.0
+* @description: TcpServer 测试：每个工作线程一个监听 socket，连接在 accept 它的线程上处理
+********************************************************************************/
+
+#include "../sylar/sylar.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <map>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const int CLIENTS = 32;
+static std::atomic<int> s_handled(0);
+static sylar::Mutex s_mutex;
+static std::map<int, int> s_threads;    // 处理连接的线程 -> 连接数
+
+class EchoServer : public sylar::TcpServer {
+public:
+    typedef std::shared_ptr<EchoServer> ptr;
+    EchoServer(sylar::IOManager *worker) : TcpServer(worker) {}
+
+protected:
+    void handleClient(sylar::Socket::ptr client) override {
+        {
+            sylar::Mutex::Lock lock(s_mutex);
+            ++s_threads[sylar::GetThreadId()];
+        }
+        char buf[64];
+        ssize_t n = 0;
+        while((n = client->recv(buf, sizeof(buf))) > 0) {
+            SYLAR_ASSERT(client->send(buf, n) == n);
+        }
+        ++s_handled;
+    }
+};
+
+void test_server(bool multi_reactor) {
+    sylar::Config::Lookup<bool>("iomanager.multi_reactor")->setValue(multi_reactor);
+    s_handled = 0;
+    s_threads.clear();
+    sylar::IOManager iom(3, false, "tcp_server");
+    EchoServer::ptr server(new EchoServer(&iom));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    SYLAR_ASSERT(server->bind((sockaddr *)&addr, sizeof(addr)));
+    SYLAR_ASSERT(server->getSocks().size() == 3);
+    memcpy(&addr, server->getSocks()[0]->getLocalAddress(), sizeof(addr));
+    SYLAR_LOG_INFO(g_logger) << server->toString();
+    server->start();
+
+    std::atomic<int> done(0);
+    for(int i = 0; i < CLIENTS; ++i) {
+        iom.schedule([addr, i, &done](){
+            sylar::Socket::ptr sock = sylar::Socket::CreateTCPSocket();
+            SYLAR_ASSERT(sock->connect((const sockaddr *)&addr, sizeof(addr), 1000));
+            std::string msg = "hello " + std::to_string(i);
+            char buf[64];
+            SYLAR_ASSERT(sock->send(msg.c_str(), msg.size()) == (ssize_t)msg.size());
+            SYLAR_ASSERT(sock->recv(buf, sizeof(buf)) == (ssize_t)msg.size());
+            SYLAR_ASSERT(std::string(buf, msg.size()) == msg);
+            sock->close();
+            ++done;
+        });
+    }
+    while(s_handled < CLIENTS) {
+        usleep(1000);
+    }
+    SYLAR_ASSERT(done == CLIENTS);
+    SYLAR_ASSERT(server->getAcceptCount() == CLIENTS);
+    std::stringstream ss;
+    for(auto &i : s_threads) {
+        ss << " " << i.first << "=" << i.second;
+    }
+    SYLAR_LOG_INFO(g_logger) << "multi_reactor=" << multi_reactor << " handled=" << s_handled
+                             << " threads:" << ss.str();
+    server->stop();
+}
+
+/**
+ * @brief fd 用完的时候 accept 一直失败，不能空转；放开之后积压的连接还能接进来
+ */
+void test_accept_backoff() {
+    sylar::Config::Lookup<bool>("iomanager.multi_reactor")->setValue(false);
+    s_handled = 0;
+    sylar::IOManager iom(1, false, "backoff");
+    EchoServer::ptr server(new EchoServer(&iom));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    SYLAR_ASSERT(server->bind((sockaddr *)&addr, sizeof(addr), 1));
+    memcpy(&addr, server->getSocks()[0]->getLocalAddress(), sizeof(addr));
+
+    int client = socket(AF_INET, SOCK_STREAM, 0);   // 先把客户端的 fd 建好
+    SYLAR_ASSERT(!connect(client, (sockaddr *)&addr, sizeof(addr)));   // 连接在内核的队列里，还没 accept
+    rlimit old_limit;
+    SYLAR_ASSERT(!getrlimit(RLIMIT_NOFILE, &old_limit));
+    int lowest = dup(client);   // 最小的空闲 fd，限制到它就再也分配不出来了
+    close(lowest);
+    rlimit limit = old_limit;
+    limit.rlim_cur = lowest;
+    SYLAR_ASSERT(!setrlimit(RLIMIT_NOFILE, &limit));
+
+    rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    server->start();
+    usleep(200 * 1000);
+    getrusage(RUSAGE_SELF, &after);
+    uint64_t cpu_us = (after.ru_utime.tv_sec - before.ru_utime.tv_sec) * 1000000ull
+                      + after.ru_utime.tv_usec - before.ru_utime.tv_usec
+                      + (after.ru_stime.tv_sec - before.ru_stime.tv_sec) * 1000000ull
+                      + after.ru_stime.tv_usec - before.ru_stime.tv_usec;
+    SYLAR_ASSERT(!setrlimit(RLIMIT_NOFILE, &old_limit));
+    SYLAR_LOG_INFO(g_logger) << "accept EMFILE for 200ms cpu=" << cpu_us << "us";
+    SYLAR_ASSERT2(cpu_us < 100 * 1000, std::to_string(cpu_us));
+    SYLAR_ASSERT(server->getAcceptCount() == 0);
+
+    SYLAR_ASSERT(write(client, "ping", 4) == 4);
+    char buf[8];
+    SYLAR_ASSERT(read(client, buf, sizeof(buf)) == 4);
+    close(client);
+    while(s_handled < 1) {
+        usleep(1000);
+    }
+    SYLAR_ASSERT(server->getAcceptCount() == 1);
+    server->stop();
+}
+
+int main(int argc, char **argv) {
+    test_server(false);
+    test_server(true);
+    test_accept_backoff();
+    return 0;
+}
@@ -0,0 +1,154 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/5 16:40
+* @version: 1.0
+* @description: 时间轮测试，和 TimerManager(红黑树) 的性能对比
+********************************************************************************/
+
+#include "../sylar/sylar.h"
+#include <cstdlib>
+
+sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+class BenchTimerManager : public sylar::TimerManager {
+protected:
+    void onTimerInsertedAtFront() override {}
+};
+
+void test_fire() {
+    sylar::TimingWheel wheel;
+    std::vector<int> fired;
+    uint64_t timeouts[] = {5, 1, 300, 20, 70000, 3};  // 70s 的要级联两层
+    std::vector<sylar::TimingWheel::Timer::ptr> timers;
+    for(auto ms : timeouts) {
+        timers.push_back(wheel.addTimer(ms, [&fired, ms](){
+            fired.push_back(ms);
+        }));
+    }
+    SYLAR_ASSERT(timers[1]->cancel());
+    SYLAR_ASSERT(!timers[1]->cancel());
+
+    uint64_t start = sylar::GetMonotonicMS();
+    std::vector<std::function<void()> > cbs;
+    wheel.advance(start + 10, cbs);
+    for(auto &cb : cbs) {
+        cb();
+    }
+    cbs.clear();
+    SYLAR_ASSERT(fired.size() == 2 && fired[0] == 3 && fired[1] == 5);
+
+    wheel.advance(start + 71000, cbs);
+    for(auto &cb : cbs) {
+        cb();
+    }
+    SYLAR_ASSERT(fired.size() == 5 && fired[2] == 20 && fired[3] == 300 && fired[4] == 70000);
+    SYLAR_ASSERT(wheel.size() == 0);
+    SYLAR_LOG_INFO(g_logger) << "test_fire ok";
+}
+
+void test_iomanager() {
+    static const uint64_t TIMEOUT = 50;
+    static const uint64_t SLACK = 30;   // 线程唤醒、调度的延迟
+    static sylar::TimingWheel::Timer::ptr s_timer;
+    sylar::Mutex mutex;
+    std::vector<uint64_t> fires;        // 循环定时器每次触发距离添加的时间
+    std::vector<uint64_t> shared_fires; // 共享时间轮上的
+    std::atomic<bool> cancelled_fired(false);
+    {
+        sylar::IOManager iom(2, false, "wheel");
+        iom.schedule([&](){
+            uint64_t start = sylar::GetMonotonicMS();
+            s_timer = sylar::IOManager::GetThis()->addWheelTimer(TIMEOUT, [&, start](){
+                sylar::Mutex::Lock lock(mutex);
+                fires.push_back(sylar::GetMonotonicMS() - start);
+                SYLAR_LOG_INFO(g_logger) << "wheel timer i=" << fires.size() - 1 << " elapse=" << fires.back();
+                if(fires.size() == 3) {
+                    s_timer->cancel();
+                }
+            }, true);
+            auto timer = sylar::IOManager::GetThis()->addWheelTimer(TIMEOUT / 2, [&](){
+                cancelled_fired = true;
+            });
+            SYLAR_ASSERT(timer->cancel());
+        });
+        uint64_t start = sylar::GetMonotonicMS();
+        iom.addWheelTimer(120, [&, start](){
+            sylar::Mutex::Lock lock(mutex);
+            shared_fires.push_back(sylar::GetMonotonicMS() - start);
+            SYLAR_LOG_INFO(g_logger) << "shared wheel timer elapse=" << shared_fires.back();
+        });
+    }
+
+    // 循环定时器从触发的时候重新计时，第 k 次最多累积 k 个 tick 加调度延迟
+    SYLAR_ASSERT(fires.size() == 3);
+    for(size_t i = 0; i < fires.size(); ++i) {
+        SYLAR_ASSERT2(fires[i] >= (i + 1) * TIMEOUT && fires[i] <= (i + 1) * (TIMEOUT + 1 + SLACK),
+                      std::to_string(fires[i]));
+    }
+    SYLAR_ASSERT(shared_fires.size() == 1);
+    SYLAR_ASSERT2(shared_fires[0] >= 120 && shared_fires[0] <= 120 + 1 + SLACK, std::to_string(shared_fires[0]));
+    SYLAR_ASSERT(!cancelled_fired);
+    SYLAR_LOG_INFO(g_logger) << "test_iomanager ok";
+}
+
+void bench(size_t n) {
+    std::vector<uint64_t> timeouts(n);
+    for(size_t i = 0; i < n; ++i) {
+        timeouts[i] = 1000 + rand() % 60000;
+    }
+
+    {
+        sylar::TimingWheel wheel;
+        std::vector<sylar::TimingWheel::Timer::ptr> timers;
+        timers.reserve(n);
+        uint64_t t0 = sylar::GetCurrentUS();
+        for(size_t i = 0; i < n; ++i) {
+            timers.push_back(wheel.addTimer(timeouts[i], nullptr));
+        }
+        uint64_t t1 = sylar::GetCurrentUS();
+        for(size_t i = 0; i < n; ++i) {
+            timers[i]->refresh();
+        }
+        uint64_t t2 = sylar::GetCurrentUS();
+        for(size_t i = 0; i < n; ++i) {
+            timers[i]->cancel();
+        }
+        uint64_t t3 = sylar::GetCurrentUS();
+        SYLAR_LOG_INFO(g_logger) << "wheel n=" << n
+                                 << " add=" << (t1 - t0) / 1000 << "ms"
+                                 << " refresh=" << (t2 - t1) / 1000 << "ms"
+                                 << " cancel=" << (t3 - t2) / 1000 << "ms";
+    }
+
+    {
+        BenchTimerManager mgr;
+        std::vector<sylar::Timer::ptr> timers;
+        timers.reserve(n);
+        uint64_t t0 = sylar::GetCurrentUS();
+        for(size_t i = 0; i < n; ++i) {
+            timers.push_back(mgr.addTimer(timeouts[i], [](){}));
+        }
+        uint64_t t1 = sylar::GetCurrentUS();
+        for(size_t i = 0; i < n; ++i) {
+            timers[i]->refresh();
+        }
+        uint64_t t2 = sylar::GetCurrentUS();
+        for(size_t i = 0; i < n; ++i) {
+            timers[i]->cancel();
+        }
+        uint64_t t3 = sylar::GetCurrentUS();
+        SYLAR_LOG_INFO(g_logger) << "rbtree n=" << n
+                                 << " add=" << (t1 - t0) / 1000 << "ms"
+                                 << " refresh=" << (t2 - t1) / 1000 << "ms"
+                                 << " cancel=" << (t3 - t2) / 1000 << "ms";
+    }
+}
+
+int main(int argc, char **argv) {
+    test_fire();
+    test_iomanager();
+    bench(argc > 1 ? atoi(argv[1]) : 1000000);
+    return 0;
+}
@@ -0,0 +1,194 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/27 10:00
+* @version: 1.0
+* @description: UDP 批量收发测试：recvmmsg/sendmmsg、GSO/GRO，和一次一个数据报的收发比较
+********************************************************************************/
+
+#include "../sylar/sylar.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static sylar::Socket::ptr make_udp() {
+    sylar::Socket::ptr sock = sylar::Socket::CreateUDP();
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    SYLAR_ASSERT(sock->bind((sockaddr *)&addr, sizeof(addr)));
+    sock->setOption(SOL_SOCKET, SO_RCVBUF, 4 * 1024 * 1024);
+    sock->setRecvTimeout(3000);
+    return sock;
+}
+
+static bool same_address(const sockaddr *a, const sockaddr *b) {
+    const sockaddr_in *x = (const sockaddr_in *)a;
+    const sockaddr_in *y = (const sockaddr_in *)b;
+    return x->sin_port == y->sin_port && x->sin_addr.s_addr == y->sin_addr.s_addr;
+}
+
+void test_batch() {
+    sylar::Socket::ptr server = make_udp();
+    sylar::Socket::ptr client = make_udp();
+    const int N = 100;
+
+    // 先开始收，没有数据的时候等可读，数据到了被唤醒
+    std::atomic<bool> done(false);
+    sylar::IOManager::GetThis()->schedule([server, client, &done]() {
+        sylar::UdpBatch batch(16);
+        int recved = 0;
+        int batches = 0;
+        while(recved < N) {
+            int n = server->recvBatch(batch);
+            SYLAR_ASSERT(n > 0 && (size_t)n == batch.size());
+            for(int i = 0; i < n; ++i) {
+                std::string expect = "msg-" + std::to_string(recved + i);
+                SYLAR_ASSERT(std::string(batch.getData(i), batch.getLength(i)) == expect);
+                SYLAR_ASSERT(same_address(batch.getAddress(i), client->getLocalAddress()));
+                SYLAR_ASSERT(!batch.isTruncated(i) && !batch.getSegmentSize(i));
+            }
+            recved += n;
+            ++batches;
+        }
+        SYLAR_LOG_INFO(g_logger) << "recv " << recved << " datagrams in " << batches << " batches";
+        done = true;
+    });
+    usleep(10 * 1000);    // 开启了 hook，只挂起协程
+
+    sylar::UdpBatch batch(32);
+    for(int i = 0; i < N; ++i) {
+        std::string msg = "msg-" + std::to_string(i);
+        SYLAR_ASSERT(batch.add(msg.c_str(), msg.size(), server->getLocalAddress(), server->getLocalAddressLen()));
+        if(batch.full() || i == N - 1) {
+            SYLAR_ASSERT(client->sendBatch(batch) == (int)batch.size());
+            batch.clear();
+        }
+    }
+    while(!done) {
+        usleep(1000);
+    }
+
+    // 缓冲区放不下的数据报截断
+    sylar::UdpBatch small(4, 8);
+    std::string big(100, 'x');
+    SYLAR_ASSERT(!small.add(big.c_str(), big.size()));
+    SYLAR_ASSERT(client->sendTo(big.c_str(), big.size(), server->getLocalAddress(),
+                                server->getLocalAddressLen()) == (ssize_t)big.size());
+    SYLAR_ASSERT(server->recvBatch(small) == 1 && small.isTruncated(0) && small.getLength(0) == 8);
+    SYLAR_LOG_INFO(g_logger) << "batch ok";
+}
+
+/**
+ * @brief 收到的数据报按 GRO 的段大小拆开，拼回原来的数据
+ */
+static std::string recv_segments(sylar::Socket::ptr sock, size_t length, uint16_t segment_size, int &merged) {
+    sylar::UdpBatch batch(64, 65536);
+    std::string data;
+    merged = 0;
+    while(data.size() < length) {
+        int n = sock->recvBatch(batch);
+        SYLAR_ASSERT(n > 0);
+        for(int i = 0; i < n; ++i) {
+            uint16_t seg = batch.getSegmentSize(i);
+            if(seg) {
+                SYLAR_ASSERT(seg == segment_size);
+                ++merged;
+            } else {
+                SYLAR_ASSERT(batch.getLength(i) <= segment_size);
+            }
+            data.append(batch.getData(i), batch.getLength(i));
+        }
+    }
+    return data;
+}
+
+void test_gso() {
+    sylar::Socket::ptr server = make_udp();
+    sylar::Socket::ptr client = make_udp();
+    std::string data(100 * 1000 + 123, 0);
+    for(size_t i = 0; i < data.size(); ++i) {
+        data[i] = 'a' + (i * 7 + i / 1000) % 26;
+    }
+
+    // 没开 GRO：收到的是一个一个切好的数据报
+    SYLAR_ASSERT(client->sendSegments(data.c_str(), data.size(), 1000, server->getLocalAddress(),
+                                      server->getLocalAddressLen()) == (ssize_t)data.size());
+    int merged = 0;
+    SYLAR_ASSERT(recv_segments(server, data.size(), 1000, merged) == data);
+    SYLAR_ASSERT(merged == 0);
+
+    // 开了 GRO：内核可以整段交上来，带着段大小
+    bool gro = server->setGRO();
+    SYLAR_ASSERT(client->sendSegments(data.c_str(), data.size(), 1000, server->getLocalAddress(),
+                                      server->getLocalAddressLen()) == (ssize_t)data.size());
+    SYLAR_ASSERT(recv_segments(server, data.size(), 1000, merged) == data);
+    SYLAR_LOG_INFO(g_logger) << "gso ok gro=" << gro << " merged=" << merged;
+}
+
+void bench() {
+    sylar::Socket::ptr server = make_udp();
+    sylar::Socket::ptr client = make_udp();
+    const sockaddr *to = server->getLocalAddress();
+    socklen_t tolen = server->getLocalAddressLen();
+    const int ROUNDS = 2000;
+    const int BATCH = 64;   // 一轮的数据报在接收缓冲区里放得下，不会丢
+    char msg[64];
+    memset(msg, 'x', sizeof(msg));
+    char buf[2048];
+    uint64_t send_us[2] = {0, 0};
+    uint64_t recv_us[2] = {0, 0};
+
+    sylar::UdpBatch send_batch(BATCH, sizeof(msg));
+    sylar::UdpBatch recv_batch(BATCH);
+    for(int r = 0; r < ROUNDS; ++r) {
+        bool batched = r & 1;
+        uint64_t begin = sylar::GetCurrentUS();
+        if(batched) {
+            send_batch.clear();
+            for(int i = 0; i < BATCH; ++i) {
+                send_batch.add(msg, sizeof(msg), to, tolen);
+            }
+            SYLAR_ASSERT(client->sendBatch(send_batch) == BATCH);
+        } else {
+            for(int i = 0; i < BATCH; ++i) {
+                SYLAR_ASSERT(client->sendTo(msg, sizeof(msg), to, tolen) == sizeof(msg));
+            }
+        }
+        uint64_t mid = sylar::GetCurrentUS();
+        int recved = 0;
+        while(recved < BATCH) {
+            if(batched) {
+                int n = server->recvBatch(recv_batch);
+                SYLAR_ASSERT(n > 0);
+                recved += n;
+            } else {
+                sockaddr_storage from;
+                socklen_t fromlen = sizeof(from);
+                SYLAR_ASSERT(server->recvFrom(buf, sizeof(buf), (sockaddr *)&from, &fromlen) == sizeof(msg));
+                ++recved;
+            }
+        }
+        send_us[batched] += mid - begin;
+        recv_us[batched] += sylar::GetCurrentUS() - mid;
+    }
+    double count = ROUNDS / 2 * BATCH;
+    SYLAR_LOG_INFO(g_logger) << "per datagram: sendTo=" << send_us[0] * 1000 / count << "ns"
+                             << " sendBatch=" << send_us[1] * 1000 / count << "ns"
+                             << " recvFrom=" << recv_us[0] * 1000 / count << "ns"
+                             << " recvBatch=" << recv_us[1] * 1000 / count << "ns";
+}
+
+int main(int argc, char **argv) {
+    sylar::IOManager iom(2, false, "udp");
+    iom.setHookEnable(true);
+    iom.schedule([]() {     // 按顺序跑，bench 不和别的测试抢线程
+        test_batch();
+        test_gso();
+        bench();
+    });
+    return 0;
+}
@@ -0,0 +1,205 @@
+/********************************************************************************
+* @author: Cuyu Tang
+* @email: me@expoli.tech
+* @website: www.expoli.tech
+* @date: 2023/6/19 11:00
+* @version: 1.0
+* @description: 零拷贝测试：sendfile 发文件、splice 转发 socket、tee 复制管道
+********************************************************************************/
+
+#include "../sylar/sylar.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const size_t FILE_SIZE = 1 << 20;
+
+class RawSocket : public sylar::Socket {    // 用现成的 fd 初始化
+public:
+    typedef std::shared_ptr<RawSocket> ptr;
+    RawSocket(int fd) : Socket(AF_UNIX, SOCK_STREAM) { init(fd); }
+};
+
+static std::string make_data(size_t size) {
+    std::string data(size, 0);
+    for(size_t i = 0; i < size; ++i) {
+        data[i] = 'a' + (i * 7 + i / 4096) % 26;
+    }
+    return data;
+}
+
+/**
+ * 临时文件，打开之后马上删掉
+ */
+static int make_file(const std::string &data) {
+    char path[] = "/tmp/test_zero_copy_XXXXXX";
+    int fd = mkstemp(path);
+    SYLAR_ASSERT(fd >= 0);
+    unlink(path);
+    SYLAR_ASSERT(write(fd, data.c_str(), data.size()) == (ssize_t)data.size());
+    return fd;
+}
+
+static void make_pair(RawSocket::ptr &a, RawSocket::ptr &b) {
+    int sv[2];
+    SYLAR_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sv));
+    a.reset(new RawSocket(sv[0]));
+    b.reset(new RawSocket(sv[1]));
+    a->setOption(SOL_SOCKET, SO_SNDBUF, 16 * 1024);     // 缓冲区小一点，中途一定会 EAGAIN
+}
+
+static std::string recv_all(RawSocket::ptr sock, size_t size) {
+    std::string data(size, 0);
+    size_t recved = 0;
+    while(recved < size) {
+        ssize_t n = sock->recv(&data[recved], size - recved);
+        SYLAR_ASSERT(n > 0);
+        recved += n;
+    }
+    return data;
+}
+
+static void send_all(RawSocket::ptr sock, const std::string &data) {
+    size_t sent = 0;
+    while(sent < data.size()) {
+        ssize_t n = sock->send(data.c_str() + sent, data.size() - sent);
+        SYLAR_ASSERT(n > 0);
+        sent += n;
+    }
+}
+
+static void wait_done(std::atomic<int> &done, int count) {
+    while(done < count) {
+        usleep(1000);
+    }
+}
+
+/**
+ * 从文件中间开始 sendfile，接收端在另一个协程里校验
+ */
+void test_sendfile() {
+    std::string data = make_data(FILE_SIZE);
+    int file = make_file(data);
+    sylar::IOManager iom(2, false, "sendfile");     // socket 要在 IOManager 之前关闭
+    RawSocket::ptr out, in;
+    make_pair(out, in);
+
+    std::atomic<int> done(0);
+    const off_t start = 4096 + 17;
+    iom.schedule([&]() {
+        off_t offset = start;
+        ssize_t n = sylar::SendFile(out->getSocket(), file, &offset, FILE_SIZE);  // 超出文件的部分到文件结束为止
+        SYLAR_ASSERT(n == (ssize_t)(FILE_SIZE - start));
+        SYLAR_ASSERT(offset == (off_t)FILE_SIZE);
+        ++done;
+    });
+    iom.schedule([&]() {
+        SYLAR_ASSERT(recv_all(in, FILE_SIZE - start) == data.substr(start));
+        ++done;
+    });
+    wait_done(done, 2);
+
+    done = 0;
+    iom.schedule([&]() {    // Socket::sendFile，用文件自己的读写位置
+        lseek(file, 0, SEEK_SET);
+        SYLAR_ASSERT(out->sendFile(file, nullptr, 100000) == 100000);
+        SYLAR_ASSERT(lseek(file, 0, SEEK_CUR) == 100000);
+        ++done;
+    });
+    iom.schedule([&]() {
+        SYLAR_ASSERT(recv_all(in, 100000) == data.substr(0, 100000));
+        ++done;
+    });
+    wait_done(done, 2);
+
+    done = 0;
+    iom.schedule([&]() {    // 对端不读，等待超时
+        off_t offset = 0;
+        uint64_t begin = sylar::GetCurrentMS();
+        ssize_t n = sylar::SendFile(out->getSocket(), file, &offset, FILE_SIZE, 50);
+        SYLAR_ASSERT(errno == ETIMEDOUT);  // 超时之前发出去的部分照实返回
+        SYLAR_ASSERT(sylar::GetCurrentMS() - begin >= 40);
+        SYLAR_ASSERT(n > 0 && n < (ssize_t)FILE_SIZE && offset == (off_t)n);
+        ++done;
+    });
+    wait_done(done, 1);
+    close(file);
+    SYLAR_LOG_INFO(g_logger) << "sendfile ok";
+}
+
+/**
+ * socket 到 socket 的转发，数据经过内部管道，不进用户态
+ */
+void test_splice_proxy() {
+    std::string data = make_data(FILE_SIZE);
+    sylar::IOManager iom(2, false, "splice");
+    RawSocket::ptr client, upstream_in, upstream_out, server;
+    make_pair(client, upstream_in);
+    make_pair(upstream_out, server);
+
+    std::atomic<int> done(0);
+    iom.schedule([&]() {
+        send_all(client, data);
+        shutdown(client->getSocket(), SHUT_WR);
+        ++done;
+    });
+    iom.schedule([&]() {
+        ssize_t n = sylar::SpliceAll(upstream_in->getSocket(), upstream_out->getSocket());
+        SYLAR_ASSERT(n == (ssize_t)data.size());
+        ++done;
+    });
+    iom.schedule([&]() {
+        SYLAR_ASSERT(recv_all(server, data.size()) == data);
+        ++done;
+    });
+    wait_done(done, 3);
+
+    done = 0;
+    int file = make_file(data);
+    iom.schedule([&]() {    // 文件到 socket，指定长度
+        lseek(file, 1000, SEEK_SET);
+        SYLAR_ASSERT(sylar::SpliceAll(file, upstream_out->getSocket(), 300000) == 300000);
+        ++done;
+    });
+    iom.schedule([&]() {
+        SYLAR_ASSERT(recv_all(server, 300000) == data.substr(1000, 300000));
+        ++done;
+    });
+    wait_done(done, 2);
+    close(file);
+    SYLAR_LOG_INFO(g_logger) << "splice ok";
+}
+
+/**
+ * tee 复制管道里的数据，不消费源管道
+ */
+void test_tee() {
+    int src[2], dst[2];
+    SYLAR_ASSERT(!pipe2(src, O_NONBLOCK | O_CLOEXEC));
+    SYLAR_ASSERT(!pipe2(dst, O_NONBLOCK | O_CLOEXEC));
+    std::string data = make_data(1000);
+    SYLAR_ASSERT(write(src[1], data.c_str(), data.size()) == (ssize_t)data.size());
+
+    SYLAR_ASSERT(sylar::Tee(src[0], dst[1], data.size()) == (ssize_t)data.size());
+    char buf[1000];
+    SYLAR_ASSERT(read(dst[0], buf, sizeof(buf)) == (ssize_t)data.size());
+    SYLAR_ASSERT(std::string(buf, sizeof(buf)) == data);
+    SYLAR_ASSERT(read(src[0], buf, sizeof(buf)) == (ssize_t)data.size());    // 源管道的数据还在
+    SYLAR_ASSERT(std::string(buf, sizeof(buf)) == data);
+
+    // 源管道空的时候等待，超时返回 ETIMEDOUT
+    SYLAR_ASSERT(sylar::Tee(src[0], dst[1], data.size(), 0, 20) == -1);
+    SYLAR_ASSERT(errno == ETIMEDOUT);
+    for(int fd : {src[0], src[1], dst[0], dst[1]}) {
+        close(fd);
+    }
+    SYLAR_LOG_INFO(g_logger) << "tee ok";
+}
+
+int main(int argc, char **argv) {
+    test_sendfile();
+    test_splice_proxy();
+    test_tee();
+    return 0;
+}